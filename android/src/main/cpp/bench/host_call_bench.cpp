@@ -0,0 +1,191 @@
+// Host-call bridge micro benchmark.
+//
+// Compares the legacy string protocol (every argument converted with
+// JS_ToCString and copied into a string array, result returned as text and
+// compared with "true") against the typed call buffer from host_call.h.
+// The host side is mocked in-process, so JNI transition and method lookup
+// costs are not included; the numbers isolate marshalling overhead only.
+//
+// Usage: host_call_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "host_call.h"
+
+static HostCallBuffer g_buf;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// ==================== Mock Host ====================
+
+// What the Kotlin side does for "click": parse two numbers, report success
+static bool host_click(float x, float y) {
+    return x >= 0 && y >= 0;
+}
+
+static std::string legacy_host(const std::string &name, const std::vector<std::string> &args) {
+    if (name == "click") {
+        float x = args.size() > 0 ? strtof(args[0].c_str(), nullptr) : 0;
+        float y = args.size() > 1 ? strtof(args[1].c_str(), nullptr) : 0;
+        return host_click(x, y) ? "true" : "false";
+    }
+    if (name == "selector.exists") {
+        return args.size() > 0 && args[0].size() > 2 ? "true" : "false";
+    }
+    if (name == "device.getBattery") {
+        return "87";
+    }
+    return "";
+}
+
+static void typed_host(int fid, int argc) {
+    HostValue v[8];
+    uint32_t off = 0;
+    for (int i = 0; i < argc && i < 8; i++) host_call_read(&g_buf, &off, &v[i]);
+    host_call_reset(&g_buf);
+    switch (fid) {
+    case 0: host_call_put_bool(&g_buf, host_click((float)v[0].d, (float)v[1].d)); break;
+    case 1: host_call_put_bool(&g_buf, v[0].len > 2); break;
+    case 2: host_call_put_int(&g_buf, 87); break;
+    default: host_call_put_null(&g_buf); break;
+    }
+}
+
+// ==================== Legacy Path ====================
+
+static JSValue legacy_call(JSContext *ctx, const char *name, int argc, JSValueConst *argv) {
+    std::vector<std::string> args;
+    args.reserve(argc);
+    for (int i = 0; i < argc; i++) {
+        const char *s = JS_ToCString(ctx, argv[i]);
+        args.emplace_back(s ? s : "");
+        if (s) JS_FreeCString(ctx, s);
+    }
+    std::string r = legacy_host(name, args);
+    return JS_NewStringLen(ctx, r.data(), r.size());
+}
+
+static JSValue js_legacy_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    JSValue r = legacy_call(ctx, "click", argc, argv);
+    const char *s = JS_ToCString(ctx, r);
+    bool ok = s && strcmp(s, "true") == 0;
+    if (s) JS_FreeCString(ctx, s);
+    JS_FreeValue(ctx, r);
+    return JS_NewBool(ctx, ok);
+}
+
+static JSValue js_legacy_exists(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    // Conditions used to be stringified before the call
+    JSValue json = JS_JSONStringify(ctx, argv[0], JS_UNDEFINED, JS_UNDEFINED);
+    JSValue r = legacy_call(ctx, "selector.exists", 1, &json);
+    JS_FreeValue(ctx, json);
+    const char *s = JS_ToCString(ctx, r);
+    bool ok = s && strcmp(s, "true") == 0;
+    if (s) JS_FreeCString(ctx, s);
+    JS_FreeValue(ctx, r);
+    return JS_NewBool(ctx, ok);
+}
+
+static JSValue js_legacy_battery(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    JSValue r = legacy_call(ctx, "device.getBattery", 0, nullptr);
+    const char *s = JS_ToCString(ctx, r);
+    int v = s ? atoi(s) : 0;
+    if (s) JS_FreeCString(ctx, s);
+    JS_FreeValue(ctx, r);
+    return JS_NewInt32(ctx, v);
+}
+
+// ==================== Typed Path ====================
+
+static bool typed_call(JSContext *ctx, int fid, int argc, JSValueConst *argv, HostValue *out) {
+    host_call_reset(&g_buf);
+    if (!host_call_put_values(ctx, &g_buf, argc, argv)) return false;
+    typed_host(fid, argc);
+    uint32_t off = 0;
+    return host_call_read(&g_buf, &off, out);
+}
+
+static JSValue js_typed_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    HostValue v;
+    return JS_NewBool(ctx, typed_call(ctx, 0, argc, argv, &v) && host_value_to_bool(&v));
+}
+
+static JSValue js_typed_exists(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    HostValue v;
+    return JS_NewBool(ctx, typed_call(ctx, 1, 1, argv, &v) && host_value_to_bool(&v));
+}
+
+static JSValue js_typed_battery(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    HostValue v;
+    return JS_NewInt32(ctx, typed_call(ctx, 2, 0, nullptr, &v) ? host_value_to_int(&v) : 0);
+}
+
+// ==================== Driver ====================
+
+static double run(JSContext *ctx, const char *fn, const char *call, int iterations) {
+    char code[512];
+    snprintf(code, sizeof(code),
+             "(function() { var s = 0; var c = [{type:'text',value:'OK'},{type:'clickable',value:'true'}];"
+             " for (var i = 0; i < %d; i++) { if (%s(%s)) s++; } return s; })()",
+             iterations, fn, call);
+    double t0 = now_ms();
+    JSValue r = JS_Eval(ctx, code, strlen(code), "<bench>", JS_EVAL_TYPE_GLOBAL);
+    double t1 = now_ms();
+    if (JS_IsException(r)) {
+        JSValue e = JS_GetException(ctx);
+        const char *s = JS_ToCString(ctx, e);
+        fprintf(stderr, "%s: %s\n", fn, s ? s : "error");
+        if (s) JS_FreeCString(ctx, s);
+        JS_FreeValue(ctx, e);
+    }
+    JS_FreeValue(ctx, r);
+    return (t1 - t0) * 1e6 / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    if (iterations <= 0) iterations = 200000;
+
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    host_call_buffer_init(&g_buf, HOST_CALL_INITIAL_CAPACITY);
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    JS_SetPropertyStr(ctx, global, "legacyClick", JS_NewCFunction(ctx, js_legacy_click, "legacyClick", 2));
+    JS_SetPropertyStr(ctx, global, "legacyExists", JS_NewCFunction(ctx, js_legacy_exists, "legacyExists", 1));
+    JS_SetPropertyStr(ctx, global, "legacyBattery", JS_NewCFunction(ctx, js_legacy_battery, "legacyBattery", 0));
+    JS_SetPropertyStr(ctx, global, "typedClick", JS_NewCFunction(ctx, js_typed_click, "typedClick", 2));
+    JS_SetPropertyStr(ctx, global, "typedExists", JS_NewCFunction(ctx, js_typed_exists, "typedExists", 1));
+    JS_SetPropertyStr(ctx, global, "typedBattery", JS_NewCFunction(ctx, js_typed_battery, "typedBattery", 0));
+    JS_FreeValue(ctx, global);
+
+    struct { const char *name, *legacy, *typed, *args; } cases[] = {
+        { "click(x, y)",        "legacyClick",   "typedClick",   "i, i + 1" },
+        { "selector.exists()",  "legacyExists",  "typedExists",  "c" },
+        { "device.getBattery()", "legacyBattery", "typedBattery", "" },
+    };
+
+    printf("host call bench, %d iterations (ns/call, JNI cost excluded)\n", iterations);
+    printf("%-22s %10s %10s %8s\n", "call", "legacy", "typed", "speedup");
+    for (auto &c : cases) {
+        run(ctx, c.legacy, c.args, iterations / 10);  // warm up
+        double legacy = run(ctx, c.legacy, c.args, iterations);
+        double typed = run(ctx, c.typed, c.args, iterations);
+        printf("%-22s %10.1f %10.1f %7.2fx\n", c.name, legacy, typed, legacy / typed);
+    }
+
+    host_call_buffer_free(&g_buf);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return 0;
+}
@@ -0,0 +1,291 @@
+// Template matching benchmark.
+//
+// Matches templates (image_match.h) on a synthetic 1080x2400 screen of
+// cards, "text" and icons, checks each lands where the template was cut
+// or drawn, and compares the pyramid search with the exhaustive reference
+// on a region around the target; then times classifying the screen with a
+// batch of templates, half of them absent, against matching them one by
+// one.
+//
+// Usage: image_match_bench [WIDTHxHEIGHT] [--iterations N] [--csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "image_match.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint32_t g_seed = 12345;
+
+static uint32_t rnd() {
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return g_seed;
+}
+
+// ==================== Frame ====================
+
+static void fill_rect(ImageFrame *f, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t argb) {
+    for (int32_t j = std::max(y, 0); j < y + h && j < f->height; j++) {
+        for (int32_t i = std::max(x, 0); i < x + w && i < f->width; i++) {
+            uint8_t *p = f->pixels.data() + ((size_t)j * f->width + i) * 4;
+            p[0] = (uint8_t)(argb >> 16);
+            p[1] = (uint8_t)(argb >> 8);
+            p[2] = (uint8_t)argb;
+            p[3] = (uint8_t)(argb >> 24);
+        }
+    }
+}
+
+// Copy src into f at (x, y), skipping transparent pixels
+static void draw(ImageFrame *f, const ImageFrame &src, int32_t x, int32_t y) {
+    for (int32_t j = 0; j < src.height; j++) {
+        for (int32_t i = 0; i < src.width; i++) {
+            const uint8_t *s = src.pixels.data() + ((size_t)j * src.width + i) * 4;
+            if (s[3] < 128) continue;
+            memcpy(f->pixels.data() + ((size_t)(y + j) * f->width + x + i) * 4, s, 4);
+        }
+    }
+}
+
+// A 48x48 icon: a colored disc (transparent corners) with a glyph
+static ImageFrame make_icon() {
+    ImageFrame icon;
+    icon.width = icon.height = 48;
+    icon.pixels.assign(48 * 48 * 4, 0);
+    for (int32_t y = 0; y < 48; y++) {
+        for (int32_t x = 0; x < 48; x++) {
+            int32_t dx = x - 24, dy = y - 24;
+            if (dx * dx + dy * dy > 23 * 23) continue;
+            bool glyph = (x > 14 && x < 20 && y > 10 && y < 38) || (y > 30 && y < 36 && x > 14 && x < 34);
+            fill_rect(&icon, x, y, 1, 1, glyph ? 0xffffffff : 0xffe53935);
+        }
+    }
+    return icon;
+}
+
+static const int32_t kIcons[5][2] = { { 40, 300 }, { 900, 520 }, { 300, 1500 }, { 640, 2000 }, { 100, 2250 } };
+
+static ImageFrame make_frame(int32_t width, int32_t height, const ImageFrame &icon) {
+    ImageFrame f;
+    f.width = width;
+    f.height = height;
+    f.pixels.resize((size_t)width * height * 4);
+    for (int32_t y = 0; y < height; y++) fill_rect(&f, 0, y, width, 1, 0xff000000u | (uint32_t)(0xf0 - y * 16 / height) * 0x010101u);
+    // Cards of text lines: runs of dark "glyphs"
+    for (int32_t top = 24; top + 120 < height; top += 150) {
+        fill_rect(&f, 16, top, width - 32, 130, 0xff000000u | (rnd() & 0x3f3f3f) | 0xc0c0c0);
+        for (int32_t line = 0; line < 4; line++) {
+            int32_t y = top + 14 + line * 28;
+            for (int32_t x = 40 + (int32_t)(rnd() % 30); x < width - 80; x += 10 + (int32_t)(rnd() % 12)) {
+                fill_rect(&f, x, y + (int32_t)(rnd() % 4), 4 + (int32_t)(rnd() % 8), 14 + (int32_t)(rnd() % 6),
+                          0xff000000u | (rnd() & 0x3f3f3f));
+            }
+        }
+    }
+    for (const auto &p : kIcons) {
+        if (p[0] + icon.width <= width && p[1] + icon.height <= height) draw(&f, icon, p[0], p[1]);
+    }
+    // Sensor noise, +-3 per channel
+    for (size_t i = 0; i < f.pixels.size(); i++) {
+        if (i % 4 == 3) continue;
+        int v = f.pixels[i] + (int)(rnd() % 7) - 3;
+        f.pixels[i] = (uint8_t)std::min(std::max(v, 0), 255);
+    }
+    return f;
+}
+
+static ImageFrame crop(const ImageFrame &f, int32_t x, int32_t y, int32_t w, int32_t h) {
+    ImageFrame c;
+    c.width = w;
+    c.height = h;
+    c.pixels.resize((size_t)w * h * 4);
+    for (int32_t j = 0; j < h; j++) {
+        memcpy(c.pixels.data() + (size_t)j * w * 4, f.pixels.data() + ((size_t)(y + j) * f.width + x) * 4, (size_t)w * 4);
+    }
+    return c;
+}
+
+// ==================== Cases ====================
+
+struct Case {
+    const char *name;
+    const ImageFrame *tpl;
+    ImageMatchMethod method;
+    size_t limit;
+    std::vector<ImagePoint> expect;     // top-left corners, any order
+};
+
+int main(int argc, char **argv) {
+    int32_t width = 1080, height = 2400;
+    int iterations = 10;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (sscanf(argv[i], "%dx%d", &width, &height) != 2) {
+            fprintf(stderr, "usage: image_match_bench [WIDTHxHEIGHT] [--iterations N] [--csv]\n");
+            return 1;
+        }
+    }
+    if (iterations <= 0) iterations = 10;
+    if (width < 200 || height < 400) return 1;
+
+    ImageFrame icon = make_icon();
+    ImageFrame frame = make_frame(width, height, icon);
+    ImageView img = frame.view();
+    int32_t cx = width / 3, cy = height / 2 + 7;
+    ImageFrame big = crop(frame, cx, cy, 100, 100), small = crop(frame, cx + 200, cy + 40, 24, 24);
+    std::vector<ImagePoint> icons;
+    for (const auto &p : kIcons) {
+        if (p[0] + icon.width <= width && p[1] + icon.height <= height) icons.push_back({ p[0], p[1] });
+    }
+
+    std::vector<Case> cases = {
+        { "100x100 ncc", &big, IMAGE_MATCH_NCC, 1, { { cx, cy } } },
+        { "100x100 ssd", &big, IMAGE_MATCH_SSD, 1, { { cx, cy } } },
+        { "24x24 ncc", &small, IMAGE_MATCH_NCC, 1, { { cx + 200, cy + 40 } } },
+        { "48x48 masked icon, all", &icon, IMAGE_MATCH_NCC, 10, icons },
+    };
+
+    if (csv) printf("case,levels,matches,cold_us,warm_us,exhaustive_region_us,ok\n");
+    else printf("%dx%d, best of %d\n  %-24s %6s %7s %10s %10s %14s %4s\n", width, height, iterations, "case", "levels",
+                "matches", "cold us", "warm us", "exh. region us", "ok");
+    int failures = 0;
+    for (const Case &c : cases) {
+        ImageMatchOptions opts;
+        opts.method = c.method;
+        opts.threshold = 0.8f;
+        opts.limit = c.limit;
+        ImageView tv = c.tpl->view();
+        std::vector<ImageMatch> found;
+
+        // Cold: a fresh pyramid each time, as for one search on a new frame
+        double cold = 1e30, warm = 1e30;
+        for (int i = 0; i < iterations; i++) {
+            found.clear();
+            double start = now_us();
+            ImagePyramid pyramid(img);
+            ImageTemplate tpl(tv);
+            image_match_template(pyramid, tpl, opts, &found);
+            cold = std::min(cold, now_us() - start);
+        }
+        // Warm: the frame's pyramid already built by an earlier search
+        ImagePyramid shared(img);
+        ImageTemplate tpl(tv);
+        for (int i = 0; i < iterations; i++) {
+            std::vector<ImageMatch> again;
+            double start = now_us();
+            image_match_template(shared, tpl, opts, &again);
+            warm = std::min(warm, now_us() - start);
+        }
+
+        bool ok = found.size() == c.expect.size();
+        for (const ImagePoint &e : c.expect) {
+            ok = ok && std::any_of(found.begin(), found.end(), [&](const ImageMatch &m) {
+                return abs(m.x - e.x) <= 1 && abs(m.y - e.y) <= 1;
+            });
+        }
+
+        // Exhaustive on a region around the first target must agree
+        ImageMatchOptions region = opts;
+        region.limit = 1;
+        region.region = { c.expect[0].x - 60, c.expect[0].y - 60, tv.width + 120, tv.height + 120 };
+        std::vector<ImageMatch> exact, fast;
+        double start = now_us();
+        image_match_template_exhaustive(img, tv, region, &exact);
+        double exhaustive = now_us() - start;
+        image_match_template(shared, tpl, region, &fast);
+        if (exact.size() != 1 || fast.size() != 1 || exact[0].x != fast[0].x || exact[0].y != fast[0].y ||
+            exact[0].score != fast[0].score) {
+            fprintf(stderr, "%s: pyramid search disagrees with the exhaustive one\n", c.name);
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: found", c.name);
+            for (const ImageMatch &m : found) fprintf(stderr, " (%d, %d) %.3f", m.x, m.y, m.score);
+            fprintf(stderr, "\n");
+            failures++;
+        }
+
+        int levels = image_match_levels(tv, opts);
+        if (csv) printf("%s,%d,%zu,%.1f,%.1f,%.1f,%d\n", c.name, levels, found.size(), cold, warm, exhaustive, ok);
+        else printf("  %-24s %6d %7zu %10.1f %10.1f %14.1f %4s\n", c.name, levels, found.size(), cold, warm, exhaustive,
+                    ok ? "yes" : "NO");
+    }
+
+    // Screen classification: 20 templates of 24 to 100 pixels, the odd
+    // ones inverted so they match nowhere. Each time on a fresh pyramid:
+    // from scratch builds one per template, one by one shares it as
+    // successive findImage calls on an Image do.
+    std::vector<ImageFrame> crops;
+    for (int i = 0; i < 20; i++) {
+        int32_t side = 24 + (i * 37) % 77;
+        ImageFrame t = crop(frame, (i * 211) % (width - side), (i * 467) % (height - side), side, side);
+        if (i % 2) {
+            for (size_t k = 0; k < t.pixels.size(); k++) {
+                if (k % 4 != 3) t.pixels[k] = (uint8_t)~t.pixels[k];
+            }
+        }
+        crops.push_back(std::move(t));
+    }
+    std::vector<std::unique_ptr<ImageTemplate>> tpls;
+    std::vector<ImageTemplate *> batch;
+    for (const ImageFrame &t : crops) {
+        tpls.emplace_back(new ImageTemplate(t.view()));
+        batch.push_back(tpls.back().get());
+    }
+    ImageMatchOptions opts;
+    opts.threshold = 0.8f;
+    double scratch = 1e30, single = 1e30, batched = 1e30;
+    std::vector<std::vector<ImageMatch>> expect(batch.size()), found;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_us();
+        for (size_t k = 0; k < batch.size(); k++) {
+            ImagePyramid pyramid(img);
+            ImageTemplate tpl(crops[k].view());
+            expect[k].clear();
+            image_match_template(pyramid, tpl, opts, &expect[k]);
+        }
+        scratch = std::min(scratch, now_us() - start);
+        start = now_us();
+        ImagePyramid shared(img);
+        for (size_t k = 0; k < batch.size(); k++) {
+            std::vector<ImageMatch> m;
+            image_match_template(shared, *batch[k], opts, &m);
+        }
+        single = std::min(single, now_us() - start);
+        start = now_us();
+        ImagePyramid pyramid(img);
+        image_match_templates(pyramid, batch, opts, &found);
+        batched = std::min(batched, now_us() - start);
+    }
+    size_t matches = 0;
+    for (size_t k = 0; k < batch.size(); k++) {
+        matches += found[k].size();
+        bool same = found[k].size() == expect[k].size() &&
+                    (found[k].empty() || (found[k][0].x == expect[k][0].x && found[k][0].y == expect[k][0].y &&
+                                          found[k][0].score == expect[k][0].score));
+        if (!same) {
+            fprintf(stderr, "batch template %zu: differs from matching it alone\n", k);
+            failures++;
+        }
+    }
+    if (csv) printf("\ncase,matches,scratch_us,one_by_one_us,batch_us\nbatch of %zu,%zu,%.1f,%.1f,%.1f\n",
+                    batch.size(), matches, scratch, single, batched);
+    else printf("\n  batch of %zu templates: %zu found; from scratch %.1f us, one by one %.1f us, batch %.1f us "
+                "(%.2fx, %.2fx)\n", batch.size(), matches, scratch, single, batched, scratch / batched, single / batched);
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,228 @@
+// Color search benchmark.
+//
+// Runs findColor/findAllColors and findMultiColors cases (image_search.h)
+// on a synthetic screen capture, with the vector kernels and with the
+// scalar reference, and checks that both find the same points; then times
+// a batch of multi-color patterns against searching them one by one. The
+// frame is a noisy background with a few solid "buttons", so misses scan
+// every pixel as on a real screen.
+//
+// Usage: image_search_bench [WIDTHxHEIGHT] [--iterations N] [--csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "image_search.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Frame ====================
+
+static void fill_rect(ImageFrame *f, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t argb) {
+    for (int32_t j = y; j < y + h && j < f->height; j++) {
+        for (int32_t i = x; i < x + w && i < f->width; i++) {
+            uint8_t *p = f->pixels.data() + ((size_t)j * f->width + i) * 4;
+            p[0] = (uint8_t)(argb >> 16);
+            p[1] = (uint8_t)(argb >> 8);
+            p[2] = (uint8_t)argb;
+            p[3] = 0xff;
+        }
+    }
+}
+
+// Background red stays in [128, 255], so colors with less red never match
+static ImageFrame make_frame(int32_t width, int32_t height) {
+    ImageFrame f;
+    f.width = width;
+    f.height = height;
+    f.pixels.resize((size_t)width * height * 4);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        uint8_t *p = f.pixels.data() + i * 4;
+        p[0] = (uint8_t)(128 | (seed & 0x7f));
+        p[1] = (uint8_t)(seed >> 8);
+        p[2] = (uint8_t)(seed >> 16);
+        p[3] = 0xff;
+    }
+    fill_rect(&f, width / 8, height / 3, width / 4, height / 30, 0xff1e88e5);           // button
+    fill_rect(&f, width - width / 5, height - height / 20, width / 6, height / 40, 0xff43a047);
+    // A two-tone icon: white square with a blue dot
+    fill_rect(&f, width / 2, height / 2, 24, 24, 0xffffffff);
+    fill_rect(&f, width / 2 + 8, height / 2 + 8, 8, 8, 0xff1e88e5);
+    return f;
+}
+
+// ==================== Cases ====================
+
+struct Case {
+    const char *name;
+    uint32_t color;
+    int threshold;
+    bool all;
+    // Region as fractions of the frame
+    double x, y, w, h;
+};
+
+static const Case g_cases[] = {
+    { "findColor miss", 0xff102030, 4, false, 0, 0, 1, 1 },
+    { "findColor near end", 0xff43a047, 4, false, 0, 0, 1, 1 },
+    { "findColor miss (region)", 0xff102030, 4, false, 0.25, 0.4, 0.5, 0.2 },
+    { "findAllColors button", 0xff1e88e5, 8, true, 0, 0, 1, 1 },
+    { "findAllColors noisy", 0xffc08080, 16, true, 0, 0, 1, 1 },
+};
+
+typedef size_t (*FindFn)(const ImageView &, uint32_t, int, ImageRegion, size_t, std::vector<ImagePoint> *);
+
+static double time_us(FindFn fn, const ImageView &img, const Case &c, ImageRegion r, int iterations,
+                      std::vector<ImagePoint> *out) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        out->clear();
+        double start = now_us();
+        fn(img, c.color, c.threshold, r, c.all ? 1000 : 1, out);
+        best = std::min(best, now_us() - start);
+    }
+    return best;
+}
+
+// ==================== Multi-Color Cases ====================
+
+struct MultiCase {
+    const char *name;
+    ImageMultiColor pattern;
+    bool all;
+};
+
+static std::vector<MultiCase> multi_cases() {
+    std::vector<MultiCase> cases;
+    // First color common in the background, offsets rarely matching
+    cases.push_back({ "findMultiColors noisy miss", { 0xffc08080, { { 5, 0, 0xff102030 }, { 0, 5, 0xff102030 } }, 16 }, false });
+    cases.push_back({ "findMultiColors icon", { 0xffffffff, { { 8, 8, 0xff1e88e5 }, { 20, 20, 0xffffffff } }, 4 }, false });
+    cases.push_back({ "findAllMultiColors icon", { 0xffffffff, { { 8, 8, 0xff1e88e5 }, { -4, 0, 0xffffffff } }, 4 }, true });
+    cases.push_back({ "findAllMultiColors button", { 0xff1e88e5, { { 10, 0, 0xff1e88e5 }, { 0, 10, 0xff1e88e5 } }, 8 }, true });
+    return cases;
+}
+
+typedef size_t (*FindMultiFn)(const ImageView &, const ImageMultiColor &, ImageRegion, size_t, std::vector<ImagePoint> *);
+
+static double time_multi_us(FindMultiFn fn, const ImageView &img, const MultiCase &c, int iterations,
+                            std::vector<ImagePoint> *out) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        out->clear();
+        double start = now_us();
+        fn(img, c.pattern, image_full_region(img), c.all ? 1000 : 1, out);
+        best = std::min(best, now_us() - start);
+    }
+    return best;
+}
+
+static bool same_points(const std::vector<ImagePoint> &a, const std::vector<ImagePoint> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].x != b[i].x || a[i].y != b[i].y) return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int32_t width = 1080, height = 2400;
+    int iterations = 20;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (sscanf(argv[i], "%dx%d", &width, &height) != 2) {
+            fprintf(stderr, "usage: image_search_bench [WIDTHxHEIGHT] [--iterations N] [--csv]\n");
+            return 1;
+        }
+    }
+    if (iterations <= 0) iterations = 20;
+    if (width <= 0 || height <= 0) return 1;
+
+    ImageFrame frame = make_frame(width, height);
+    ImageView img = frame.view();
+    if (csv) printf("case,matches,scalar_us,vector_us,speedup\n");
+    else printf("%dx%d, best of %d\n  %-26s %8s %12s %12s %8s\n", width, height, iterations, "case", "matches",
+                "scalar us", "vector us", "speedup");
+
+    int mismatches = 0;
+    for (const Case &c : g_cases) {
+        ImageRegion r = { (int32_t)(c.x * width), (int32_t)(c.y * height), (int32_t)(c.w * width),
+                          (int32_t)(c.h * height) };
+        std::vector<ImagePoint> scalar, vec;
+        double scalar_us = time_us(image_find_colors_scalar, img, c, r, iterations, &scalar);
+        double vector_us = time_us(image_find_colors, img, c, r, iterations, &vec);
+        if (!same_points(scalar, vec)) {
+            fprintf(stderr, "mismatch: %s: scalar %zu points, vector %zu\n", c.name, scalar.size(), vec.size());
+            mismatches++;
+        }
+        if (csv) printf("%s,%zu,%.1f,%.1f,%.2f\n", c.name, vec.size(), scalar_us, vector_us, scalar_us / vector_us);
+        else printf("  %-26s %8zu %12.1f %12.1f %7.2fx\n", c.name, vec.size(), scalar_us, vector_us,
+                    scalar_us / vector_us);
+    }
+
+    std::vector<MultiCase> multi = multi_cases();
+    for (const MultiCase &c : multi) {
+        std::vector<ImagePoint> scalar, vec;
+        double scalar_us = time_multi_us(image_find_multi_colors_scalar, img, c, iterations, &scalar);
+        double vector_us = time_multi_us(image_find_multi_colors, img, c, iterations, &vec);
+        if (!same_points(scalar, vec)) {
+            fprintf(stderr, "mismatch: %s: scalar %zu points, vector %zu\n", c.name, scalar.size(), vec.size());
+            mismatches++;
+        }
+        if (csv) printf("%s,%zu,%.1f,%.1f,%.2f\n", c.name, vec.size(), scalar_us, vector_us, scalar_us / vector_us);
+        else printf("  %-26s %8zu %12.1f %12.1f %7.2fx\n", c.name, vec.size(), scalar_us, vector_us,
+                    scalar_us / vector_us);
+    }
+
+    // Batch: every pattern twice with a different threshold, first match
+    // each, against the same searches one by one
+    std::vector<ImageMultiColor> patterns;
+    for (const MultiCase &c : multi) {
+        patterns.push_back(c.pattern);
+        patterns.push_back(c.pattern);
+        patterns.back().threshold += 2;
+    }
+    std::vector<std::vector<ImagePoint>> batch;
+    std::vector<ImagePoint> single;
+    double batch_us = 1e30, single_us = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        double start = now_us();
+        image_find_multi_colors_batch(img, patterns, image_full_region(img), 1, &batch);
+        batch_us = std::min(batch_us, now_us() - start);
+    }
+    size_t matches = 0;
+    for (int i = 0; i < iterations; i++) {
+        single.clear();
+        matches = 0;
+        double start = now_us();
+        for (size_t k = 0; k < patterns.size(); k++) {
+            size_t n = image_find_multi_colors(img, patterns[k], image_full_region(img), 1, &single);
+            if (i == 0 && !same_points(std::vector<ImagePoint>(single.end() - n, single.end()), batch[k])) {
+                fprintf(stderr, "mismatch: batch pattern %zu\n", k);
+                mismatches++;
+            }
+            matches += n;
+        }
+        single_us = std::min(single_us, now_us() - start);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "batch of %zu", patterns.size());
+    if (csv) printf("%s,%zu,%.1f,%.1f,%.2f\n", name, matches, single_us, batch_us, single_us / batch_us);
+    else printf("  %-26s %8zu %12.1f %12.1f %7.2fx   (one by one vs batch)\n", name, matches, single_us, batch_us,
+                single_us / batch_us);
+    return mismatches ? 2 : 0;
+}
@@ -0,0 +1,211 @@
+// Search thread scaling benchmark.
+//
+// Times color, multi-color and template searches (image_search.h,
+// image_match.h) on a synthetic screen capture with 1 to N search threads
+// (image_pool.h), reporting the speedup over one thread, and checks that
+// every thread count finds exactly the points one thread finds. The
+// "near end" cases stop at the first match, low on the screen, so the
+// bands after it are cancelled.
+//
+// Usage: image_threads_bench [WIDTHxHEIGHT] [--threads N] [--iterations N] [--csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "image_match.h"
+#include "image_pool.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Frame ====================
+
+static void fill_rect(ImageFrame *f, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t argb) {
+    for (int32_t j = y; j < y + h && j < f->height; j++) {
+        for (int32_t i = x; i < x + w && i < f->width; i++) {
+            uint8_t *p = f->pixels.data() + ((size_t)j * f->width + i) * 4;
+            p[0] = (uint8_t)(argb >> 16);
+            p[1] = (uint8_t)(argb >> 8);
+            p[2] = (uint8_t)argb;
+            p[3] = 0xff;
+        }
+    }
+}
+
+// Noise with red in [128, 255], a button high up and one low down
+static ImageFrame make_frame(int32_t width, int32_t height) {
+    ImageFrame f;
+    f.width = width;
+    f.height = height;
+    f.pixels.resize((size_t)width * height * 4);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        uint8_t *p = f.pixels.data() + i * 4;
+        p[0] = (uint8_t)(128 | (seed & 0x7f));
+        p[1] = (uint8_t)(seed >> 8);
+        p[2] = (uint8_t)(seed >> 16);
+        p[3] = 0xff;
+    }
+    fill_rect(&f, width / 8, height / 3, width / 4, height / 30, 0xff1e88e5);
+    fill_rect(&f, width - width / 5, height - height / 20, width / 6, height / 40, 0xff43a047);
+    return f;
+}
+
+static ImageFrame crop(const ImageFrame &f, int32_t x, int32_t y, int32_t w, int32_t h) {
+    ImageFrame c;
+    c.width = w;
+    c.height = h;
+    c.pixels.resize((size_t)w * h * 4);
+    for (int32_t j = 0; j < h; j++) {
+        memcpy(c.pixels.data() + (size_t)j * w * 4, f.pixels.data() + ((size_t)(y + j) * f.width + x) * 4, (size_t)w * 4);
+    }
+    return c;
+}
+
+// ==================== Cases ====================
+
+struct Case {
+    const char *name;
+    // Runs the search, returning its points flattened as x, y pairs
+    std::function<std::vector<int32_t>()> run;
+};
+
+static std::vector<int32_t> flatten(const std::vector<ImagePoint> &p) {
+    std::vector<int32_t> v;
+    for (const ImagePoint &q : p) {
+        v.push_back(q.x);
+        v.push_back(q.y);
+    }
+    return v;
+}
+
+int main(int argc, char **argv) {
+    int32_t width = 1080, height = 2400;
+    int iterations = 10, maxThreads = IMAGE_MAX_THREADS;
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) maxThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (sscanf(argv[i], "%dx%d", &width, &height) != 2) {
+            fprintf(stderr, "usage: image_threads_bench [WIDTHxHEIGHT] [--threads N] [--iterations N] [--csv]\n");
+            return 1;
+        }
+    }
+    if (iterations <= 0) iterations = 10;
+    maxThreads = std::min(std::max(maxThreads, 1), IMAGE_MAX_THREADS);
+    if (width < 200 || height < 400) return 1;
+
+    ImageFrame frame = make_frame(width, height);
+    ImageView img = frame.view();
+    ImageRegion full = image_full_region(img);
+    ImageFrame big = crop(frame, width / 3, height / 2 + 7, 100, 100);
+    ImageFrame small = crop(frame, width / 2, height * 3 / 4, 32, 32);
+    ImagePyramid pyramid(img);
+    ImageTemplate bigTpl(big.view()), smallTpl(small.view());
+    // Warm: the frame's pyramid is shared by the searches on it
+    std::vector<ImageMatch> warm;
+    image_match_template(pyramid, bigTpl, ImageMatchOptions(), &warm);
+
+    ImageMultiColor icon;
+    icon.color = 0xff1e88e5;
+    icon.offsets = { { 4, 4, 0xff1e88e5 }, { 0, 8, 0xffffffff } };
+    ImageMultiColor end;
+    end.color = 0xff43a047;
+    end.offsets = { { 8, 0, 0xff43a047 }, { 0, 4, 0xff43a047 } };
+
+    auto colors = [&](uint32_t color, size_t limit) {
+        return [&img, full, color, limit] {
+            std::vector<ImagePoint> p;
+            image_find_colors(img, color, 4, full, limit, &p);
+            return flatten(p);
+        };
+    };
+    auto multi = [&](const ImageMultiColor &pattern, size_t limit) {
+        return [&img, full, &pattern, limit] {
+            std::vector<ImagePoint> p;
+            image_find_multi_colors(img, pattern, full, limit, &p);
+            return flatten(p);
+        };
+    };
+    auto match = [&](ImageTemplate &tpl, int levels, size_t limit) {
+        return [&pyramid, &tpl, levels, limit] {
+            ImageMatchOptions opts;
+            opts.threshold = 0.8f;
+            opts.levels = levels;
+            opts.limit = limit;
+            std::vector<ImageMatch> m;
+            image_match_template(pyramid, tpl, opts, &m);
+            std::vector<int32_t> v;
+            for (const ImageMatch &q : m) {
+                v.push_back(q.x);
+                v.push_back(q.y);
+            }
+            return v;
+        };
+    };
+    std::vector<Case> cases = {
+        { "findColor miss", colors(0xff102030, 1) },
+        { "findColor near end", colors(0xff43a047, 1) },
+        { "findAllColors button", colors(0xff1e88e5, 1000) },
+        { "findMultiColors button", multi(icon, 1) },
+        { "findMultiColors near end", multi(end, 1) },
+        { "findImage 100x100", match(bigTpl, -1, 1) },
+        { "findImage 32x32 levels 1", match(smallTpl, 1, 1) },
+        { "findAll 2 templates", [&] {
+              std::vector<std::vector<ImageMatch>> m;
+              image_match_templates(pyramid, { &bigTpl, &smallTpl }, ImageMatchOptions(), &m);
+              std::vector<int32_t> v;
+              for (const std::vector<ImageMatch> &q : m) {
+                  v.push_back(q.empty() ? -1 : q[0].x);
+                  v.push_back(q.empty() ? -1 : q[0].y);
+              }
+              return v;
+          } },
+    };
+
+    if (csv) printf("case,threads,matches,us,speedup,same\n");
+    else printf("%dx%d, best of %d\n  %-26s %7s %7s %10s %8s %5s\n", width, height, iterations, "case", "threads",
+                "matches", "us", "speedup", "same");
+    int failures = 0;
+    for (const Case &c : cases) {
+        std::vector<int32_t> expect;
+        double base = 0;
+        for (int threads = 1; threads <= maxThreads; threads++) {
+            image_set_threads(threads);
+            std::vector<int32_t> found = c.run();
+            double best = 1e30;
+            for (int i = 0; i < iterations; i++) {
+                double start = now_us();
+                c.run();
+                best = std::min(best, now_us() - start);
+            }
+            if (threads == 1) {
+                expect = found;
+                base = best;
+            }
+            bool same = found == expect;
+            if (!same) {
+                fprintf(stderr, "%s: %d threads find other points than one\n", c.name, threads);
+                failures++;
+            }
+            if (csv) printf("%s,%d,%zu,%.1f,%.2f,%d\n", c.name, threads, found.size() / 2, best, base / best, same);
+            else printf("  %-26s %7d %7zu %10.1f %7.2fx %5s\n", c.name, threads, found.size() / 2, best, base / best,
+                        same ? "yes" : "NO");
+        }
+    }
+    image_set_threads(0);
+    return failures ? 2 : 0;
+}
@@ -0,0 +1,212 @@
+// findAll() result transfer micro benchmark.
+//
+// Compares three ways of handing n matched nodes to a script:
+//   json   the legacy path: one JSON object per node with the ~25 fields
+//          uiObjectToJson wrote, parsed with JS_ParseJSON, then each
+//          element given the UiObject prototype
+//   eager  a JS array of native UiObject handles, all created up front
+//   lazy   a UiCollection (ui_collection.h) over the snapshot's node index
+//          column; "lazy+read" also reads every element once
+// The legacy JSON was built by Kotlin's JSONObject and crossed JNI as a
+// Java string; here it is built natively, so the json column is a lower
+// bound of what that path cost.
+//
+// Usage: ui_collection_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "ui_collection.h"
+#include "ui_snapshot.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Snapshot ====================
+
+// A flat list screen: a root with n rows
+static std::shared_ptr<UiSnapshot> build_snapshot(int rows) {
+    auto s = std::make_shared<UiSnapshot>();
+    std::vector<std::string> strings = { "", "com.example.shop", "android.widget.TextView",
+                                         "com.example.shop:id/name", "android.widget.FrameLayout" };
+    for (int i = 0; i < rows; i++) strings.push_back("Product " + std::to_string(i));
+    s->stringOffsets.push_back(0);
+    for (const std::string &str : strings) {
+        s->stringData += str;
+        s->stringOffsets.push_back((uint32_t)s->stringData.size());
+    }
+
+    for (int i = 0; i <= rows; i++) {
+        bool root = i == 0;
+        s->parent.push_back(root ? -1 : 0);
+        s->subtreeEnd.push_back(root ? rows + 1 : i + 1);
+        s->depth.push_back(root ? 0 : 1);
+        s->indexInParent.push_back(root ? -1 : i - 1);
+        s->drawingOrder.push_back(i);
+        s->childCount.push_back(root ? rows : 0);
+        s->text.push_back(root ? 0 : 4 + i);
+        s->id.push_back(root ? 0 : 3);
+        s->className.push_back(root ? 4 : 2);
+        s->desc.push_back(0);
+        s->packageName.push_back(1);
+        s->left.push_back(0);
+        s->top.push_back(i * 120);
+        s->right.push_back(1080);
+        s->bottom.push_back(i * 120 + 120);
+        s->flags.push_back(UI_FLAG_ENABLED | UI_FLAG_VISIBLE_TO_USER | (root ? 0 : UI_FLAG_CLICKABLE));
+    }
+    return s;
+}
+
+// ==================== Result Paths ====================
+
+struct BenchObject {
+    std::shared_ptr<const UiSnapshot> snap;
+    int32_t node;
+};
+
+static JSClassID g_object_class_id;
+
+static void object_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<BenchObject *>(JS_GetOpaque(val, g_object_class_id));
+}
+
+static JSClassDef g_object_class = {
+    "UiObject",
+    .finalizer = object_finalizer,
+};
+
+// Same shape as quickjs_jni.cpp's uiobject_new
+static JSValue object_new(JSContext *ctx, const std::shared_ptr<const UiSnapshot> &snap, int32_t node) {
+    JSValue obj = JS_NewObjectClass(ctx, g_object_class_id);
+    JS_SetOpaque(obj, new BenchObject{ snap, node });
+    return obj;
+}
+
+static void json_escape(std::string &out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+static JSValue result_json(JSContext *ctx, JSValueConst proto, const UiSnapshot &s, const std::vector<int32_t> &nodes) {
+    std::string json = "[";
+    char buf[256];
+    for (size_t k = 0; k < nodes.size(); k++) {
+        int32_t i = nodes[k];
+        if (k) json += ',';
+        json += "{\"_text\":";
+        json_escape(json, s.str(s.text[i]));
+        json += ",\"_id\":";
+        json_escape(json, s.str(s.id[i]));
+        json += ",\"_className\":";
+        json_escape(json, s.str(s.className[i]));
+        json += ",\"_desc\":";
+        json_escape(json, s.str(s.desc[i]));
+        json += ",\"_packageName\":";
+        json_escape(json, s.str(s.packageName[i]));
+        uint32_t f = s.flags[i];
+        auto b = [f](uint32_t flag) { return (f & flag) ? "true" : "false"; };
+        snprintf(buf, sizeof(buf),
+                 ",\"bounds\":{\"left\":%d,\"top\":%d,\"right\":%d,\"bottom\":%d,\"centerX\":%d,\"centerY\":%d}"
+                 ",\"_indexInParent\":%d,\"_depth\":%d,\"_drawingOrder\":%d",
+                 s.left[i], s.top[i], s.right[i], s.bottom[i], (s.left[i] + s.right[i]) / 2,
+                 (s.top[i] + s.bottom[i]) / 2, s.indexInParent[i], s.depth[i], s.drawingOrder[i]);
+        json += buf;
+        snprintf(buf, sizeof(buf),
+                 ",\"clickable\":%s,\"longClickable\":%s,\"scrollable\":%s,\"enabled\":%s,\"checked\":%s"
+                 ",\"selected\":%s,\"focusable\":%s,\"focused\":%s,\"checkable\":%s,\"editable\":%s"
+                 ",\"visibleToUser\":%s,\"childCount\":%d}",
+                 b(UI_FLAG_CLICKABLE), b(UI_FLAG_LONG_CLICKABLE), b(UI_FLAG_SCROLLABLE), b(UI_FLAG_ENABLED),
+                 b(UI_FLAG_CHECKED), b(UI_FLAG_SELECTED), b(UI_FLAG_FOCUSABLE), b(UI_FLAG_FOCUSED),
+                 b(UI_FLAG_CHECKABLE), b(UI_FLAG_EDITABLE), b(UI_FLAG_VISIBLE_TO_USER), s.childCount[i]);
+        json += buf;
+    }
+    json += ']';
+
+    JSValue arr = JS_ParseJSON(ctx, json.data(), json.size(), "<findAll>");
+    for (size_t k = 0; k < nodes.size(); k++) {
+        JSValue obj = JS_GetPropertyUint32(ctx, arr, (uint32_t)k);
+        JS_SetPrototype(ctx, obj, proto);
+        JS_FreeValue(ctx, obj);
+    }
+    return arr;
+}
+
+static JSValue result_eager(JSContext *ctx, const std::shared_ptr<const UiSnapshot> &snap,
+                            const std::vector<int32_t> &nodes) {
+    JSValue arr = JS_NewArray(ctx);
+    for (size_t k = 0; k < nodes.size(); k++) {
+        JS_SetPropertyUint32(ctx, arr, (uint32_t)k, object_new(ctx, snap, nodes[k]));
+    }
+    return arr;
+}
+
+static void read_all(JSContext *ctx, JSValueConst result, size_t n) {
+    for (size_t k = 0; k < n; k++) JS_FreeValue(ctx, JS_GetPropertyUint32(ctx, result, (uint32_t)k));
+}
+
+// ==================== Driver ====================
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    if (iterations <= 0) iterations = 200;
+
+    JSRuntime *rt = JS_NewRuntime();
+    JSContext *ctx = JS_NewContext(rt);
+    JS_NewClassID(&g_object_class_id);
+    JS_NewClass(rt, g_object_class_id, &g_object_class);
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetClassProto(ctx, g_object_class_id, JS_DupValue(ctx, proto));
+    ui_collection_register(ctx, object_new);
+
+    std::shared_ptr<const UiSnapshot> snap = build_snapshot(1000);
+
+    printf("%8s %12s %12s %12s %12s\n", "results", "json us", "eager us", "lazy us", "lazy+read us");
+    for (int n : { 10, 100, 1000 }) {
+        std::vector<int32_t> nodes;
+        for (int i = 1; i <= n; i++) nodes.push_back(i);
+
+        double t[4] = { 0, 0, 0, 0 };
+        for (int it = 0; it < iterations; it++) {
+            double start = now_us();
+            JSValue r = result_json(ctx, proto, *snap, nodes);
+            t[0] += now_us() - start;
+            JS_FreeValue(ctx, r);
+
+            start = now_us();
+            r = result_eager(ctx, snap, nodes);
+            t[1] += now_us() - start;
+            JS_FreeValue(ctx, r);
+
+            start = now_us();
+            r = ui_collection_new(ctx, snap, nodes);
+            t[2] += now_us() - start;
+            JS_FreeValue(ctx, r);
+
+            start = now_us();
+            r = ui_collection_new(ctx, snap, nodes);
+            read_all(ctx, r, nodes.size());
+            t[3] += now_us() - start;
+            JS_FreeValue(ctx, r);
+        }
+        printf("%8d %12.2f %12.2f %12.2f %12.2f\n", n, t[0] / iterations, t[1] / iterations,
+               t[2] / iterations, t[3] / iterations);
+    }
+
+    JS_FreeValue(ctx, proto);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    return 0;
+}
@@ -0,0 +1,352 @@
+// Selector corpus benchmark.
+//
+// Runs a corpus of selectors, written as in scripts, against a corpus of
+// snapshot files (ui_snapshot.h; dumpSnapshot() on a device, or
+// ui_selector_bench --save) and reports per snapshot and selector the
+// matches, the first run (which builds the lookup indexes it needs), the
+// time per query and the heap allocations per query. Queries run with the
+// result memo off, so every one is a full search. Kept per release, the
+// CSV output tracks selector latency and allocation over time.
+//
+// A selector file has one chain per line; blank lines and lines starting
+// with # are skipped. Arguments are strings, /regex/flags, numbers,
+// true/false or a nested chain, and a trailing findOne()/findOnce()/exists()
+// stops at the first match while findAll()/find() (the default) finds all:
+//
+//     text("OK").clickable()
+//     textMatches(/\d+ sold/).boundsInside(0, 0, 1080, 1920).findOne()
+//     id("item").descendant(text("Sold out"))
+//
+// Without files named it runs bench/corpus: selectors.txt against the
+// snapshots there (shop_list.bin, a 599-node product list saved by
+// ui_selector_bench --save). Snapshots dumped from devices go next to it.
+//
+// Usage: ui_corpus_bench [selectors.txt snapshot.bin|dir...] [--iterations N] [--csv]
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ui_selector.h"
+#include "ui_snapshot.h"
+
+// The corpus in the source tree, run when no files are named
+#ifndef UI_CORPUS_DIR
+#define UI_CORPUS_DIR "bench/corpus"
+#endif
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Allocation Counting ====================
+
+static std::atomic<size_t> g_allocs(0);
+static std::atomic<size_t> g_alloc_bytes(0);
+
+void *operator new(size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    if (void *p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// ==================== Selector Parsing ====================
+
+struct Parser {
+    const char *p;
+    std::string error;
+
+    void skip() { while (isspace((unsigned char)*p)) p++; }
+
+    bool eat(char c) {
+        skip();
+        if (*p != c) return false;
+        p++;
+        return true;
+    }
+
+    bool fail(const char *what) {
+        if (error.empty()) error = std::string(what) + " at \"" + std::string(p).substr(0, 16) + "\"";
+        return false;
+    }
+
+    std::string ident() {
+        skip();
+        const char *start = p;
+        while (isalnum((unsigned char)*p) || *p == '_' || *p == '$') p++;
+        return std::string(start, p);
+    }
+
+    bool string(std::string *out) {
+        char quote = *p++;
+        for (; *p && *p != quote; p++) {
+            if (*p == '\\' && p[1]) {
+                p++;
+                out->push_back(*p == 'n' ? '\n' : *p == 't' ? '\t' : *p);
+            } else {
+                out->push_back(*p);
+            }
+        }
+        if (!*p) return fail("unterminated string");
+        p++;
+        return true;
+    }
+
+    // /source/flags; the source is kept as written
+    bool regex(std::string *source, std::string *flags) {
+        p++;
+        bool cls = false;
+        for (; *p && (*p != '/' || cls); p++) {
+            if (*p == '\\' && p[1]) source->push_back(*p++);
+            else if (*p == '[') cls = true;
+            else if (*p == ']') cls = false;
+            source->push_back(*p);
+        }
+        if (!*p) return fail("unterminated regex");
+        p++;
+        while (isalpha((unsigned char)*p)) flags->push_back(*p++);
+        return true;
+    }
+
+    bool number(int32_t *out) {
+        skip();
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p) return fail("expected a number");
+        p = end;
+        *out = (int32_t)v;
+        return true;
+    }
+
+    bool arg(Selector *sel, int op) {
+        skip();
+        SelectorArg type = selector_op_arg(op);
+        switch (type) {
+            case SEL_ARG_STRING:
+            case SEL_ARG_REGEX: {
+                std::string s, flags;
+                if (*p == '/' && type == SEL_ARG_REGEX) {
+                    if (!regex(&s, &flags)) return false;
+                } else if (*p == '"' || *p == '\'') {
+                    if (!string(&s)) return false;
+                } else {
+                    return fail("expected a string");
+                }
+                if (type == SEL_ARG_REGEX) {
+                    selector_add_regex(sel, op, s.data(), s.size(), selector_regex_flags(flags.data(), flags.size()));
+                } else {
+                    selector_add_string(sel, op, s.data(), s.size());
+                }
+                return true;
+            }
+            case SEL_ARG_BOOL: {
+                if (*p == ')') {
+                    selector_add_int(sel, op, 1);
+                    return true;
+                }
+                std::string v = ident();
+                if (v != "true" && v != "false") return fail("expected true or false");
+                selector_add_int(sel, op, v == "true");
+                return true;
+            }
+            case SEL_ARG_INT: {
+                int32_t v = 0;
+                if (!number(&v)) return false;
+                selector_add_int(sel, op, v);
+                return true;
+            }
+            case SEL_ARG_RECT:
+            case SEL_ARG_POINT: {
+                int32_t v[4] = {};
+                int n = type == SEL_ARG_RECT ? 4 : 2;
+                for (int i = 0; i < n; i++) {
+                    if ((i > 0 && !eat(',')) || !number(&v[i])) return fail("expected a number");
+                }
+                if (n == 2) selector_add_rect(sel, op, v[0], v[1], v[0], v[1]);
+                else selector_add_rect(sel, op, v[0], v[1], v[2], v[3]);
+                return true;
+            }
+            case SEL_ARG_SELECTOR: {
+                Selector sub;
+                if (!chain(&sub, nullptr)) return false;
+                selector_add_selector(sel, op, sub);
+                return true;
+            }
+        }
+        return fail("unknown argument type");
+    }
+
+    // name(args).name(args)...; limit is set by a trailing find method
+    // (null where none is allowed, i.e. in a nested selector)
+    bool chain(Selector *sel, size_t *limit) {
+        do {
+            std::string name = ident();
+            if (name.empty()) return fail("expected a selector");
+            if (!eat('(')) return fail("expected (");
+            if (limit && (name == "findOne" || name == "findOnce" || name == "exists" ||
+                          name == "findAll" || name == "find")) {
+                *limit = name == "findAll" || name == "find" ? 0 : 1;
+                if (!eat(')')) return fail("expected )");
+                skip();
+                return *p == 0 || fail("unexpected text after find method");
+            }
+            int op = 0;
+            while (op < SEL_OP_COUNT && name != selector_op_name(op)) op++;
+            if (op == SEL_OP_COUNT) return fail(("unknown selector " + name).c_str());
+            if (!arg(sel, op) || !eat(')')) return fail("expected )");
+        } while (eat('.'));
+        return true;
+    }
+};
+
+struct Query {
+    std::string source;
+    Selector sel;
+    size_t limit = 0;
+};
+
+static bool read_selectors(const char *path, std::vector<Query> *out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+    char line[4096];
+    bool ok = true;
+    for (int n = 1; fgets(line, sizeof(line), f); n++) {
+        std::string s(line);
+        while (!s.empty() && isspace((unsigned char)s.back())) s.pop_back();
+        size_t start = s.find_first_not_of(" \t");
+        if (start == std::string::npos || s[start] == '#') continue;
+        Query q;
+        q.source = s.substr(start);
+        Parser parser = { q.source.c_str(), "" };
+        if (!parser.chain(&q.sel, &q.limit) || (parser.skip(), *parser.p != 0)) {
+            if (parser.error.empty()) parser.error = "unexpected text";
+            fprintf(stderr, "%s:%d: %s\n", path, n, parser.error.c_str());
+            ok = false;
+            continue;
+        }
+        out->push_back(std::move(q));
+    }
+    fclose(f);
+    return ok;
+}
+
+// ==================== Driver ====================
+
+// Snapshot files named on the command line; directories contribute their
+// *.bin files, sorted by name
+static void collect_snapshots(const char *path, std::vector<std::string> *out) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        out->push_back(path);
+        return;
+    }
+    std::vector<std::string> files;
+    if (DIR *dir = opendir(path)) {
+        while (struct dirent *e = readdir(dir)) {
+            size_t len = strlen(e->d_name);
+            if (len > 4 && strcmp(e->d_name + len - 4, ".bin") == 0) files.push_back(std::string(path) + "/" + e->d_name);
+        }
+        closedir(dir);
+    }
+    std::sort(files.begin(), files.end());
+    out->insert(out->end(), files.begin(), files.end());
+}
+
+static const char *base_name(const std::string &path) {
+    size_t slash = path.rfind('/');
+    return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 1000;
+    bool csv = false;
+    const char *selectorPath = nullptr;
+    std::vector<std::string> snapshots;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (!selectorPath) selectorPath = argv[i];
+        else collect_snapshots(argv[i], &snapshots);
+    }
+    if (!selectorPath) selectorPath = UI_CORPUS_DIR "/selectors.txt";
+    if (snapshots.empty()) collect_snapshots(UI_CORPUS_DIR, &snapshots);
+    if (snapshots.empty()) {
+        fprintf(stderr, "usage: ui_corpus_bench [selectors.txt snapshot.bin|dir...] [--iterations N] [--csv]\n");
+        return 1;
+    }
+    if (iterations <= 0) iterations = 1000;
+
+    std::vector<Query> queries;
+    if (!read_selectors(selectorPath, &queries)) return 1;
+    selector_memo_set_enabled(false);
+
+    if (csv) printf("snapshot,nodes,selector,matches,first_us,us_per_query,allocs_per_query,bytes_per_query\n");
+    for (const std::string &path : snapshots) {
+        auto snap = std::make_shared<UiSnapshot>();
+        double start = now_us();
+        if (!ui_snapshot_load(path.c_str(), snap.get())) {
+            fprintf(stderr, "cannot load %s\n", path.c_str());
+            return 1;
+        }
+        double load_us = now_us() - start;
+        // Published like a pushed snapshot, so per-snapshot caches apply
+        ui_snapshot_publish(snap);
+        int32_t n = (int32_t)snap->size();
+
+        if (!csv) {
+            printf("%s: %d nodes, %zu strings, load %.1f us\n", base_name(path), n, snap->stringCount(), load_us);
+            printf("  %-44s %8s %10s %10s %10s %10s\n", "selector", "matches", "first us", "us/query", "allocs", "bytes");
+        }
+        for (Query &q : queries) {
+            std::vector<int32_t> found;
+            start = now_us();
+            size_t matches = selector_find(&q.sel, *snap, 0, n, q.limit, &found);
+            double first_us = now_us() - start;
+
+            size_t allocs = g_allocs.load(), bytes = g_alloc_bytes.load();
+            start = now_us();
+            for (int i = 0; i < iterations; i++) {
+                found.clear();
+                selector_find(&q.sel, *snap, 0, n, q.limit, &found);
+            }
+            double query_us = (now_us() - start) / iterations;
+            double allocs_per = (double)(g_allocs.load() - allocs) / iterations;
+            double bytes_per = (double)(g_alloc_bytes.load() - bytes) / iterations;
+
+            if (csv) {
+                std::string quoted = q.source;
+                for (size_t i = 0; (i = quoted.find('"', i)) != std::string::npos; i += 2) quoted.insert(i, "\"");
+                printf("%s,%d,\"%s\",%zu,%.2f,%.3f,%.2f,%.1f\n", base_name(path), n, quoted.c_str(), matches,
+                       first_us, query_us, allocs_per, bytes_per);
+            } else {
+                std::string name = q.source.size() > 44 ? q.source.substr(0, 41) + "..." : q.source;
+                printf("  %-44s %8zu %10.2f %10.3f %10.2f %10.1f\n", name.c_str(), matches, first_us, query_us,
+                       allocs_per, bytes_per);
+            }
+        }
+    }
+    return 0;
+}
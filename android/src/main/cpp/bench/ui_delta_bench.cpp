@@ -0,0 +1,416 @@
+// Snapshot delta micro benchmark.
+//
+// Drives a synthetic list screen through a stream of small changes (a text
+// update, a row whose children are rebuilt, a removed row; one to three per
+// delta, like the events between two captures) and compares applying each
+// delta (ui_snapshot_apply_delta) with parsing the equivalent full snapshot.
+// Every applied snapshot is checked against that full snapshot. "diff" is
+// ui.diff() between the two generations (ui_diff.h).
+//
+// A stream can be recorded and replayed later, e.g. one captured on a
+// device: the stream file is a sequence of u32 length + delta, each against
+// the snapshot the previous one produced. It comes with the snapshot the
+// stream should end on (on a device, dumpSnapshot() after the last delta),
+// and a replay that ends on anything else fails.
+//
+// Usage: ui_delta_bench [nodes] [deltas]
+//        ui_delta_bench --record base.bin stream.bin final.bin [nodes] [deltas]
+//        ui_delta_bench base.bin stream.bin final.bin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ui_diff.h"
+#include "ui_snapshot.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Model Tree ====================
+
+struct Node {
+    std::string cls, text, id, desc;
+    int32_t top = 0;
+    int32_t drawingOrder = 0;
+    uint32_t flags = 0;
+    std::vector<std::unique_ptr<Node>> children;
+
+    Node *add(const char *c, const std::string &t, const std::string &i, const std::string &d, uint32_t f) {
+        auto n = std::make_unique<Node>();
+        n->cls = c;
+        n->text = t;
+        n->id = i.empty() ? "" : "com.example.shop:id/" + i;
+        n->desc = d;
+        n->top = top;
+        n->drawingOrder = (int32_t)children.size() + 1;
+        n->flags = f | UI_FLAG_ENABLED | UI_FLAG_VISIBLE_TO_USER;
+        children.push_back(std::move(n));
+        return children.back().get();
+    }
+};
+
+struct Flat {
+    Node *node;
+    int32_t parent, depth, indexInParent, end;
+};
+
+static void flatten(Node *root, std::vector<Flat> *out) {
+    size_t start = out->size();
+    struct Entry { Node *node; int32_t parent, depth, indexInParent; };
+    std::vector<Entry> stack = { { root, -1, 0, -1 } };
+    while (!stack.empty()) {
+        Entry e = stack.back();
+        stack.pop_back();
+        int32_t index = (int32_t)(out->size() - start);
+        out->push_back({ e.node, e.parent, e.depth, e.indexInParent, 0 });
+        for (size_t i = e.node->children.size(); i-- > 0;) {
+            stack.push_back({ e.node->children[i].get(), index, e.depth + 1, (int32_t)i });
+        }
+    }
+    // Pre-order: a subtree ends at the next node no deeper than its root
+    std::vector<int32_t> path;
+    int32_t n = (int32_t)(out->size() - start);
+    for (int32_t i = 0; i < n; i++) {
+        while (!path.empty() && (*out)[start + path.back()].depth >= (*out)[start + i].depth) {
+            (*out)[start + path.back()].end = i;
+            path.pop_back();
+        }
+        path.push_back(i);
+    }
+    for (int32_t i : path) (*out)[start + i].end = n;
+}
+
+static void fill_row(Node *item, int row, int variant) {
+    char buf[64];
+    item->children.clear();
+    snprintf(buf, sizeof(buf), "Product %d", row);
+    item->add("android.widget.ImageView", "", "icon", buf, 0);
+    Node *col = item->add("android.widget.LinearLayout", "", "", "", 0);
+    col->add("android.widget.TextView", buf, "name", "", 0);
+    snprintf(buf, sizeof(buf), "$%d.%02d, %d sold", 5 + row % 95, row % 100, (row * 7 + variant) % 1000);
+    col->add("android.widget.TextView", buf, "price", "", 0);
+    if (variant % 3 == 1) col->add("android.widget.TextView", "Limited offer", "badge", "", 0);
+    item->add("android.widget.Button", variant % 10 == 9 ? "Sold out" : "Add to cart", "buy", "",
+              UI_FLAG_CLICKABLE | UI_FLAG_FOCUSABLE);
+}
+
+static std::unique_ptr<Node> build_tree(int target, int *rows) {
+    auto root = std::make_unique<Node>();
+    root->cls = "android.widget.FrameLayout";
+    root->flags = UI_FLAG_ENABLED | UI_FLAG_VISIBLE_TO_USER;
+    Node *content = root->add("android.widget.LinearLayout", "", "content", "", 0);
+    Node *toolbar = content->add("android.view.ViewGroup", "", "toolbar", "", 0);
+    toolbar->add("android.widget.ImageButton", "", "", "Navigate up", UI_FLAG_CLICKABLE | UI_FLAG_FOCUSABLE);
+    toolbar->add("android.widget.TextView", "Shop", "title", "", 0);
+    Node *list = content->add("androidx.recyclerview.widget.RecyclerView", "", "list", "",
+                              UI_FLAG_SCROLLABLE | UI_FLAG_FOCUSABLE);
+    int nodes = 6;
+    for (*rows = 0; nodes + 6 <= target; ++*rows, nodes += 6) {
+        list->top = 240 + *rows * 120;
+        Node *item = list->add("android.widget.LinearLayout", "", "item", "", UI_FLAG_CLICKABLE);
+        fill_row(item, *rows, 0);
+    }
+    return root;
+}
+
+// ==================== Encoding ====================
+
+struct Writer {
+    std::vector<uint8_t> out;
+
+    void put(const void *p, size_t n) { out.insert(out.end(), (const uint8_t *)p, (const uint8_t *)p + n); }
+    void u32(uint32_t v) { put(&v, 4); }
+};
+
+struct Strings {
+    std::vector<std::string> list;
+    std::unordered_map<std::string, int32_t> index;
+
+    Strings() { intern(""); }
+
+    int32_t intern(const std::string &s) {
+        auto it = index.find(s);
+        if (it != index.end()) return it->second;
+        list.push_back(s);
+        return index[s] = (int32_t)list.size() - 1;
+    }
+
+    void write(Writer *w) const {
+        w->u32((uint32_t)list.size());
+        for (const std::string &s : list) {
+            w->u32((uint32_t)s.size());
+            w->put(s.data(), s.size());
+        }
+    }
+};
+
+static void put_record(std::vector<int32_t> *records, Strings *strings, const Flat &f) {
+    const Node *n = f.node;
+    int32_t r[UI_SNAPSHOT_NODE_FIELDS] = {
+        f.parent, f.depth, f.indexInParent, n->drawingOrder, (int32_t)n->children.size(),
+        strings->intern(n->text), strings->intern(n->id), strings->intern(n->cls), strings->intern(n->desc),
+        strings->intern("com.example.shop"), 0, n->top, 1080, n->top + 120, (int32_t)n->flags,
+    };
+    records->insert(records->end(), r, r + UI_SNAPSHOT_NODE_FIELDS);
+}
+
+static std::vector<uint8_t> encode_full(Node *root) {
+    std::vector<Flat> flat;
+    flatten(root, &flat);
+    Strings strings;
+    std::vector<int32_t> records;
+    for (const Flat &f : flat) put_record(&records, &strings, f);
+
+    Writer w;
+    w.u32(UI_SNAPSHOT_MAGIC);
+    w.u32(UI_SNAPSHOT_VERSION);
+    w.u32((uint32_t)flat.size());
+    strings.write(&w);
+    w.put(records.data(), records.size() * 4);
+    return w.out;
+}
+
+// ==================== Changes ====================
+
+struct Change {
+    uint32_t kind;
+    int32_t target;
+};
+
+// Pick one to three non-nested changes on the current tree, apply them to
+// the model and return the delta that describes them
+static std::vector<uint8_t> mutate(Node *root, uint32_t generation, std::mt19937 &rng, int *serial) {
+    std::vector<Flat> flat;
+    flatten(root, &flat);
+    int32_t n = (int32_t)flat.size();
+
+    std::vector<Change> changes;
+    int count = 1 + (int)(rng() % 3);
+    for (int tries = 0; (int)changes.size() < count && tries < 32; tries++) {
+        int32_t t = (int32_t)(rng() % n);
+        uint32_t r = rng() % 100;
+        uint32_t kind = r < 60 ? UI_DELTA_UPDATE : r < 90 ? UI_DELTA_REPLACE : UI_DELTA_REMOVE;
+        int32_t end = kind == UI_DELTA_UPDATE ? t + 1 : flat[t].end;
+        if (kind != UI_DELTA_UPDATE && (t == 0 || end - t > 64)) continue;
+        bool overlaps = false;
+        for (const Change &c : changes) {
+            int32_t cend = c.kind == UI_DELTA_UPDATE ? c.target + 1 : flat[c.target].end;
+            if (t < cend && c.target < end) overlaps = true;
+        }
+        if (!overlaps) changes.push_back({ kind, t });
+    }
+
+    Strings strings;
+    std::vector<std::vector<int32_t>> records(changes.size());
+    for (size_t k = 0; k < changes.size(); k++) {
+        Node *node = flat[changes[k].target].node;
+        int s = ++*serial;
+        if (changes[k].kind == UI_DELTA_UPDATE) {
+            node->text = "Updated " + std::to_string(s);
+            node->flags ^= UI_FLAG_SELECTED;
+            put_record(&records[k], &strings, { node, -1, 0, -1, 0 });
+        } else if (changes[k].kind == UI_DELTA_REPLACE) {
+            fill_row(node, s, s);
+            std::vector<Flat> sub;
+            flatten(node, &sub);
+            for (const Flat &f : sub) put_record(&records[k], &strings, f);
+        }
+    }
+    // Removals last, from the end: they shift later siblings and free nodes
+    std::vector<Change> removals = changes;
+    std::sort(removals.begin(), removals.end(), [](const Change &x, const Change &y) { return x.target > y.target; });
+    for (const Change &c : removals) {
+        if (c.kind != UI_DELTA_REMOVE) continue;
+        auto &siblings = flat[flat[c.target].parent].node->children;
+        siblings.erase(siblings.begin() + flat[c.target].indexInParent);
+    }
+
+    Writer w;
+    w.u32(UI_DELTA_MAGIC);
+    w.u32(UI_DELTA_VERSION);
+    w.u32(generation);
+    w.u32((uint32_t)changes.size());
+    strings.write(&w);
+    for (size_t k = 0; k < changes.size(); k++) {
+        w.u32(changes[k].kind);
+        w.u32((uint32_t)changes[k].target);
+        if (changes[k].kind == UI_DELTA_REPLACE) w.u32((uint32_t)(records[k].size() / UI_SNAPSHOT_NODE_FIELDS));
+        w.put(records[k].data(), records[k].size() * 4);
+    }
+    return w.out;
+}
+
+// ==================== Driver ====================
+
+static bool same_snapshot(const UiSnapshot &a, const UiSnapshot &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a.parent[i] != b.parent[i] || a.subtreeEnd[i] != b.subtreeEnd[i] || a.depth[i] != b.depth[i] ||
+            a.indexInParent[i] != b.indexInParent[i] || a.drawingOrder[i] != b.drawingOrder[i] ||
+            a.childCount[i] != b.childCount[i] || a.left[i] != b.left[i] || a.top[i] != b.top[i] ||
+            a.right[i] != b.right[i] || a.bottom[i] != b.bottom[i] || a.flags[i] != b.flags[i] ||
+            a.str(a.text[i]) != b.str(b.text[i]) || a.str(a.id[i]) != b.str(b.id[i]) ||
+            a.str(a.className[i]) != b.str(b.className[i]) || a.str(a.desc[i]) != b.str(b.desc[i]) ||
+            a.str(a.packageName[i]) != b.str(b.packageName[i])) {
+            fprintf(stderr, "node %zu differs\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static bool write_file(const char *path, const std::vector<uint8_t> &data) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static int replay(const char *basePath, const char *streamPath, const char *finalPath) {
+    std::vector<uint8_t> base, stream, final;
+    if (!read_file(basePath, &base) || !read_file(streamPath, &stream) || !read_file(finalPath, &final)) {
+        fprintf(stderr, "cannot read %s, %s or %s\n", basePath, streamPath, finalPath);
+        return 1;
+    }
+    auto cur = std::make_shared<UiSnapshot>();
+    UiSnapshot expected;
+    if (!ui_snapshot_parse(base.data(), base.size(), cur.get()) ||
+        !ui_snapshot_parse(final.data(), final.size(), &expected)) {
+        fprintf(stderr, "malformed snapshot\n");
+        return 1;
+    }
+
+    size_t deltas = 0, bytes = 0;
+    double apply_us = 0;
+    for (size_t pos = 0; pos + 4 <= stream.size(); deltas++) {
+        uint32_t len;
+        memcpy(&len, &stream[pos], 4);
+        pos += 4;
+        if (len < 12 || stream.size() - pos < len) {
+            fprintf(stderr, "truncated stream at delta %zu\n", deltas);
+            return 1;
+        }
+        // Recorded generations are the device's; take the delta's own base
+        memcpy(&cur->generation, &stream[pos + 8], 4);
+        auto next = std::make_shared<UiSnapshot>();
+        double start = now_us();
+        bool ok = ui_snapshot_apply_delta(*cur, &stream[pos], len, next.get());
+        apply_us += now_us() - start;
+        if (!ok) {
+            fprintf(stderr, "delta %zu does not apply\n", deltas);
+            return 1;
+        }
+        cur = std::move(next);
+        pos += len;
+        bytes += len;
+    }
+    if (!same_snapshot(*cur, expected)) {
+        fprintf(stderr, "replayed %zu deltas: result differs from %s\n", deltas, finalPath);
+        return 1;
+    }
+    printf("replayed %zu deltas (%.0f bytes avg), final %zu nodes match: apply %.2f us/delta\n", deltas,
+           deltas ? (double)bytes / deltas : 0.0, cur->size(), deltas ? apply_us / deltas : 0.0);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bool record = argc > 4 && strcmp(argv[1], "--record") == 0;
+    if (!record && argc > 1 && atoi(argv[1]) <= 0) {
+        if (argc > 3) return replay(argv[1], argv[2], argv[3]);
+        fprintf(stderr, "usage: ui_delta_bench [nodes] [deltas]\n"
+                        "       ui_delta_bench --record base.bin stream.bin final.bin [nodes] [deltas]\n"
+                        "       ui_delta_bench base.bin stream.bin final.bin\n");
+        return 1;
+    }
+
+    int a = record ? 5 : 1;
+    int target = argc > a ? atoi(argv[a]) : 5000;
+    int deltas = argc > a + 1 ? atoi(argv[a + 1]) : 500;
+    if (target <= 6) target = 5000;
+    if (deltas <= 0) deltas = 500;
+
+    int rows, serial = 0;
+    std::unique_ptr<Node> root = build_tree(target, &rows);
+    std::vector<uint8_t> full = encode_full(root.get());
+    auto cur = std::make_shared<UiSnapshot>();
+    if (!ui_snapshot_parse(full.data(), full.size(), cur.get())) {
+        fprintf(stderr, "malformed snapshot\n");
+        return 1;
+    }
+    cur->generation = 1;
+    if (record && !write_file(argv[2], full)) {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<uint8_t> stream;
+    double apply_us = 0, parse_us = 0, diff_us = 0;
+    size_t delta_bytes = 0, full_bytes = 0, diff_changes = 0;
+    for (int i = 0; i < deltas; i++) {
+        std::vector<uint8_t> delta = mutate(root.get(), cur->generation, rng, &serial);
+        uint32_t len = (uint32_t)delta.size();
+        stream.insert(stream.end(), (const uint8_t *)&len, (const uint8_t *)&len + 4);
+        stream.insert(stream.end(), delta.begin(), delta.end());
+        delta_bytes += delta.size();
+
+        auto next = std::make_shared<UiSnapshot>();
+        double start = now_us();
+        bool ok = ui_snapshot_apply_delta(*cur, delta.data(), delta.size(), next.get());
+        apply_us += now_us() - start;
+        next->generation = cur->generation + 1;
+
+        full = encode_full(root.get());
+        full_bytes += full.size();
+        UiSnapshot expected;
+        start = now_us();
+        ui_snapshot_parse(full.data(), full.size(), &expected);
+        parse_us += now_us() - start;
+
+        if (!ok || !same_snapshot(*next, expected)) {
+            fprintf(stderr, "delta %d: %s\n", i, ok ? "result differs from full snapshot" : "does not apply");
+            return 1;
+        }
+        UiDiff diff;
+        start = now_us();
+        ui_diff(*cur, *next, &diff);
+        diff_us += now_us() - start;
+        diff_changes += diff.added.size() + diff.removed.size() + diff.moved.size() + diff.textChanged.size();
+        cur = std::move(next);
+    }
+    // full is the encoding of the model after the last delta, which the
+    // last applied snapshot was checked against
+    if (record && (!write_file(argv[3], stream) || !write_file(argv[4], full))) {
+        fprintf(stderr, "cannot write %s or %s\n", argv[3], argv[4]);
+        return 1;
+    }
+
+    printf("delta bench: %d deltas over %zu nodes, all match full snapshots\n", deltas, cur->size());
+    printf("%-12s %12s %12s\n", "", "bytes avg", "us/update");
+    printf("%-12s %12.0f %12.2f\n", "full parse", (double)full_bytes / deltas, parse_us / deltas);
+    printf("%-12s %12.0f %12.2f\n", "delta apply", (double)delta_bytes / deltas, apply_us / deltas);
+    printf("%-12s %12s %12.2f  (%.1f changed nodes avg)\n", "diff", "-", diff_us / deltas, (double)diff_changes / deltas);
+    return 0;
+}
@@ -0,0 +1,393 @@
+// Selector engine scaling benchmark.
+//
+// Generates synthetic trees in the snapshot wire format (ui_snapshot.h) and
+// sweeps tree size against selector type, reporting per-query latency
+// percentiles and heap bytes allocated per query, plus the snapshot parse
+// that every capture pays. Real screens range from ~50 nodes to ~20k
+// (WebView content), so the default sweep covers that span.
+//
+// The generator is parameterized so a sweep can model a given kind of
+// screen:
+//   --depth D        maximum depth (default 24)
+//   --fanout F       average children per inner node (default 4)
+//   --strings K      distinct texts, 0 = one per 4 nodes (default 0)
+//   --dup-bounds R   share of nodes with their parent's exact bounds, as
+//                    wrapper layouts have (default 0.3)
+//   --seed S         generator seed (default 1)
+// --generate writes one such tree to a snapshot file instead, e.g. as a
+// fixture for ui_corpus_bench.
+//
+// With --baseline, the run is compared with an earlier --csv output and
+// exits with 2 if some p50 is more than --tolerance (default 1.25) times
+// its baseline, so selector engine changes can be gated on the curves.
+//
+// Usage: ui_scaling_bench [sizes,...] [options] [--iterations N] [--csv]
+//                         [--baseline old.csv [--tolerance T]]
+//        ui_scaling_bench --generate out.bin nodes [options]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ui_selector.h"
+#include "ui_snapshot.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Allocation Counting ====================
+
+static std::atomic<size_t> g_alloc_bytes(0);
+
+void *operator new(size_t n) {
+    g_alloc_bytes.fetch_add(n, std::memory_order_relaxed);
+    if (void *p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// ==================== Tree Generator ====================
+
+struct GenParams {
+    int nodes = 1000;
+    int depth = 24;
+    int fanout = 4;
+    int strings = 0;
+    double dupBounds = 0.3;
+    uint32_t seed = 1;
+
+    int textCount() const { return strings > 0 ? strings : std::max(1, nodes / 4); }
+};
+
+static const char *g_classes[] = {
+    "android.widget.FrameLayout", "android.widget.LinearLayout", "android.view.ViewGroup",
+    "android.widget.TextView", "android.widget.TextView", "android.widget.TextView",
+    "android.widget.ImageView", "android.widget.Button", "android.widget.EditText",
+    "android.widget.CheckBox", "androidx.recyclerview.widget.RecyclerView", "android.view.View",
+};
+
+struct GenNode {
+    int32_t parent, depth, indexInParent;
+    std::vector<int32_t> children;
+};
+
+// Shape first: nodes take children breadth first, 1..2F-1 each, until the
+// target count; nodes at the maximum depth stay leaves. Then attributes are
+// drawn per node in pre-order, children splitting their parent's height
+// unless they repeat its bounds.
+static std::vector<uint8_t> generate_tree(const GenParams &p) {
+    std::mt19937 rng(p.seed);
+    std::vector<GenNode> tree = { { -1, 0, -1, {} } };
+    tree.reserve(p.nodes);
+    for (size_t next = 0; (int)tree.size() < p.nodes; next++) {
+        if (next == tree.size()) next = rng() % tree.size();  // depth-capped: widen random nodes
+        if (tree[next].depth >= p.depth) continue;
+        int count = 1 + (int)(rng() % std::max(1, 2 * p.fanout - 1));
+        for (int i = 0; i < count && (int)tree.size() < p.nodes; i++) {
+            int32_t index = (int32_t)tree[next].children.size();
+            tree[next].children.push_back((int32_t)tree.size());
+            tree.push_back({ (int32_t)next, tree[next].depth + 1, index, {} });
+        }
+    }
+
+    std::vector<std::string> strings = { "" };
+    std::unordered_map<std::string, int32_t> index = { { "", 0 } };
+    auto intern = [&](const std::string &s) {
+        auto it = index.find(s);
+        if (it != index.end()) return it->second;
+        strings.push_back(s);
+        return index[s] = (int32_t)strings.size() - 1;
+    };
+    int texts = p.textCount(), ids = std::max(1, texts / 4);
+    int32_t pkg = intern("com.example.gen");
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    std::vector<int32_t> order, position(tree.size()), records;
+    std::vector<std::array<int32_t, 4>> bounds(tree.size());
+    std::vector<int32_t> stack = { 0 };
+    while (!stack.empty()) {
+        int32_t n = stack.back();
+        stack.pop_back();
+        position[n] = (int32_t)order.size();
+        order.push_back(n);
+        for (size_t i = tree[n].children.size(); i-- > 0;) stack.push_back(tree[n].children[i]);
+    }
+    bounds[0] = { 0, 0, 1080, std::max(2400, p.nodes * 8) };
+    records.reserve(order.size() * UI_SNAPSHOT_NODE_FIELDS);
+    char buf[64];
+    for (int32_t n : order) {
+        const GenNode &g = tree[n];
+        if (g.parent >= 0) {
+            const auto &pb = bounds[g.parent];
+            int32_t count = (int32_t)tree[g.parent].children.size();
+            int32_t h = std::max(1, (pb[3] - pb[1]) / count);
+            int32_t top = pb[1] + g.indexInParent * h;
+            bounds[n] = unit(rng) < p.dupBounds ? pb : std::array<int32_t, 4>{ pb[0], top, pb[2], top + h };
+        }
+        const char *cls = g.children.empty() ? g_classes[3 + rng() % 9] : g_classes[rng() % 3];
+        int32_t text = 0, id = 0, desc = 0;
+        if (g.children.empty() && unit(rng) < 0.7) {
+            snprintf(buf, sizeof(buf), "Text %u", (unsigned)(rng() % texts));
+            text = intern(buf);
+        }
+        if (unit(rng) < 0.5) {
+            snprintf(buf, sizeof(buf), "com.example.gen:id/v%u", (unsigned)(rng() % ids));
+            id = intern(buf);
+        }
+        if (unit(rng) < 0.1) {
+            snprintf(buf, sizeof(buf), "Image %u", (unsigned)(rng() % texts));
+            desc = intern(buf);
+        }
+        uint32_t flags = UI_FLAG_ENABLED | UI_FLAG_VISIBLE_TO_USER;
+        if (unit(rng) < 0.2) flags |= UI_FLAG_CLICKABLE | UI_FLAG_FOCUSABLE;
+        if (!g.children.empty() && unit(rng) < 0.05) flags |= UI_FLAG_SCROLLABLE;
+        const auto &b = bounds[n];
+        int32_t r[UI_SNAPSHOT_NODE_FIELDS] = {
+            g.parent < 0 ? -1 : position[g.parent], g.depth, g.indexInParent, g.indexInParent + 1,
+            (int32_t)g.children.size(), text, id, intern(cls), desc, pkg, b[0], b[1], b[2], b[3], (int32_t)flags,
+        };
+        records.insert(records.end(), r, r + UI_SNAPSHOT_NODE_FIELDS);
+    }
+
+    std::vector<uint8_t> out;
+    auto put = [&out](const void *d, size_t n) { out.insert(out.end(), (const uint8_t *)d, (const uint8_t *)d + n); };
+    uint32_t header[4] = { UI_SNAPSHOT_MAGIC, UI_SNAPSHOT_VERSION, (uint32_t)order.size(), (uint32_t)strings.size() };
+    put(header, sizeof(header));
+    for (const std::string &s : strings) {
+        uint32_t n = (uint32_t)s.size();
+        put(&n, 4);
+        put(s.data(), n);
+    }
+    put(records.data(), records.size() * 4);
+    return out;
+}
+
+// ==================== Sweep ====================
+
+// Selector types, built against the generator's string pools
+struct Kind {
+    const char *name;
+    void (*build)(Selector *sel, const GenParams &p);
+    bool all;
+};
+
+static void add_str(Selector *sel, int op, const std::string &s) { selector_add_string(sel, op, s.data(), s.size()); }
+
+static Kind g_kinds[] = {
+    { "text", [](Selector *s, const GenParams &p) { add_str(s, SEL_TEXT, "Text " + std::to_string(p.textCount() / 2)); }, false },
+    { "text (missing)", [](Selector *s, const GenParams &) { add_str(s, SEL_TEXT, "Checkout"); }, false },
+    { "textContains", [](Selector *s, const GenParams &) { add_str(s, SEL_TEXT_CONTAINS, "77"); }, true },
+    { "textMatches", [](Selector *s, const GenParams &) {
+        const char *re = "^Text 9\\d$";
+        selector_add_regex(s, SEL_TEXT_MATCHES, re, strlen(re), 0);
+    }, true },
+    { "textContainsNormalized", [](Selector *s, const GenParams &) { add_str(s, SEL_TEXT_CONTAINS_NORMALIZED, "XT 77"); }, true },
+    { "idStartsWith", [](Selector *s, const GenParams &) { add_str(s, SEL_ID_STARTS_WITH, "v1"); }, true },
+    { "className + clickable", [](Selector *s, const GenParams &) {
+        add_str(s, SEL_CLASS_NAME, "Button");
+        selector_add_int(s, SEL_CLICKABLE, 1);
+    }, true },
+    { "clickable (scan)", [](Selector *s, const GenParams &) { selector_add_int(s, SEL_CLICKABLE, 1); }, true },
+    { "boundsInside", [](Selector *s, const GenParams &) { selector_add_rect(s, SEL_BOUNDS_INSIDE, 0, 0, 1080, 2400); }, true },
+    { "nodeAt", [](Selector *s, const GenParams &) { selector_add_rect(s, SEL_NODE_AT, 540, 1200, 540, 1200); }, false },
+    { "descendant(text)", [](Selector *s, const GenParams &p) {
+        selector_add_int(s, SEL_CLICKABLE, 1);
+        Selector sub;
+        add_str(&sub, SEL_TEXT_STARTS_WITH, "Text " + std::to_string(p.textCount() / 3));
+        selector_add_selector(s, SEL_DESCENDANT, sub);
+    }, true },
+    { "ancestor(clickable)", [](Selector *s, const GenParams &) {
+        add_str(s, SEL_TEXT_STARTS_WITH, "Text 1");
+        Selector sub;
+        selector_add_int(&sub, SEL_CLICKABLE, 1);
+        selector_add_selector(s, SEL_ANCESTOR, sub);
+    }, true },
+};
+
+struct Result {
+    size_t matches;
+    double first, p50, p90, p99, max, bytes;
+};
+
+static double percentile(std::vector<double> &v, double q) {
+    size_t i = std::min(v.size() - 1, (size_t)(q * (v.size() - 1) + 0.5));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+// Time fn over iterations runs (after one untimed first run)
+template <typename F>
+static Result measure(int iterations, F fn) {
+    Result r = {};
+    double start = now_us();
+    r.matches = fn();
+    r.first = now_us() - start;
+    std::vector<double> samples(iterations);
+    size_t bytes = g_alloc_bytes.load();
+    for (int i = 0; i < iterations; i++) {
+        start = now_us();
+        fn();
+        samples[i] = now_us() - start;
+    }
+    r.bytes = (double)(g_alloc_bytes.load() - bytes) / iterations;
+    r.max = *std::max_element(samples.begin(), samples.end());
+    r.p99 = percentile(samples, 0.99);
+    r.p90 = percentile(samples, 0.90);
+    r.p50 = percentile(samples, 0.50);
+    return r;
+}
+
+// nodes,kind -> p50 from an earlier --csv run
+static bool read_baseline(const char *path, std::map<std::pair<int, std::string>, double> *out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char kind[128];
+        int nodes;
+        double p50;
+        if (sscanf(line, "%d,%127[^,],%*d,%*f,%lf", &nodes, kind, &p50) == 3) (*out)[{ nodes, kind }] = p50;
+    }
+    fclose(f);
+    return true;
+}
+
+static bool parse_gen_option(int argc, char **argv, int *i, GenParams *p) {
+    if (*i + 1 >= argc) return false;
+    const char *v = argv[*i + 1];
+    if (strcmp(argv[*i], "--depth") == 0) p->depth = atoi(v);
+    else if (strcmp(argv[*i], "--fanout") == 0) p->fanout = atoi(v);
+    else if (strcmp(argv[*i], "--strings") == 0) p->strings = atoi(v);
+    else if (strcmp(argv[*i], "--dup-bounds") == 0) p->dupBounds = atof(v);
+    else if (strcmp(argv[*i], "--seed") == 0) p->seed = (uint32_t)strtoul(v, nullptr, 10);
+    else return false;
+    ++*i;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    GenParams params;
+    std::vector<int> sizes = { 50, 200, 1000, 5000, 20000 };
+    int iterations = 500;
+    bool csv = false;
+    const char *generate = nullptr, *baseline = nullptr;
+    double tolerance = 1.25;
+    for (int i = 1; i < argc; i++) {
+        if (parse_gen_option(argc, argv, &i, &params)) continue;
+        if (strcmp(argv[i], "--generate") == 0 && i + 2 < argc) {
+            generate = argv[++i];
+            sizes = { atoi(argv[++i]) };
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+            sizes.clear();
+            for (char *s = argv[i], *end; *s; s = *end == ',' ? end + 1 : end) {
+                sizes.push_back((int)strtol(s, &end, 10));
+                if (end == s) break;
+            }
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (iterations <= 0) iterations = 500;
+    params.depth = std::max(1, params.depth);
+    params.fanout = std::max(1, params.fanout);
+
+    if (generate) {
+        params.nodes = std::max(1, sizes[0]);
+        std::vector<uint8_t> data = generate_tree(params);
+        FILE *f = fopen(generate, "wb");
+        if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+            fprintf(stderr, "cannot write %s\n", generate);
+            return 1;
+        }
+        fclose(f);
+        return 0;
+    }
+
+    std::map<std::pair<int, std::string>, double> base;
+    if (baseline && !read_baseline(baseline, &base)) {
+        fprintf(stderr, "cannot read %s\n", baseline);
+        return 1;
+    }
+    selector_memo_set_enabled(false);
+
+    if (csv) printf("nodes,kind,matches,first_us,p50_us,p90_us,p99_us,max_us,bytes_per_query\n");
+    int regressions = 0;
+    for (int size : sizes) {
+        params.nodes = std::max(1, size);
+        std::vector<uint8_t> data = generate_tree(params);
+        std::shared_ptr<UiSnapshot> snap;
+        std::vector<std::pair<std::string, Result>> results;
+        results.emplace_back("parse", measure(std::max(1, iterations / 10), [&]() {
+            snap = std::make_shared<UiSnapshot>();
+            ui_snapshot_parse(data.data(), data.size(), snap.get());
+            return snap->size();
+        }));
+        // Published like a pushed snapshot, so per-snapshot caches apply
+        ui_snapshot_publish(snap);
+        int32_t n = (int32_t)snap->size();
+
+        std::vector<int32_t> found;
+        found.reserve(n);
+        for (const Kind &k : g_kinds) {
+            Selector sel;
+            k.build(&sel, params);
+            results.emplace_back(k.name, measure(iterations, [&]() {
+                found.clear();
+                return selector_find(&sel, *snap, 0, n, k.all ? 0 : 1, &found);
+            }));
+        }
+
+        if (!csv) {
+            printf("%d nodes, %zu strings, %zu bytes (depth %d, fanout %d, dup bounds %.2f)\n", n,
+                   snap->stringCount(), data.size(), params.depth, params.fanout, params.dupBounds);
+            printf("  %-22s %8s %10s %9s %9s %9s %9s %10s\n", "kind", "matches", "first us", "p50 us", "p90 us",
+                   "p99 us", "max us", "bytes");
+        }
+        for (auto &[name, r] : results) {
+            if (csv) {
+                printf("%d,%s,%zu,%.2f,%.3f,%.3f,%.3f,%.3f,%.1f\n", n, name.c_str(), r.matches, r.first, r.p50, r.p90,
+                       r.p99, r.max, r.bytes);
+            } else {
+                printf("  %-22s %8zu %10.2f %9.3f %9.3f %9.3f %9.3f %10.1f\n", name.c_str(), r.matches, r.first, r.p50,
+                       r.p90, r.p99, r.max, r.bytes);
+            }
+            auto it = base.find({ n, name });
+            // Sub-microsecond medians are within timer noise
+            if (it != base.end() && r.p50 > it->second * tolerance && r.p50 - it->second > 0.5) {
+                fprintf(stderr, "regression: %d nodes, %s: p50 %.3f us, baseline %.3f us\n", n, name.c_str(), r.p50,
+                        it->second);
+                regressions++;
+            }
+        }
+    }
+    return regressions ? 2 : 0;
+}
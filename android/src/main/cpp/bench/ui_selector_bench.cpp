@@ -0,0 +1,266 @@
+// Selector engine micro benchmark.
+//
+// Runs typical selector queries against a UI snapshot (ui_snapshot.h) and
+// reports the time per query. The first run of a query includes building
+// the snapshot lookup indexes it uses. Queries run with the result memo off;
+// "memo us" is the same query answered from the memo, as a polling loop on
+// an unchanged snapshot would be. The snapshot is either a synthetic app-like
+// tree (a list screen: toolbar, tabs, rows of icon + title + subtitle +
+// button) or a recorded fixture in the wire format UiSnapshot.kt pushes,
+// so real device trees can be replayed on the host.
+//
+// Usage: ui_selector_bench [nodes | snapshot.bin] [iterations]
+//        ui_selector_bench --save snapshot.bin [nodes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ui_selector.h"
+#include "ui_snapshot.h"
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// ==================== Synthetic Tree ====================
+
+struct TreeWriter {
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, int32_t> index;
+    std::vector<int32_t> nodes;
+    std::vector<int32_t> depth;
+    std::vector<int32_t> children;  // child count per node
+
+    TreeWriter() { intern(""); }
+
+    int32_t intern(const std::string &s) {
+        auto it = index.find(s);
+        if (it != index.end()) return it->second;
+        strings.push_back(s);
+        return index[s] = (int32_t)strings.size() - 1;
+    }
+
+    int32_t add(int32_t parent, const char *cls, const std::string &text, const std::string &id,
+                const std::string &desc, int32_t top, uint32_t flags) {
+        int32_t n = (int32_t)depth.size();
+        int32_t d = parent < 0 ? 0 : depth[parent] + 1;
+        int32_t idx = parent < 0 ? -1 : children[parent]++;
+        depth.push_back(d);
+        children.push_back(0);
+        int32_t f[UI_SNAPSHOT_NODE_FIELDS] = {
+            parent, d, idx, idx + 1, 0,
+            intern(text), intern(id.empty() ? "" : "com.example.shop:id/" + id), intern(cls),
+            intern(desc), intern("com.example.shop"),
+            0, top, 1080, top + 120, (int32_t)(flags | UI_FLAG_ENABLED | UI_FLAG_VISIBLE_TO_USER),
+        };
+        nodes.insert(nodes.end(), f, f + UI_SNAPSHOT_NODE_FIELDS);
+        return n;
+    }
+
+    std::vector<uint8_t> encode() {
+        for (size_t i = 0; i < children.size(); i++) nodes[i * UI_SNAPSHOT_NODE_FIELDS + 4] = children[i];
+        std::vector<uint8_t> out;
+        auto put = [&out](const void *p, size_t n) {
+            out.insert(out.end(), (const uint8_t *)p, (const uint8_t *)p + n);
+        };
+        uint32_t header[4] = { UI_SNAPSHOT_MAGIC, UI_SNAPSHOT_VERSION, (uint32_t)depth.size(), (uint32_t)strings.size() };
+        put(header, sizeof(header));
+        for (const std::string &s : strings) {
+            uint32_t n = (uint32_t)s.size();
+            put(&n, 4);
+            put(s.data(), n);
+        }
+        put(nodes.data(), nodes.size() * 4);
+        return out;
+    }
+};
+
+static std::vector<uint8_t> build_tree(int target) {
+    TreeWriter w;
+    int32_t root = w.add(-1, "android.widget.FrameLayout", "", "", "", 0, 0);
+    int32_t content = w.add(root, "android.widget.LinearLayout", "", "content", "", 0, 0);
+    int32_t toolbar = w.add(content, "android.view.ViewGroup", "", "toolbar", "", 0, 0);
+    w.add(toolbar, "android.widget.ImageButton", "", "", "Navigate up", 0, UI_FLAG_CLICKABLE | UI_FLAG_FOCUSABLE);
+    w.add(toolbar, "android.widget.TextView", "Shop", "title", "", 0, 0);
+    int32_t tabs = w.add(content, "android.widget.HorizontalScrollView", "", "tabs", "", 120, UI_FLAG_SCROLLABLE);
+    const char *tabNames[] = { "Home", "Deals", "Orders", "Account" };
+    for (const char *t : tabNames) w.add(tabs, "android.widget.TextView", t, "tab", "", 120, UI_FLAG_CLICKABLE);
+    int32_t list = w.add(content, "androidx.recyclerview.widget.RecyclerView", "", "list", "", 240,
+                         UI_FLAG_SCROLLABLE | UI_FLAG_FOCUSABLE);
+
+    char buf[64];
+    for (int row = 0; (int)w.depth.size() + 6 <= target; row++) {
+        int32_t top = 240 + row * 120;
+        int32_t item = w.add(list, "android.widget.LinearLayout", "", "item", "", top,
+                             UI_FLAG_CLICKABLE | UI_FLAG_LONG_CLICKABLE);
+        snprintf(buf, sizeof(buf), "Product %d", row);
+        w.add(item, "android.widget.ImageView", "", "icon", buf, top, 0);
+        int32_t col = w.add(item, "android.widget.LinearLayout", "", "", "", top, 0);
+        w.add(col, "android.widget.TextView", buf, "name", "", top, 0);
+        snprintf(buf, sizeof(buf), "$%d.%02d, %d sold", 5 + row % 95, row % 100, row * 7 % 1000);
+        w.add(col, "android.widget.TextView", buf, "price", "", top, 0);
+        w.add(item, "android.widget.Button", row % 10 == 9 ? "Sold out" : "Add to cart", "buy", "", top,
+              UI_FLAG_CLICKABLE | UI_FLAG_FOCUSABLE);
+    }
+    return w.encode();
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+// ==================== Driver ====================
+
+struct Query {
+    const char *name;
+    std::vector<std::pair<int, std::string>> strings;
+    std::vector<std::pair<int, int32_t>> ints;
+    bool all;
+    bool rebuild = false;   // new selector per query, like a polling loop
+    std::vector<std::pair<int, std::array<int32_t, 4>>> rects = {};
+    std::vector<std::pair<int, std::pair<int, std::string>>> relations = {};   // op, nested string condition
+};
+
+static void build_selector(const Query &q, Selector *sel) {
+    for (auto &s : q.strings) selector_add_string(sel, s.first, s.second.data(), s.second.size());
+    for (auto &i : q.ints) selector_add_int(sel, i.first, i.second);
+    for (auto &r : q.rects) selector_add_rect(sel, r.first, r.second[0], r.second[1], r.second[2], r.second[3]);
+    for (auto &r : q.relations) {
+        Selector sub;
+        selector_add_string(&sub, r.second.first, r.second.second.data(), r.second.second.size());
+        selector_add_selector(sel, r.first, sub);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "--save") == 0) {
+        std::vector<uint8_t> data = build_tree(argc > 3 ? atoi(argv[3]) : 5000);
+        FILE *f = fopen(argv[2], "wb");
+        if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) {
+            fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+        fclose(f);
+        return 0;
+    }
+
+    std::vector<uint8_t> data;
+    const char *source = argc > 1 ? argv[1] : "5000";
+    char *end;
+    long nodes = strtol(source, &end, 10);
+    if (*end == 0 && nodes > 0) {
+        data = build_tree((int)nodes);
+    } else if (!read_file(source, &data)) {
+        fprintf(stderr, "cannot read %s\n", source);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+    if (iterations <= 0) iterations = 2000;
+
+    auto parsed = std::make_shared<UiSnapshot>();
+    double t0 = now_us();
+    if (!ui_snapshot_parse(data.data(), data.size(), parsed.get())) {
+        fprintf(stderr, "malformed snapshot\n");
+        return 1;
+    }
+    double parse_us = now_us() - t0;
+    // Published like a pushed snapshot, so per-snapshot caches apply
+    ui_snapshot_publish(parsed);
+    const UiSnapshot &snap = *parsed;
+
+    // A point in the middle row and the rows of one screen below it
+    int32_t mid = 240 + (int32_t)(snap.size() / 12) * 120 + 60;
+    Query queries[] = {
+        { "text (last row)",          { { SEL_TEXT, "Product " + std::to_string(snap.size() / 6 - 2) } }, {}, false },
+        { "text (missing)",           { { SEL_TEXT, "Checkout" } }, {}, false },
+        { "textContains",             { { SEL_TEXT_CONTAINS, "994 sold" } }, {}, false },
+        { "textContains + editable",  { { SEL_TEXT_CONTAINS, "sold" } }, { { SEL_EDITABLE, 1 } }, false },
+        { "id + clickable",           { { SEL_ID, "buy" } }, { { SEL_CLICKABLE, 1 } }, false },
+        { "textStartsWith",           { { SEL_TEXT_STARTS_WITH, "Sold" } }, {}, true },
+        { "idStartsWith",             { { SEL_ID_STARTS_WITH, "pri" } }, {}, true },
+        { "className + text",         { { SEL_CLASS_NAME, "Button" }, { SEL_TEXT, "Sold out" } }, {}, true },
+        { "textMatches",              { { SEL_TEXT_MATCHES, "\\$9\\d\\.\\d+, .*" } }, {}, true },
+        { "textMatches (rebuilt)",    { { SEL_TEXT_MATCHES, "\\$9\\d\\.\\d+, .*" } }, {}, true, true },
+        { "descMatches (missing)",    { { SEL_DESC_MATCHES, "^Banner \\d+$" } }, {}, false },
+        { "findAll clickable",        {}, { { SEL_CLICKABLE, 1 } }, true },
+        { "nodeAt + clickable",       {}, { { SEL_CLICKABLE, 1 } }, false, false,
+                                      { { SEL_NODE_AT, { 540, mid, 540, mid } } } },
+        { "boundsInside (screen)",    {}, {}, true, false,
+                                      { { SEL_BOUNDS_INSIDE, { 0, mid - 60, 1080, mid + 1860 } } } },
+        { "id + descendant(text)",    { { SEL_ID, "item" } }, {}, true, false, {},
+                                      { { SEL_DESCENDANT, { SEL_TEXT, "Sold out" } } } },
+        { "text + ancestor(id)",      { { SEL_TEXT_STARTS_WITH, "$9" } }, {}, true, false, {},
+                                      { { SEL_ANCESTOR, { SEL_ID, "item" } } } },
+    };
+
+    printf("selector bench: %zu nodes, %zu strings, %zu bytes, parse %.1f us\n",
+           snap.size(), snap.stringCount(), data.size(), parse_us);
+    printf("%-24s %8s %10s %10s %10s\n", "query", "matches", "first us", "us/query", "memo us");
+    for (Query &q : queries) {
+        Selector sel;
+        build_selector(q, &sel);
+
+        std::vector<int32_t> found;
+        size_t limit = q.all ? 0 : 1;
+        selector_memo_set_enabled(false);
+        double start = now_us();
+        size_t matches = selector_find(&sel, snap, 0, (int32_t)snap.size(), limit, &found);
+        double first_us = now_us() - start;
+        start = now_us();
+        for (int i = 0; i < iterations; i++) {
+            found.clear();
+            if (q.rebuild) {
+                Selector fresh;
+                build_selector(q, &fresh);
+                selector_find(&fresh, snap, 0, (int32_t)snap.size(), limit, &found);
+            } else {
+                selector_find(&sel, snap, 0, (int32_t)snap.size(), limit, &found);
+            }
+        }
+        double query_us = (now_us() - start) / iterations;
+
+        selector_memo_set_enabled(true);
+        start = now_us();
+        for (int i = 0; i < iterations; i++) {
+            found.clear();
+            Selector fresh;
+            build_selector(q, &fresh);
+            selector_find(&fresh, snap, 0, (int32_t)snap.size(), limit, &found);
+        }
+        printf("%-24s %8zu %10.2f %10.2f %10.2f\n", q.name, matches, first_us, query_us, (now_us() - start) / iterations);
+        if (getenv("EXPLAIN")) printf("%s", selector_explain(&sel, &snap).c_str());
+    }
+
+    // Early exit: the first 5 rows of a long result through a cursor, in
+    // document and breadth-first order
+    selector_memo_set_enabled(false);
+    auto rows = std::make_shared<Selector>();
+    selector_add_string(rows.get(), SEL_ID, "item", 4);
+    for (int order : { SEL_ORDER_DFS, SEL_ORDER_BFS }) {
+        double start = now_us();
+        size_t matches = 0;
+        for (int i = 0; i < iterations; i++) {
+            SelectorCursor cur;
+            selector_cursor_init(&cur, rows, parsed, order, 0, -1);
+            for (matches = 0; matches < 5 && selector_cursor_next(&cur) >= 0; matches++) {}
+        }
+        printf("%-24s %8zu %10s %10.2f %10s\n", order == SEL_ORDER_DFS ? "iterate id (first 5)" : "iterate bfs (first 5)",
+               matches, "-", (now_us() - start) / iterations, "-");
+    }
+    return 0;
+}
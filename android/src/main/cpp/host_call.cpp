@@ -0,0 +1,328 @@
+#include "host_call.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <mutex>
+
+// Upper bound for a single call; larger payloads are rejected rather than
+// letting one script grow the shared buffer without limit.
+#define HOST_CALL_MAX_CAPACITY (64u * 1024 * 1024)
+
+bool host_call_buffer_init(HostCallBuffer *buf, uint32_t capacity) {
+    buf->data = (uint8_t *)malloc(capacity);
+    buf->capacity = buf->data ? capacity : 0;
+    buf->pos = 0;
+    buf->moved = false;
+    return buf->data != nullptr;
+}
+
+void host_call_buffer_free(HostCallBuffer *buf) {
+    free(buf->data);
+    buf->data = nullptr;
+    buf->capacity = 0;
+    buf->pos = 0;
+}
+
+static bool host_call_reserve(HostCallBuffer *buf, size_t extra) {
+    size_t need = (size_t)buf->pos + extra;
+    if (need <= buf->capacity) return true;
+    if (need > HOST_CALL_MAX_CAPACITY) return false;
+    size_t cap = buf->capacity ? buf->capacity : HOST_CALL_INITIAL_CAPACITY;
+    while (cap < need) cap *= 2;
+    if (cap > HOST_CALL_MAX_CAPACITY) cap = HOST_CALL_MAX_CAPACITY;
+    uint8_t *p = (uint8_t *)realloc(buf->data, cap);
+    if (!p) return false;
+    buf->data = p;
+    buf->capacity = (uint32_t)cap;
+    buf->moved = true;
+    return true;
+}
+
+static bool host_call_put_tag(HostCallBuffer *buf, int tag, size_t payload) {
+    if (!host_call_reserve(buf, 1 + payload)) return false;
+    buf->data[buf->pos++] = (uint8_t)tag;
+    return true;
+}
+
+bool host_call_put_null(HostCallBuffer *buf) {
+    return host_call_put_tag(buf, HOST_TAG_NULL, 0);
+}
+
+bool host_call_put_bool(HostCallBuffer *buf, bool v) {
+    if (!host_call_put_tag(buf, HOST_TAG_BOOL, 1)) return false;
+    buf->data[buf->pos++] = v ? 1 : 0;
+    return true;
+}
+
+bool host_call_put_int(HostCallBuffer *buf, int32_t v) {
+    if (!host_call_put_tag(buf, HOST_TAG_INT, 4)) return false;
+    memcpy(buf->data + buf->pos, &v, 4);
+    buf->pos += 4;
+    return true;
+}
+
+bool host_call_put_double(HostCallBuffer *buf, double v) {
+    if (!host_call_put_tag(buf, HOST_TAG_DOUBLE, 8)) return false;
+    memcpy(buf->data + buf->pos, &v, 8);
+    buf->pos += 8;
+    return true;
+}
+
+static bool host_call_put_blob(HostCallBuffer *buf, int tag, const void *p, size_t len) {
+    if (len > HOST_CALL_MAX_CAPACITY) return false;
+    if (!host_call_put_tag(buf, tag, 4 + len)) return false;
+    uint32_t n = (uint32_t)len;
+    memcpy(buf->data + buf->pos, &n, 4);
+    if (len) memcpy(buf->data + buf->pos + 4, p, len);
+    buf->pos += 4 + n;
+    return true;
+}
+
+bool host_call_put_string(HostCallBuffer *buf, const char *s, size_t len) {
+    return host_call_put_blob(buf, HOST_TAG_STRING, s, len);
+}
+
+bool host_call_put_bytes(HostCallBuffer *buf, const uint8_t *p, size_t len) {
+    return host_call_put_blob(buf, HOST_TAG_BYTES, p, len);
+}
+
+bool host_call_put_json(HostCallBuffer *buf, const char *s, size_t len) {
+    return host_call_put_blob(buf, HOST_TAG_JSON, s, len);
+}
+
+static bool host_call_put_cstring(JSContext *ctx, HostCallBuffer *buf, int tag, JSValueConst v) {
+    size_t len = 0;
+    const char *s = JS_ToCStringLen(ctx, &len, v);
+    if (!s) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return host_call_put_null(buf);
+    }
+    bool ok = host_call_put_blob(buf, tag, s, len);
+    JS_FreeCString(ctx, s);
+    return ok;
+}
+
+enum {
+    HOST_BINARY_NONE,
+    HOST_BINARY_BUFFER,
+    HOST_BINARY_VIEW,
+};
+
+// Class ids of ArrayBuffers (the first two probed) and typed arrays. They
+// are built in, so the same in every runtime, but quickjs.h does not
+// export them: they are found once by probing an instance of each class.
+// Objects are then classified with JS_GetOpaque(), which only compares the
+// class id and never throws. A DataView is no typed array and goes as
+// JSON.
+#define HOST_BINARY_MAX_CLASSES 16
+#define HOST_BINARY_MAX_CLASS_ID 256
+
+static std::mutex g_binary_mutex;
+static std::atomic<bool> g_binary_probed{ false };
+static int g_binary_count = 0;
+static JSClassID g_binary_class[HOST_BINARY_MAX_CLASSES];
+static int g_binary_kind[HOST_BINARY_MAX_CLASSES];
+
+static const char kBinaryProbe[] =
+    "[new ArrayBuffer(0), typeof SharedArrayBuffer == 'function' ? new SharedArrayBuffer(0) : new ArrayBuffer(0),"
+    " new Uint8ClampedArray(0), new Int8Array(0), new Uint8Array(0), new Int16Array(0), new Uint16Array(0),"
+    " new Int32Array(0), new Uint32Array(0), new BigInt64Array(0), new BigUint64Array(0), new Float32Array(0),"
+    " new Float64Array(0)]";
+
+static bool host_binary_probe(JSContext *ctx) {
+    if (g_binary_probed.load(std::memory_order_acquire)) return true;
+    std::lock_guard<std::mutex> lock(g_binary_mutex);
+    if (g_binary_probed.load(std::memory_order_relaxed)) return true;
+    JSValue arr = JS_Eval(ctx, kBinaryProbe, sizeof(kBinaryProbe) - 1, "<host_call>", JS_EVAL_TYPE_GLOBAL);
+    if (JS_IsException(arr)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return false;
+    }
+    int count = 0;
+    for (uint32_t i = 0;; i++) {
+        JSValue v = JS_GetPropertyUint32(ctx, arr, i);
+        if (JS_IsUndefined(v)) break;
+        for (JSClassID id = 1; id < HOST_BINARY_MAX_CLASS_ID; id++) {
+            if (!JS_GetOpaque(v, id)) continue;
+            bool seen = false;
+            for (int k = 0; k < count; k++) seen = seen || g_binary_class[k] == id;
+            if (!seen && count < HOST_BINARY_MAX_CLASSES) {
+                g_binary_class[count] = id;
+                g_binary_kind[count++] = i < 2 ? HOST_BINARY_BUFFER : HOST_BINARY_VIEW;
+            }
+            break;
+        }
+        JS_FreeValue(ctx, v);
+    }
+    JS_FreeValue(ctx, arr);
+    g_binary_count = count;
+    g_binary_probed.store(true, std::memory_order_release);
+    return true;
+}
+
+static int host_binary_kind(JSContext *ctx, JSValueConst v) {
+    if (!host_binary_probe(ctx)) return HOST_BINARY_NONE;
+    for (int k = 0; k < g_binary_count; k++) {
+        if (JS_GetOpaque(v, g_binary_class[k])) return g_binary_kind[k];
+    }
+    return HOST_BINARY_NONE;
+}
+
+bool host_call_put_value(JSContext *ctx, HostCallBuffer *buf, JSValueConst v) {
+    switch (JS_VALUE_GET_TAG(v)) {
+    case JS_TAG_INT:
+        return host_call_put_int(buf, JS_VALUE_GET_INT(v));
+    case JS_TAG_BOOL:
+        return host_call_put_bool(buf, JS_VALUE_GET_BOOL(v));
+    case JS_TAG_NULL:
+        return host_call_put_null(buf);
+    case JS_TAG_UNDEFINED:
+        return host_call_put_tag(buf, HOST_TAG_UNDEFINED, 0);
+    case JS_TAG_STRING:
+        return host_call_put_cstring(ctx, buf, HOST_TAG_STRING, v);
+    case JS_TAG_OBJECT: {
+        if (JS_IsFunction(ctx, v)) return host_call_put_cstring(ctx, buf, HOST_TAG_STRING, v);
+        int kind = host_binary_kind(ctx, v);
+        if (kind == HOST_BINARY_BUFFER) {
+            size_t size = 0;
+            uint8_t *bytes = JS_GetArrayBuffer(ctx, &size, v);
+            return bytes ? host_call_put_bytes(buf, bytes, size) : host_call_put_null(buf);
+        }
+        if (kind == HOST_BINARY_VIEW) {
+            size_t offset = 0, length = 0, bpe = 0, size = 0;
+            JSValue ab = JS_GetTypedArrayBuffer(ctx, v, &offset, &length, &bpe);
+            if (JS_IsException(ab)) {
+                // Detached: send as JSON like other objects
+                JS_FreeValue(ctx, JS_GetException(ctx));
+            } else {
+                uint8_t *bytes = JS_GetArrayBuffer(ctx, &size, ab);
+                bool ok = bytes && offset + length <= size
+                    ? host_call_put_bytes(buf, bytes + offset, length)
+                    : host_call_put_null(buf);
+                JS_FreeValue(ctx, ab);
+                return ok;
+            }
+        }
+        JSValue json = JS_JSONStringify(ctx, v, JS_UNDEFINED, JS_UNDEFINED);
+        bool ok = JS_IsException(json)
+            ? (JS_FreeValue(ctx, JS_GetException(ctx)), host_call_put_null(buf))
+            : host_call_put_cstring(ctx, buf, HOST_TAG_JSON, json);
+        JS_FreeValue(ctx, json);
+        return ok;
+    }
+    default:
+        if (JS_TAG_IS_FLOAT64(JS_VALUE_GET_TAG(v)))
+            return host_call_put_double(buf, JS_VALUE_GET_FLOAT64(v));
+        return host_call_put_cstring(ctx, buf, HOST_TAG_STRING, v);
+    }
+}
+
+bool host_call_put_values(JSContext *ctx, HostCallBuffer *buf, int argc, JSValueConst *argv) {
+    for (int i = 0; i < argc; i++) {
+        if (!host_call_put_value(ctx, buf, argv[i])) return false;
+    }
+    return true;
+}
+
+// ToInt32 as JS_ToInt32: NaN and infinities give 0, other values are
+// truncated and wrapped modulo 2^32 (a plain cast is undefined out of range)
+static int32_t host_double_to_int32(double d) {
+    if (!isfinite(d)) return 0;
+    double t = fmod(trunc(d), 4294967296.0);
+    if (t < 0) t += 4294967296.0;
+    return (int32_t)(uint32_t)t;
+}
+
+bool host_call_read(const HostCallBuffer *buf, uint32_t *offset, HostValue *out) {
+    uint32_t p = *offset;
+    if (p >= buf->capacity) return false;
+    memset(out, 0, sizeof(*out));
+    out->tag = buf->data[p++];
+    switch (out->tag) {
+    case HOST_TAG_UNDEFINED:
+    case HOST_TAG_NULL:
+        break;
+    case HOST_TAG_BOOL:
+        if (p + 1 > buf->capacity) return false;
+        out->i = buf->data[p] != 0;
+        p += 1;
+        break;
+    case HOST_TAG_INT:
+        if (p + 4 > buf->capacity) return false;
+        memcpy(&out->i, buf->data + p, 4);
+        out->d = out->i;
+        p += 4;
+        break;
+    case HOST_TAG_DOUBLE:
+        if (p + 8 > buf->capacity) return false;
+        memcpy(&out->d, buf->data + p, 8);
+        out->i = host_double_to_int32(out->d);
+        p += 8;
+        break;
+    case HOST_TAG_STRING:
+    case HOST_TAG_BYTES:
+    case HOST_TAG_JSON:
+        if (p + 4 > buf->capacity) return false;
+        memcpy(&out->len, buf->data + p, 4);
+        p += 4;
+        if (out->len > buf->capacity - p) return false;
+        out->str = (const char *)(buf->data + p);
+        p += out->len;
+        break;
+    default:
+        return false;
+    }
+    *offset = p;
+    return true;
+}
+
+JSValue host_value_to_js(JSContext *ctx, const HostValue *v) {
+    switch (v->tag) {
+    case HOST_TAG_NULL: return JS_NULL;
+    case HOST_TAG_BOOL: return JS_NewBool(ctx, v->i);
+    case HOST_TAG_INT: return JS_NewInt32(ctx, v->i);
+    case HOST_TAG_DOUBLE: return JS_NewFloat64(ctx, v->d);
+    case HOST_TAG_STRING: return JS_NewStringLen(ctx, v->str, v->len);
+    case HOST_TAG_BYTES: return JS_NewArrayBufferCopy(ctx, (const uint8_t *)v->str, v->len);
+    case HOST_TAG_JSON: {
+        // JS_ParseJSON requires a NUL-terminated input
+        char *tmp = (char *)malloc(v->len + 1);
+        if (!tmp) return JS_ThrowOutOfMemory(ctx);
+        memcpy(tmp, v->str, v->len);
+        tmp[v->len] = '\0';
+        JSValue r = JS_ParseJSON(ctx, tmp, v->len, "<host>");
+        free(tmp);
+        return r;
+    }
+    default: return JS_UNDEFINED;
+    }
+}
+
+bool host_value_to_bool(const HostValue *v) {
+    switch (v->tag) {
+    case HOST_TAG_BOOL:
+    case HOST_TAG_INT: return v->i != 0;
+    case HOST_TAG_DOUBLE: return v->d != 0;
+    case HOST_TAG_STRING: return v->len == 4 && memcmp(v->str, "true", 4) == 0;
+    default: return false;
+    }
+}
+
+int32_t host_value_to_int(const HostValue *v) {
+    switch (v->tag) {
+    case HOST_TAG_BOOL:
+    case HOST_TAG_INT:
+    case HOST_TAG_DOUBLE: return v->i;
+    case HOST_TAG_STRING: {
+        char tmp[32];
+        size_t n = v->len < sizeof(tmp) - 1 ? v->len : sizeof(tmp) - 1;
+        memcpy(tmp, v->str, n);
+        tmp[n] = '\0';
+        return atoi(tmp);
+    }
+    default: return 0;
+    }
+}
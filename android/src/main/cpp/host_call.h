@@ -0,0 +1,85 @@
+#ifndef HOST_CALL_H
+#define HOST_CALL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+extern "C" {
+#include "quickjs/quickjs.h"
+}
+
+// ==================== Typed Host-Call ABI ====================
+//
+// Arguments and results of host calls are packed into one reusable buffer
+// that the JNI bridge exposes to Kotlin as a direct ByteBuffer. Each value is
+// a one-byte tag followed by its payload, in native (little-endian) order:
+//
+//   HOST_TAG_UNDEFINED / HOST_TAG_NULL   no payload
+//   HOST_TAG_BOOL                        u8
+//   HOST_TAG_INT                         i32
+//   HOST_TAG_DOUBLE                      f64
+//   HOST_TAG_STRING / HOST_TAG_JSON      u32 byte length + UTF-8 bytes
+//   HOST_TAG_BYTES                       u32 byte length + raw bytes
+//
+// Arguments are written back to back from offset 0; the host writes its single
+// result value from offset 0 once it has consumed the arguments. The layout is
+// mirrored by HostCallBuffer.kt.
+
+enum HostValueTag {
+    HOST_TAG_UNDEFINED = 0,
+    HOST_TAG_NULL = 1,
+    HOST_TAG_BOOL = 2,
+    HOST_TAG_INT = 3,
+    HOST_TAG_DOUBLE = 4,
+    HOST_TAG_STRING = 5,
+    HOST_TAG_BYTES = 6,
+    HOST_TAG_JSON = 7,
+};
+
+#define HOST_CALL_INITIAL_CAPACITY (64 * 1024)
+
+typedef struct {
+    uint8_t *data;
+    uint32_t capacity;
+    uint32_t pos;
+    // Set whenever data was reallocated; the JNI bridge re-attaches the buffer.
+    bool moved;
+} HostCallBuffer;
+
+// Decoded view of a value; str/bytes point into the buffer and stay valid
+// until the next call that writes to it.
+typedef struct {
+    int tag;
+    int32_t i;
+    double d;
+    const char *str;
+    uint32_t len;
+} HostValue;
+
+bool host_call_buffer_init(HostCallBuffer *buf, uint32_t capacity);
+void host_call_buffer_free(HostCallBuffer *buf);
+
+static inline void host_call_reset(HostCallBuffer *buf) { buf->pos = 0; }
+
+bool host_call_put_null(HostCallBuffer *buf);
+bool host_call_put_bool(HostCallBuffer *buf, bool v);
+bool host_call_put_int(HostCallBuffer *buf, int32_t v);
+bool host_call_put_double(HostCallBuffer *buf, double v);
+bool host_call_put_string(HostCallBuffer *buf, const char *s, size_t len);
+bool host_call_put_bytes(HostCallBuffer *buf, const uint8_t *p, size_t len);
+bool host_call_put_json(HostCallBuffer *buf, const char *s, size_t len);
+
+// Encode a JS value by its runtime type: ints stay ints, numbers become
+// doubles, ArrayBuffers/typed arrays become byte blobs, plain objects and
+// arrays are sent as JSON and everything else as a string.
+bool host_call_put_value(JSContext *ctx, HostCallBuffer *buf, JSValueConst v);
+bool host_call_put_values(JSContext *ctx, HostCallBuffer *buf, int argc, JSValueConst *argv);
+
+// Read one value at *offset and advance it. Returns false on a malformed buffer.
+bool host_call_read(const HostCallBuffer *buf, uint32_t *offset, HostValue *out);
+
+JSValue host_value_to_js(JSContext *ctx, const HostValue *v);
+bool host_value_to_bool(const HostValue *v);
+int32_t host_value_to_int(const HostValue *v);
+
+#endif
@@ -0,0 +1,702 @@
+#include "image_match.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "image_pool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_MATCH_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IMAGE_MATCH_NEON 1
+#endif
+
+// ==================== Pyramids ====================
+
+namespace {
+
+// (77 R + 150 G + 29 B) / 256, rounded
+void gray_row(const uint8_t *p, int32_t w, uint8_t *q) {
+    // Whole-pixel loads keep the loop vectorizable
+    for (int32_t x = 0; x < w; x++) {
+        uint32_t v;
+        memcpy(&v, p + x * 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap32(v);
+#endif
+        q[x] = (uint8_t)((77 * (v & 0xff) + 150 * (v >> 8 & 0xff) + 29 * (v >> 16 & 0xff) + 128) >> 8);
+    }
+}
+
+void gray_plane(const ImageView &img, ImagePlane *out) {
+    out->width = img.width;
+    out->height = img.height;
+    out->pixels.resize((size_t)img.width * img.height);
+    for (int32_t y = 0; y < img.height; y++) gray_row(img.row(y), img.width, out->pixels.data() + (size_t)y * img.width);
+}
+
+// 255 where opaque (alpha >= 128), else 0
+void alpha_plane(const ImageView &img, ImagePlane *out) {
+    out->width = img.width;
+    out->height = img.height;
+    out->pixels.resize((size_t)img.width * img.height);
+    for (int32_t y = 0; y < img.height; y++) {
+        const uint8_t *p = img.row(y);
+        uint8_t *q = out->pixels.data() + (size_t)y * img.width;
+        for (int32_t x = 0; x < img.width; x++) q[x] = p[x * 4 + 3] >= 128 ? 255 : 0;
+    }
+}
+
+// Halve a w x h plane whose rows row(y) returns, in order
+template <typename Row>
+void pyr_down_rows(int32_t w, int32_t h, Row &&row, ImagePlane *dst) {
+    dst->width = (w + 1) / 2;
+    dst->height = (h + 1) / 2;
+    dst->pixels.resize((size_t)dst->width * dst->height);
+    // Vertical pass into col, padded by two replicated columns each side
+    std::vector<uint16_t> col((size_t)w + 4);
+    for (int32_t y = 0; y < dst->height; y++) {
+        const uint8_t *r[5];
+        for (int k = 0; k < 5; k++) r[k] = row(std::min(std::max(2 * y - 2 + k, 0), h - 1));
+        uint16_t *c = col.data() + 2;
+        for (int32_t x = 0; x < w; x++) c[x] = (uint16_t)(r[0][x] + 4 * r[1][x] + 6 * r[2][x] + 4 * r[3][x] + r[4][x]);
+        col[0] = col[1] = c[0];
+        col[w + 2] = col[w + 3] = c[w - 1];
+        uint8_t *out = dst->pixels.data() + (size_t)y * dst->width;
+        const uint16_t *p = col.data();
+        for (int32_t x = 0; x < dst->width; x++, p += 2) {
+            out[x] = (uint8_t)((p[0] + 4 * p[1] + 6 * p[2] + 4 * p[3] + p[4] + 128) >> 8);
+        }
+    }
+}
+
+void pyr_down(const ImagePlane &src, ImagePlane *dst) {
+    pyr_down_rows(src.width, src.height, [&](int32_t y) { return src.row(y); }, dst);
+}
+
+// Level 1 straight from the color image, gray rows converted into a ring
+// of the five the kernel spans, without the full-size gray plane
+void pyr_down_color(const ImageView &img, ImagePlane *dst) {
+    std::vector<uint8_t> ring((size_t)img.width * 5);
+    int32_t held[5] = { -1, -1, -1, -1, -1 };
+    pyr_down_rows(img.width, img.height, [&](int32_t y) {
+        uint8_t *q = ring.data() + (size_t)(y % 5) * img.width;
+        if (held[y % 5] != y) {
+            gray_row(img.row(y), img.width, q);
+            held[y % 5] = y;
+        }
+        return (const uint8_t *)q;
+    }, dst);
+}
+
+void build_integral(const ImagePlane &p, ImageIntegral *out) {
+    size_t stride = (size_t)p.width + 1;
+    out->width = p.width;
+    out->height = p.height;
+    out->sum.assign(stride * (p.height + 1), 0);
+    out->sqsum.assign(stride * (p.height + 1), 0);
+    for (int32_t y = 0; y < p.height; y++) {
+        const uint8_t *row = p.row(y);
+        uint32_t s = 0;
+        uint64_t sq = 0;
+        size_t above = (size_t)y * stride + 1, at = above + stride;
+        for (int32_t x = 0; x < p.width; x++) {
+            s += row[x];
+            sq += (uint32_t)row[x] * row[x];
+            out->sum[at + x] = out->sum[above + x] + s;
+            out->sqsum[at + x] = out->sqsum[above + x] + sq;
+        }
+    }
+}
+
+}  // namespace
+
+const ImagePlane &ImagePyramid::level(int i) {
+    if ((size_t)i >= levels_.size()) levels_.resize(i + 1);
+    if (!levels_[i]) {
+        auto p = std::make_unique<ImagePlane>();
+        if (i == 0) gray_plane(image, p.get());
+        else if (i == 1 && !levels_[0]) pyr_down_color(image, p.get());
+        else pyr_down(level(i - 1), p.get());
+        levels_[i] = std::move(p);
+    }
+    return *levels_[i];
+}
+
+void ImagePyramid::size(int i, int32_t *w, int32_t *h) const {
+    *w = image.width;
+    *h = image.height;
+    for (int k = 0; k < i; k++) {
+        *w = (*w + 1) / 2;
+        *h = (*h + 1) / 2;
+    }
+}
+
+const ImageIntegral &ImagePyramid::integral(int i) {
+    if ((size_t)i >= integrals_.size()) integrals_.resize(i + 1);
+    if (!integrals_[i]) {
+        auto p = std::make_unique<ImageIntegral>();
+        build_integral(level(i), p.get());
+        integrals_[i] = std::move(p);
+    }
+    return *integrals_[i];
+}
+
+ImageTemplate::ImageTemplate(const ImageView &tpl) : image(tpl) {
+    gray_.emplace_back();
+    alpha_.emplace_back();
+    gray_plane(tpl, &gray_[0]);
+    alpha_plane(tpl, &alpha_[0]);
+    masked = std::find(alpha_[0].pixels.begin(), alpha_[0].pixels.end(), 0) != alpha_[0].pixels.end();
+}
+
+namespace {
+
+    void level_sums(ImageTemplate::Level *l) {
+        for (size_t k = 0; k < l->pixels.size(); k++) {
+            l->n += l->mask[k];
+            l->sum += l->pixels[k];
+            l->sqsum += (uint32_t)l->pixels[k] * l->pixels[k];
+        }
+    }
+
+}
+
+const ImageTemplate::Level &ImageTemplate::level(int i) {
+    if ((size_t)i >= levels_.size()) levels_.resize(i + 1);
+    if (levels_[i]) return *levels_[i];
+    while (gray_.size() <= (size_t)i) {
+        ImagePlane g, a;
+        pyr_down(gray_.back(), &g);
+        pyr_down(alpha_.back(), &a);
+        gray_.push_back(std::move(g));
+        alpha_.push_back(std::move(a));
+    }
+    auto l = std::make_unique<Level>();
+    const ImagePlane &gray = gray_[i], &alpha = alpha_[i];
+    l->width = gray.width;
+    l->height = gray.height;
+    size_t pixels = (size_t)gray.width * gray.height;
+    l->pixels.resize(pixels);
+    l->mask.resize(pixels);
+    for (size_t k = 0; k < pixels; k++) {
+        l->mask[k] = alpha.pixels[k] >= 128;
+        l->pixels[k] = l->mask[k] ? gray.pixels[k] : 0;
+    }
+    level_sums(l.get());
+    levels_[i] = std::move(l);
+    return *levels_[i];
+}
+
+const ImageTemplate::Level &ImageTemplate::color() {
+    if (color_) return *color_;
+    auto l = std::make_unique<Level>();
+    l->width = image.width;
+    l->height = image.height;
+    l->bytes = 4;
+    size_t pixels = (size_t)image.width * image.height;
+    l->pixels.resize(pixels * 4);
+    l->mask.resize(pixels * 4);
+    for (size_t k = 0; k < pixels; k++) {
+        const uint8_t *p = image.row((int32_t)(k / image.width)) + (k % image.width) * 4;
+        uint8_t on = alpha_[0].pixels[k] >= 128;
+        for (int c = 0; c < 4; c++) {
+            l->mask[k * 4 + c] = c < 3 ? on : 0;
+            l->pixels[k * 4 + c] = c < 3 && on ? p[c] : 0;
+        }
+    }
+    level_sums(l.get());
+    color_ = std::move(l);
+    return *color_;
+}
+
+// ==================== Template Matching ====================
+
+namespace {
+
+typedef ImageTemplate::Level TemplateLevel;
+
+struct Candidate {
+    int32_t x, y;
+    double score;
+};
+
+double similarity(ImageMatchMethod method, const TemplateLevel &t, uint64_t sI, uint64_t sII, uint64_t sIT) {
+    double n = (double)t.n;
+    if (n == 0) return 0;
+    if (method == IMAGE_MATCH_SSD) {
+        double ssd = (double)sII - 2.0 * (double)sIT + (double)t.sqsum;
+        return 1.0 - sqrt(std::max(ssd, 0.0) / n) / 255.0;
+    }
+    double vi = (double)sII - (double)sI * (double)sI / n;
+    double vt = (double)t.sqsum - (double)t.sum * (double)t.sum / n;
+    // Below a unit standard deviation the correlation is noise
+    bool flatI = vi < n, flatT = vt < n;
+    if (flatI || flatT) return flatI && flatT ? 1.0 - fabs((double)sI - (double)t.sum) / (n * 255.0) : 0.0;
+    return ((double)sIT - (double)sI * (double)t.sum / n) / sqrt(vi * vt);
+}
+
+// acc[x] += sum of t[k] * s[x + k] over the taps, for x < w: one template
+// row against w consecutive corners
+void mac_row(uint32_t *acc, const uint8_t *s, const uint8_t *t, int32_t taps, int32_t w) {
+    int32_t x = 0;
+#if defined(IMAGE_MATCH_SSE2)
+    // Eight corners at a time in registers, two taps per multiply-add:
+    // pairs (s[x + k + i], s[x + k + 1 + i]) against (t[k], t[k + 1])
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 8 <= w; x += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + x));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + x + 4));
+        const uint8_t *p = s + x;
+        int32_t k = 0;
+        for (; k + 2 <= taps; k += 2) {
+            __m128i tt = _mm_set1_epi32(t[k] | t[k + 1] << 16);
+            __m128i pairs = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k)),
+                                              _mm_loadl_epi64((const __m128i *)(p + k + 1)));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi8(pairs, zero), tt));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi8(pairs, zero), tt));
+        }
+        if (k < taps) {
+            __m128i tt = _mm_set1_epi32(t[k]);
+            __m128i pairs = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k)), zero);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi8(pairs, zero), tt));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi8(pairs, zero), tt));
+        }
+        _mm_storeu_si128((__m128i *)(acc + x), lo);
+        _mm_storeu_si128((__m128i *)(acc + x + 4), hi);
+    }
+#elif defined(IMAGE_MATCH_NEON)
+    for (; x + 8 <= w; x += 8) {
+        uint32x4_t lo = vld1q_u32(acc + x), hi = vld1q_u32(acc + x + 4);
+        const uint8_t *p = s + x;
+        for (int32_t k = 0; k < taps; k++) {
+            uint16x8_t prod = vmull_u8(vld1_u8(p + k), vdup_n_u8(t[k]));
+            lo = vaddw_u16(lo, vget_low_u16(prod));
+            hi = vaddw_u16(hi, vget_high_u16(prod));
+        }
+        vst1q_u32(acc + x, lo);
+        vst1q_u32(acc + x + 4, hi);
+    }
+#endif
+    for (; x < w; x++) {
+        uint32_t c = 0;
+        for (int32_t k = 0; k < taps; k++) c += (uint32_t)t[k] * s[x + k];
+        acc[x] += c;
+    }
+}
+
+#if defined(IMAGE_MATCH_NEON)
+inline uint64_t sum_lanes(uint32x4_t v) {
+    uint64x2_t p = vpaddlq_u32(v);
+    return vgetq_lane_u64(p, 0) + vgetq_lane_u64(p, 1);
+}
+#endif
+
+// Sums of m[i] * s[i], m[i] * s[i]^2 and t[i] * s[i] over n bytes, m 0 or 1
+void masked_dot(const uint8_t *s, const uint8_t *t, const uint8_t *m, int32_t n, uint64_t *sI, uint64_t *sII,
+                uint64_t *sIT) {
+    int32_t i = 0;
+    uint64_t a = 0, q = 0, c = 0;
+#if defined(IMAGE_MATCH_SSE2)
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+    __m128i va = zero, vq = zero, vc = zero;
+    for (; i + 16 <= n; i += 16) {
+        __m128i sv = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i tv = _mm_loadu_si128((const __m128i *)(t + i));
+        // Masked bytes: m is 0 or 1, so 0 - m is 0 or all ones
+        __m128i sm = _mm_and_si128(sv, _mm_sub_epi8(zero, _mm_loadu_si128((const __m128i *)(m + i))));
+        for (int h = 0; h < 2; h++) {
+            __m128i s16 = h ? _mm_unpackhi_epi8(sv, zero) : _mm_unpacklo_epi8(sv, zero);
+            __m128i t16 = h ? _mm_unpackhi_epi8(tv, zero) : _mm_unpacklo_epi8(tv, zero);
+            __m128i m16 = h ? _mm_unpackhi_epi8(sm, zero) : _mm_unpacklo_epi8(sm, zero);
+            va = _mm_add_epi32(va, _mm_madd_epi16(m16, ones));
+            vq = _mm_add_epi32(vq, _mm_madd_epi16(m16, m16));
+            vc = _mm_add_epi32(vc, _mm_madd_epi16(s16, t16));
+        }
+        // Flush before the 32-bit lanes could overflow (2^32 / (4 * 65025))
+        if ((i & 0x3fff) == 0x3ff0) {
+            uint32_t l[12];
+            _mm_storeu_si128((__m128i *)l, va);
+            _mm_storeu_si128((__m128i *)(l + 4), vq);
+            _mm_storeu_si128((__m128i *)(l + 8), vc);
+            a += (uint64_t)l[0] + l[1] + l[2] + l[3];
+            q += (uint64_t)l[4] + l[5] + l[6] + l[7];
+            c += (uint64_t)l[8] + l[9] + l[10] + l[11];
+            va = vq = vc = zero;
+        }
+    }
+    uint32_t l[12];
+    _mm_storeu_si128((__m128i *)l, va);
+    _mm_storeu_si128((__m128i *)(l + 4), vq);
+    _mm_storeu_si128((__m128i *)(l + 8), vc);
+    a += (uint64_t)l[0] + l[1] + l[2] + l[3];
+    q += (uint64_t)l[4] + l[5] + l[6] + l[7];
+    c += (uint64_t)l[8] + l[9] + l[10] + l[11];
+#elif defined(IMAGE_MATCH_NEON)
+    uint32x4_t va = vdupq_n_u32(0), vq = vdupq_n_u32(0), vc = vdupq_n_u32(0);
+    for (; i + 8 <= n; i += 8) {
+        uint8x8_t sv = vld1_u8(s + i), sm = vmul_u8(sv, vld1_u8(m + i));
+        va = vpadalq_u16(va, vmovl_u8(sm));
+        vq = vpadalq_u16(vq, vmull_u8(sm, sm));
+        vc = vpadalq_u16(vc, vmull_u8(sv, vld1_u8(t + i)));
+        // Flush before the 32-bit lanes could overflow
+        if ((i & 0x3fff) == 0x3ff8) {
+            a += sum_lanes(va);
+            q += sum_lanes(vq);
+            c += sum_lanes(vc);
+            va = vq = vc = vdupq_n_u32(0);
+        }
+    }
+    a += sum_lanes(va);
+    q += sum_lanes(vq);
+    c += sum_lanes(vc);
+#endif
+    for (; i < n; i++) {
+        uint32_t v = s[i] * m[i];
+        a += v;
+        q += v * v;
+        c += (uint32_t)s[i] * t[i];
+    }
+    *sI = a;
+    *sII = q;
+    *sIT = c;
+}
+
+// Window sums over the template's matched bytes, src at the window's
+// top-left byte
+void masked_sums(const uint8_t *src, size_t stride, const TemplateLevel &t, uint64_t *sI, uint64_t *sII,
+                 uint64_t *sIT) {
+    int32_t rb = t.width * t.bytes;
+    *sI = *sII = *sIT = 0;
+    for (int32_t ty = 0; ty < t.height; ty++) {
+        uint64_t a, q, c;
+        masked_dot(src + ty * stride, t.pixels.data() + (size_t)ty * rb, t.mask.data() + (size_t)ty * rb, rb, &a, &q,
+                   &c);
+        *sI += a;
+        *sII += q;
+        *sIT += c;
+    }
+}
+
+// Searches one template on one pyramid
+struct Matcher {
+    ImagePyramid &img;
+    ImageTemplate &tpl;
+    const ImageMatchOptions &opts;
+    ImageRegion valid;      // top-left corners at full resolution, inclusive of x + width - 1
+
+    Matcher(ImagePyramid &i, ImageTemplate &t, const ImageMatchOptions &o) : img(i), tpl(t), opts(o) {}
+
+    // Corners at level l: [x0, x1] x [y0, y1]
+    bool range(int l, const TemplateLevel &t, int32_t *x0, int32_t *y0, int32_t *x1, int32_t *y1) {
+        int32_t w, h;
+        img.size(l, &w, &h);
+        *x0 = valid.x >> l;
+        *y0 = valid.y >> l;
+        *x1 = std::min((valid.x + valid.width - 1) >> l, w - t.width);
+        *y1 = std::min((valid.y + valid.height - 1) >> l, h - t.height);
+        return *x0 <= *x1 && *y0 <= *y1;
+    }
+
+    // One corner's score, with direct window sums: refinement scores a few
+    // corners per level, too few to pay for that level's integral image
+    double score(int l, const TemplateLevel &t, int32_t x, int32_t y) {
+        uint64_t sI, sII, sIT;
+        if (t.bytes == 4) {
+            const ImageView &v = img.image;
+            masked_sums(v.row(y) + x * 4, v.stride, t, &sI, &sII, &sIT);
+        } else {
+            const ImagePlane &s = img.level(l);
+            masked_sums(s.row(y) + x, s.width, t, &sI, &sII, &sIT);
+        }
+        return similarity(opts.method, t, sI, sII, sIT);
+    }
+
+    // Scores of every corner in rows [y0, y1] of gray level l, map row
+    // y - y0 holding corners x0..x1. Sums accumulate a row of corners at a
+    // time, one template pixel after the other, so the inner loops run
+    // along image rows.
+    void scan(int l, const TemplateLevel &t, int32_t x0, int32_t x1, int32_t y0, int32_t y1, float *map) {
+        const ImagePlane &s = img.level(l);
+        const ImageIntegral *integral = window_sums(l);
+        int32_t w = x1 - x0 + 1;
+        // Window sums in 32 bits
+        if ((uint64_t)t.width * t.height * 65025 > UINT32_MAX) {
+            for (int32_t y = y0; y <= y1; y++) {
+                for (int32_t x = x0; x <= x1; x++) map[(size_t)(y - y0) * w + (x - x0)] = (float)score(l, t, x, y);
+            }
+            return;
+        }
+        std::vector<uint32_t> accT(w), accI(w), accII(w);
+        // Masked: the opaque runs of each template row, and prefix sums of
+        // a source row and of its squares to sum them
+        std::vector<std::vector<std::pair<int32_t, int32_t>>> runs(t.height);
+        std::vector<uint32_t> prefix, prefixSq;
+        if (!integral) {
+            for (int32_t ty = 0; ty < t.height; ty++) {
+                const uint8_t *m = t.mask.data() + (size_t)ty * t.width;
+                for (int32_t tx = 0; tx < t.width; tx++) {
+                    if (!m[tx]) continue;
+                    if (runs[ty].empty() || runs[ty].back().second != tx) runs[ty].push_back({ tx, tx });
+                    runs[ty].back().second = tx + 1;
+                }
+            }
+            prefix.resize(w + t.width);
+            prefixSq.resize(w + t.width);
+        }
+        for (int32_t y = y0; y <= y1; y++) {
+            std::fill(accT.begin(), accT.end(), 0);
+            std::fill(accI.begin(), accI.end(), 0);
+            std::fill(accII.begin(), accII.end(), 0);
+            for (int32_t ty = 0; ty < t.height; ty++) {
+                const uint8_t *row = s.row(y + ty) + x0;
+                mac_row(accT.data(), row, t.pixels.data() + (size_t)ty * t.width, t.width, w);
+                if (integral || runs[ty].empty()) continue;
+                uint32_t *p = prefix.data(), *p2 = prefixSq.data(), *a = accI.data(), *q = accII.data();
+                p[0] = p2[0] = 0;
+                for (int32_t x = 0; x < w + t.width - 1; x++) {
+                    p[x + 1] = p[x] + row[x];
+                    p2[x + 1] = p2[x] + (uint32_t)row[x] * row[x];
+                }
+                for (const auto &r : runs[ty]) {
+                    for (int32_t x = 0; x < w; x++) {
+                        a[x] += p[x + r.second] - p[x + r.first];
+                        q[x] += p2[x + r.second] - p2[x + r.first];
+                    }
+                }
+            }
+            float *out = map + (size_t)(y - y0) * w;
+            for (int32_t x = 0; x < w; x++) {
+                uint64_t sI = accI[x], sII = accII[x];
+                if (integral) integral->window(x0 + x, y, t.width, t.height, &sI, &sII);
+                out[x] = (float)similarity(opts.method, t, sI, sII, accT[x]);
+            }
+        }
+    }
+
+    // The integral image scan() takes window sums from at level l, null
+    // for masked sums. Full resolution is only scanned for levels = 0: the
+    // runs and prefix sums of the masked path then cost less than the
+    // level's integral.
+    const ImageIntegral *window_sums(int l) {
+        return tpl.masked || l == 0 ? nullptr : &img.integral(l);
+    }
+
+    // Scores of the corners of level l, scanned by scan_rows()
+    struct ScoreMap {
+        int l = 0;
+        const TemplateLevel *t = nullptr;
+        int32_t x0 = 0, y0 = 0, x1 = -1, y1 = -1, w = 0, h = 0;
+        std::vector<float> map;
+    };
+
+    // Set up the map of level l and build what its scan reads, as the
+    // bands share it. False if no corner is left at that level.
+    bool prepare(int l, ScoreMap *m) {
+        m->l = l;
+        m->t = &tpl.level(l);
+        if (!range(l, *m->t, &m->x0, &m->y0, &m->x1, &m->y1)) return false;
+        m->w = m->x1 - m->x0 + 1;
+        m->h = m->y1 - m->y0 + 1;
+        m->map.assign((size_t)m->w * m->h, 0);
+        img.level(l);
+        window_sums(l);
+        return true;
+    }
+
+    // Multiply-adds per row of corners
+    static int64_t row_work(const ScoreMap &m) { return (int64_t)m.w * m.t->width * m.t->height; }
+
+    // Scan corner rows [ya, yb] of the map, clipped to its range
+    void scan_rows(ScoreMap *m, int32_t ya, int32_t yb) {
+        ya = std::max(ya, m->y0);
+        yb = std::min(yb, m->y1);
+        if (ya <= yb) scan(m->l, *m->t, m->x0, m->x1, ya, yb, m->map.data() + (size_t)(ya - m->y0) * m->w);
+    }
+
+    // The best k local maxima of the map, at least half the template apart
+    std::vector<Candidate> peaks(const ScoreMap &m, size_t k) {
+        std::vector<Candidate> found;
+        for (int32_t y = 0; y < m.h; y++) {
+            for (int32_t x = 0; x < m.w; x++) {
+                float v = m.map[(size_t)y * m.w + x];
+                bool peak = true;
+                for (int32_t dy = -1; peak && dy <= 1; dy++) {
+                    for (int32_t dx = -1; peak && dx <= 1; dx++) {
+                        int32_t nx = x + dx, ny = y + dy;
+                        if (nx >= 0 && ny >= 0 && nx < m.w && ny < m.h) peak = m.map[(size_t)ny * m.w + nx] <= v;
+                    }
+                }
+                if (peak) found.push_back({ m.x0 + x, m.y0 + y, v });
+            }
+        }
+        return suppress(std::move(found), m.t->width, m.t->height, k);
+    }
+
+    // The best k local maxima of the top level. The level is scanned in
+    // bands of rows on the search threads; the maxima are taken from the
+    // whole map once all are done, so they do not depend on the banding.
+    std::vector<Candidate> top(int l, size_t k) {
+        ScoreMap m;
+        if (!prepare(l, &m)) return std::vector<Candidate>();
+        int32_t bh = image_band_height(m.h, (int32_t)std::max<int64_t>(1, (1 << 18) / row_work(m)));
+        image_run_bands((m.h + bh - 1) / bh, [&](int b) {
+            scan_rows(&m, m.y0 + b * bh, m.y0 + b * bh + bh - 1);
+            return true;
+        });
+        return peaks(m, k);
+    }
+
+    // Candidates refined from level top down to full resolution
+    void descend(std::vector<Candidate> *c, int top) {
+        for (int l = top - 1; l >= 0; l--) refine(c, l, l + 1);
+        // Searched in gray at full resolution: score in color in place
+        if (top == 0) refine(c, 0, 0);
+    }
+
+    // Best-first, dropping candidates within half of w x h of a better one
+    static std::vector<Candidate> suppress(std::vector<Candidate> c, int32_t w, int32_t h, size_t k) {
+        std::stable_sort(c.begin(), c.end(), [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+        std::vector<Candidate> kept;
+        int32_t hw = std::max(w / 2, 1), hh = std::max(h / 2, 1);
+        for (const Candidate &a : c) {
+            if (k != 0 && kept.size() == k) break;
+            bool near = false;
+            for (const Candidate &b : kept) {
+                if (abs(a.x - b.x) < hw && abs(a.y - b.y) < hh) {
+                    near = true;
+                    break;
+                }
+            }
+            if (!near) kept.push_back(a);
+        }
+        return kept;
+    }
+
+    // Move candidates of level l + 1 (or of level l itself, from == l)
+    // to their best corner at level l, in color at level 0. Candidates are
+    // refined in parallel, each on its own.
+    void refine(std::vector<Candidate> *c, int l, int from) {
+        const TemplateLevel &t = l == 0 ? tpl.color() : tpl.level(l);
+        int32_t x0, y0, x1, y1;
+        if (!range(l, t, &x0, &y0, &x1, &y1)) {
+            c->clear();
+            return;
+        }
+        if (l > 0) img.level(l);
+        image_run_bands((int)c->size(), [&](int i) {
+            Candidate &a = (*c)[i];
+            int32_t bx = from == l ? a.x : 2 * a.x, by = from == l ? a.y : 2 * a.y;
+            int32_t lo = from == l ? 0 : -1, hi = from == l ? 0 : 2;
+            Candidate best = { 0, 0, -2 };
+            for (int32_t y = std::max(by + lo, y0); y <= std::min(by + hi, y1); y++) {
+                for (int32_t x = std::max(bx + lo, x0); x <= std::min(bx + hi, x1); x++) {
+                    double s = score(l, t, x, y);
+                    if (s > best.score) best = { x, y, s };
+                }
+            }
+            if (best.score < -1) best = { std::min(std::max(bx, x0), x1), std::min(std::max(by, y0), y1), -1 };
+            a = best;
+            return true;
+        });
+    }
+};
+
+// Corners where the template lies inside region, false if none
+bool valid_corners(const ImageView &img, const ImageView &tpl, ImageRegion region, ImageRegion *out) {
+    ImageRegion r;
+    if (tpl.width <= 0 || tpl.height <= 0 ||
+        !image_clip_region(img, region, &r) || r.width < tpl.width || r.height < tpl.height) {
+        return false;
+    }
+    *out = { r.x, r.y, r.width - tpl.width + 1, r.height - tpl.height + 1 };
+    return true;
+}
+
+// Candidates kept from the top level
+size_t candidates(const ImageMatchOptions &opts) {
+    return std::max(opts.topK, opts.limit == 0 ? (size_t)64 : opts.limit * 2);
+}
+
+size_t finish(std::vector<Candidate> c, const ImageView &tpl, const ImageMatchOptions &opts,
+              std::vector<ImageMatch> *out) {
+    c.erase(std::remove_if(c.begin(), c.end(), [&](const Candidate &a) { return a.score < opts.threshold; }),
+            c.end());
+    std::vector<Candidate> kept = Matcher::suppress(std::move(c), tpl.width, tpl.height, opts.limit);
+    for (const Candidate &a : kept) out->push_back({ a.x, a.y, (float)a.score });
+    return kept.size();
+}
+
+}  // namespace
+
+int image_match_levels(const ImageView &tpl, const ImageMatchOptions &opts) {
+    int32_t side = std::min(tpl.width, tpl.height);
+    int levels = 0;
+    if (opts.levels < 0) {
+        while (levels < 6 && (side >> (levels + 1)) >= 8) levels++;
+    } else {
+        // The template keeps a few pixels at the top
+        while (levels < opts.levels && levels < 10 && (side >> (levels + 1)) >= 2) levels++;
+    }
+    return levels;
+}
+
+size_t image_match_template(ImagePyramid &img, ImageTemplate &tpl, const ImageMatchOptions &opts,
+                            std::vector<ImageMatch> *out) {
+    Matcher m(img, tpl, opts);
+    if (!valid_corners(img.image, tpl.image, opts.region, &m.valid)) return 0;
+    int top = image_match_levels(tpl.image, opts);
+    std::vector<Candidate> c = m.top(top, candidates(opts));
+    m.descend(&c, top);
+    return finish(std::move(c), tpl.image, opts, out);
+}
+
+void image_match_templates(ImagePyramid &img, const std::vector<ImageTemplate *> &tpls,
+                           const ImageMatchOptions &opts, std::vector<std::vector<ImageMatch>> *out) {
+    size_t n = tpls.size();
+    out->assign(n, std::vector<ImageMatch>());
+    std::vector<Matcher> m;
+    std::vector<std::vector<Candidate>> c(n);
+    std::vector<int> top(n, -1);
+    m.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        m.emplace_back(img, *tpls[i], opts);
+        if (!valid_corners(img.image, tpls[i]->image, opts.region, &m[i].valid)) continue;
+        top[i] = image_match_levels(tpls[i]->image, opts);
+        c[i] = m[i].top(top[i], candidates(opts));
+        // Everything refinement reads, as templates refine in parallel (and
+        // one template may be given twice)
+        for (int k = 1; k < top[i]; k++) {
+            img.level(k);
+            tpls[i]->level(k);
+        }
+        tpls[i]->color();
+    }
+    // One template per band: its candidates refine on that thread
+    image_run_bands((int)n, [&](int i) {
+        if (top[i] < 0) return true;
+        m[i].descend(&c[i], top[i]);
+        finish(std::move(c[i]), tpls[i]->image, opts, &(*out)[i]);
+        return true;
+    });
+}
+
+size_t image_match_template_exhaustive(const ImageView &img, const ImageView &tpl, const ImageMatchOptions &opts,
+                                       std::vector<ImageMatch> *out) {
+    ImagePyramid pyramid(img);
+    ImageTemplate t(tpl);
+    Matcher m(pyramid, t, opts);
+    if (!valid_corners(img, tpl, opts.region, &m.valid)) return 0;
+    const TemplateLevel &level = t.color();
+    std::vector<Candidate> c;
+    for (int32_t y = m.valid.y; y < m.valid.y + m.valid.height; y++) {
+        for (int32_t x = m.valid.x; x < m.valid.x + m.valid.width; x++) c.push_back({ x, y, m.score(0, level, x, y) });
+    }
+    return finish(std::move(c), tpl, opts, out);
+}
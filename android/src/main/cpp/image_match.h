@@ -0,0 +1,142 @@
+#ifndef IMAGE_MATCH_H
+#define IMAGE_MATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "image_search.h"
+
+// ==================== Pyramids ====================
+//
+// Template matching runs coarse-to-fine on Gaussian pyramids: level 0 is
+// the gray image, each further level the previous one blurred with the
+// 5-tap binomial kernel [1 4 6 4 1] / 16 (both directions, edges
+// replicated) and halved. Levels and their integral images are built on
+// first use and kept, so every template matched against one pyramid shares
+// them.
+
+// 8-bit plane, rows packed
+struct ImagePlane {
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<uint8_t> pixels;
+
+    const uint8_t *row(int32_t y) const { return pixels.data() + (size_t)y * width; }
+};
+
+// Sums of the pixels and of their squares over [0, x) x [0, y), at
+// (width + 1) * y + x
+struct ImageIntegral {
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<uint32_t> sum;
+    std::vector<uint64_t> sqsum;
+
+    // Sums over the w x h window at (x, y)
+    void window(int32_t x, int32_t y, int32_t w, int32_t h, uint64_t *s, uint64_t *sq) const {
+        size_t stride = (size_t)width + 1;
+        size_t a = (size_t)y * stride + x, b = a + w, c = a + (size_t)h * stride, d = c + w;
+        *s = (uint64_t)sum[d] - sum[b] - sum[c] + sum[a];
+        *sq = sqsum[d] - sqsum[b] - sqsum[c] + sqsum[a];
+    }
+};
+
+// Gray pyramid of an image. The image's pixels must outlive it.
+struct ImagePyramid {
+    ImageView image;
+
+    explicit ImagePyramid(const ImageView &img) : image(img) {}
+
+    const ImagePlane &level(int i);
+    const ImageIntegral &integral(int i);
+    // Size of level i, built or not
+    void size(int i, int32_t *w, int32_t *h) const;
+
+  private:
+    std::vector<std::unique_ptr<ImagePlane>> levels_;
+    std::vector<std::unique_ptr<ImageIntegral>> integrals_;
+};
+
+// A template: its pixels, the gray pyramid, and the alpha mask (pixels
+// with alpha < 128 take no part, as in ImageUtils.findImage) per level.
+// The template's pixels must outlive it.
+struct ImageTemplate {
+    ImageView image;
+    bool masked = false;    // some pixel is transparent
+
+    explicit ImageTemplate(const ImageView &tpl);
+
+    // A level as matched, transparent pixels zeroed: gray (bytes = 1), or
+    // for color() RGBA at full resolution (bytes = 4, alpha always masked)
+    struct Level {
+        int32_t width = 0, height = 0, bytes = 1;
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> mask;      // 1 per matched byte
+        uint64_t n = 0, sum = 0, sqsum = 0;
+    };
+    const Level &level(int i);
+    const Level &color();
+
+  private:
+    std::vector<ImagePlane> gray_, alpha_;
+    std::vector<std::unique_ptr<Level>> levels_;
+    std::unique_ptr<Level> color_;
+};
+
+// ==================== Template Matching ====================
+//
+// Scores are similarities, higher is better:
+//   NCC  zero-mean normalized cross-correlation in [-1, 1] (a flat window
+//        or template, whose correlation is undefined, scores by the
+//        difference of the means instead)
+//   SSD  1 - RMS difference / 255, in [0, 1]
+// over the matched bytes of the template: R, G and B of its opaque pixels
+// at full resolution. The top level of the pyramid is searched at every
+// position, with window sums from the integral image (or masked sums for a
+// template with transparent pixels); the best topK local maxima are
+// refined level by level in a 4 x 4 neighbourhood, and scored at full
+// resolution in color.
+
+enum ImageMatchMethod {
+    IMAGE_MATCH_NCC,
+    IMAGE_MATCH_SSD,
+};
+
+typedef struct {
+    int32_t x, y;       // top-left corner of the match
+    float score;
+} ImageMatch;
+
+struct ImageMatchOptions {
+    ImageMatchMethod method = IMAGE_MATCH_NCC;
+    float threshold = 0.9f;
+    ImageRegion region = { 0, 0, INT32_MAX, INT32_MAX };    // the match lies inside
+    int levels = -1;        // pyramid levels above full resolution, -1 = the template's smaller side >= 8 at the top
+    size_t topK = 8;        // candidates refined, at least 2 * limit
+    size_t limit = 1;       // matches returned, 0 = no limit
+};
+
+// Append the matches scoring at least threshold, best first, none within
+// half the template's size of a better one, up to limit. Returns the
+// number appended.
+size_t image_match_template(ImagePyramid &img, ImageTemplate &tpl, const ImageMatchOptions &opts,
+                            std::vector<ImageMatch> *out);
+
+// Match several templates against one pyramid, as image_match_template
+// each: the levels and integral images are built once for all of them, and
+// templates refine in parallel. out[i] receives the matches of tpls[i].
+void image_match_templates(ImagePyramid &img, const std::vector<ImageTemplate *> &tpls,
+                           const ImageMatchOptions &opts, std::vector<std::vector<ImageMatch>> *out);
+
+// Every position at full resolution, the reference for the pyramid search
+size_t image_match_template_exhaustive(const ImageView &img, const ImageView &tpl, const ImageMatchOptions &opts,
+                                       std::vector<ImageMatch> *out);
+
+// The pyramid levels image_match_template searches for opts. They depend
+// only on the template: the search region is never smaller than it.
+int image_match_levels(const ImageView &tpl, const ImageMatchOptions &opts);
+
+#endif
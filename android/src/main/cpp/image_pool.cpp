@@ -0,0 +1,137 @@
+#include "image_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// One image_run_bands call: bands are taken in order by every thread
+// running it
+struct BandJob {
+    const std::function<bool(int)> &band;
+    int bands;
+    std::atomic<int> next{ 0 };
+    std::atomic<bool> stop{ false };
+
+    BandJob(const std::function<bool(int)> &f, int n) : band(f), bands(n) {}
+
+    void run();
+};
+
+struct Workers {
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::vector<std::thread> threads;
+    BandJob *job = nullptr;         // cleared under mutex once the job is over
+    uint64_t generation = 0;
+    int active = 0;                 // workers inside job
+    bool quit = false;
+
+    ~Workers() { resize(0); }
+
+    void loop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+            // Woken after the job was over
+            if (!job) continue;
+            BandJob *j = job;
+            active++;
+            lock.unlock();
+            j->run();
+            lock.lock();
+            if (--active == 0) idle.notify_all();
+        }
+    }
+
+    void resize(size_t n) {
+        if (threads.size() == n) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : threads) t.join();
+        threads.clear();
+        quit = false;
+        for (size_t i = 0; i < n; i++) threads.emplace_back([this] { loop(); });
+    }
+
+    void run(BandJob *j) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = j;
+            generation++;
+        }
+        wake.notify_all();
+        j->run();
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return active == 0; });
+        job = nullptr;
+    }
+};
+
+}  // namespace
+
+// Set while the thread runs a band: bands run nested searches inline
+static thread_local bool g_in_band = false;
+
+void BandJob::run() {
+    bool nested = g_in_band;
+    g_in_band = true;
+    while (!stop.load(std::memory_order_relaxed)) {
+        int i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= bands) break;
+        if (!band(i)) stop.store(true, std::memory_order_relaxed);
+    }
+    g_in_band = nested;
+}
+
+// One search at a time runs on the workers; g_pool_mutex also guards
+// resizing them
+static std::mutex g_pool_mutex;
+static Workers g_workers;
+static std::atomic<int> g_threads{ 0 };
+
+static int default_threads() {
+    int n = (int)std::thread::hardware_concurrency();
+    return std::min(std::max(n, 1), IMAGE_MAX_THREADS);
+}
+
+int image_set_threads(int n) {
+    g_threads.store(n <= 0 ? 0 : std::min(n, IMAGE_MAX_THREADS));
+    return image_threads();
+}
+
+int image_threads() {
+    int n = g_threads.load();
+    return n > 0 ? n : default_threads();
+}
+
+int32_t image_band_height(int32_t rows, int32_t minRows) {
+    int threads = image_threads();
+    if (threads <= 1 || rows <= 0) return std::max(rows, 1);
+    int32_t h = (rows + threads * 4 - 1) / (threads * 4);
+    return std::min(std::max(h, std::max(minRows, 1)), rows);
+}
+
+void image_run_bands(int bands, const std::function<bool(int)> &band) {
+    BandJob job(band, bands);
+    int threads = image_threads();
+    if (bands > 1 && threads > 1 && !g_in_band) {
+        std::unique_lock<std::mutex> lock(g_pool_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            g_workers.resize((size_t)threads - 1);
+            g_workers.run(&job);
+            return;
+        }
+    }
+    job.run();
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGE_POOL_H
+#define IMAGE_POOL_H
+
+#include <stdint.h>
+
+#include <functional>
+
+// ==================== Search Threads ====================
+//
+// The image searches split their region into bands of rows and run them
+// on a small persistent pool of threads, the calling thread taking bands
+// too. Bands are handed out in increasing order, and each band collects
+// its own results; the search merges them in band order, so results do
+// not depend on the thread count or on scheduling. With one thread, or
+// while another search holds the pool, every band runs on the caller.
+
+// Threads a search may use, the caller included. n <= 0 restores the
+// default, the number of CPUs (at most IMAGE_MAX_THREADS). Returns the
+// count now in effect.
+#define IMAGE_MAX_THREADS 8
+int image_set_threads(int n);
+int image_threads();
+
+// Height of the bands splitting rows rows: a few bands per thread, so
+// threads finishing early take more, and none under minRows rows. rows
+// itself (a single band) with one thread.
+int32_t image_band_height(int32_t rows, int32_t minRows);
+
+// Run band(i) for each i in [0, bands). A band returning false cancels
+// the bands not yet handed out, all after it: the ones before it have
+// started and run to the end. Returns once no band is running.
+// Called from a band, the bands run on the calling thread.
+void image_run_bands(int bands, const std::function<bool(int)> &band);
+
+#endif
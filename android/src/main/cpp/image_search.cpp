@@ -0,0 +1,485 @@
+#include "image_search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include "image_pool.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGE_SEARCH_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IMAGE_SEARCH_NEON 1
+#endif
+
+// ==================== Image Frames ====================
+
+bool image_frame_copy(const uint8_t *p, int32_t width, int32_t height, int32_t stride, ImageFrame *out) {
+    if (!p || width <= 0 || height <= 0 || stride < (int64_t)width * 4) return false;
+    size_t row = (size_t)width * 4;
+    out->width = width;
+    out->height = height;
+    out->pixels.resize(row * height);
+    if (stride == (int32_t)row) {
+        memcpy(out->pixels.data(), p, row * height);
+    } else {
+        for (int32_t y = 0; y < height; y++) memcpy(out->pixels.data() + row * y, p + (size_t)stride * y, row);
+    }
+    return true;
+}
+
+static std::mutex g_frame_mutex;
+static std::shared_ptr<const ImageFrame> g_frame;
+static uint32_t g_frame_generation = 0;
+
+uint32_t image_frame_publish(std::shared_ptr<ImageFrame> frame) {
+    std::lock_guard<std::mutex> lock(g_frame_mutex);
+    frame->generation = ++g_frame_generation;
+    g_frame = std::move(frame);
+    return g_frame_generation;
+}
+
+std::shared_ptr<const ImageFrame> image_frame_current() {
+    std::lock_guard<std::mutex> lock(g_frame_mutex);
+    return g_frame;
+}
+
+// ==================== Color Search ====================
+
+namespace {
+
+// Target color in frame byte order and the per-channel tolerance; alpha
+// tolerates anything
+struct ColorKey {
+    uint8_t color[4];
+    uint8_t tolerance[4];
+
+    ColorKey(uint32_t argb, int threshold) {
+        uint8_t t = (uint8_t)std::min(threshold, 255);
+        color[0] = (uint8_t)(argb >> 16);
+        color[1] = (uint8_t)(argb >> 8);
+        color[2] = (uint8_t)argb;
+        color[3] = 0;
+        tolerance[0] = tolerance[1] = tolerance[2] = t;
+        tolerance[3] = 255;
+    }
+
+    bool match(const uint8_t *p) const {
+        return abs(p[0] - color[0]) <= tolerance[0] && abs(p[1] - color[1]) <= tolerance[1] &&
+               abs(p[2] - color[2]) <= tolerance[2];
+    }
+};
+
+#if defined(IMAGE_SEARCH_SSE2)
+
+// Matches among the 16 pixels at p, bit i for pixel i
+struct ColorLanes {
+    __m128i color, tolerance;
+
+    explicit ColorLanes(const ColorKey &k) {
+        uint32_t c, t;
+        memcpy(&c, k.color, 4);
+        memcpy(&t, k.tolerance, 4);
+        color = _mm_set1_epi32((int)c);
+        tolerance = _mm_set1_epi32((int)t);
+    }
+
+    uint32_t match16(const uint8_t *p) const {
+        uint32_t mask = 0;
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + k * 16));
+            // |v - color| per byte, then what exceeds the tolerance
+            __m128i d = _mm_or_si128(_mm_subs_epu8(v, color), _mm_subs_epu8(color, v));
+            __m128i over = _mm_subs_epu8(d, tolerance);
+            __m128i hit = _mm_cmpeq_epi32(over, _mm_setzero_si128());
+            mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(hit)) << (k * 4);
+        }
+        return mask;
+    }
+};
+
+#elif defined(IMAGE_SEARCH_NEON)
+
+struct ColorLanes {
+    uint8x16_t r, g, b, tolerance;
+
+    explicit ColorLanes(const ColorKey &k)
+        : r(vdupq_n_u8(k.color[0])), g(vdupq_n_u8(k.color[1])), b(vdupq_n_u8(k.color[2])),
+          tolerance(vdupq_n_u8(k.tolerance[0])) {}
+
+    uint32_t match16(const uint8_t *p) const {
+        static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        // Deinterleaved: one lane per pixel and channel
+        uint8x16x4_t v = vld4q_u8(p);
+        uint8x16_t hit = vandq_u8(vandq_u8(vcleq_u8(vabdq_u8(v.val[0], r), tolerance),
+                                           vcleq_u8(vabdq_u8(v.val[1], g), tolerance)),
+                                  vcleq_u8(vabdq_u8(v.val[2], b), tolerance));
+        // Lane bits summed per half: low byte pixels 0-7, high byte 8-15
+        uint8x16_t m = vandq_u8(hit, vld1q_u8(bits));
+        uint8x8_t s = vpadd_u8(vget_low_u8(m), vget_high_u8(m));
+        s = vpadd_u8(s, s);
+        s = vpadd_u8(s, s);
+        return vget_lane_u16(vreinterpret_u16_u8(s), 0);
+    }
+};
+
+#endif
+
+bool intersect_region(ImageRegion a, ImageRegion b, ImageRegion *out) {
+    int64_t x0 = std::max<int64_t>(a.x, b.x), y0 = std::max<int64_t>(a.y, b.y);
+    int64_t x1 = std::min<int64_t>((int64_t)a.x + a.width, (int64_t)b.x + b.width);
+    int64_t y1 = std::min<int64_t>((int64_t)a.y + a.height, (int64_t)b.y + b.height);
+    if (x0 >= x1 || y0 >= y1) return false;
+    *out = { (int32_t)x0, (int32_t)y0, (int32_t)(x1 - x0), (int32_t)(y1 - y0) };
+    return true;
+}
+
+
+// Call visit(x, y) on each match of key in r (clipped) in row-major order,
+// until it returns false
+template <typename Visit>
+void scan_colors(const ImageView &img, const ColorKey &key, const ImageRegion &r, Visit &&visit) {
+    int32_t x1 = r.x + r.width;
+#if defined(IMAGE_SEARCH_SSE2) || defined(IMAGE_SEARCH_NEON)
+    ColorLanes lanes(key);
+#endif
+    for (int32_t y = r.y; y < r.y + r.height; y++) {
+        const uint8_t *row = img.row(y);
+        int32_t x = r.x;
+#if defined(IMAGE_SEARCH_SSE2) || defined(IMAGE_SEARCH_NEON)
+        for (; x + 16 <= x1; x += 16) {
+            for (uint32_t m = lanes.match16(row + x * 4); m; m &= m - 1) {
+                if (!visit(x + __builtin_ctz(m), y)) return;
+            }
+        }
+#endif
+        for (; x < x1; x++) {
+            if (key.match(row + x * 4) && !visit(x, y)) return;
+        }
+    }
+}
+
+// Band height for a search over r, bands of at least 64K pixels
+int32_t band_height(const ImageRegion &r) {
+    return image_band_height(r.height, std::max<int32_t>(16, 65536 / r.width));
+}
+
+ImageRegion band_region(const ImageRegion &r, int32_t h, int b) {
+    int32_t y = r.y + b * h;
+    return { r.x, y, r.width, std::min(h, r.y + r.height - y) };
+}
+
+// Append the points of n bands, band b's at bands[b * stride], in band
+// order up to limit in all (0 = no limit): a band's points all precede
+// the next band's
+size_t merge_bands(const std::vector<ImagePoint> *bands, size_t n, size_t stride, size_t limit,
+                   std::vector<ImagePoint> *out) {
+    size_t found = 0;
+    for (size_t b = 0; b < n && (limit == 0 || found < limit); b++) {
+        const std::vector<ImagePoint> &f = bands[b * stride];
+        size_t take = limit == 0 ? f.size() : std::min(f.size(), limit - found);
+        out->insert(out->end(), f.begin(), f.begin() + take);
+        found += take;
+    }
+    return found;
+}
+
+}  // namespace
+
+ImageRegion image_full_region(const ImageView &img) {
+    return { 0, 0, img.width, img.height };
+}
+
+bool image_clip_region(const ImageView &img, ImageRegion r, ImageRegion *out) {
+    return intersect_region(r, image_full_region(img), out);
+}
+
+size_t image_find_colors(const ImageView &img, uint32_t color, int threshold, ImageRegion region, size_t limit,
+                         std::vector<ImagePoint> *out) {
+    ImageRegion r;
+    if (threshold < 0 || !image_clip_region(img, region, &r)) return 0;
+    ColorKey key(color, threshold);
+    int32_t h = band_height(r);
+    int bands = (r.height + h - 1) / h;
+    if (bands == 1) {
+        size_t found = 0;
+        scan_colors(img, key, r, [&](int32_t x, int32_t y) {
+            out->push_back({ x, y });
+            return ++found != limit;
+        });
+        return found;
+    }
+    std::vector<std::vector<ImagePoint>> found(bands);
+    image_run_bands(bands, [&](int b) {
+        std::vector<ImagePoint> &f = found[b];
+        scan_colors(img, key, band_region(r, h, b), [&](int32_t x, int32_t y) {
+            f.push_back({ x, y });
+            return f.size() != limit;
+        });
+        // Full before any later band: those are not needed
+        return limit == 0 || f.size() < limit;
+    });
+    return merge_bands(found.data(), found.size(), 1, limit, out);
+}
+
+size_t image_find_colors_scalar(const ImageView &img, uint32_t color, int threshold, ImageRegion region,
+                                size_t limit, std::vector<ImagePoint> *out) {
+    ImageRegion r;
+    if (threshold < 0 || !image_clip_region(img, region, &r)) return 0;
+    ColorKey key(color, threshold);
+    size_t found = 0;
+    for (int32_t y = r.y; y < r.y + r.height; y++) {
+        const uint8_t *row = img.row(y);
+        for (int32_t x = r.x; x < r.x + r.width; x++) {
+            if (!key.match(row + x * 4)) continue;
+            out->push_back({ x, y });
+            if (++found == limit) return found;
+        }
+    }
+    return found;
+}
+
+// ==================== Multi-Color Search ====================
+
+namespace {
+
+// Candidates of one row: bit x - x0 of bits is set where the pixel at x
+// matches key
+struct RowMask {
+    ColorKey key;
+#if defined(IMAGE_SEARCH_SSE2) || defined(IMAGE_SEARCH_NEON)
+    ColorLanes lanes;
+#endif
+    std::vector<uint64_t> bits;
+
+    explicit RowMask(const ColorKey &k)
+        : key(k)
+#if defined(IMAGE_SEARCH_SSE2) || defined(IMAGE_SEARCH_NEON)
+        , lanes(k)
+#endif
+    {
+    }
+
+    void fill(const uint8_t *row, int32_t x0, int32_t x1) {
+        bits.assign(((size_t)(x1 - x0) + 63) / 64, 0);
+        int32_t x = x0;
+#if defined(IMAGE_SEARCH_SSE2) || defined(IMAGE_SEARCH_NEON)
+        // Steps of 16 from x0 never straddle a word
+        for (; x + 16 <= x1; x += 16) {
+            size_t i = (size_t)(x - x0);
+            bits[i >> 6] |= (uint64_t)lanes.match16(row + x * 4) << (i & 63);
+        }
+#endif
+        for (; x < x1; x++) {
+            size_t i = (size_t)(x - x0);
+            if (key.match(row + x * 4)) bits[i >> 6] |= 1ull << (i & 63);
+        }
+    }
+};
+
+// A pattern ready to search: the anchors, the part of the region where
+// every offset stays in the image, and the offsets as byte distances from
+// the anchor pixel
+struct MultiColorPlan {
+    ColorKey anchor;
+    ImageRegion anchors;
+    bool empty;
+    std::vector<ptrdiff_t> delta;
+    std::vector<ColorKey> keys;
+
+    MultiColorPlan(const ImageView &img, const ImageMultiColor &p, ImageRegion region)
+        : anchor(p.color, p.threshold) {
+        int64_t minDx = 0, maxDx = 0, minDy = 0, maxDy = 0;
+        for (const ImageColorOffset &o : p.offsets) {
+            minDx = std::min<int64_t>(minDx, o.dx);
+            maxDx = std::max<int64_t>(maxDx, o.dx);
+            minDy = std::min<int64_t>(minDy, o.dy);
+            maxDy = std::max<int64_t>(maxDy, o.dy);
+            delta.push_back((ptrdiff_t)o.dy * img.stride + (ptrdiff_t)o.dx * 4);
+            keys.emplace_back(o.color, p.threshold);
+        }
+        ImageRegion inner = { (int32_t)-minDx, (int32_t)-minDy, 0, 0 };
+        empty = p.threshold < 0 || maxDx - minDx >= img.width || maxDy - minDy >= img.height;
+        if (!empty) {
+            inner.width = (int32_t)(img.width - maxDx + minDx);
+            inner.height = (int32_t)(img.height - maxDy + minDy);
+            empty = !image_clip_region(img, region, &anchors) || !intersect_region(anchors, inner, &anchors);
+        }
+    }
+
+    bool verify(const uint8_t *p) const {
+        for (size_t i = 0; i < delta.size(); i++) {
+            if (!keys[i].match(p + delta[i])) return false;
+        }
+        return true;
+    }
+};
+
+bool same_key(const ColorKey &a, const ColorKey &b) {
+    return memcmp(a.color, b.color, 4) == 0 && memcmp(a.tolerance, b.tolerance, 4) == 0;
+}
+
+// Plans sharing a first color: the prefilter covers the union of their
+// anchors
+struct AnchorGroup {
+    RowMask mask;
+    ImageRegion bounds;
+    std::vector<size_t> plans;
+    size_t live = 0;
+
+    explicit AnchorGroup(const ColorKey &k) : mask(k) {}
+};
+
+// out[i] receives up to limit matches of patterns[i]
+void search_multi_colors(const ImageView &img, const ImageMultiColor *patterns, size_t n, ImageRegion region,
+                         size_t limit, std::vector<ImagePoint> *out) {
+    std::vector<MultiColorPlan> plans;
+    std::vector<AnchorGroup> groups;
+    plans.reserve(n);
+    int32_t y0 = INT32_MAX, y1 = INT32_MIN;
+    for (size_t i = 0; i < n; i++) {
+        plans.emplace_back(img, patterns[i], region);
+        const MultiColorPlan &plan = plans.back();
+        if (plan.empty) continue;
+        size_t g = 0;
+        while (g < groups.size() && !same_key(groups[g].mask.key, plan.anchor)) g++;
+        if (g == groups.size()) {
+            groups.emplace_back(plan.anchor);
+            groups[g].bounds = plan.anchors;
+        } else {
+            ImageRegion &b = groups[g].bounds;
+            int32_t bx1 = std::max(b.x + b.width, plan.anchors.x + plan.anchors.width);
+            int32_t by1 = std::max(b.y + b.height, plan.anchors.y + plan.anchors.height);
+            b.x = std::min(b.x, plan.anchors.x);
+            b.y = std::min(b.y, plan.anchors.y);
+            b.width = bx1 - b.x;
+            b.height = by1 - b.y;
+        }
+        groups[g].plans.push_back(i);
+        groups[g].live++;
+        y0 = std::min(y0, plan.anchors.y);
+        y1 = std::max(y1, plan.anchors.y + plan.anchors.height);
+    }
+
+    std::vector<size_t> found(n, 0);
+    size_t live = 0;
+    for (const AnchorGroup &g : groups) live += g.live;
+    for (int32_t y = y0; live > 0 && y < y1; y++) {
+        const uint8_t *row = img.row(y);
+        for (AnchorGroup &g : groups) {
+            if (g.live == 0 || y < g.bounds.y || y >= g.bounds.y + g.bounds.height) continue;
+            g.mask.fill(row, g.bounds.x, g.bounds.x + g.bounds.width);
+            for (size_t i : g.plans) {
+                const MultiColorPlan &plan = plans[i];
+                const ImageRegion &a = plan.anchors;
+                if (found[i] == limit && limit != 0) continue;
+                if (y < a.y || y >= a.y + a.height) continue;
+                // Candidate bits lo..hi of the group's mask
+                size_t lo = (size_t)(a.x - g.bounds.x), hi = lo + (size_t)a.width;
+                bool done = false;
+                for (size_t w = lo >> 6; !done && w <= (hi - 1) >> 6; w++) {
+                    uint64_t bits = g.mask.bits[w];
+                    if (w == lo >> 6) bits &= ~0ull << (lo & 63);
+                    for (; bits; bits &= bits - 1) {
+                        size_t b = (w << 6) + __builtin_ctzll(bits);
+                        if (b >= hi) break;
+                        int32_t x = g.bounds.x + (int32_t)b;
+                        if (!plan.verify(row + x * 4)) continue;
+                        out[i].push_back({ x, y });
+                        if (++found[i] == limit) {
+                            g.live--;
+                            live--;
+                            done = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// search_multi_colors over bands of the region
+void search_multi_colors_bands(const ImageView &img, const ImageMultiColor *patterns, size_t n, ImageRegion region,
+                               size_t limit, std::vector<ImagePoint> *out) {
+    ImageRegion r;
+    if (!image_clip_region(img, region, &r)) return;
+    int32_t h = band_height(r);
+    int bands = (r.height + h - 1) / h;
+    if (bands == 1) {
+        search_multi_colors(img, patterns, n, r, limit, out);
+        return;
+    }
+    // Band b's matches of patterns[i] at b * n + i
+    std::vector<std::vector<ImagePoint>> found((size_t)bands * n);
+    image_run_bands(bands, [&](int b) {
+        std::vector<ImagePoint> *f = found.data() + (size_t)b * n;
+        search_multi_colors(img, patterns, n, band_region(r, h, b), limit, f);
+        if (limit == 0) return true;
+        for (size_t i = 0; i < n; i++) {
+            if (f[i].size() < limit) return true;
+        }
+        return false;
+    });
+    for (size_t i = 0; i < n; i++) merge_bands(found.data() + i, bands, n, limit, out + i);
+}
+
+}  // namespace
+
+size_t image_find_multi_colors(const ImageView &img, const ImageMultiColor &pattern, ImageRegion region,
+                               size_t limit, std::vector<ImagePoint> *out) {
+    size_t before = out->size();
+    search_multi_colors_bands(img, &pattern, 1, region, limit, out);
+    return out->size() - before;
+}
+
+void image_find_multi_colors_batch(const ImageView &img, const std::vector<ImageMultiColor> &patterns,
+                                   ImageRegion region, size_t limit, std::vector<std::vector<ImagePoint>> *out) {
+    out->assign(patterns.size(), std::vector<ImagePoint>());
+    search_multi_colors_bands(img, patterns.data(), patterns.size(), region, limit, out->data());
+}
+
+size_t image_find_multi_colors_scalar(const ImageView &img, const ImageMultiColor &pattern, ImageRegion region,
+                                      size_t limit, std::vector<ImagePoint> *out) {
+    ImageRegion r;
+    if (pattern.threshold < 0 || !image_clip_region(img, region, &r)) return 0;
+    ColorKey first(pattern.color, pattern.threshold);
+    size_t found = 0;
+    for (int32_t y = r.y; y < r.y + r.height; y++) {
+        for (int32_t x = r.x; x < r.x + r.width; x++) {
+            if (!first.match(img.row(y) + x * 4)) continue;
+            bool all = true;
+            for (const ImageColorOffset &o : pattern.offsets) {
+                int64_t ox = (int64_t)x + o.dx, oy = (int64_t)y + o.dy;
+                if (ox < 0 || ox >= img.width || oy < 0 || oy >= img.height ||
+                    !ColorKey(o.color, pattern.threshold).match(img.row((int32_t)oy) + ox * 4)) {
+                    all = false;
+                    break;
+                }
+            }
+            if (!all) continue;
+            out->push_back({ x, y });
+            if (++found == limit) return found;
+        }
+    }
+    return found;
+}
+
+bool image_parse_color(const char *s, uint32_t *out) {
+    if (*s == '#') s++;
+    size_t len = strlen(s);
+    if (len != 6 && len != 8) return false;
+    uint32_t v = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) return false;
+        v = v << 4 | (uint32_t)d;
+    }
+    *out = len == 6 ? 0xff000000u | v : v;
+    return true;
+}
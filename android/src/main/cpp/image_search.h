@@ -0,0 +1,130 @@
+#ifndef IMAGE_SEARCH_H
+#define IMAGE_SEARCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+// ==================== Image Frames ====================
+//
+// Screen captures are pushed by the host as RGBA8888 (the byte order of an
+// ARGB_8888 Bitmap and of a MediaProjection ImageReader plane): 4 bytes per
+// pixel, rows stride bytes apart. Searches run on a view of such a buffer,
+// so a frame is never converted or copied per query.
+
+struct ImageView {
+    const uint8_t *pixels = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;     // bytes per row, >= width * 4
+
+    const uint8_t *row(int32_t y) const { return pixels + (size_t)y * stride; }
+    // 0xAARRGGBB, as android.graphics.Color ints
+    uint32_t pixel(int32_t x, int32_t y) const {
+        const uint8_t *p = row(y) + x * 4;
+        return (uint32_t)p[3] << 24 | (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    }
+};
+
+// A frame owns its pixels, rows packed (stride = width * 4)
+struct ImageFrame {
+    uint32_t generation = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+    std::vector<uint8_t> pixels;
+
+    ImageView view() const {
+        ImageView v;
+        v.pixels = pixels.data();
+        v.width = width;
+        v.height = height;
+        v.stride = width * 4;
+        return v;
+    }
+};
+
+// Copy a width x height RGBA buffer with the given row stride into out.
+// False on a non-positive size or a stride shorter than a row.
+bool image_frame_copy(const uint8_t *p, int32_t width, int32_t height, int32_t stride, ImageFrame *out);
+
+// The most recent screen capture, like ui_snapshot_publish/current
+uint32_t image_frame_publish(std::shared_ptr<ImageFrame> frame);
+std::shared_ptr<const ImageFrame> image_frame_current();
+
+// ==================== Color Search ====================
+//
+// A pixel matches a color when each of R, G and B is within threshold of
+// the color's (alpha is ignored), as ImageUtils.colorMatch. Pixels are
+// searched row by row over a region of interest, 16 per step with SSE2 or
+// NEON where available; the scalar loop handles row tails and other
+// targets. Regions are clipped to the image, and split into bands of rows
+// on the search threads (image_pool.h): the points found are the same in
+// the same order with any number of threads.
+
+typedef struct {
+    int32_t x, y;
+} ImagePoint;
+
+typedef struct {
+    int32_t x, y, width, height;
+} ImageRegion;
+
+// The whole image
+ImageRegion image_full_region(const ImageView &img);
+
+// r clipped to the image, false if nothing is left
+bool image_clip_region(const ImageView &img, ImageRegion r, ImageRegion *out);
+
+// Append the matches in row-major order, stopping after limit (0 = no
+// limit). Returns the number appended.
+size_t image_find_colors(const ImageView &img, uint32_t color, int threshold, ImageRegion region, size_t limit,
+                         std::vector<ImagePoint> *out);
+
+// Pixel by pixel, the reference for the vector kernels
+size_t image_find_colors_scalar(const ImageView &img, uint32_t color, int threshold, ImageRegion region,
+                                size_t limit, std::vector<ImagePoint> *out);
+
+// ==================== Multi-Color Search ====================
+//
+// A multi-color pattern matches at (x, y) when the pixel there matches its
+// first color and each offset pixel (x + dx, y + dy) matches the offset's
+// color, all within the pattern's threshold, as ImageUtils.findMultiColors.
+// Offsets falling outside the image never match. Each row of the region is
+// prefiltered for the first color into a candidate bitmask with the color
+// search kernels; offsets are checked only on candidates, reading the
+// buffer directly.
+
+typedef struct {
+    int32_t dx, dy;
+    uint32_t color;
+} ImageColorOffset;
+
+struct ImageMultiColor {
+    uint32_t color = 0;
+    std::vector<ImageColorOffset> offsets;
+    int threshold = 4;
+};
+
+// Append the points where pattern matches in region, in row-major order,
+// stopping after limit (0 = no limit). Returns the number appended.
+size_t image_find_multi_colors(const ImageView &img, const ImageMultiColor &pattern, ImageRegion region,
+                               size_t limit, std::vector<ImagePoint> *out);
+
+// Search several patterns in one pass over the region: each row is read
+// once for all of them, and patterns with the same first color and
+// threshold share the prefilter. out[i] receives the matches of
+// patterns[i], up to limit each.
+void image_find_multi_colors_batch(const ImageView &img, const std::vector<ImageMultiColor> &patterns,
+                                   ImageRegion region, size_t limit, std::vector<std::vector<ImagePoint>> *out);
+
+// Pixel by pixel with per-offset bounds checks, the reference
+size_t image_find_multi_colors_scalar(const ImageView &img, const ImageMultiColor &pattern, ImageRegion region,
+                                      size_t limit, std::vector<ImagePoint> *out);
+
+// Parse "#RRGGBB", "#AARRGGBB" or the same without "#" into 0xAARRGGBB
+// (alpha 0xff if not given). False if s is none of these.
+bool image_parse_color(const char *s, uint32_t *out);
+
+#endif
@@ -7,12 +7,25 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <pthread.h>
+#include <math.h>
+
+#include <string>
+#include <unordered_set>
 
 extern "C" {
 #include "quickjs/quickjs.h"
 #include "quickjs/quickjs-libc.h"
 }
 
+#include "host_call.h"
+#include "image_match.h"
+#include "image_pool.h"
+#include "image_search.h"
+#include "ui_collection.h"
+#include "ui_diff.h"
+#include "ui_selector.h"
+#include "ui_snapshot.h"
+
 #define LOG_TAG "QuickJSJNI"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
@@ -21,6 +34,8 @@ extern "C" {
 
 static JSRuntime *g_runtime = nullptr;
 static JSContext *g_ctx = nullptr;
+// Regexes compiled by g_runtime's selectors; replaced along with it
+static std::shared_ptr<SelectorRegexCache> g_regex_cache;
 static JavaVM *g_jvm = nullptr;
 static jobject g_callback = nullptr;
 static volatile int g_interrupt_flag = 0;
@@ -110,62 +125,223 @@ static JNIEnv* getEnv() {
 
 // ==================== Host Function Bridge ====================
 
-static JSValue js_call_host(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    if (argc < 1 || !g_callback) return JS_UNDEFINED;
-    
-    const char *func_name = JS_ToCString(ctx, argv[0]);
-    if (!func_name) return JS_UNDEFINED;
+// Host functions reachable through the typed bridge. The enum order is the
+// function ID; names are bound once per engine in HostCallback.bindFunctions().
+#define HOST_FUNC_LIST(X) \
+    X(HF_TOAST, "toast") \
+    X(HF_SET_CLIP, "setClip") \
+    X(HF_GET_CLIP, "getClip") \
+    X(HF_CLICK, "click") \
+    X(HF_LONG_CLICK, "longClick") \
+    X(HF_PRESS, "press") \
+    X(HF_SWIPE, "swipe") \
+    X(HF_SWIPE_UP, "swipeUp") \
+    X(HF_SWIPE_DOWN, "swipeDown") \
+    X(HF_SWIPE_LEFT, "swipeLeft") \
+    X(HF_SWIPE_RIGHT, "swipeRight") \
+    X(HF_BACK, "back") \
+    X(HF_HOME, "home") \
+    X(HF_RECENTS, "recents") \
+    X(HF_NOTIFICATIONS, "notifications") \
+    X(HF_QUICK_SETTINGS, "quickSettings") \
+    X(HF_SET_TEXT, "setText") \
+    X(HF_GESTURE, "gesture") \
+    X(HF_GESTURES, "gestures") \
+    X(HF_UI_SNAPSHOT, "ui.snapshot") \
+    X(HF_UI_WATCH, "ui.watch") \
+    X(HF_IMAGES_CAPTURE, "images.capture") \
+    X(HF_UIOBJECT_ACTION, "uiobject.action") \
+    X(HF_APP_LAUNCH, "app.launch") \
+    X(HF_APP_LAUNCH_APP, "app.launchApp") \
+    X(HF_APP_OPEN_URL, "openUrl") \
+    X(HF_APP_CURRENT_PACKAGE, "app.currentPackage") \
+    X(HF_CURRENT_PACKAGE, "currentPackage") \
+    X(HF_DEVICE_GET_BATTERY, "device.getBattery") \
+    X(HF_DEVICE_WAKE_UP, "device.wakeUp") \
+    X(HF_DEVICE_WIDTH, "device.width") \
+    X(HF_DEVICE_HEIGHT, "device.height") \
+    X(HF_SHELL, "shell") \
+    X(HF_FILES_READ, "files.read") \
+    X(HF_FILES_WRITE, "files.write") \
+    X(HF_HTTP_GET, "http.get") \
+    X(HF_HTTP_POST_FORM, "http.postForm") \
+    X(HF_STORAGE_GET, "storage.get") \
+    X(HF_STORAGE_PUT, "storage.put") \
+    X(HF_STORAGE_REMOVE, "storage.remove") \
+    X(HF_STORAGE_CONTAINS, "storage.contains") \
+    X(HF_STORAGE_CLEAR, "storage.clear")
+
+enum HostFunc {
+#define X(id, name) id,
+    HOST_FUNC_LIST(X)
+#undef X
+    HF_COUNT
+};
+
+static const char *const g_host_func_names[HF_COUNT] = {
+#define X(id, name) name,
+    HOST_FUNC_LIST(X)
+#undef X
+};
+
+// __callHost(name, ...) resolves the name on the host side instead
+#define HF_DYNAMIC (-1)
+
+static HostCallBuffer g_call_buf = {};
+static jmethodID g_invoke_typed = nullptr;
+static jmethodID g_attach_buffer = nullptr;
+
+typedef struct {
+    HostValue value;
+    jstring str;        // set when the host returned a String instead of a buffer value
+    const char *chars;
+} HostResult;
+
+static void host_attach_buffer(JNIEnv *env) {
+    jobject bb = env->NewDirectByteBuffer(g_call_buf.data, g_call_buf.capacity);
+    env->CallVoidMethod(g_callback, g_attach_buffer, bb);
+    env->DeleteLocalRef(bb);
+    g_call_buf.moved = false;
+}
+
+// Bind function IDs and the shared call buffer once per engine
+static bool host_bridge_init(JNIEnv *env, jobject callback) {
+    jclass cls = env->GetObjectClass(callback);
+    g_invoke_typed = env->GetMethodID(cls, "invokeTyped", "(II)Ljava/lang/String;");
+    g_attach_buffer = env->GetMethodID(cls, "attachCallBuffer", "(Ljava/nio/ByteBuffer;)V");
+    jmethodID bind = env->GetMethodID(cls, "bindFunctions", "([Ljava/lang/String;)V");
+    if (!g_invoke_typed || !g_attach_buffer || !bind) {
+        env->ExceptionClear();
+        env->DeleteLocalRef(cls);
+        LOGE("HostCallback is missing typed bridge methods");
+        return false;
+    }
     
-    JNIEnv *env = getEnv();
     jclass stringClass = env->FindClass("java/lang/String");
-    jobjectArray jargs = env->NewObjectArray(argc - 1, stringClass, nullptr);
-    
-    for (int i = 1; i < argc; i++) {
-        const char *arg = JS_ToCString(ctx, argv[i]);
-        if (arg) {
-            jstring jarg = env->NewStringUTF(arg);
-            env->SetObjectArrayElement(jargs, i - 1, jarg);
-            env->DeleteLocalRef(jarg);
-            JS_FreeCString(ctx, arg);
-        }
+    jobjectArray names = env->NewObjectArray(HF_COUNT, stringClass, nullptr);
+    for (int i = 0; i < HF_COUNT; i++) {
+        jstring name = env->NewStringUTF(g_host_func_names[i]);
+        env->SetObjectArrayElement(names, i, name);
+        env->DeleteLocalRef(name);
     }
+    env->CallVoidMethod(callback, bind, names);
+    env->DeleteLocalRef(names);
+    env->DeleteLocalRef(stringClass);
+    env->DeleteLocalRef(cls);
     
-    jclass callbackClass = env->GetObjectClass(g_callback);
-    jmethodID method = env->GetMethodID(callbackClass, "invoke", 
-        "(Ljava/lang/String;[Ljava/lang/String;)Ljava/lang/String;");
+    if (!g_call_buf.data && !host_call_buffer_init(&g_call_buf, HOST_CALL_INITIAL_CAPACITY)) return false;
+    host_attach_buffer(env);
+    return true;
+}
+
+static void host_result_free(HostResult *res) {
+    if (res->str) {
+        JNIEnv *env = getEnv();
+        if (res->chars) env->ReleaseStringUTFChars(res->str, res->chars);
+        env->DeleteLocalRef(res->str);
+    }
+    res->str = nullptr;
+    res->chars = nullptr;
+}
+
+// Invoke the host with argc arguments already packed into g_call_buf and
+// decode its result. Returns false if the call could not be made; otherwise
+// res must be freed.
+static bool host_dispatch(int fid, int argc, HostResult *res) {
+    memset(res, 0, sizeof(*res));
+    if (!g_callback || !g_invoke_typed) return false;
     
-    jstring jfunc = env->NewStringUTF(func_name);
-    jstring result = static_cast<jstring>(env->CallObjectMethod(g_callback, method, jfunc, jargs));
+    JNIEnv *env = getEnv();
+    if (g_call_buf.moved) host_attach_buffer(env);
     
-    JS_FreeCString(ctx, func_name);
-    env->DeleteLocalRef(jfunc);
-    env->DeleteLocalRef(jargs);
+    jstring str = static_cast<jstring>(env->CallObjectMethod(g_callback, g_invoke_typed, (jint)fid, (jint)argc));
+    if (env->ExceptionCheck()) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+        return false;
+    }
     
-    if (result) {
-        const char *result_str = env->GetStringUTFChars(result, nullptr);
-        JSValue ret = JS_NewString(ctx, result_str);
-        env->ReleaseStringUTFChars(result, result_str);
-        env->DeleteLocalRef(result);
-        return ret;
+    if (str) {
+        res->str = str;
+        res->chars = env->GetStringUTFChars(str, nullptr);
+        res->value.tag = HOST_TAG_STRING;
+        res->value.str = res->chars;
+        res->value.len = res->chars ? (uint32_t)strlen(res->chars) : 0;
+        return true;
     }
-    return JS_UNDEFINED;
+    
+    uint32_t offset = 0;
+    if (!host_call_read(&g_call_buf, &offset, &res->value)) res->value.tag = HOST_TAG_UNDEFINED;
+    return true;
 }
 
-static bool call_host_bool(JSContext *ctx, const char *func, int argc, JSValueConst *argv) {
-    JSValue args[10];
-    args[0] = JS_NewString(ctx, func);
-    for (int i = 0; i < argc && i < 9; i++) {
-        args[i + 1] = JS_DupValue(ctx, argv[i]);
+// Pack argv into the shared buffer and invoke the host
+static bool host_invoke(JSContext *ctx, int fid, int argc, JSValueConst *argv, HostResult *res) {
+    memset(res, 0, sizeof(*res));
+    host_call_reset(&g_call_buf);
+    if (!host_call_put_values(ctx, &g_call_buf, argc, argv)) {
+        LOGE("host call %d: arguments too large", fid);
+        return false;
     }
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, argc + 1, args);
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    for (int i = 0; i <= argc && i < 10; i++) JS_FreeValue(ctx, args[i]);
+    return host_dispatch(fid, argc, res);
+}
+
+static JSValue call_host(JSContext *ctx, int fid, int argc, JSValueConst *argv) {
+    HostResult res;
+    if (!host_invoke(ctx, fid, argc, argv, &res)) return JS_UNDEFINED;
+    JSValue ret = host_value_to_js(ctx, &res.value);
+    host_result_free(&res);
+    return ret;
+}
+
+static bool call_host_bool(JSContext *ctx, int fid, int argc, JSValueConst *argv) {
+    HostResult res;
+    if (!host_invoke(ctx, fid, argc, argv, &res)) return false;
+    bool ret = host_value_to_bool(&res.value);
+    host_result_free(&res);
+    return ret;
+}
+
+static int32_t call_host_int(JSContext *ctx, int fid, int argc, JSValueConst *argv) {
+    HostResult res;
+    if (!host_invoke(ctx, fid, argc, argv, &res)) return 0;
+    int32_t ret = host_value_to_int(&res.value);
+    host_result_free(&res);
+    return ret;
+}
+
+// Host result decoded as JSON; legacy string results are parsed too.
+// Empty and "null" results map to null.
+static JSValue host_result_json(JSContext *ctx, HostResult *res) {
+    if (res->value.tag != HOST_TAG_STRING && res->value.tag != HOST_TAG_JSON) {
+        return host_value_to_js(ctx, &res->value);
+    }
+    if (res->value.len == 0 || (res->value.len == 4 && memcmp(res->value.str, "null", 4) == 0)) {
+        return JS_NULL;
+    }
+    res->value.tag = HOST_TAG_JSON;
+    JSValue ret = host_value_to_js(ctx, &res->value);
+    if (JS_IsException(ret)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        ret = JS_NULL;
+    }
+    return ret;
+}
+
+static JSValue call_host_json(JSContext *ctx, int fid, int argc, JSValueConst *argv) {
+    HostResult res;
+    if (!host_invoke(ctx, fid, argc, argv, &res)) return JS_NULL;
+    JSValue ret = host_result_json(ctx, &res);
+    host_result_free(&res);
     return ret;
 }
 
+// __callHost(name, ...args): untyped escape hatch, the host resolves the name
+static JSValue js_call_host(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    if (argc < 1) return JS_UNDEFINED;
+    return call_host(ctx, HF_DYNAMIC, argc, argv);
+}
+
 // ==================== Console ====================
 
 // 日志回调函数指针
@@ -277,7 +453,7 @@ static JSValue js_exit(JSContext *ctx, JSValueConst this_val, int argc, JSValueC
 
 static JSValue js_toast(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_UNDEFINED;
-    call_host_bool(ctx, "toast", argc, argv);
+    call_host_bool(ctx, HF_TOAST, argc, argv);
     return JS_UNDEFINED;
 }
 
@@ -285,643 +461,460 @@ static JSValue js_toast(JSContext *ctx, JSValueConst this_val, int argc, JSValue
 
 static JSValue js_setClip(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "setClip", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SET_CLIP, argc, argv));
 }
 
 static JSValue js_getClip(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "getClip") };
-    JSValue r = js_call_host(ctx, this_val, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    return r;
+    return call_host(ctx, HF_GET_CLIP, 0, nullptr);
 }
 
 // ==================== Gestures ====================
 
 static JSValue js_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 2) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "click", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_CLICK, argc, argv));
 }
 
 static JSValue js_longClick(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 2) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "longClick", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_LONG_CLICK, argc, argv));
 }
 
 static JSValue js_press(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 3) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "press", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_PRESS, argc, argv));
 }
 
 static JSValue js_swipe(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 4) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "swipe", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SWIPE, argc, argv));
 }
 
 static JSValue js_swipeUp(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "swipeUp", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SWIPE_UP, 0, nullptr));
 }
 
 static JSValue js_swipeDown(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "swipeDown", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SWIPE_DOWN, 0, nullptr));
 }
 
 static JSValue js_swipeLeft(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "swipeLeft", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SWIPE_LEFT, 0, nullptr));
 }
 
 static JSValue js_swipeRight(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "swipeRight", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_SWIPE_RIGHT, 0, nullptr));
 }
 
 // ==================== Global Actions ====================
 
 static JSValue js_back(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "back", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_BACK, 0, nullptr));
 }
 
 static JSValue js_home(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "home", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_HOME, 0, nullptr));
 }
 
 static JSValue js_recents(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "recents", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_RECENTS, 0, nullptr));
 }
 
 static JSValue js_notifications(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "notifications", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_NOTIFICATIONS, 0, nullptr));
 }
 
 static JSValue js_quickSettings(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "quickSettings", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_QUICK_SETTINGS, 0, nullptr));
 }
 
 // ==================== UI Selector Implementation ====================
 
-// Forward declarations
-static JSValue js_selector_findOne(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_findAll(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_waitFor(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_exists(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_setText(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+// Conditions live in a native Selector (ui_selector.h); chain methods append
+// to it and return the same object, action methods send its cached binary
+// encoding to the host.
+static JSClassID js_selector_class_id;
 
-// Add condition to selector and return the same selector (chainable)
-static JSValue selector_add_condition(JSContext *ctx, JSValueConst selector, const char *type, const char *value) {
-    JSValue conditions = JS_GetPropertyStr(ctx, selector, "_conditions");
-    JSValue lenVal = JS_GetPropertyStr(ctx, conditions, "length");
-    int32_t len = 0;
-    JS_ToInt32(ctx, &len, lenVal);
-    JS_FreeValue(ctx, lenVal);
-    
-    JSValue cond = JS_NewObject(ctx);
-    JS_SetPropertyStr(ctx, cond, "type", JS_NewString(ctx, type));
-    JS_SetPropertyStr(ctx, cond, "value", JS_NewString(ctx, value));
-    JS_SetPropertyUint32(ctx, conditions, len, cond);
-    JS_FreeValue(ctx, conditions);
-    
-    return JS_DupValue(ctx, selector);
+static void js_selector_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<Selector *>(JS_GetOpaque(val, js_selector_class_id));
 }
 
-// Chain method template
-#define SELECTOR_CHAIN_METHOD(name, condType) \
-static JSValue js_selector_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
-    if (argc < 1) return JS_DupValue(ctx, this_val); \
-    const char *str = JS_ToCString(ctx, argv[0]); \
-    JSValue ret = selector_add_condition(ctx, this_val, condType, str ? str : ""); \
-    if (str) JS_FreeCString(ctx, str); \
-    return ret; \
-}
-
-SELECTOR_CHAIN_METHOD(text_chain, "text")
-SELECTOR_CHAIN_METHOD(textContains_chain, "textContains")
-SELECTOR_CHAIN_METHOD(textStartsWith_chain, "textStartsWith")
-SELECTOR_CHAIN_METHOD(textEndsWith_chain, "textEndsWith")
-SELECTOR_CHAIN_METHOD(textMatches_chain, "textMatches")
-SELECTOR_CHAIN_METHOD(desc_chain, "desc")
-SELECTOR_CHAIN_METHOD(descContains_chain, "descContains")
-SELECTOR_CHAIN_METHOD(descStartsWith_chain, "descStartsWith")
-SELECTOR_CHAIN_METHOD(descEndsWith_chain, "descEndsWith")
-SELECTOR_CHAIN_METHOD(descMatches_chain, "descMatches")
-SELECTOR_CHAIN_METHOD(id_chain, "id")
-SELECTOR_CHAIN_METHOD(idContains_chain, "idContains")
-SELECTOR_CHAIN_METHOD(idStartsWith_chain, "idStartsWith")
-SELECTOR_CHAIN_METHOD(idEndsWith_chain, "idEndsWith")
-SELECTOR_CHAIN_METHOD(idMatches_chain, "idMatches")
-SELECTOR_CHAIN_METHOD(className_chain, "className")
-SELECTOR_CHAIN_METHOD(classNameContains_chain, "classNameContains")
-SELECTOR_CHAIN_METHOD(classNameStartsWith_chain, "classNameStartsWith")
-SELECTOR_CHAIN_METHOD(classNameEndsWith_chain, "classNameEndsWith")
-SELECTOR_CHAIN_METHOD(classNameMatches_chain, "classNameMatches")
-SELECTOR_CHAIN_METHOD(packageName_chain, "packageName")
-SELECTOR_CHAIN_METHOD(packageNameContains_chain, "packageNameContains")
-SELECTOR_CHAIN_METHOD(packageNameStartsWith_chain, "packageNameStartsWith")
-SELECTOR_CHAIN_METHOD(packageNameEndsWith_chain, "packageNameEndsWith")
+static JSClassDef js_selector_class = {
+    "UiSelector",
+    .finalizer = js_selector_finalizer,
+};
 
-static JSValue js_selector_clickable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "clickable", val ? "true" : "false");
+static Selector *selector_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<Selector *>(JS_GetOpaque2(ctx, this_val, js_selector_class_id));
 }
 
-static JSValue js_selector_scrollable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "scrollable", val ? "true" : "false");
+static JSValue selector_new(JSContext *ctx) {
+    JSValue obj = JS_NewObjectClass(ctx, js_selector_class_id);
+    if (JS_IsException(obj)) return obj;
+    Selector *sel = new Selector();
+    sel->regexes = g_regex_cache;
+    JS_SetOpaque(obj, sel);
+    return obj;
 }
 
-static JSValue js_selector_enabled_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "enabled", val ? "true" : "false");
+// textMatches(/\d+ sold/i) - add a RegExp literal's source and flags.
+// Returns 0 if value is not a RegExp, -1 on exception, 1 once added.
+static int selector_add_regexp(JSContext *ctx, Selector *sel, int op, JSValueConst value) {
+    if (!JS_IsObject(value)) return 0;
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue ctor = JS_GetPropertyStr(ctx, global, "RegExp");
+    int is_regexp = JS_IsInstanceOf(ctx, value, ctor);
+    JS_FreeValue(ctx, ctor);
+    JS_FreeValue(ctx, global);
+    if (is_regexp <= 0) return is_regexp;
+
+    JSValue source = JS_GetPropertyStr(ctx, value, "source");
+    JSValue flags = JS_GetPropertyStr(ctx, value, "flags");
+    size_t source_len = 0, flags_len = 0;
+    const char *source_str = JS_ToCStringLen(ctx, &source_len, source);
+    const char *flags_str = source_str ? JS_ToCStringLen(ctx, &flags_len, flags) : nullptr;
+    int ret = -1;
+    if (flags_str) {
+        selector_add_regex(sel, op, source_str, source_len, selector_regex_flags(flags_str, flags_len));
+        ret = 1;
+    }
+    JS_FreeCString(ctx, source_str);
+    JS_FreeCString(ctx, flags_str);
+    JS_FreeValue(ctx, source);
+    JS_FreeValue(ctx, flags);
+    return ret;
 }
 
-static JSValue js_selector_checked_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "checked", val ? "true" : "false");
+// Append the condition described by op (the function's magic) from argv[0].
+// Returns false only if argument conversion threw.
+static bool selector_add_arg(JSContext *ctx, Selector *sel, int op, int argc, JSValueConst *argv) {
+    switch (selector_op_arg(op)) {
+    case SEL_ARG_STRING:
+    case SEL_ARG_REGEX: {
+        if (argc < 1) return true;
+        if (selector_op_arg(op) == SEL_ARG_REGEX) {
+            int added = selector_add_regexp(ctx, sel, op, argv[0]);
+            if (added != 0) return added > 0;
+        }
+        size_t len = 0;
+        const char *str = JS_ToCStringLen(ctx, &len, argv[0]);
+        if (!str) return false;
+        selector_add_string(sel, op, str, len);
+        JS_FreeCString(ctx, str);
+        return true;
+    }
+    case SEL_ARG_BOOL:
+        selector_add_int(sel, op, argc < 1 || JS_ToBool(ctx, argv[0]));
+        return true;
+    case SEL_ARG_INT: {
+        if (argc < 1) return true;
+        int32_t v = 0;
+        if (JS_ToInt32(ctx, &v, argv[0])) return false;
+        selector_add_int(sel, op, v);
+        return true;
+    }
+    case SEL_ARG_RECT:
+    case SEL_ARG_POINT: {
+        int n = selector_op_arg(op) == SEL_ARG_RECT ? 4 : 2;
+        if (argc < n) return true;
+        int32_t r[4];
+        for (int i = 0; i < n; i++) {
+            if (JS_ToInt32(ctx, &r[i], argv[i])) return false;
+        }
+        if (n == 2) selector_add_rect(sel, op, r[0], r[1], r[0], r[1]);
+        else selector_add_rect(sel, op, r[0], r[1], r[2], r[3]);
+        return true;
+    }
+    case SEL_ARG_SELECTOR: {
+        if (argc < 1) return true;
+        Selector *sub = static_cast<Selector *>(JS_GetOpaque2(ctx, argv[0], js_selector_class_id));
+        if (!sub) return false;
+        selector_add_selector(sel, op, *sub);
+        return true;
+    }
+    }
+    return true;
 }
 
-static JSValue js_selector_selected_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "selected", val ? "true" : "false");
+// Selector.text(...)/clickable(...)/depth(...) etc. - chainable
+static JSValue js_selector_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int op) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    if (!selector_add_arg(ctx, sel, op, argc, argv)) return JS_EXCEPTION;
+    return JS_DupValue(ctx, this_val);
 }
 
-static JSValue js_selector_focusable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "focusable", val ? "true" : "false");
+// Global text(...)/clickable(...)/depth(...) etc. - start a new selector
+static JSValue js_selector_start(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int op) {
+    JSValue obj = selector_new(ctx);
+    if (JS_IsException(obj)) return obj;
+    if (!selector_add_arg(ctx, static_cast<Selector *>(JS_GetOpaque(obj, js_selector_class_id)), op, argc, argv)) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    return obj;
 }
 
-static JSValue js_selector_focused_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "focused", val ? "true" : "false");
-}
+// ==================== UiObject Class ====================
 
-static JSValue js_selector_longClickable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "longClickable", val ? "true" : "false");
-}
+struct UiFlagName {
+    const char *name;
+    uint32_t flag;
+};
 
-static JSValue js_selector_checkable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "checkable", val ? "true" : "false");
-}
+static const UiFlagName g_ui_flag_names[] = {
+    { "clickable", UI_FLAG_CLICKABLE },
+    { "longClickable", UI_FLAG_LONG_CLICKABLE },
+    { "scrollable", UI_FLAG_SCROLLABLE },
+    { "enabled", UI_FLAG_ENABLED },
+    { "checked", UI_FLAG_CHECKED },
+    { "selected", UI_FLAG_SELECTED },
+    { "focusable", UI_FLAG_FOCUSABLE },
+    { "focused", UI_FLAG_FOCUSED },
+    { "checkable", UI_FLAG_CHECKABLE },
+    { "editable", UI_FLAG_EDITABLE },
+    { "visibleToUser", UI_FLAG_VISIBLE_TO_USER },
+};
 
-static JSValue js_selector_editable_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "editable", val ? "true" : "false");
-}
+// Node actions resolved on the host through the node handle, mirrors
+// UiSnapshot.ACTION_* in UiSnapshot.kt
+enum {
+    UI_ACTION_CLICK,
+    UI_ACTION_LONG_CLICK,
+    UI_ACTION_SET_TEXT,
+    UI_ACTION_SCROLL_FORWARD,
+    UI_ACTION_SCROLL_BACKWARD,
+};
 
-static JSValue js_selector_visibleToUser_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    return selector_add_condition(ctx, this_val, "visibleToUser", val ? "true" : "false");
+// A UiObject is a handle to one node of a snapshot: the snapshot generation
+// plus the node index. It keeps its snapshot alive, so properties and tree
+// navigation are plain array lookups. Methods live on one shared prototype
+// per context, so creating a UiObject is a single small allocation.
+struct UiObjectData {
+    std::shared_ptr<const UiSnapshot> snap;
+    int32_t node;
+};
+
+static JSClassID js_uiobject_class_id;
+
+static void js_uiobject_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<UiObjectData *>(JS_GetOpaque(val, js_uiobject_class_id));
 }
 
-// Depth selector
-static JSValue js_selector_depth_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    if (argc < 1) return JS_DupValue(ctx, this_val);
-    int32_t depth = 0;
-    JS_ToInt32(ctx, &depth, argv[0]);
-    char buf[16];
-    snprintf(buf, 16, "%d", depth);
-    return selector_add_condition(ctx, this_val, "depth", buf);
+static JSClassDef js_uiobject_class = {
+    "UiObject",
+    .finalizer = js_uiobject_finalizer,
+};
+
+static UiObjectData *uiobject_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<UiObjectData *>(JS_GetOpaque2(ctx, this_val, js_uiobject_class_id));
 }
 
-// drawingOrder selector
-static JSValue js_selector_drawingOrder_chain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    if (argc < 1) return JS_DupValue(ctx, this_val);
-    int32_t order = 0;
-    JS_ToInt32(ctx, &order, argv[0]);
-    char buf[16];
-    snprintf(buf, 16, "%d", order);
-    return selector_add_condition(ctx, this_val, "drawingOrder", buf);
+static JSValue uiobject_new(JSContext *ctx, const std::shared_ptr<const UiSnapshot> &snap, int32_t node) {
+    JSValue obj = JS_NewObjectClass(ctx, js_uiobject_class_id);
+    if (JS_IsException(obj)) return obj;
+    JS_SetOpaque(obj, new UiObjectData{ snap, node });
+    return obj;
 }
 
-// Forward declarations for selector methods
-static JSValue js_selector_findOnce(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_longClick(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_scrollForward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
-static JSValue js_selector_scrollBackward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+static JSValue uiobject_array(JSContext *ctx, const std::shared_ptr<const UiSnapshot> &snap,
+                              const std::vector<int32_t> &nodes) {
+    JSValue ret = JS_NewArray(ctx);
+    for (size_t k = 0; k < nodes.size(); k++) {
+        JS_SetPropertyUint32(ctx, ret, (uint32_t)k, uiobject_new(ctx, snap, nodes[k]));
+    }
+    return ret;
+}
 
-// Create selector object with all methods
-static JSValue create_selector_object(JSContext *ctx) {
-    JSValue obj = JS_NewObject(ctx);
-    JS_SetPropertyStr(ctx, obj, "_conditions", JS_NewArray(ctx));
-    
-    // Text selectors
-    JS_SetPropertyStr(ctx, obj, "text", JS_NewCFunction(ctx, js_selector_text_chain, "text", 1));
-    JS_SetPropertyStr(ctx, obj, "textContains", JS_NewCFunction(ctx, js_selector_textContains_chain, "textContains", 1));
-    JS_SetPropertyStr(ctx, obj, "textStartsWith", JS_NewCFunction(ctx, js_selector_textStartsWith_chain, "textStartsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "textEndsWith", JS_NewCFunction(ctx, js_selector_textEndsWith_chain, "textEndsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "textMatches", JS_NewCFunction(ctx, js_selector_textMatches_chain, "textMatches", 1));
-    
-    // Desc selectors
-    JS_SetPropertyStr(ctx, obj, "desc", JS_NewCFunction(ctx, js_selector_desc_chain, "desc", 1));
-    JS_SetPropertyStr(ctx, obj, "descContains", JS_NewCFunction(ctx, js_selector_descContains_chain, "descContains", 1));
-    JS_SetPropertyStr(ctx, obj, "descStartsWith", JS_NewCFunction(ctx, js_selector_descStartsWith_chain, "descStartsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "descEndsWith", JS_NewCFunction(ctx, js_selector_descEndsWith_chain, "descEndsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "descMatches", JS_NewCFunction(ctx, js_selector_descMatches_chain, "descMatches", 1));
-    
-    // ID selectors
-    JS_SetPropertyStr(ctx, obj, "id", JS_NewCFunction(ctx, js_selector_id_chain, "id", 1));
-    JS_SetPropertyStr(ctx, obj, "idContains", JS_NewCFunction(ctx, js_selector_idContains_chain, "idContains", 1));
-    JS_SetPropertyStr(ctx, obj, "idStartsWith", JS_NewCFunction(ctx, js_selector_idStartsWith_chain, "idStartsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "idEndsWith", JS_NewCFunction(ctx, js_selector_idEndsWith_chain, "idEndsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "idMatches", JS_NewCFunction(ctx, js_selector_idMatches_chain, "idMatches", 1));
-    
-    // ClassName selectors
-    JS_SetPropertyStr(ctx, obj, "className", JS_NewCFunction(ctx, js_selector_className_chain, "className", 1));
-    JS_SetPropertyStr(ctx, obj, "classNameContains", JS_NewCFunction(ctx, js_selector_classNameContains_chain, "classNameContains", 1));
-    JS_SetPropertyStr(ctx, obj, "classNameStartsWith", JS_NewCFunction(ctx, js_selector_classNameStartsWith_chain, "classNameStartsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "classNameEndsWith", JS_NewCFunction(ctx, js_selector_classNameEndsWith_chain, "classNameEndsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "classNameMatches", JS_NewCFunction(ctx, js_selector_classNameMatches_chain, "classNameMatches", 1));
-    
-    // PackageName selectors
-    JS_SetPropertyStr(ctx, obj, "packageName", JS_NewCFunction(ctx, js_selector_packageName_chain, "packageName", 1));
-    JS_SetPropertyStr(ctx, obj, "packageNameContains", JS_NewCFunction(ctx, js_selector_packageNameContains_chain, "packageNameContains", 1));
-    JS_SetPropertyStr(ctx, obj, "packageNameStartsWith", JS_NewCFunction(ctx, js_selector_packageNameStartsWith_chain, "packageNameStartsWith", 1));
-    JS_SetPropertyStr(ctx, obj, "packageNameEndsWith", JS_NewCFunction(ctx, js_selector_packageNameEndsWith_chain, "packageNameEndsWith", 1));
-    
-    // Boolean property selectors
-    JS_SetPropertyStr(ctx, obj, "clickable", JS_NewCFunction(ctx, js_selector_clickable_chain, "clickable", 0));
-    JS_SetPropertyStr(ctx, obj, "scrollable", JS_NewCFunction(ctx, js_selector_scrollable_chain, "scrollable", 0));
-    JS_SetPropertyStr(ctx, obj, "enabled", JS_NewCFunction(ctx, js_selector_enabled_chain, "enabled", 0));
-    JS_SetPropertyStr(ctx, obj, "checked", JS_NewCFunction(ctx, js_selector_checked_chain, "checked", 0));
-    JS_SetPropertyStr(ctx, obj, "selected", JS_NewCFunction(ctx, js_selector_selected_chain, "selected", 0));
-    JS_SetPropertyStr(ctx, obj, "focusable", JS_NewCFunction(ctx, js_selector_focusable_chain, "focusable", 0));
-    JS_SetPropertyStr(ctx, obj, "focused", JS_NewCFunction(ctx, js_selector_focused_chain, "focused", 0));
-    JS_SetPropertyStr(ctx, obj, "longClickable", JS_NewCFunction(ctx, js_selector_longClickable_chain, "longClickable", 0));
-    JS_SetPropertyStr(ctx, obj, "checkable", JS_NewCFunction(ctx, js_selector_checkable_chain, "checkable", 0));
-    JS_SetPropertyStr(ctx, obj, "editable", JS_NewCFunction(ctx, js_selector_editable_chain, "editable", 0));
-    JS_SetPropertyStr(ctx, obj, "visibleToUser", JS_NewCFunction(ctx, js_selector_visibleToUser_chain, "visibleToUser", 0));
-    
-    // Depth and drawingOrder selectors
-    JS_SetPropertyStr(ctx, obj, "depth", JS_NewCFunction(ctx, js_selector_depth_chain, "depth", 1));
-    JS_SetPropertyStr(ctx, obj, "drawingOrder", JS_NewCFunction(ctx, js_selector_drawingOrder_chain, "drawingOrder", 1));
-    
-    // Finder methods
-    JS_SetPropertyStr(ctx, obj, "findOne", JS_NewCFunction(ctx, js_selector_findOne, "findOne", 0));
-    JS_SetPropertyStr(ctx, obj, "findOnce", JS_NewCFunction(ctx, js_selector_findOnce, "findOnce", 1));
-    JS_SetPropertyStr(ctx, obj, "findAll", JS_NewCFunction(ctx, js_selector_findAll, "findAll", 0));
-    JS_SetPropertyStr(ctx, obj, "find", JS_NewCFunction(ctx, js_selector_findAll, "find", 0));
-    JS_SetPropertyStr(ctx, obj, "waitFor", JS_NewCFunction(ctx, js_selector_waitFor, "waitFor", 1));
-    JS_SetPropertyStr(ctx, obj, "exists", JS_NewCFunction(ctx, js_selector_exists, "exists", 0));
-    JS_SetPropertyStr(ctx, obj, "click", JS_NewCFunction(ctx, js_selector_click, "click", 0));
-    JS_SetPropertyStr(ctx, obj, "longClick", JS_NewCFunction(ctx, js_selector_longClick, "longClick", 0));
-    JS_SetPropertyStr(ctx, obj, "setText", JS_NewCFunction(ctx, js_selector_setText, "setText", 1));
-    JS_SetPropertyStr(ctx, obj, "scrollForward", JS_NewCFunction(ctx, js_selector_scrollForward, "scrollForward", 0));
-    JS_SetPropertyStr(ctx, obj, "scrollBackward", JS_NewCFunction(ctx, js_selector_scrollBackward, "scrollBackward", 0));
-    
-    return obj;
+// Direct children of a node: in pre-order the first child follows its
+// parent and each next sibling starts where the previous subtree ends
+static void snapshot_children(const UiSnapshot &s, int32_t node, std::vector<int32_t> *out) {
+    for (int32_t c = node + 1; c < s.subtreeEnd[node]; c = s.subtreeEnd[c]) out->push_back(c);
 }
 
-// Serialize conditions to JSON
-static char* serialize_conditions(JSContext *ctx, JSValueConst selector) {
-    JSValue conditions = JS_GetPropertyStr(ctx, selector, "_conditions");
-    JSValue json = JS_JSONStringify(ctx, conditions, JS_UNDEFINED, JS_UNDEFINED);
-    const char *str = JS_ToCString(ctx, json);
-    char *result = str ? strdup(str) : strdup("[]");
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, json);
-    JS_FreeValue(ctx, conditions);
-    return result;
+static JSValue uiobject_bounds_object(JSContext *ctx, const UiObjectData *d) {
+    const UiSnapshot &s = *d->snap;
+    int32_t i = d->node;
+    JSValue bounds = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, bounds, "left", JS_NewInt32(ctx, s.left[i]));
+    JS_SetPropertyStr(ctx, bounds, "top", JS_NewInt32(ctx, s.top[i]));
+    JS_SetPropertyStr(ctx, bounds, "right", JS_NewInt32(ctx, s.right[i]));
+    JS_SetPropertyStr(ctx, bounds, "bottom", JS_NewInt32(ctx, s.bottom[i]));
+    JS_SetPropertyStr(ctx, bounds, "centerX", JS_NewInt32(ctx, (s.left[i] + s.right[i]) / 2));
+    JS_SetPropertyStr(ctx, bounds, "centerY", JS_NewInt32(ctx, (s.top[i] + s.bottom[i]) / 2));
+    return bounds;
 }
 
-// Forward declarations
-static void add_uiobject_methods(JSContext *ctx, JSValue obj);
-static JSValue create_uiobject(JSContext *ctx, const char *json);
+// Perform an action on the host node behind a handle. Fails if the host no
+// longer retains that snapshot.
+static bool snapshot_node_action(JSContext *ctx, const UiSnapshot &snap, int32_t node, int action, JSValueConst text) {
+    JSValue args[4] = {
+        JS_NewInt32(ctx, (int32_t)snap.generation), JS_NewInt32(ctx, node), JS_NewInt32(ctx, action), text,
+    };
+    return call_host_bool(ctx, HF_UIOBJECT_ACTION, JS_IsUndefined(text) ? 3 : 4, args);
+}
 
 // UiObject.click()
 static JSValue js_uiobject_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    if (!JS_IsObject(bounds)) { JS_FreeValue(ctx, bounds); return JS_FALSE; }
-    
-    JSValue left = JS_GetPropertyStr(ctx, bounds, "left");
-    JSValue right = JS_GetPropertyStr(ctx, bounds, "right");
-    JSValue top = JS_GetPropertyStr(ctx, bounds, "top");
-    JSValue bottom = JS_GetPropertyStr(ctx, bounds, "bottom");
-    
-    int32_t l, r, t, b;
-    JS_ToInt32(ctx, &l, left); JS_ToInt32(ctx, &r, right);
-    JS_ToInt32(ctx, &t, top); JS_ToInt32(ctx, &b, bottom);
-    
-    JS_FreeValue(ctx, left); JS_FreeValue(ctx, right);
-    JS_FreeValue(ctx, top); JS_FreeValue(ctx, bottom);
-    JS_FreeValue(ctx, bounds);
-    
-    int cx = (l + r) / 2, cy = (t + b) / 2;
-    char cx_str[16], cy_str[16];
-    snprintf(cx_str, 16, "%d", cx);
-    snprintf(cy_str, 16, "%d", cy);
-    
-    JSValue args[2] = { JS_NewString(ctx, cx_str), JS_NewString(ctx, cy_str) };
-    bool ret = call_host_bool(ctx, "click", 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    return JS_NewBool(ctx, ret);
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    const UiSnapshot &s = *d->snap;
+    JSValue args[2] = { JS_NewInt32(ctx, (s.left[d->node] + s.right[d->node]) / 2),
+                        JS_NewInt32(ctx, (s.top[d->node] + s.bottom[d->node]) / 2) };
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_CLICK, 2, args));
 }
 
 // UiObject.setText()
 static JSValue js_uiobject_setText(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
     if (argc < 1) return JS_FALSE;
-    js_uiobject_click(ctx, this_val, 0, nullptr);
-    usleep(100000);
-    return JS_NewBool(ctx, call_host_bool(ctx, "setText", argc, argv));
-}
-
-// UiObject.text()
-static JSValue js_uiobject_text(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "_text");
-}
-
-// UiObject.id()
-static JSValue js_uiobject_id(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "_id");
+    JSValue text = JS_ToString(ctx, argv[0]);
+    if (JS_IsException(text)) return text;
+    bool ret = snapshot_node_action(ctx, *d->snap, d->node, UI_ACTION_SET_TEXT, text);
+    JS_FreeValue(ctx, text);
+    return JS_NewBool(ctx, ret);
 }
 
-// UiObject.className()
-static JSValue js_uiobject_className(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "_className");
+// UiObject string getters: text()/id()/className()/desc()/packageName()
+#define UIOBJECT_STRING_GETTER(name, field) \
+static JSValue js_uiobject_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
+    UiObjectData *d = uiobject_get(ctx, this_val); \
+    if (!d) return JS_EXCEPTION; \
+    std::string_view s = d->snap->str(d->snap->field[d->node]); \
+    return JS_NewStringLen(ctx, s.data(), s.size()); \
 }
 
-// UiObject.desc()
-static JSValue js_uiobject_desc(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "_desc");
-}
-
-// UiObject.packageName()
-static JSValue js_uiobject_packageName(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "_packageName");
-}
+UIOBJECT_STRING_GETTER(text, text)
+UIOBJECT_STRING_GETTER(id, id)
+UIOBJECT_STRING_GETTER(className, className)
+UIOBJECT_STRING_GETTER(desc, desc)
+UIOBJECT_STRING_GETTER(packageName, packageName)
 
 // UiObject.bounds()
 static JSValue js_uiobject_bounds(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "bounds");
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return uiobject_bounds_object(ctx, d);
 }
 
 // UiObject.parent()
 static JSValue js_uiobject_parent(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    JSValue args[2] = { JS_NewString(ctx, "uiobject.parent"), JS_NewString(ctx, boundsStr ? boundsStr : "{}") };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    JSValue uiobj = create_uiobject(ctx, str);
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return uiobj;
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    int32_t p = d->snap->parent[d->node];
+    return p < 0 ? JS_NULL : uiobject_new(ctx, d->snap, p);
 }
 
 // UiObject.children()
 static JSValue js_uiobject_children(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    JSValue args[2] = { JS_NewString(ctx, "uiobject.children"), JS_NewString(ctx, boundsStr ? boundsStr : "{}") };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    JS_FreeValue(ctx, result);
-    if (!str || !*str) return JS_NewArray(ctx);
-    
-    JSValue arr = JS_ParseJSON(ctx, str, strlen(str), "<children>");
-    JS_FreeCString(ctx, str);
-    if (!JS_IsArray(ctx, arr)) return JS_NewArray(ctx);
-    
-    // Add methods to each child
-    JSValue lenVal = JS_GetPropertyStr(ctx, arr, "length");
-    int32_t len = 0; JS_ToInt32(ctx, &len, lenVal);
-    JS_FreeValue(ctx, lenVal);
-    for (int i = 0; i < len; i++) {
-        JSValue item = JS_GetPropertyUint32(ctx, arr, i);
-        add_uiobject_methods(ctx, item);
-        JS_SetPropertyUint32(ctx, arr, i, item);
-    }
-    return arr;
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    std::vector<int32_t> children;
+    snapshot_children(*d->snap, d->node, &children);
+    return uiobject_array(ctx, d->snap, children);
 }
 
-// UiObject.find() - find in subtree
+// UiObject.find(selector) - matches in this node's subtree, itself included
 static JSValue js_uiobject_find(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    // Get selector conditions from argument
-    const char *selectorJson = "[]";
-    if (argc > 0) {
-        JSValue conditions = JS_GetPropertyStr(ctx, argv[0], "_conditions");
-        if (!JS_IsUndefined(conditions)) {
-            JSValue json = JS_JSONStringify(ctx, conditions, JS_UNDEFINED, JS_UNDEFINED);
-            selectorJson = JS_ToCString(ctx, json);
-            JS_FreeValue(ctx, json);
-        }
-        JS_FreeValue(ctx, conditions);
-    }
-    
-    JSValue args[3] = { 
-        JS_NewString(ctx, "uiobject.find"), 
-        JS_NewString(ctx, boundsStr ? boundsStr : "{}"),
-        JS_NewString(ctx, selectorJson ? selectorJson : "[]")
-    };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    JS_FreeValue(ctx, result);
-    if (!str || !*str) return JS_NewArray(ctx);
-    
-    JSValue arr = JS_ParseJSON(ctx, str, strlen(str), "<find>");
-    JS_FreeCString(ctx, str);
-    if (!JS_IsArray(ctx, arr)) return JS_NewArray(ctx);
-    
-    // Add methods to each item
-    JSValue lenVal = JS_GetPropertyStr(ctx, arr, "length");
-    int32_t len = 0; JS_ToInt32(ctx, &len, lenVal);
-    JS_FreeValue(ctx, lenVal);
-    for (int i = 0; i < len; i++) {
-        JSValue item = JS_GetPropertyUint32(ctx, arr, i);
-        add_uiobject_methods(ctx, item);
-        JS_SetPropertyUint32(ctx, arr, i, item);
-    }
-    return arr;
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    Selector *sel = static_cast<Selector *>(JS_GetOpaque2(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, js_selector_class_id));
+    if (!sel) return JS_EXCEPTION;
+
+    std::vector<int32_t> found;
+    selector_find(sel, *d->snap, d->node, d->snap->subtreeEnd[d->node], 0, &found);
+    return ui_collection_new(ctx, d->snap, std::move(found));
 }
 
 // UiObject.content() - desc() || text()
 static JSValue js_uiobject_content(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue desc = JS_GetPropertyStr(ctx, this_val, "_desc");
-    const char *descStr = JS_ToCString(ctx, desc);
-    if (descStr && strlen(descStr) > 0) {
-        JS_FreeValue(ctx, desc);
-        return JS_NewString(ctx, descStr);
-    }
-    if (descStr) JS_FreeCString(ctx, descStr);
-    JS_FreeValue(ctx, desc);
-    return JS_GetPropertyStr(ctx, this_val, "_text");
-}
-
-// UiObject.childCount()
-static JSValue js_uiobject_childCount(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_GetPropertyStr(ctx, this_val, "childCount");
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    const UiSnapshot &s = *d->snap;
+    std::string_view v = s.str(s.desc[d->node]);
+    if (v.empty()) v = s.str(s.text[d->node]);
+    return JS_NewStringLen(ctx, v.data(), v.size());
 }
 
-// UiObject.indexInParent()
-static JSValue js_uiobject_indexInParent(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue idx = JS_GetPropertyStr(ctx, this_val, "_indexInParent");
-    if (JS_IsUndefined(idx)) return JS_NewInt32(ctx, -1);
-    return idx;
+// UiObject integer getters: childCount()/indexInParent()/depth()/drawingOrder()
+#define UIOBJECT_INT_GETTER(name, field) \
+static JSValue js_uiobject_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
+    UiObjectData *d = uiobject_get(ctx, this_val); \
+    if (!d) return JS_EXCEPTION; \
+    return JS_NewInt32(ctx, d->snap->field[d->node]); \
 }
 
-// UiObject.depth()
-static JSValue js_uiobject_depth(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue d = JS_GetPropertyStr(ctx, this_val, "_depth");
-    if (JS_IsUndefined(d)) return JS_NewInt32(ctx, 0);
-    return d;
-}
+UIOBJECT_INT_GETTER(childCount, childCount)
+UIOBJECT_INT_GETTER(indexInParent, indexInParent)
+UIOBJECT_INT_GETTER(depth, depth)
+UIOBJECT_INT_GETTER(drawingOrder, drawingOrder)
 
-// UiObject.drawingOrder()
-static JSValue js_uiobject_drawingOrder(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue d = JS_GetPropertyStr(ctx, this_val, "_drawingOrder");
-    if (JS_IsUndefined(d)) return JS_NewInt32(ctx, 0);
-    return d;
+// UiObject.identity() - the node's structural identity (ui_snapshot.h) as a
+// BigInt, the same for this view in later snapshots
+static JSValue js_uiobject_identity(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return JS_NewBigUint64(ctx, ui_snapshot_identities(*d->snap)[d->node]);
 }
 
 // UiObject boolean property getters
-#define UIOBJECT_BOOL_GETTER(name, propName) \
+#define UIOBJECT_BOOL_GETTER(name, flag) \
 static JSValue js_uiobject_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
-    JSValue val = JS_GetPropertyStr(ctx, this_val, propName); \
-    if (JS_IsUndefined(val)) return JS_FALSE; \
-    return val; \
-}
-
-UIOBJECT_BOOL_GETTER(clickable, "clickable")
-UIOBJECT_BOOL_GETTER(longClickable, "longClickable")
-UIOBJECT_BOOL_GETTER(scrollable, "scrollable")
-UIOBJECT_BOOL_GETTER(enabled, "enabled")
-UIOBJECT_BOOL_GETTER(checked, "checked")
-UIOBJECT_BOOL_GETTER(selected, "selected")
-UIOBJECT_BOOL_GETTER(focusable, "focusable")
-UIOBJECT_BOOL_GETTER(focused, "focused")
-UIOBJECT_BOOL_GETTER(checkable, "checkable")
-UIOBJECT_BOOL_GETTER(editable, "editable")
-UIOBJECT_BOOL_GETTER(visibleToUser, "visibleToUser")
+    UiObjectData *d = uiobject_get(ctx, this_val); \
+    if (!d) return JS_EXCEPTION; \
+    return JS_NewBool(ctx, (d->snap->flags[d->node] & flag) != 0); \
+}
+
+UIOBJECT_BOOL_GETTER(clickable, UI_FLAG_CLICKABLE)
+UIOBJECT_BOOL_GETTER(longClickable, UI_FLAG_LONG_CLICKABLE)
+UIOBJECT_BOOL_GETTER(scrollable, UI_FLAG_SCROLLABLE)
+UIOBJECT_BOOL_GETTER(enabled, UI_FLAG_ENABLED)
+UIOBJECT_BOOL_GETTER(checked, UI_FLAG_CHECKED)
+UIOBJECT_BOOL_GETTER(selected, UI_FLAG_SELECTED)
+UIOBJECT_BOOL_GETTER(focusable, UI_FLAG_FOCUSABLE)
+UIOBJECT_BOOL_GETTER(focused, UI_FLAG_FOCUSED)
+UIOBJECT_BOOL_GETTER(checkable, UI_FLAG_CHECKABLE)
+UIOBJECT_BOOL_GETTER(editable, UI_FLAG_EDITABLE)
+UIOBJECT_BOOL_GETTER(visibleToUser, UI_FLAG_VISIBLE_TO_USER)
 
 // UiObject.boundsLeft/Top/Right/Bottom/Width/Height/CenterX/CenterY
-static JSValue js_uiobject_boundsLeft(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue left = JS_GetPropertyStr(ctx, bounds, "left");
-    JS_FreeValue(ctx, bounds);
-    return left;
-}
-static JSValue js_uiobject_boundsTop(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue top = JS_GetPropertyStr(ctx, bounds, "top");
-    JS_FreeValue(ctx, bounds);
-    return top;
-}
-static JSValue js_uiobject_boundsRight(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue right = JS_GetPropertyStr(ctx, bounds, "right");
-    JS_FreeValue(ctx, bounds);
-    return right;
-}
-static JSValue js_uiobject_boundsBottom(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue bottom = JS_GetPropertyStr(ctx, bounds, "bottom");
-    JS_FreeValue(ctx, bounds);
-    return bottom;
-}
-static JSValue js_uiobject_boundsWidth(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue left = JS_GetPropertyStr(ctx, bounds, "left");
-    JSValue right = JS_GetPropertyStr(ctx, bounds, "right");
-    int32_t l, r;
-    JS_ToInt32(ctx, &l, left); JS_ToInt32(ctx, &r, right);
-    JS_FreeValue(ctx, left); JS_FreeValue(ctx, right); JS_FreeValue(ctx, bounds);
-    return JS_NewInt32(ctx, r - l);
-}
-static JSValue js_uiobject_boundsHeight(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue top = JS_GetPropertyStr(ctx, bounds, "top");
-    JSValue bottom = JS_GetPropertyStr(ctx, bounds, "bottom");
-    int32_t t, b;
-    JS_ToInt32(ctx, &t, top); JS_ToInt32(ctx, &b, bottom);
-    JS_FreeValue(ctx, top); JS_FreeValue(ctx, bottom); JS_FreeValue(ctx, bounds);
-    return JS_NewInt32(ctx, b - t);
-}
-static JSValue js_uiobject_boundsCenterX(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue cx = JS_GetPropertyStr(ctx, bounds, "centerX");
-    JS_FreeValue(ctx, bounds);
-    return cx;
-}
-static JSValue js_uiobject_boundsCenterY(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue cy = JS_GetPropertyStr(ctx, bounds, "centerY");
-    JS_FreeValue(ctx, bounds);
-    return cy;
-}
+#define UIOBJECT_BOUNDS_GETTER(name, expr) \
+static JSValue js_uiobject_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
+    UiObjectData *d = uiobject_get(ctx, this_val); \
+    if (!d) return JS_EXCEPTION; \
+    const UiSnapshot &s = *d->snap; \
+    int32_t i = d->node; \
+    return JS_NewInt32(ctx, expr); \
+}
+
+UIOBJECT_BOUNDS_GETTER(boundsLeft, s.left[i])
+UIOBJECT_BOUNDS_GETTER(boundsTop, s.top[i])
+UIOBJECT_BOUNDS_GETTER(boundsRight, s.right[i])
+UIOBJECT_BOUNDS_GETTER(boundsBottom, s.bottom[i])
+UIOBJECT_BOUNDS_GETTER(boundsWidth, s.right[i] - s.left[i])
+UIOBJECT_BOUNDS_GETTER(boundsHeight, s.bottom[i] - s.top[i])
+UIOBJECT_BOUNDS_GETTER(boundsCenterX, (s.left[i] + s.right[i]) / 2)
+UIOBJECT_BOUNDS_GETTER(boundsCenterY, (s.top[i] + s.bottom[i]) / 2)
 
 // UiObject.longClick() - click with long duration
 static JSValue js_uiobject_longClick(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    if (!JS_IsObject(bounds)) { JS_FreeValue(ctx, bounds); return JS_FALSE; }
-    
-    JSValue left = JS_GetPropertyStr(ctx, bounds, "left");
-    JSValue right = JS_GetPropertyStr(ctx, bounds, "right");
-    JSValue top = JS_GetPropertyStr(ctx, bounds, "top");
-    JSValue bottom = JS_GetPropertyStr(ctx, bounds, "bottom");
-    
-    int32_t l, r, t, b;
-    JS_ToInt32(ctx, &l, left); JS_ToInt32(ctx, &r, right);
-    JS_ToInt32(ctx, &t, top); JS_ToInt32(ctx, &b, bottom);
-    
-    JS_FreeValue(ctx, left); JS_FreeValue(ctx, right);
-    JS_FreeValue(ctx, top); JS_FreeValue(ctx, bottom);
-    JS_FreeValue(ctx, bounds);
-    
-    int cx = (l + r) / 2, cy = (t + b) / 2;
-    char cx_str[16], cy_str[16];
-    snprintf(cx_str, 16, "%d", cx);
-    snprintf(cy_str, 16, "%d", cy);
-    
-    JSValue args[2] = { JS_NewString(ctx, cx_str), JS_NewString(ctx, cy_str) };
-    bool ret = call_host_bool(ctx, "longClick", 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    return JS_NewBool(ctx, ret);
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    const UiSnapshot &s = *d->snap;
+    JSValue args[2] = { JS_NewInt32(ctx, (s.left[d->node] + s.right[d->node]) / 2),
+                        JS_NewInt32(ctx, (s.top[d->node] + s.bottom[d->node]) / 2) };
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_LONG_CLICK, 2, args));
 }
 
 // UiObject.clickBounds(offsetX, offsetY) - click with offset
 static JSValue js_uiobject_clickBounds(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    if (!JS_IsObject(bounds)) { JS_FreeValue(ctx, bounds); return JS_FALSE; }
-    
-    JSValue left = JS_GetPropertyStr(ctx, bounds, "left");
-    JSValue right = JS_GetPropertyStr(ctx, bounds, "right");
-    JSValue top = JS_GetPropertyStr(ctx, bounds, "top");
-    JSValue bottom = JS_GetPropertyStr(ctx, bounds, "bottom");
-    
-    int32_t l, r, t, b;
-    JS_ToInt32(ctx, &l, left); JS_ToInt32(ctx, &r, right);
-    JS_ToInt32(ctx, &t, top); JS_ToInt32(ctx, &b, bottom);
-    
-    JS_FreeValue(ctx, left); JS_FreeValue(ctx, right);
-    JS_FreeValue(ctx, top); JS_FreeValue(ctx, bottom);
-    JS_FreeValue(ctx, bounds);
-    
-    int cx = (l + r) / 2, cy = (t + b) / 2;
-    
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+
+    const UiSnapshot &s = *d->snap;
+    int cx = (s.left[d->node] + s.right[d->node]) / 2, cy = (s.top[d->node] + s.bottom[d->node]) / 2;
+
     // Apply offsets
     if (argc >= 1) {
         double offsetX = 0;
@@ -933,461 +926,507 @@ static JSValue js_uiobject_clickBounds(JSContext *ctx, JSValueConst this_val, in
         JS_ToFloat64(ctx, &offsetY, argv[1]);
         cy += (int)offsetY;
     }
-    
-    char cx_str[16], cy_str[16];
-    snprintf(cx_str, 16, "%d", cx);
-    snprintf(cy_str, 16, "%d", cy);
-    
-    JSValue args[2] = { JS_NewString(ctx, cx_str), JS_NewString(ctx, cy_str) };
-    bool ret = call_host_bool(ctx, "click", 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    return JS_NewBool(ctx, ret);
+
+    JSValue args[2] = { JS_NewInt32(ctx, cx), JS_NewInt32(ctx, cy) };
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_CLICK, 2, args));
 }
 
-// UiObject sibling methods
+// UiObject.sibling(i) - i-th child of the parent, negative counts from the end
 static JSValue js_uiobject_sibling(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
     if (argc < 1) return JS_NULL;
     int32_t idx = 0;
     JS_ToInt32(ctx, &idx, argv[0]);
-    
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    char idxStr[16];
-    snprintf(idxStr, 16, "%d", idx);
-    
-    JSValue args[3] = { JS_NewString(ctx, "uiobject.sibling"), JS_NewString(ctx, boundsStr ? boundsStr : "{}"), JS_NewString(ctx, idxStr) };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    JSValue uiobj = create_uiobject(ctx, str);
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return uiobj;
+
+    int32_t p = d->snap->parent[d->node];
+    if (p < 0) return JS_NULL;
+    std::vector<int32_t> siblings;
+    snapshot_children(*d->snap, p, &siblings);
+    if (idx < 0) idx += (int32_t)siblings.size();
+    if (idx < 0 || idx >= (int32_t)siblings.size()) return JS_NULL;
+    return uiobject_new(ctx, d->snap, siblings[idx]);
 }
 
 // UiObject.scrollForward/scrollBackward
 static JSValue js_uiobject_scrollForward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    JSValue args[2] = { JS_NewString(ctx, "uiobject.scrollForward"), JS_NewString(ctx, boundsStr ? boundsStr : "{}") };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, ret);
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return JS_NewBool(ctx, snapshot_node_action(ctx, *d->snap, d->node, UI_ACTION_SCROLL_FORWARD, JS_UNDEFINED));
 }
 
 static JSValue js_uiobject_scrollBackward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue bounds = JS_GetPropertyStr(ctx, this_val, "bounds");
-    JSValue boundsJson = JS_JSONStringify(ctx, bounds, JS_UNDEFINED, JS_UNDEFINED);
-    const char *boundsStr = JS_ToCString(ctx, boundsJson);
-    JS_FreeValue(ctx, boundsJson);
-    JS_FreeValue(ctx, bounds);
-    
-    JSValue args[2] = { JS_NewString(ctx, "uiobject.scrollBackward"), JS_NewString(ctx, boundsStr ? boundsStr : "{}") };
-    if (boundsStr) JS_FreeCString(ctx, boundsStr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, ret);
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return JS_NewBool(ctx, snapshot_node_action(ctx, *d->snap, d->node, UI_ACTION_SCROLL_BACKWARD, JS_UNDEFINED));
+}
+
+// UiObject.toJSON() - plain snapshot of the node, used by JSON.stringify/console.log
+static JSValue js_uiobject_toJSON(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiObjectData *d = uiobject_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    const UiSnapshot &s = *d->snap;
+    int32_t i = d->node;
+    JSValue obj = JS_NewObject(ctx);
+    struct { const char *name; uint32_t idx; } strs[] = {
+        { "text", s.text[i] }, { "id", s.id[i] }, { "className", s.className[i] },
+        { "desc", s.desc[i] }, { "packageName", s.packageName[i] },
+    };
+    for (auto &f : strs) {
+        std::string_view v = s.str(f.idx);
+        JS_SetPropertyStr(ctx, obj, f.name, JS_NewStringLen(ctx, v.data(), v.size()));
+    }
+    JS_SetPropertyStr(ctx, obj, "bounds", uiobject_bounds_object(ctx, d));
+    JS_SetPropertyStr(ctx, obj, "depth", JS_NewInt32(ctx, s.depth[i]));
+    JS_SetPropertyStr(ctx, obj, "indexInParent", JS_NewInt32(ctx, s.indexInParent[i]));
+    JS_SetPropertyStr(ctx, obj, "drawingOrder", JS_NewInt32(ctx, s.drawingOrder[i]));
+    JS_SetPropertyStr(ctx, obj, "childCount", JS_NewInt32(ctx, s.childCount[i]));
+    for (const UiFlagName &f : g_ui_flag_names) {
+        JS_SetPropertyStr(ctx, obj, f.name, JS_NewBool(ctx, (s.flags[i] & f.flag) != 0));
+    }
+    return obj;
 }
 
-static void add_uiobject_methods(JSContext *ctx, JSValue obj) {
+static const JSCFunctionListEntry js_uiobject_proto_funcs[] = {
     // Basic getters
-    JS_SetPropertyStr(ctx, obj, "click", JS_NewCFunction(ctx, js_uiobject_click, "click", 0));
-    JS_SetPropertyStr(ctx, obj, "longClick", JS_NewCFunction(ctx, js_uiobject_longClick, "longClick", 0));
-    JS_SetPropertyStr(ctx, obj, "clickBounds", JS_NewCFunction(ctx, js_uiobject_clickBounds, "clickBounds", 2));
-    JS_SetPropertyStr(ctx, obj, "setText", JS_NewCFunction(ctx, js_uiobject_setText, "setText", 1));
-    JS_SetPropertyStr(ctx, obj, "text", JS_NewCFunction(ctx, js_uiobject_text, "text", 0));
-    JS_SetPropertyStr(ctx, obj, "id", JS_NewCFunction(ctx, js_uiobject_id, "id", 0));
-    JS_SetPropertyStr(ctx, obj, "className", JS_NewCFunction(ctx, js_uiobject_className, "className", 0));
-    JS_SetPropertyStr(ctx, obj, "desc", JS_NewCFunction(ctx, js_uiobject_desc, "desc", 0));
-    JS_SetPropertyStr(ctx, obj, "content", JS_NewCFunction(ctx, js_uiobject_content, "content", 0));
-    JS_SetPropertyStr(ctx, obj, "packageName", JS_NewCFunction(ctx, js_uiobject_packageName, "packageName", 0));
-    JS_SetPropertyStr(ctx, obj, "getBounds", JS_NewCFunction(ctx, js_uiobject_bounds, "getBounds", 0));
-    JS_SetPropertyStr(ctx, obj, "bounds", JS_NewCFunction(ctx, js_uiobject_bounds, "bounds", 0));
-    
+    JS_CFUNC_DEF("click", 0, js_uiobject_click),
+    JS_CFUNC_DEF("longClick", 0, js_uiobject_longClick),
+    JS_CFUNC_DEF("clickBounds", 2, js_uiobject_clickBounds),
+    JS_CFUNC_DEF("setText", 1, js_uiobject_setText),
+    JS_CFUNC_DEF("text", 0, js_uiobject_text),
+    JS_CFUNC_DEF("id", 0, js_uiobject_id),
+    JS_CFUNC_DEF("className", 0, js_uiobject_className),
+    JS_CFUNC_DEF("desc", 0, js_uiobject_desc),
+    JS_CFUNC_DEF("content", 0, js_uiobject_content),
+    JS_CFUNC_DEF("packageName", 0, js_uiobject_packageName),
+    JS_CFUNC_DEF("getBounds", 0, js_uiobject_bounds),
+    JS_CFUNC_DEF("bounds", 0, js_uiobject_bounds),
+    JS_CFUNC_DEF("toJSON", 0, js_uiobject_toJSON),
+
     // Tree navigation
-    JS_SetPropertyStr(ctx, obj, "parent", JS_NewCFunction(ctx, js_uiobject_parent, "parent", 0));
-    JS_SetPropertyStr(ctx, obj, "children", JS_NewCFunction(ctx, js_uiobject_children, "children", 0));
-    JS_SetPropertyStr(ctx, obj, "find", JS_NewCFunction(ctx, js_uiobject_find, "find", 1));
-    JS_SetPropertyStr(ctx, obj, "sibling", JS_NewCFunction(ctx, js_uiobject_sibling, "sibling", 1));
-    
+    JS_CFUNC_DEF("parent", 0, js_uiobject_parent),
+    JS_CFUNC_DEF("children", 0, js_uiobject_children),
+    JS_CFUNC_DEF("find", 1, js_uiobject_find),
+    JS_CFUNC_DEF("sibling", 1, js_uiobject_sibling),
+
     // Counts and indices
-    JS_SetPropertyStr(ctx, obj, "childCount", JS_NewCFunction(ctx, js_uiobject_childCount, "childCount", 0));
-    JS_SetPropertyStr(ctx, obj, "indexInParent", JS_NewCFunction(ctx, js_uiobject_indexInParent, "indexInParent", 0));
-    JS_SetPropertyStr(ctx, obj, "depth", JS_NewCFunction(ctx, js_uiobject_depth, "depth", 0));
-    JS_SetPropertyStr(ctx, obj, "drawingOrder", JS_NewCFunction(ctx, js_uiobject_drawingOrder, "drawingOrder", 0));
-    
+    JS_CFUNC_DEF("childCount", 0, js_uiobject_childCount),
+    JS_CFUNC_DEF("indexInParent", 0, js_uiobject_indexInParent),
+    JS_CFUNC_DEF("depth", 0, js_uiobject_depth),
+    JS_CFUNC_DEF("drawingOrder", 0, js_uiobject_drawingOrder),
+    JS_CFUNC_DEF("identity", 0, js_uiobject_identity),
+
     // Boolean properties
-    JS_SetPropertyStr(ctx, obj, "clickable", JS_NewCFunction(ctx, js_uiobject_clickable, "clickable", 0));
-    JS_SetPropertyStr(ctx, obj, "longClickable", JS_NewCFunction(ctx, js_uiobject_longClickable, "longClickable", 0));
-    JS_SetPropertyStr(ctx, obj, "scrollable", JS_NewCFunction(ctx, js_uiobject_scrollable, "scrollable", 0));
-    JS_SetPropertyStr(ctx, obj, "enabled", JS_NewCFunction(ctx, js_uiobject_enabled, "enabled", 0));
-    JS_SetPropertyStr(ctx, obj, "checked", JS_NewCFunction(ctx, js_uiobject_checked, "checked", 0));
-    JS_SetPropertyStr(ctx, obj, "selected", JS_NewCFunction(ctx, js_uiobject_selected, "selected", 0));
-    JS_SetPropertyStr(ctx, obj, "focusable", JS_NewCFunction(ctx, js_uiobject_focusable, "focusable", 0));
-    JS_SetPropertyStr(ctx, obj, "focused", JS_NewCFunction(ctx, js_uiobject_focused, "focused", 0));
-    JS_SetPropertyStr(ctx, obj, "checkable", JS_NewCFunction(ctx, js_uiobject_checkable, "checkable", 0));
-    JS_SetPropertyStr(ctx, obj, "editable", JS_NewCFunction(ctx, js_uiobject_editable, "editable", 0));
-    JS_SetPropertyStr(ctx, obj, "visibleToUser", JS_NewCFunction(ctx, js_uiobject_visibleToUser, "visibleToUser", 0));
-    
+    JS_CFUNC_DEF("clickable", 0, js_uiobject_clickable),
+    JS_CFUNC_DEF("longClickable", 0, js_uiobject_longClickable),
+    JS_CFUNC_DEF("scrollable", 0, js_uiobject_scrollable),
+    JS_CFUNC_DEF("enabled", 0, js_uiobject_enabled),
+    JS_CFUNC_DEF("checked", 0, js_uiobject_checked),
+    JS_CFUNC_DEF("selected", 0, js_uiobject_selected),
+    JS_CFUNC_DEF("focusable", 0, js_uiobject_focusable),
+    JS_CFUNC_DEF("focused", 0, js_uiobject_focused),
+    JS_CFUNC_DEF("checkable", 0, js_uiobject_checkable),
+    JS_CFUNC_DEF("editable", 0, js_uiobject_editable),
+    JS_CFUNC_DEF("visibleToUser", 0, js_uiobject_visibleToUser),
+
     // Bounds convenience methods
-    JS_SetPropertyStr(ctx, obj, "left", JS_NewCFunction(ctx, js_uiobject_boundsLeft, "left", 0));
-    JS_SetPropertyStr(ctx, obj, "top", JS_NewCFunction(ctx, js_uiobject_boundsTop, "top", 0));
-    JS_SetPropertyStr(ctx, obj, "right", JS_NewCFunction(ctx, js_uiobject_boundsRight, "right", 0));
-    JS_SetPropertyStr(ctx, obj, "bottom", JS_NewCFunction(ctx, js_uiobject_boundsBottom, "bottom", 0));
-    JS_SetPropertyStr(ctx, obj, "width", JS_NewCFunction(ctx, js_uiobject_boundsWidth, "width", 0));
-    JS_SetPropertyStr(ctx, obj, "height", JS_NewCFunction(ctx, js_uiobject_boundsHeight, "height", 0));
-    JS_SetPropertyStr(ctx, obj, "centerX", JS_NewCFunction(ctx, js_uiobject_boundsCenterX, "centerX", 0));
-    JS_SetPropertyStr(ctx, obj, "centerY", JS_NewCFunction(ctx, js_uiobject_boundsCenterY, "centerY", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsLeft", JS_NewCFunction(ctx, js_uiobject_boundsLeft, "boundsLeft", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsTop", JS_NewCFunction(ctx, js_uiobject_boundsTop, "boundsTop", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsRight", JS_NewCFunction(ctx, js_uiobject_boundsRight, "boundsRight", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsBottom", JS_NewCFunction(ctx, js_uiobject_boundsBottom, "boundsBottom", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsWidth", JS_NewCFunction(ctx, js_uiobject_boundsWidth, "boundsWidth", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsHeight", JS_NewCFunction(ctx, js_uiobject_boundsHeight, "boundsHeight", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsCenterX", JS_NewCFunction(ctx, js_uiobject_boundsCenterX, "boundsCenterX", 0));
-    JS_SetPropertyStr(ctx, obj, "boundsCenterY", JS_NewCFunction(ctx, js_uiobject_boundsCenterY, "boundsCenterY", 0));
-    
+    JS_CFUNC_DEF("left", 0, js_uiobject_boundsLeft),
+    JS_CFUNC_DEF("top", 0, js_uiobject_boundsTop),
+    JS_CFUNC_DEF("right", 0, js_uiobject_boundsRight),
+    JS_CFUNC_DEF("bottom", 0, js_uiobject_boundsBottom),
+    JS_CFUNC_DEF("width", 0, js_uiobject_boundsWidth),
+    JS_CFUNC_DEF("height", 0, js_uiobject_boundsHeight),
+    JS_CFUNC_DEF("centerX", 0, js_uiobject_boundsCenterX),
+    JS_CFUNC_DEF("centerY", 0, js_uiobject_boundsCenterY),
+    JS_CFUNC_DEF("boundsLeft", 0, js_uiobject_boundsLeft),
+    JS_CFUNC_DEF("boundsTop", 0, js_uiobject_boundsTop),
+    JS_CFUNC_DEF("boundsRight", 0, js_uiobject_boundsRight),
+    JS_CFUNC_DEF("boundsBottom", 0, js_uiobject_boundsBottom),
+    JS_CFUNC_DEF("boundsWidth", 0, js_uiobject_boundsWidth),
+    JS_CFUNC_DEF("boundsHeight", 0, js_uiobject_boundsHeight),
+    JS_CFUNC_DEF("boundsCenterX", 0, js_uiobject_boundsCenterX),
+    JS_CFUNC_DEF("boundsCenterY", 0, js_uiobject_boundsCenterY),
+
     // Scroll methods
-    JS_SetPropertyStr(ctx, obj, "scrollForward", JS_NewCFunction(ctx, js_uiobject_scrollForward, "scrollForward", 0));
-    JS_SetPropertyStr(ctx, obj, "scrollBackward", JS_NewCFunction(ctx, js_uiobject_scrollBackward, "scrollBackward", 0));
+    JS_CFUNC_DEF("scrollForward", 0, js_uiobject_scrollForward),
+    JS_CFUNC_DEF("scrollBackward", 0, js_uiobject_scrollBackward),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "UiObject", JS_PROP_CONFIGURABLE),
+};
+
+// Register the UiObject class and its shared prototype on a context
+static void register_uiobject_class(JSContext *ctx) {
+    JS_NewClassID(&js_uiobject_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_uiobject_class_id, &js_uiobject_class);
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_uiobject_proto_funcs,
+                               sizeof(js_uiobject_proto_funcs) / sizeof(js_uiobject_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_uiobject_class_id, proto);
 }
 
-// Create UiObject from JSON
-static JSValue create_uiobject(JSContext *ctx, const char *json) {
-    if (!json || !*json || strcmp(json, "null") == 0) return JS_NULL;
-    JSValue obj = JS_ParseJSON(ctx, json, strlen(json), "<uiobject>");
-    if (JS_IsException(obj)) return JS_NULL;
-    add_uiobject_methods(ctx, obj);
-    return obj;
+// ==================== Selector Queries ====================
+
+// Ask the host for an up-to-date snapshot (it recaptures at most once per
+// frame, and only after the UI changed) and return it. Null when the
+// accessibility service is not running.
+static std::shared_ptr<const UiSnapshot> selector_snapshot(JSContext *ctx) {
+    if (call_host_int(ctx, HF_UI_SNAPSHOT, 0, nullptr) < 0) return nullptr;
+    return ui_snapshot_current();
+}
+
+// First match in document order, or -1
+static int32_t selector_find_first(Selector *sel, const UiSnapshot &snap) {
+    std::vector<int32_t> found;
+    selector_find(sel, snap, 0, (int32_t)snap.size(), 1, &found);
+    return found.empty() ? -1 : found[0];
+}
+
+// Selector.findOne()
+static JSValue js_selector_findOne(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    auto snap = selector_snapshot(ctx);
+    if (!snap) return JS_NULL;
+    int32_t i = selector_find_first(sel, *snap);
+    return i < 0 ? JS_NULL : uiobject_new(ctx, snap, i);
 }
 
-// Selector.findOnce(i) - find one with index
+// Selector.findOnce(i) - the i-th match
 static JSValue js_selector_findOnce(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
     int32_t index = 0;
     if (argc > 0) JS_ToInt32(ctx, &index, argv[0]);
-    char indexStr[16];
-    snprintf(indexStr, 16, "%d", index);
-    
-    JSValue args[3] = { JS_NewString(ctx, "selector.findOnce"), JS_NewString(ctx, json), JS_NewString(ctx, indexStr) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    const char *str = JS_ToCString(ctx, result);
-    JSValue uiobj = create_uiobject(ctx, str);
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return uiobj;
-}
-
-// Selector.longClick()
-static JSValue js_selector_longClick(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.longClick"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    bool success = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, success);
-}
-
-// Selector.scrollForward()
-static JSValue js_selector_scrollForward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.scrollForward"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    bool success = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, success);
-}
-
-// Selector.scrollBackward()
-static JSValue js_selector_scrollBackward(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.scrollBackward"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    bool success = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, success);
+    if (index < 0) return JS_NULL;
+    auto snap = selector_snapshot(ctx);
+    if (!snap) return JS_NULL;
+    std::vector<int32_t> found;
+    selector_find(sel, *snap, 0, (int32_t)snap->size(), (size_t)index + 1, &found);
+    return (int32_t)found.size() > index ? uiobject_new(ctx, snap, found[index]) : JS_NULL;
 }
 
-// Selector.findOne()
-static JSValue js_selector_findOne(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.findOne"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    JSValue uiobj = create_uiobject(ctx, str);
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return uiobj;
-}
-
-// Selector.findAll()
+// Selector.findAll() - a UiCollection, elements are created as they are read
 static JSValue js_selector_findAll(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.findAll"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    JS_FreeValue(ctx, result);
-    if (!str || !*str) return JS_NewArray(ctx);
-    JSValue arr = JS_ParseJSON(ctx, str, strlen(str), "<findAll>");
-    JS_FreeCString(ctx, str);
-    if (!JS_IsArray(ctx, arr)) return JS_NewArray(ctx);
-    
-    // Add methods to each object
-    JSValue lenVal = JS_GetPropertyStr(ctx, arr, "length");
-    int32_t len = 0; JS_ToInt32(ctx, &len, lenVal);
-    JS_FreeValue(ctx, lenVal);
-    for (int i = 0; i < len; i++) {
-        JSValue item = JS_GetPropertyUint32(ctx, arr, i);
-        add_uiobject_methods(ctx, item);
-        JS_SetPropertyUint32(ctx, arr, i, item);
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    auto snap = selector_snapshot(ctx);
+    std::vector<int32_t> found;
+    if (snap) selector_find(sel, *snap, 0, (int32_t)snap->size(), 0, &found);
+    return ui_collection_new(ctx, snap, std::move(found));
+}
+
+// Read an integer option; false if conversion threw
+static bool option_int(JSContext *ctx, JSValueConst options, const char *name, int32_t *out) {
+    JSValue v = JS_GetPropertyStr(ctx, options, name);
+    bool ok = JS_IsUndefined(v) || JS_IsNull(v) || JS_ToInt32(ctx, out, v) == 0;
+    JS_FreeValue(ctx, v);
+    return ok;
+}
+
+// Selector.iterate({ limit, maxDepth, order }) / findLazy(limit) - a
+// UiIterator that searches as it is consumed; magic 1 is findLazy
+static JSValue js_selector_iterate(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int lazy) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    int32_t limit = 0, max_depth = -1;
+    int order = SEL_ORDER_DFS;
+    if (lazy) {
+        if (argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToInt32(ctx, &limit, argv[0])) return JS_EXCEPTION;
+    } else if (argc > 0 && JS_IsObject(argv[0])) {
+        if (!option_int(ctx, argv[0], "limit", &limit) || !option_int(ctx, argv[0], "maxDepth", &max_depth)) {
+            return JS_EXCEPTION;
+        }
+        JSValue v = JS_GetPropertyStr(ctx, argv[0], "order");
+        if (!JS_IsUndefined(v)) {
+            const char *name = JS_ToCString(ctx, v);
+            if (!name) {
+                JS_FreeValue(ctx, v);
+                return JS_EXCEPTION;
+            }
+            if (strcmp(name, "bfs") == 0) order = SEL_ORDER_BFS;
+            else if (strcmp(name, "drawingOrder") == 0) order = SEL_ORDER_DRAWING;
+            else if (strcmp(name, "dfs") != 0) order = -1;
+            JS_FreeCString(ctx, name);
+        }
+        JS_FreeValue(ctx, v);
+        if (order < 0) return JS_ThrowRangeError(ctx, "order must be \"dfs\", \"bfs\" or \"drawingOrder\"");
     }
-    return arr;
-}
 
-// Selector.waitFor()
-static JSValue js_selector_waitFor(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    int64_t timeout = 10000;
-    if (argc > 0) JS_ToInt64(ctx, &timeout, argv[0]);
-    char timeout_str[32]; snprintf(timeout_str, 32, "%lld", (long long)timeout);
-    
-    JSValue args[3] = { JS_NewString(ctx, "selector.waitFor"), JS_NewString(ctx, json), JS_NewString(ctx, timeout_str) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    const char *str = JS_ToCString(ctx, result);
-    JSValue uiobj = create_uiobject(ctx, str);
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return uiobj;
+    SelectorCursor cursor;
+    selector_cursor_init(&cursor, std::make_shared<Selector>(*sel), selector_snapshot(ctx), order,
+                         limit > 0 ? (size_t)limit : 0, max_depth);
+    return ui_iterator_new(ctx, std::move(cursor));
 }
 
-// Selector.exists()
-static JSValue js_selector_exists(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.exists"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    bool exists = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, exists);
-}
-
-// Selector.click()
-static JSValue js_selector_click(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    char *json = serialize_conditions(ctx, this_val);
-    JSValue args[2] = { JS_NewString(ctx, "selector.click"), JS_NewString(ctx, json) };
-    free(json);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *str = JS_ToCString(ctx, result);
-    bool success = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, success);
-}
+// Pull a fresh snapshot at least this often while waiting: some UI changes
+// (e.g. inside a WebView) send no accessibility event
+#define SELECTOR_WAIT_PULL_MS 1000
 
-// Selector.setText()
-static JSValue js_selector_setText(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    if (argc < 1) return JS_FALSE;
-    char *json = serialize_conditions(ctx, this_val);
-    const char *text = JS_ToCString(ctx, argv[0]);
-    JSValue args[3] = { JS_NewString(ctx, "selector.setText"), JS_NewString(ctx, json), JS_NewString(ctx, text ? text : "") };
-    free(json);
-    if (text) JS_FreeCString(ctx, text);
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    const char *str = JS_ToCString(ctx, result);
-    bool success = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, success);
-}
-
-// Global selector functions
-#define GLOBAL_SELECTOR(name, condType) \
-static JSValue js_##name(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) { \
-    JSValue sel = create_selector_object(ctx); \
-    if (argc > 0) { \
-        const char *str = JS_ToCString(ctx, argv[0]); \
-        JSValue ret = selector_add_condition(ctx, sel, condType, str ? str : ""); \
-        if (str) JS_FreeCString(ctx, str); \
-        JS_FreeValue(ctx, sel); \
-        return ret; \
-    } \
-    return sel; \
-}
-
-GLOBAL_SELECTOR(text, "text")
-GLOBAL_SELECTOR(textContains, "textContains")
-GLOBAL_SELECTOR(textStartsWith, "textStartsWith")
-GLOBAL_SELECTOR(textEndsWith, "textEndsWith")
-GLOBAL_SELECTOR(textMatches, "textMatches")
-GLOBAL_SELECTOR(desc, "desc")
-GLOBAL_SELECTOR(descContains, "descContains")
-GLOBAL_SELECTOR(descStartsWith, "descStartsWith")
-GLOBAL_SELECTOR(descEndsWith, "descEndsWith")
-GLOBAL_SELECTOR(descMatches, "descMatches")
-GLOBAL_SELECTOR(id, "id")
-GLOBAL_SELECTOR(idContains, "idContains")
-GLOBAL_SELECTOR(idStartsWith, "idStartsWith")
-GLOBAL_SELECTOR(idEndsWith, "idEndsWith")
-GLOBAL_SELECTOR(idMatches, "idMatches")
-GLOBAL_SELECTOR(className, "className")
-GLOBAL_SELECTOR(classNameContains, "classNameContains")
-GLOBAL_SELECTOR(classNameStartsWith, "classNameStartsWith")
-GLOBAL_SELECTOR(classNameEndsWith, "classNameEndsWith")
-GLOBAL_SELECTOR(classNameMatches, "classNameMatches")
-GLOBAL_SELECTOR(packageName, "packageName")
-GLOBAL_SELECTOR(packageNameContains, "packageNameContains")
-GLOBAL_SELECTOR(packageNameStartsWith, "packageNameStartsWith")
-GLOBAL_SELECTOR(packageNameEndsWith, "packageNameEndsWith")
-
-static JSValue js_clickable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "clickable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+static double monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
 }
 
-static JSValue js_scrollable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "scrollable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
-}
+// Selector.waitFor(timeout = 10000, minInterval = 16) - wait for a match.
+// While waiting the host captures and publishes a snapshot as soon as an
+// accessibility event arrives ("ui.watch"), and the selector is re-evaluated
+// on each new generation, at most once per minInterval ms. Events arriving
+// within minInterval collapse into the newest generation.
+static JSValue js_selector_waitFor(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    double timeout = 10000, min_interval = 16;
+    if (argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToFloat64(ctx, &timeout, argv[0])) return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) && JS_ToFloat64(ctx, &min_interval, argv[1])) return JS_EXCEPTION;
+    if (!(timeout >= 0)) return JS_ThrowRangeError(ctx, "waitFor: timeout must be a non-negative number");
+    if (!(min_interval >= 0) || !isfinite(min_interval)) {
+        return JS_ThrowRangeError(ctx, "waitFor: minInterval must be a non-negative number");
+    }
+    double deadline = monotonic_ms() + timeout;
+
+    JSValue on = JS_TRUE;
+    call_host_bool(ctx, HF_UI_WATCH, 1, &on);
+
+    JSValue result = JS_NULL;
+    auto snap = selector_snapshot(ctx);
+    for (;;) {
+        double evaluated = monotonic_ms();
+        if (snap) {
+            int32_t i = selector_find_first(sel, *snap);
+            if (i >= 0) {
+                result = uiobject_new(ctx, snap, i);
+                break;
+            }
+        }
 
-static JSValue js_enabled(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "enabled", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
-}
+        double now = monotonic_ms();
+        if (now >= deadline || g_interrupt_flag) break;
+        double idle = evaluated + min_interval - now;
+        if (idle > deadline - now) idle = deadline - now;
+        if (idle > 0) usleep((useconds_t)(idle * 1000));
+        if (g_interrupt_flag) break;
+
+        // Returns at once if a newer generation came out during the pause
+        uint32_t generation = snap ? snap->generation : 0;
+        double wait = deadline - monotonic_ms();
+        if (wait > SELECTOR_WAIT_PULL_MS) wait = SELECTOR_WAIT_PULL_MS;
+        auto next = ui_snapshot_wait(generation, wait > 0 ? (int64_t)wait + 1 : 0, &g_interrupt_flag);
+        if (g_interrupt_flag) break;
+        // Nothing published in the meantime: pull, in case the UI changed silently
+        snap = next && next->generation != generation ? next : selector_snapshot(ctx);
+    }
 
-static JSValue js_checked(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "checked", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+    JSValue off = JS_FALSE;
+    call_host_bool(ctx, HF_UI_WATCH, 1, &off);
+    return result;
 }
 
-static JSValue js_selected(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "selected", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+// Selector.exists()
+static JSValue js_selector_exists(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    auto snap = selector_snapshot(ctx);
+    return JS_NewBool(ctx, snap && selector_find_first(sel, *snap) >= 0);
+}
+
+// Selector.explain() - how the selector runs against the current snapshot
+static JSValue js_selector_explain(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    auto snap = selector_snapshot(ctx);
+    std::string plan = selector_explain(sel, snap.get());
+    return JS_NewStringLen(ctx, plan.data(), plan.size());
+}
+
+// selectorCacheStats(reset = false) - result memo counters (ui_selector.h):
+// { hits, revalidated, misses }, then zeroed if reset
+static JSValue js_selector_cache_stats(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    SelectorMemoStats stats = selector_memo_stats();
+    if (argc > 0 && JS_ToBool(ctx, argv[0])) selector_memo_reset_stats();
+    JSValue obj = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, obj, "hits", JS_NewInt64(ctx, (int64_t)stats.hits));
+    JS_SetPropertyStr(ctx, obj, "revalidated", JS_NewInt64(ctx, (int64_t)stats.revalidated));
+    JS_SetPropertyStr(ctx, obj, "misses", JS_NewInt64(ctx, (int64_t)stats.misses));
+    return obj;
 }
 
-static JSValue js_focusable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "focusable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+// dumpSnapshot(path) - save the current UI snapshot as a snapshot file
+// (ui_snapshot.h) for offline replay and the host benchmarks
+static JSValue js_dump_snapshot(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    const char *path = argc > 0 ? JS_ToCString(ctx, argv[0]) : nullptr;
+    if (!path) return JS_ThrowTypeError(ctx, "dumpSnapshot: path required");
+    auto snap = selector_snapshot(ctx);
+    bool ok = snap && ui_snapshot_save(*snap, path);
+    JS_FreeCString(ctx, path);
+    return JS_NewBool(ctx, ok);
 }
 
-static JSValue js_focused(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "focused", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
-}
+// ==================== Selector Actions ====================
 
-static JSValue js_longClickable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "longClickable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+// Find the first match on a fresh snapshot and act on it through its handle
+static bool selector_action(JSContext *ctx, Selector *sel, int action, JSValueConst text) {
+    auto snap = selector_snapshot(ctx);
+    if (!snap) return false;
+    int32_t i = selector_find_first(sel, *snap);
+    return i >= 0 && snapshot_node_action(ctx, *snap, i, action, text);
 }
 
-static JSValue js_checkable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "checkable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+// Selector.click()/longClick()/scrollForward()/scrollBackward(), by action
+static JSValue js_selector_action(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int action) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    return JS_NewBool(ctx, selector_action(ctx, sel, action, JS_UNDEFINED));
 }
 
-static JSValue js_editable(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "editable", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
+// Selector.setText()
+static JSValue js_selector_setText(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    Selector *sel = selector_get(ctx, this_val);
+    if (!sel) return JS_EXCEPTION;
+    if (argc < 1) return JS_FALSE;
+    JSValue text = JS_ToString(ctx, argv[0]);
+    if (JS_IsException(text)) return text;
+    bool ret = selector_action(ctx, sel, UI_ACTION_SET_TEXT, text);
+    JS_FreeValue(ctx, text);
+    return JS_NewBool(ctx, ret);
 }
 
-static JSValue js_visibleToUser(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    bool val = argc < 1 || JS_ToBool(ctx, argv[0]);
-    JSValue ret = selector_add_condition(ctx, sel, "visibleToUser", val ? "true" : "false");
-    JS_FreeValue(ctx, sel);
-    return ret;
-}
+#define SELECTOR_CHAIN_DEF(name, op) JS_CFUNC_MAGIC_DEF(name, 1, js_selector_chain, op)
+#define SELECTOR_START_DEF(name, op) JS_CFUNC_MAGIC_DEF(name, 1, js_selector_start, op)
+
+static const JSCFunctionListEntry js_selector_proto_funcs[] = {
+    // Conditions
+    SELECTOR_CHAIN_DEF("text", SEL_TEXT),
+    SELECTOR_CHAIN_DEF("textContains", SEL_TEXT_CONTAINS),
+    SELECTOR_CHAIN_DEF("textStartsWith", SEL_TEXT_STARTS_WITH),
+    SELECTOR_CHAIN_DEF("textEndsWith", SEL_TEXT_ENDS_WITH),
+    SELECTOR_CHAIN_DEF("textMatches", SEL_TEXT_MATCHES),
+    SELECTOR_CHAIN_DEF("textEqualsNormalized", SEL_TEXT_EQUALS_NORMALIZED),
+    SELECTOR_CHAIN_DEF("textContainsNormalized", SEL_TEXT_CONTAINS_NORMALIZED),
+    SELECTOR_CHAIN_DEF("desc", SEL_DESC),
+    SELECTOR_CHAIN_DEF("descContains", SEL_DESC_CONTAINS),
+    SELECTOR_CHAIN_DEF("descStartsWith", SEL_DESC_STARTS_WITH),
+    SELECTOR_CHAIN_DEF("descEndsWith", SEL_DESC_ENDS_WITH),
+    SELECTOR_CHAIN_DEF("descMatches", SEL_DESC_MATCHES),
+    SELECTOR_CHAIN_DEF("descEqualsNormalized", SEL_DESC_EQUALS_NORMALIZED),
+    SELECTOR_CHAIN_DEF("descContainsNormalized", SEL_DESC_CONTAINS_NORMALIZED),
+    SELECTOR_CHAIN_DEF("id", SEL_ID),
+    SELECTOR_CHAIN_DEF("idContains", SEL_ID_CONTAINS),
+    SELECTOR_CHAIN_DEF("idStartsWith", SEL_ID_STARTS_WITH),
+    SELECTOR_CHAIN_DEF("idEndsWith", SEL_ID_ENDS_WITH),
+    SELECTOR_CHAIN_DEF("idMatches", SEL_ID_MATCHES),
+    SELECTOR_CHAIN_DEF("className", SEL_CLASS_NAME),
+    SELECTOR_CHAIN_DEF("classNameContains", SEL_CLASS_NAME_CONTAINS),
+    SELECTOR_CHAIN_DEF("classNameStartsWith", SEL_CLASS_NAME_STARTS_WITH),
+    SELECTOR_CHAIN_DEF("classNameEndsWith", SEL_CLASS_NAME_ENDS_WITH),
+    SELECTOR_CHAIN_DEF("classNameMatches", SEL_CLASS_NAME_MATCHES),
+    SELECTOR_CHAIN_DEF("packageName", SEL_PACKAGE_NAME),
+    SELECTOR_CHAIN_DEF("packageNameContains", SEL_PACKAGE_NAME_CONTAINS),
+    SELECTOR_CHAIN_DEF("packageNameStartsWith", SEL_PACKAGE_NAME_STARTS_WITH),
+    SELECTOR_CHAIN_DEF("packageNameEndsWith", SEL_PACKAGE_NAME_ENDS_WITH),
+    SELECTOR_CHAIN_DEF("clickable", SEL_CLICKABLE),
+    SELECTOR_CHAIN_DEF("scrollable", SEL_SCROLLABLE),
+    SELECTOR_CHAIN_DEF("enabled", SEL_ENABLED),
+    SELECTOR_CHAIN_DEF("checked", SEL_CHECKED),
+    SELECTOR_CHAIN_DEF("selected", SEL_SELECTED),
+    SELECTOR_CHAIN_DEF("focusable", SEL_FOCUSABLE),
+    SELECTOR_CHAIN_DEF("focused", SEL_FOCUSED),
+    SELECTOR_CHAIN_DEF("longClickable", SEL_LONG_CLICKABLE),
+    SELECTOR_CHAIN_DEF("checkable", SEL_CHECKABLE),
+    SELECTOR_CHAIN_DEF("editable", SEL_EDITABLE),
+    SELECTOR_CHAIN_DEF("visibleToUser", SEL_VISIBLE_TO_USER),
+    SELECTOR_CHAIN_DEF("depth", SEL_DEPTH),
+    SELECTOR_CHAIN_DEF("drawingOrder", SEL_DRAWING_ORDER),
+    SELECTOR_CHAIN_DEF("bounds", SEL_BOUNDS),
+    SELECTOR_CHAIN_DEF("boundsInside", SEL_BOUNDS_INSIDE),
+    SELECTOR_CHAIN_DEF("boundsContains", SEL_BOUNDS_CONTAINS),
+    SELECTOR_CHAIN_DEF("boundsIntersects", SEL_BOUNDS_INTERSECTS),
+    SELECTOR_CHAIN_DEF("nodeAt", SEL_NODE_AT),
+    SELECTOR_CHAIN_DEF("parent", SEL_PARENT),
+    SELECTOR_CHAIN_DEF("child", SEL_CHILD),
+    SELECTOR_CHAIN_DEF("sibling", SEL_SIBLING),
+    SELECTOR_CHAIN_DEF("ancestor", SEL_ANCESTOR),
+    SELECTOR_CHAIN_DEF("descendant", SEL_DESCENDANT),
+    
+    // Actions
+    JS_CFUNC_DEF("findOne", 0, js_selector_findOne),
+    JS_CFUNC_DEF("findOnce", 1, js_selector_findOnce),
+    JS_CFUNC_DEF("findAll", 0, js_selector_findAll),
+    JS_CFUNC_DEF("find", 0, js_selector_findAll),
+    JS_CFUNC_MAGIC_DEF("iterate", 1, js_selector_iterate, 0),
+    JS_CFUNC_MAGIC_DEF("findLazy", 1, js_selector_iterate, 1),
+    JS_CFUNC_DEF("waitFor", 1, js_selector_waitFor),
+    JS_CFUNC_DEF("exists", 0, js_selector_exists),
+    JS_CFUNC_DEF("explain", 0, js_selector_explain),
+    JS_CFUNC_MAGIC_DEF("click", 0, js_selector_action, UI_ACTION_CLICK),
+    JS_CFUNC_MAGIC_DEF("longClick", 0, js_selector_action, UI_ACTION_LONG_CLICK),
+    JS_CFUNC_DEF("setText", 1, js_selector_setText),
+    JS_CFUNC_MAGIC_DEF("scrollForward", 0, js_selector_action, UI_ACTION_SCROLL_FORWARD),
+    JS_CFUNC_MAGIC_DEF("scrollBackward", 0, js_selector_action, UI_ACTION_SCROLL_BACKWARD),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "UiSelector", JS_PROP_CONFIGURABLE),
+};
 
-static JSValue js_depth(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue sel = create_selector_object(ctx);
-    if (argc > 0) {
-        int32_t depth = 0;
-        JS_ToInt32(ctx, &depth, argv[0]);
-        char buf[16];
-        snprintf(buf, 16, "%d", depth);
-        JSValue ret = selector_add_condition(ctx, sel, "depth", buf);
-        JS_FreeValue(ctx, sel);
-        return ret;
-    }
-    return sel;
+// Global selector functions (AutoJS style), each starts a new selector
+static const JSCFunctionListEntry js_selector_global_funcs[] = {
+    SELECTOR_START_DEF("text", SEL_TEXT),
+    SELECTOR_START_DEF("textContains", SEL_TEXT_CONTAINS),
+    SELECTOR_START_DEF("textStartsWith", SEL_TEXT_STARTS_WITH),
+    SELECTOR_START_DEF("textEndsWith", SEL_TEXT_ENDS_WITH),
+    SELECTOR_START_DEF("textMatches", SEL_TEXT_MATCHES),
+    SELECTOR_START_DEF("textEqualsNormalized", SEL_TEXT_EQUALS_NORMALIZED),
+    SELECTOR_START_DEF("textContainsNormalized", SEL_TEXT_CONTAINS_NORMALIZED),
+    SELECTOR_START_DEF("desc", SEL_DESC),
+    SELECTOR_START_DEF("descContains", SEL_DESC_CONTAINS),
+    SELECTOR_START_DEF("descStartsWith", SEL_DESC_STARTS_WITH),
+    SELECTOR_START_DEF("descEndsWith", SEL_DESC_ENDS_WITH),
+    SELECTOR_START_DEF("descMatches", SEL_DESC_MATCHES),
+    SELECTOR_START_DEF("descEqualsNormalized", SEL_DESC_EQUALS_NORMALIZED),
+    SELECTOR_START_DEF("descContainsNormalized", SEL_DESC_CONTAINS_NORMALIZED),
+    SELECTOR_START_DEF("id", SEL_ID),
+    SELECTOR_START_DEF("idContains", SEL_ID_CONTAINS),
+    SELECTOR_START_DEF("idStartsWith", SEL_ID_STARTS_WITH),
+    SELECTOR_START_DEF("idEndsWith", SEL_ID_ENDS_WITH),
+    SELECTOR_START_DEF("idMatches", SEL_ID_MATCHES),
+    SELECTOR_START_DEF("className", SEL_CLASS_NAME),
+    SELECTOR_START_DEF("classNameContains", SEL_CLASS_NAME_CONTAINS),
+    SELECTOR_START_DEF("classNameStartsWith", SEL_CLASS_NAME_STARTS_WITH),
+    SELECTOR_START_DEF("classNameEndsWith", SEL_CLASS_NAME_ENDS_WITH),
+    SELECTOR_START_DEF("classNameMatches", SEL_CLASS_NAME_MATCHES),
+    SELECTOR_START_DEF("packageName", SEL_PACKAGE_NAME),
+    SELECTOR_START_DEF("packageNameContains", SEL_PACKAGE_NAME_CONTAINS),
+    SELECTOR_START_DEF("packageNameStartsWith", SEL_PACKAGE_NAME_STARTS_WITH),
+    SELECTOR_START_DEF("packageNameEndsWith", SEL_PACKAGE_NAME_ENDS_WITH),
+    SELECTOR_START_DEF("clickable", SEL_CLICKABLE),
+    SELECTOR_START_DEF("scrollable", SEL_SCROLLABLE),
+    SELECTOR_START_DEF("enabled", SEL_ENABLED),
+    SELECTOR_START_DEF("checked", SEL_CHECKED),
+    SELECTOR_START_DEF("selected", SEL_SELECTED),
+    SELECTOR_START_DEF("focusable", SEL_FOCUSABLE),
+    SELECTOR_START_DEF("focused", SEL_FOCUSED),
+    SELECTOR_START_DEF("longClickable", SEL_LONG_CLICKABLE),
+    SELECTOR_START_DEF("checkable", SEL_CHECKABLE),
+    SELECTOR_START_DEF("editable", SEL_EDITABLE),
+    SELECTOR_START_DEF("visibleToUser", SEL_VISIBLE_TO_USER),
+    SELECTOR_START_DEF("depth", SEL_DEPTH),
+    SELECTOR_START_DEF("bounds", SEL_BOUNDS),
+    SELECTOR_START_DEF("boundsInside", SEL_BOUNDS_INSIDE),
+    SELECTOR_START_DEF("boundsContains", SEL_BOUNDS_CONTAINS),
+    SELECTOR_START_DEF("boundsIntersects", SEL_BOUNDS_INTERSECTS),
+    SELECTOR_START_DEF("nodeAt", SEL_NODE_AT),
+    JS_CFUNC_DEF("selectorCacheStats", 1, js_selector_cache_stats),
+    JS_CFUNC_DEF("dumpSnapshot", 1, js_dump_snapshot),
+};
+
+static void register_selector_class(JSContext *ctx, JSValueConst global) {
+    JS_NewClassID(&js_selector_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_selector_class_id, &js_selector_class);
+    
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_selector_proto_funcs,
+                               sizeof(js_selector_proto_funcs) / sizeof(js_selector_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_selector_class_id, proto);
+    
+    JS_SetPropertyFunctionList(ctx, global, js_selector_global_funcs,
+                               sizeof(js_selector_global_funcs) / sizeof(js_selector_global_funcs[0]));
 }
 
 // ==================== Gesture: gesture() and gestures() ====================
@@ -1396,50 +1435,25 @@ static JSValue js_gesture(JSContext *ctx, JSValueConst this_val, int argc, JSVal
     // gesture(duration, [x1,y1], [x2,y2], ...)
     if (argc < 2) return JS_FALSE;
     
-    // Build args array as JSON and call host
+    // All arguments travel as one JSON array
     JSValue jsonArr = JS_NewArray(ctx);
     for (int i = 0; i < argc; i++) {
         JS_SetPropertyUint32(ctx, jsonArr, i, JS_DupValue(ctx, argv[i]));
     }
-    JSValue jsonStr = JS_JSONStringify(ctx, jsonArr, JS_UNDEFINED, JS_UNDEFINED);
-    const char *str = JS_ToCString(ctx, jsonStr);
-    
-    JSValue args[2] = { JS_NewString(ctx, "gesture"), JS_NewString(ctx, str ? str : "[]") };
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, jsonStr);
+    bool ret = call_host_bool(ctx, HF_GESTURE, 1, &jsonArr);
     JS_FreeValue(ctx, jsonArr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *resStr = JS_ToCString(ctx, result);
-    bool ret = resStr && strcmp(resStr, "true") == 0;
-    if (resStr) JS_FreeCString(ctx, resStr);
-    JS_FreeValue(ctx, result);
     return JS_NewBool(ctx, ret);
 }
 
 static JSValue js_gestures(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     // gestures([delay1, duration1, points...], [delay2, duration2, points...], ...)
+    // All arguments travel as one JSON array
     JSValue jsonArr = JS_NewArray(ctx);
     for (int i = 0; i < argc; i++) {
         JS_SetPropertyUint32(ctx, jsonArr, i, JS_DupValue(ctx, argv[i]));
     }
-    JSValue jsonStr = JS_JSONStringify(ctx, jsonArr, JS_UNDEFINED, JS_UNDEFINED);
-    const char *str = JS_ToCString(ctx, jsonStr);
-    
-    JSValue args[2] = { JS_NewString(ctx, "gestures"), JS_NewString(ctx, str ? str : "[]") };
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, jsonStr);
+    bool ret = call_host_bool(ctx, HF_GESTURES, 1, &jsonArr);
     JS_FreeValue(ctx, jsonArr);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *resStr = JS_ToCString(ctx, result);
-    bool ret = resStr && strcmp(resStr, "true") == 0;
-    if (resStr) JS_FreeCString(ctx, resStr);
-    JS_FreeValue(ctx, result);
     return JS_NewBool(ctx, ret);
 }
 
@@ -1459,88 +1473,715 @@ static JSValue js_setScreenMetrics(JSContext *ctx, JSValueConst this_val, int ar
 
 static JSValue js_app_launch(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "app.launch", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_APP_LAUNCH, argc, argv));
 }
 
 static JSValue js_app_openUrl(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "openUrl", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_APP_OPEN_URL, argc, argv));
 }
 
 static JSValue js_app_currentPackage(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "app.currentPackage") };
-    JSValue r = js_call_host(ctx, this_val, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    return r;
+    return call_host(ctx, HF_APP_CURRENT_PACKAGE, 0, nullptr);
 }
 
 // ==================== Device Module ====================
 
 static JSValue js_device_getBattery(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "device.getBattery") };
-    JSValue result = js_call_host(ctx, this_val, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    const char *str = JS_ToCString(ctx, result);
-    int battery = str ? atoi(str) : 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewInt32(ctx, battery);
+    return JS_NewInt32(ctx, call_host_int(ctx, HF_DEVICE_GET_BATTERY, 0, nullptr));
 }
 
 static JSValue js_device_wakeUp(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    return JS_NewBool(ctx, call_host_bool(ctx, "device.wakeUp", 0, nullptr));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_DEVICE_WAKE_UP, 0, nullptr));
+}
+
+// ==================== UI Module ====================
+
+// A UiSnapshot (ui.snapshot()) holds one snapshot generation, so scripts can
+// keep it and diff it against a later one
+struct UiSnapshotData {
+    std::shared_ptr<const UiSnapshot> snap;
+};
+
+static JSClassID js_uisnapshot_class_id;
+
+static void js_uisnapshot_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<UiSnapshotData *>(JS_GetOpaque(val, js_uisnapshot_class_id));
+}
+
+static JSClassDef js_uisnapshot_class = {
+    "UiSnapshot",
+    .finalizer = js_uisnapshot_finalizer,
+};
+
+static UiSnapshotData *uisnapshot_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<UiSnapshotData *>(JS_GetOpaque2(ctx, this_val, js_uisnapshot_class_id));
+}
+
+static JSValue js_uisnapshot_generation(JSContext *ctx, JSValueConst this_val) {
+    UiSnapshotData *d = uisnapshot_get(ctx, this_val);
+    return d ? JS_NewUint32(ctx, d->snap->generation) : JS_EXCEPTION;
+}
+
+static JSValue js_uisnapshot_size(JSContext *ctx, JSValueConst this_val) {
+    UiSnapshotData *d = uisnapshot_get(ctx, this_val);
+    return d ? JS_NewInt32(ctx, (int32_t)d->snap->size()) : JS_EXCEPTION;
+}
+
+static const JSCFunctionListEntry js_uisnapshot_proto_funcs[] = {
+    JS_CGETSET_DEF("generation", js_uisnapshot_generation, NULL),
+    JS_CGETSET_DEF("size", js_uisnapshot_size, NULL),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "UiSnapshot", JS_PROP_CONFIGURABLE),
+};
+
+static void register_uisnapshot_class(JSContext *ctx) {
+    JS_NewClassID(&js_uisnapshot_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_uisnapshot_class_id, &js_uisnapshot_class);
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_uisnapshot_proto_funcs,
+                               sizeof(js_uisnapshot_proto_funcs) / sizeof(js_uisnapshot_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_uisnapshot_class_id, proto);
+}
+
+// ui.snapshot() - the current snapshot, or null when the accessibility
+// service is not running
+static JSValue js_ui_snapshot(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    auto snap = selector_snapshot(ctx);
+    if (!snap) return JS_NULL;
+    JSValue obj = JS_NewObjectClass(ctx, js_uisnapshot_class_id);
+    if (JS_IsException(obj)) return obj;
+    JS_SetOpaque(obj, new UiSnapshotData{ std::move(snap) });
+    return obj;
+}
+
+// ui.diff(a, b = current snapshot) - what changed from a to b (ui_diff.h):
+// { added, removed, moved, movedFrom, textChanged, textChangedFrom }, each a
+// UiCollection; removed and the *From lists hold nodes of a, aligned with
+// moved and textChanged
+static JSValue js_ui_diff(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiSnapshotData *a = uisnapshot_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!a) return JS_EXCEPTION;
+    std::shared_ptr<const UiSnapshot> b;
+    if (argc > 1 && !JS_IsUndefined(argv[1])) {
+        UiSnapshotData *d = uisnapshot_get(ctx, argv[1]);
+        if (!d) return JS_EXCEPTION;
+        b = d->snap;
+    } else {
+        b = selector_snapshot(ctx);
+        if (!b) return JS_NULL;
+    }
+    UiDiff diff;
+    ui_diff(*a->snap, *b, &diff);
+    JSValue ret = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ret, "added", ui_collection_new(ctx, b, std::move(diff.added)));
+    JS_SetPropertyStr(ctx, ret, "removed", ui_collection_new(ctx, a->snap, std::move(diff.removed)));
+    JS_SetPropertyStr(ctx, ret, "moved", ui_collection_new(ctx, b, std::move(diff.moved)));
+    JS_SetPropertyStr(ctx, ret, "movedFrom", ui_collection_new(ctx, a->snap, std::move(diff.movedFrom)));
+    JS_SetPropertyStr(ctx, ret, "textChanged", ui_collection_new(ctx, b, std::move(diff.textChanged)));
+    JS_SetPropertyStr(ctx, ret, "textChangedFrom", ui_collection_new(ctx, a->snap, std::move(diff.textChangedFrom)));
+    return ret;
+}
+
+// ==================== IdentitySet ====================
+
+// new IdentitySet() - a native set of 64-bit keys for "seen" tracking in
+// scroll loops, O(1) per item. A UiObject stands for its identity(), a
+// BigInt for itself and any other value for the hash of its string form.
+typedef std::unordered_set<uint64_t> IdentitySet;
+
+static JSClassID js_identityset_class_id;
+
+static void js_identityset_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<IdentitySet *>(JS_GetOpaque(val, js_identityset_class_id));
+}
+
+static JSClassDef js_identityset_class = {
+    "IdentitySet",
+    .finalizer = js_identityset_finalizer,
+};
+
+static IdentitySet *identityset_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<IdentitySet *>(JS_GetOpaque2(ctx, this_val, js_identityset_class_id));
+}
+
+// Returns false if converting v threw
+static bool identity_key(JSContext *ctx, JSValueConst v, uint64_t *key) {
+    if (UiObjectData *d = static_cast<UiObjectData *>(JS_GetOpaque(v, js_uiobject_class_id))) {
+        *key = ui_snapshot_identities(*d->snap)[d->node];
+        return true;
+    }
+    if (JS_IsBigInt(ctx, v)) {
+        int64_t x;
+        if (JS_ToBigInt64(ctx, &x, v)) return false;
+        *key = (uint64_t)x;
+        return true;
+    }
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, v);
+    if (!str) return false;
+    *key = ui_hash_string(std::string_view(str, len));
+    JS_FreeCString(ctx, str);
+    return true;
+}
+
+static JSValue js_identityset_ctor(JSContext *ctx, JSValueConst new_target, int argc, JSValueConst *argv) {
+    JSValue proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto)) return proto;
+    JSValue obj = JS_NewObjectProtoClass(ctx, proto, js_identityset_class_id);
+    JS_FreeValue(ctx, proto);
+    if (JS_IsException(obj)) return obj;
+    JS_SetOpaque(obj, new IdentitySet());
+    return obj;
+}
+
+// IdentitySet.add(v) - true if v was not in the set yet
+static JSValue js_identityset_add(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    IdentitySet *set = identityset_get(ctx, this_val);
+    uint64_t key;
+    if (!set || !identity_key(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &key)) return JS_EXCEPTION;
+    return JS_NewBool(ctx, set->insert(key).second);
+}
+
+// IdentitySet.has(v)
+static JSValue js_identityset_has(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    IdentitySet *set = identityset_get(ctx, this_val);
+    uint64_t key;
+    if (!set || !identity_key(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &key)) return JS_EXCEPTION;
+    return JS_NewBool(ctx, set->count(key) != 0);
+}
+
+// IdentitySet.delete(v) - true if v was in the set
+static JSValue js_identityset_delete(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    IdentitySet *set = identityset_get(ctx, this_val);
+    uint64_t key;
+    if (!set || !identity_key(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &key)) return JS_EXCEPTION;
+    return JS_NewBool(ctx, set->erase(key) != 0);
+}
+
+// IdentitySet.clear()
+static JSValue js_identityset_clear(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    IdentitySet *set = identityset_get(ctx, this_val);
+    if (!set) return JS_EXCEPTION;
+    set->clear();
+    return JS_UNDEFINED;
+}
+
+static JSValue js_identityset_size(JSContext *ctx, JSValueConst this_val) {
+    IdentitySet *set = identityset_get(ctx, this_val);
+    return set ? JS_NewInt64(ctx, (int64_t)set->size()) : JS_EXCEPTION;
+}
+
+static const JSCFunctionListEntry js_identityset_proto_funcs[] = {
+    JS_CFUNC_DEF("add", 1, js_identityset_add),
+    JS_CFUNC_DEF("has", 1, js_identityset_has),
+    JS_CFUNC_DEF("delete", 1, js_identityset_delete),
+    JS_CFUNC_DEF("clear", 0, js_identityset_clear),
+    JS_CGETSET_DEF("size", js_identityset_size, NULL),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "IdentitySet", JS_PROP_CONFIGURABLE),
+};
+
+static void register_identityset_class(JSContext *ctx, JSValueConst global) {
+    JS_NewClassID(&js_identityset_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_identityset_class_id, &js_identityset_class);
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_identityset_proto_funcs,
+                               sizeof(js_identityset_proto_funcs) / sizeof(js_identityset_proto_funcs[0]));
+    JSValue ctor = JS_NewCFunction2(ctx, js_identityset_ctor, "IdentitySet", 0, JS_CFUNC_constructor, 0);
+    JS_SetConstructor(ctx, ctor, proto);
+    JS_SetClassProto(ctx, js_identityset_class_id, proto);
+    JS_SetPropertyStr(ctx, global, "IdentitySet", ctor);
+}
+
+// ==================== Images Module ====================
+
+// An Image holds one RGBA frame (image_search.h): a screen capture or
+// pixels handed in by the script
+struct ImageData {
+    std::shared_ptr<const ImageFrame> frame;
+    // Built by the first findImage on or with this image, over frame's
+    // pixels, and kept for the next ones
+    std::unique_ptr<ImagePyramid> pyramid;
+    std::unique_ptr<ImageTemplate> tpl;
+};
+
+static JSClassID js_image_class_id;
+
+static void js_image_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<ImageData *>(JS_GetOpaque(val, js_image_class_id));
+}
+
+static JSClassDef js_image_class = {
+    "Image",
+    .finalizer = js_image_finalizer,
+};
+
+static ImageData *image_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<ImageData *>(JS_GetOpaque2(ctx, this_val, js_image_class_id));
+}
+
+static JSValue image_new(JSContext *ctx, std::shared_ptr<const ImageFrame> frame) {
+    JSValue obj = JS_NewObjectClass(ctx, js_image_class_id);
+    if (JS_IsException(obj)) return obj;
+    ImageData *d = new ImageData();
+    d->frame = std::move(frame);
+    JS_SetOpaque(obj, d);
+    return obj;
+}
+
+static JSValue js_image_width(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ImageData *d = image_get(ctx, this_val);
+    return d ? JS_NewInt32(ctx, d->frame->width) : JS_EXCEPTION;
+}
+
+static JSValue js_image_height(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ImageData *d = image_get(ctx, this_val);
+    return d ? JS_NewInt32(ctx, d->frame->height) : JS_EXCEPTION;
+}
+
+// Image.pixel(x, y) - the color as an ARGB int (colors.red() etc. style), 0
+// outside the image
+static JSValue js_image_pixel(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ImageData *d = image_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    int32_t x = 0, y = 0;
+    if (argc > 0) JS_ToInt32(ctx, &x, argv[0]);
+    if (argc > 1) JS_ToInt32(ctx, &y, argv[1]);
+    const ImageFrame &f = *d->frame;
+    if (x < 0 || y < 0 || x >= f.width || y >= f.height) return JS_NewInt32(ctx, 0);
+    return JS_NewInt32(ctx, (int32_t)f.view().pixel(x, y));
+}
+
+static const JSCFunctionListEntry js_image_proto_funcs[] = {
+    JS_CFUNC_DEF("width", 0, js_image_width),
+    JS_CFUNC_DEF("height", 0, js_image_height),
+    JS_CFUNC_DEF("pixel", 2, js_image_pixel),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Image", JS_PROP_CONFIGURABLE),
+};
+
+static void register_image_class(JSContext *ctx) {
+    JS_NewClassID(&js_image_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_image_class_id, &js_image_class);
+    JSValue proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, js_image_proto_funcs,
+                               sizeof(js_image_proto_funcs) / sizeof(js_image_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_image_class_id, proto);
+}
+
+// images.capture: the host had no new frame since the last one, so the
+// screen has not changed (ScreenCapture.NO_NEW_FRAME)
+#define IMAGES_CAPTURE_NO_NEW_FRAME (-2)
+
+// images.captureScreen() - the screen as an Image, or null without the
+// screen capture permission. The host pushes the frame (nativePushFrame);
+// on an unchanged screen the last one pushed is still current.
+static JSValue js_images_captureScreen(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    int32_t ret = call_host_int(ctx, HF_IMAGES_CAPTURE, 0, nullptr);
+    if (ret <= 0 && ret != IMAGES_CAPTURE_NO_NEW_FRAME) return JS_NULL;
+    auto frame = image_frame_current();
+    return frame ? image_new(ctx, std::move(frame)) : JS_NULL;
+}
+
+// images.fromBytes(buffer, width, height, stride = width * 4) - an Image of
+// RGBA bytes (ArrayBuffer or typed array), copied
+static JSValue js_images_fromBytes(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    if (argc < 3) return JS_ThrowTypeError(ctx, "fromBytes(buffer, width, height, stride?)");
+    int32_t width = 0, height = 0, stride = 0;
+    if (JS_ToInt32(ctx, &width, argv[1]) || JS_ToInt32(ctx, &height, argv[2])) return JS_EXCEPTION;
+    if (argc > 3 && !JS_IsUndefined(argv[3]) && JS_ToInt32(ctx, &stride, argv[3])) return JS_EXCEPTION;
+    // In 64 bits: width * 4 may not fit an int32_t
+    int64_t row = (int64_t)width * 4, pitch = stride == 0 ? row : stride;
+
+    size_t len = 0, offset = 0, elem;
+    uint8_t *p = JS_GetArrayBuffer(ctx, &len, argv[0]);
+    if (!p) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        JSValue ab = JS_GetTypedArrayBuffer(ctx, argv[0], &offset, &len, &elem);
+        if (JS_IsException(ab)) return JS_ThrowTypeError(ctx, "fromBytes: buffer must be an ArrayBuffer or typed array");
+        size_t total;
+        p = JS_GetArrayBuffer(ctx, &total, ab);
+        JS_FreeValue(ctx, ab);
+        if (!p) return JS_EXCEPTION;
+        p += offset;
+    }
+    if (width <= 0 || height <= 0 || pitch < row || pitch > INT32_MAX ||
+        (int64_t)len < pitch * (height - 1) + row) {
+        return JS_ThrowRangeError(ctx, "fromBytes: %zu bytes do not hold %dx%d pixels", len, width, height);
+    }
+    auto frame = std::make_shared<ImageFrame>();
+    image_frame_copy(p, width, height, (int32_t)pitch, frame.get());
+    return image_new(ctx, std::move(frame));
+}
+
+// A color argument: an ARGB int or "#RRGGBB" / "#AARRGGBB"
+static bool image_color_arg(JSContext *ctx, JSValueConst v, uint32_t *color) {
+    if (JS_IsString(v)) {
+        const char *s = JS_ToCString(ctx, v);
+        if (!s) return false;
+        bool ok = image_parse_color(s, color);
+        JS_FreeCString(ctx, s);
+        if (!ok) JS_ThrowTypeError(ctx, "invalid color");
+        return ok;
+    }
+    int64_t c;
+    if (JS_ToInt64(ctx, &c, v)) return false;
+    *color = (uint32_t)c;
+    return true;
+}
+
+// options.region as [x, y, width, height]; out is left alone without one
+static bool image_region_arg(JSContext *ctx, JSValueConst opts, ImageRegion *out) {
+    JSValue v = JS_GetPropertyStr(ctx, opts, "region");
+    bool ok = true;
+    if (JS_IsObject(v)) {
+        // Without a width or height the region extends to the image's edges
+        int32_t r[4] = { 0, 0, INT32_MAX, INT32_MAX };
+        for (uint32_t i = 0; ok && i < 4; i++) {
+            JSValue e = JS_GetPropertyUint32(ctx, v, i);
+            if (!JS_IsUndefined(e)) ok = !JS_ToInt32(ctx, &r[i], e);
+            JS_FreeValue(ctx, e);
+        }
+        *out = { r[0], r[1], r[2], r[3] };
+    }
+    JS_FreeValue(ctx, v);
+    return ok;
+}
+
+// { threshold = 4, region: [x, y, width, height], limit = 1000 }
+typedef struct {
+    int threshold;
+    ImageRegion region;
+    int32_t limit;
+} ImageSearchOptions;
+
+static bool image_options_arg(JSContext *ctx, JSValueConst opts, const ImageView &img, ImageSearchOptions *out) {
+    out->threshold = 4;
+    out->region = image_full_region(img);
+    out->limit = 1000;
+    if (!JS_IsObject(opts)) return true;
+    JSValue v = JS_GetPropertyStr(ctx, opts, "threshold");
+    bool ok = JS_IsUndefined(v) || !JS_ToInt32(ctx, &out->threshold, v);
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, opts, "limit");
+    ok = ok && (JS_IsUndefined(v) || !JS_ToInt32(ctx, &out->limit, v));
+    JS_FreeValue(ctx, v);
+    return ok && image_region_arg(ctx, opts, &out->region);
+}
+
+static JSValue image_point_new(JSContext *ctx, ImagePoint p) {
+    JSValue obj = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, obj, "x", JS_NewInt32(ctx, p.x));
+    JS_SetPropertyStr(ctx, obj, "y", JS_NewInt32(ctx, p.y));
+    return obj;
+}
+
+static JSValue image_points_new(JSContext *ctx, const std::vector<ImagePoint> &points) {
+    JSValue arr = JS_NewArray(ctx);
+    for (size_t i = 0; i < points.size(); i++) JS_SetPropertyUint32(ctx, arr, (uint32_t)i, image_point_new(ctx, points[i]));
+    return arr;
+}
+
+// images.findColor(image, color, options?) - the first matching pixel in
+// row-major order as { x, y }, or null
+// images.findAllColors(image, color, options?) - all of them, up to
+// options.limit (0 = no limit)
+static JSValue js_images_findColor(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int all) {
+    ImageData *d = image_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!d) return JS_EXCEPTION;
+    uint32_t color;
+    ImageSearchOptions opts;
+    ImageView img = d->frame->view();
+    if (!image_color_arg(ctx, argc > 1 ? argv[1] : JS_UNDEFINED, &color) ||
+        !image_options_arg(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, img, &opts)) {
+        return JS_EXCEPTION;
+    }
+    std::vector<ImagePoint> found;
+    size_t limit = !all ? 1 : opts.limit > 0 ? (size_t)opts.limit : 0;
+    image_find_colors(img, color, opts.threshold, opts.region, limit, &found);
+    if (!all) return found.empty() ? JS_NULL : image_point_new(ctx, found[0]);
+    return image_points_new(ctx, found);
+}
+
+// Length of a JS array, false (with a TypeError) if v is none
+static bool image_array_length(JSContext *ctx, JSValueConst v, const char *what, int64_t *len) {
+    if (JS_IsArray(ctx, v) <= 0) {
+        JS_ThrowTypeError(ctx, "%s must be an array", what);
+        return false;
+    }
+    JSValue n = JS_GetPropertyStr(ctx, v, "length");
+    bool ok = !JS_ToInt64(ctx, len, n);
+    JS_FreeValue(ctx, n);
+    return ok;
+}
+
+// Offsets of a multi-color pattern: [[dx, dy, color], ...]
+static bool image_offsets_arg(JSContext *ctx, JSValueConst arr, ImageMultiColor *out) {
+    int64_t len = 0;
+    if (!image_array_length(ctx, arr, "colors", &len)) return false;
+    out->offsets.clear();
+    bool ok = true;
+    for (int64_t i = 0; ok && i < len; i++) {
+        JSValue e = JS_GetPropertyUint32(ctx, arr, (uint32_t)i);
+        JSValue dx = JS_GetPropertyUint32(ctx, e, 0), dy = JS_GetPropertyUint32(ctx, e, 1);
+        JSValue color = JS_GetPropertyUint32(ctx, e, 2);
+        ImageColorOffset o;
+        ok = !JS_ToInt32(ctx, &o.dx, dx) && !JS_ToInt32(ctx, &o.dy, dy) && image_color_arg(ctx, color, &o.color);
+        if (ok) out->offsets.push_back(o);
+        JS_FreeValue(ctx, color);
+        JS_FreeValue(ctx, dy);
+        JS_FreeValue(ctx, dx);
+        JS_FreeValue(ctx, e);
+    }
+    return ok;
+}
+
+// images.findMultiColors(image, firstColor, colors, options?) - the first
+// point in row-major order whose pixel matches firstColor and each
+// [dx, dy, color] of colors the pixel at that offset, or null
+// images.findAllMultiColors(image, firstColor, colors, options?) - all of
+// them, up to options.limit
+static JSValue js_images_findMultiColors(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv,
+                                         int all) {
+    ImageData *d = image_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!d) return JS_EXCEPTION;
+    ImageMultiColor pattern;
+    ImageSearchOptions opts;
+    ImageView img = d->frame->view();
+    if (!image_color_arg(ctx, argc > 1 ? argv[1] : JS_UNDEFINED, &pattern.color) ||
+        !image_offsets_arg(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &pattern) ||
+        !image_options_arg(ctx, argc > 3 ? argv[3] : JS_UNDEFINED, img, &opts)) {
+        return JS_EXCEPTION;
+    }
+    pattern.threshold = opts.threshold;
+    std::vector<ImagePoint> found;
+    size_t limit = !all ? 1 : opts.limit > 0 ? (size_t)opts.limit : 0;
+    image_find_multi_colors(img, pattern, opts.region, limit, &found);
+    if (!all) return found.empty() ? JS_NULL : image_point_new(ctx, found[0]);
+    return image_points_new(ctx, found);
+}
+
+// images.findMultiColorsBatch(image, patterns, options?) - search many
+// patterns, { firstColor, colors, threshold? }, in one pass over the image.
+// One result per pattern: its first point or null, or with options.all the
+// array of its points (up to options.limit each).
+static JSValue js_images_findMultiColorsBatch(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ImageData *d = image_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!d) return JS_EXCEPTION;
+    ImageSearchOptions opts;
+    ImageView img = d->frame->view();
+    JSValueConst arr = argc > 1 ? argv[1] : JS_UNDEFINED;
+    int64_t len = 0;
+    if (!image_array_length(ctx, arr, "patterns", &len) ||
+        !image_options_arg(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, img, &opts)) {
+        return JS_EXCEPTION;
+    }
+    int all = 0;
+    if (argc > 2 && JS_IsObject(argv[2])) {
+        JSValue v = JS_GetPropertyStr(ctx, argv[2], "all");
+        all = JS_ToBool(ctx, v);
+        JS_FreeValue(ctx, v);
+    }
+
+    // Grown as patterns check out: the array's length alone may be anything
+    std::vector<ImageMultiColor> patterns;
+    bool ok = true;
+    for (int64_t i = 0; ok && i < len; i++) {
+        JSValue e = JS_GetPropertyUint32(ctx, arr, (uint32_t)i);
+        JSValue first = JS_GetPropertyStr(ctx, e, "firstColor"), colors = JS_GetPropertyStr(ctx, e, "colors");
+        JSValue threshold = JS_GetPropertyStr(ctx, e, "threshold");
+        ImageMultiColor p;
+        p.threshold = opts.threshold;
+        ok = image_color_arg(ctx, first, &p.color) && image_offsets_arg(ctx, colors, &p) &&
+             (JS_IsUndefined(threshold) || !JS_ToInt32(ctx, &p.threshold, threshold));
+        if (ok) patterns.push_back(std::move(p));
+        JS_FreeValue(ctx, threshold);
+        JS_FreeValue(ctx, colors);
+        JS_FreeValue(ctx, first);
+        JS_FreeValue(ctx, e);
+    }
+    if (!ok) return JS_EXCEPTION;
+
+    std::vector<std::vector<ImagePoint>> found;
+    size_t limit = !all ? 1 : opts.limit > 0 ? (size_t)opts.limit : 0;
+    image_find_multi_colors_batch(img, patterns, opts.region, limit, &found);
+    JSValue result = JS_NewArray(ctx);
+    for (size_t i = 0; i < found.size(); i++) {
+        JSValue v = all ? image_points_new(ctx, found[i]) : found[i].empty() ? JS_NULL : image_point_new(ctx, found[i][0]);
+        JS_SetPropertyUint32(ctx, result, (uint32_t)i, v);
+    }
+    return result;
+}
+
+// { threshold = 0.9, region, method: "ncc" | "ssd", levels, limit = 10 }
+static bool image_match_options_arg(JSContext *ctx, JSValueConst opts, ImageMatchOptions *out) {
+    out->limit = 10;
+    if (!JS_IsObject(opts)) return true;
+    double threshold = out->threshold;
+    int32_t levels = out->levels, limit = (int32_t)out->limit;
+    JSValue v = JS_GetPropertyStr(ctx, opts, "threshold");
+    bool ok = JS_IsUndefined(v) || !JS_ToFloat64(ctx, &threshold, v);
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, opts, "levels");
+    ok = ok && (JS_IsUndefined(v) || !JS_ToInt32(ctx, &levels, v));
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, opts, "limit");
+    ok = ok && (JS_IsUndefined(v) || !JS_ToInt32(ctx, &limit, v));
+    JS_FreeValue(ctx, v);
+    v = JS_GetPropertyStr(ctx, opts, "method");
+    if (ok && JS_IsString(v)) {
+        const char *m = JS_ToCString(ctx, v);
+        if (!m) ok = false;
+        else if (strcmp(m, "ncc") == 0) out->method = IMAGE_MATCH_NCC;
+        else if (strcmp(m, "ssd") == 0) out->method = IMAGE_MATCH_SSD;
+        else {
+            JS_ThrowTypeError(ctx, "unknown match method: %s", m);
+            ok = false;
+        }
+        JS_FreeCString(ctx, m);
+    }
+    JS_FreeValue(ctx, v);
+    out->threshold = (float)threshold;
+    out->levels = levels;
+    out->limit = limit > 0 ? (size_t)limit : 0;
+    return ok && image_region_arg(ctx, opts, &out->region);
+}
+
+// images.findImage(image, template, options?) - the best match of template
+// (an Image; pixels with alpha < 128 are ignored) as { x, y, score }, or
+// null below options.threshold
+// images.findAllImages(image, template, options?) - the matches best
+// first, up to options.limit (default 10), none overlapping a better one
+// by more than half the template
+static JSValue js_images_findImage(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int all) {
+    ImageData *d = image_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!d) return JS_EXCEPTION;
+    ImageData *t = image_get(ctx, argc > 1 ? argv[1] : JS_UNDEFINED);
+    if (!t) return JS_EXCEPTION;
+    ImageMatchOptions opts;
+    if (!image_match_options_arg(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &opts)) return JS_EXCEPTION;
+    if (!all) opts.limit = 1;
+    if (!d->pyramid) d->pyramid.reset(new ImagePyramid(d->frame->view()));
+    if (!t->tpl) t->tpl.reset(new ImageTemplate(t->frame->view()));
+
+    std::vector<ImageMatch> found;
+    image_match_template(*d->pyramid, *t->tpl, opts, &found);
+    JSValue arr = all ? JS_NewArray(ctx) : JS_NULL;
+    for (size_t i = 0; i < found.size(); i++) {
+        JSValue m = image_point_new(ctx, { found[i].x, found[i].y });
+        JS_SetPropertyStr(ctx, m, "score", JS_NewFloat64(ctx, found[i].score));
+        if (!all) return m;
+        JS_SetPropertyUint32(ctx, arr, (uint32_t)i, m);
+    }
+    return arr;
+}
+
+// images.findAll(img, templates, options): the best match of each
+// template, or null, searched on the frame's shared pyramid.
+// images.findAny(img, templates, options): the best of those matches,
+// with the template's index, or null if none reaches the threshold.
+static JSValue js_images_findTemplates(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int any) {
+    ImageData *d = image_get(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!d) return JS_EXCEPTION;
+    JSValueConst arr = argc > 1 ? argv[1] : JS_UNDEFINED;
+    int64_t len = 0;
+    ImageMatchOptions opts;
+    if (!image_array_length(ctx, arr, "templates", &len) ||
+        !image_match_options_arg(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &opts)) {
+        return JS_EXCEPTION;
+    }
+    opts.limit = 1;
+
+    // The template values stay referenced until the search is over
+    std::vector<JSValue> values;
+    std::vector<ImageTemplate *> tpls;
+    bool ok = true;
+    for (int64_t i = 0; ok && i < len; i++) {
+        values.push_back(JS_GetPropertyUint32(ctx, arr, (uint32_t)i));
+        ImageData *t = image_get(ctx, values.back());
+        if (!t) {
+            ok = false;
+            break;
+        }
+        if (!t->tpl) t->tpl.reset(new ImageTemplate(t->frame->view()));
+        tpls.push_back(t->tpl.get());
+    }
+    JSValue result = JS_EXCEPTION;
+    if (ok) {
+        if (!d->pyramid) d->pyramid.reset(new ImagePyramid(d->frame->view()));
+        std::vector<std::vector<ImageMatch>> found;
+        image_match_templates(*d->pyramid, tpls, opts, &found);
+        size_t best = found.size();
+        result = any ? JS_NULL : JS_NewArray(ctx);
+        for (size_t i = 0; i < found.size(); i++) {
+            if (any) {
+                if (!found[i].empty() && (best == found.size() || found[i][0].score > found[best][0].score)) best = i;
+                continue;
+            }
+            JSValue m = JS_NULL;
+            if (!found[i].empty()) {
+                m = image_point_new(ctx, { found[i][0].x, found[i][0].y });
+                JS_SetPropertyStr(ctx, m, "score", JS_NewFloat64(ctx, found[i][0].score));
+            }
+            JS_SetPropertyUint32(ctx, result, (uint32_t)i, m);
+        }
+        if (any && best < found.size()) {
+            result = image_point_new(ctx, { found[best][0].x, found[best][0].y });
+            JS_SetPropertyStr(ctx, result, "score", JS_NewFloat64(ctx, found[best][0].score));
+            JS_SetPropertyStr(ctx, result, "index", JS_NewInt64(ctx, (int64_t)best));
+        }
+    }
+    for (JSValue v : values) JS_FreeValue(ctx, v);
+    return result;
 }
 
+// images.setThreads(n): threads the searches split their region over,
+// the calling one included; n <= 0 restores the CPU count. Returns the
+// count in effect, as getThreads().
+static JSValue js_images_setThreads(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    int32_t n = 0;
+    if (argc > 0 && JS_ToInt32(ctx, &n, argv[0])) return JS_EXCEPTION;
+    return JS_NewInt32(ctx, image_set_threads(n));
+}
+
+static JSValue js_images_getThreads(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return JS_NewInt32(ctx, image_threads());
+}
+
+static const JSCFunctionListEntry js_images_funcs[] = {
+    JS_CFUNC_DEF("captureScreen", 0, js_images_captureScreen),
+    JS_CFUNC_DEF("fromBytes", 4, js_images_fromBytes),
+    JS_CFUNC_MAGIC_DEF("findColor", 3, js_images_findColor, 0),
+    JS_CFUNC_MAGIC_DEF("findAllColors", 3, js_images_findColor, 1),
+    JS_CFUNC_MAGIC_DEF("findMultiColors", 4, js_images_findMultiColors, 0),
+    JS_CFUNC_MAGIC_DEF("findAllMultiColors", 4, js_images_findMultiColors, 1),
+    JS_CFUNC_DEF("findMultiColorsBatch", 3, js_images_findMultiColorsBatch),
+    JS_CFUNC_MAGIC_DEF("findImage", 3, js_images_findImage, 0),
+    JS_CFUNC_MAGIC_DEF("findAllImages", 3, js_images_findImage, 1),
+    JS_CFUNC_MAGIC_DEF("findAll", 3, js_images_findTemplates, 0),
+    JS_CFUNC_MAGIC_DEF("findAny", 3, js_images_findTemplates, 1),
+    JS_CFUNC_DEF("setThreads", 1, js_images_setThreads),
+    JS_CFUNC_DEF("getThreads", 0, js_images_getThreads),
+};
+
 // ==================== Shell/Files/HTTP ====================
 
 static JSValue js_shell(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_UNDEFINED;
-    JSValue args[3] = { JS_NewString(ctx, "shell"), JS_DupValue(ctx, argv[0]), argc > 1 ? JS_DupValue(ctx, argv[1]) : JS_UNDEFINED };
-    JSValue result = js_call_host(ctx, this_val, argc > 1 ? 3 : 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); if (argc > 1) JS_FreeValue(ctx, args[2]);
-    const char *json = JS_ToCString(ctx, result);
-    if (json) {
-        JSValue parsed = JS_ParseJSON(ctx, json, strlen(json), "<shell>");
-        JS_FreeCString(ctx, json);
-        JS_FreeValue(ctx, result);
-        return parsed;
-    }
-    return result;
+    return call_host_json(ctx, HF_SHELL, argc > 1 ? 2 : 1, argv);
 }
 
 static JSValue js_files_read(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_NULL;
-    JSValue args[2] = { JS_NewString(ctx, "files.read"), JS_DupValue(ctx, argv[0]) };
-    JSValue r = js_call_host(ctx, this_val, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    return r;
+    return call_host(ctx, HF_FILES_READ, 1, argv);
 }
 
 static JSValue js_files_write(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 2) return JS_FALSE;
-    JSValue args[3] = { JS_NewString(ctx, "files.write"), JS_DupValue(ctx, argv[0]), JS_DupValue(ctx, argv[1]) };
-    JSValue result = js_call_host(ctx, this_val, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewBool(ctx, ret);
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_FILES_WRITE, 2, argv));
 }
 
 static JSValue js_http_get(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_NULL;
-    JSValue args[2] = { JS_NewString(ctx, "http.get"), JS_DupValue(ctx, argv[0]) };
-    JSValue result = js_call_host(ctx, this_val, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    const char *json = JS_ToCString(ctx, result);
-    if (json) {
-        JSValue parsed = JS_ParseJSON(ctx, json, strlen(json), "<http>");
-        JS_FreeCString(ctx, json);
-        JS_FreeValue(ctx, result);
-        return parsed;
-    }
-    return result;
+    return call_host_json(ctx, HF_HTTP_GET, 1, argv);
 }
 
 // ==================== HTTP POST ====================
@@ -1548,25 +2189,15 @@ static JSValue js_http_get(JSContext *ctx, JSValueConst this_val, int argc, JSVa
 static JSValue js_http_post(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 2) return JS_NULL;
     
-    // Serialize data to JSON
-    const char *url = JS_ToCString(ctx, argv[0]);
-    JSValue dataJson = JS_JSONStringify(ctx, argv[1], JS_UNDEFINED, JS_UNDEFINED);
-    const char *dataStr = JS_ToCString(ctx, dataJson);
-    
-    JSValue args[3] = { JS_NewString(ctx, "http.postForm"), JS_NewString(ctx, url ? url : ""), JS_NewString(ctx, dataStr ? dataStr : "{}") };
-    if (url) JS_FreeCString(ctx, url);
-    if (dataStr) JS_FreeCString(ctx, dataStr);
-    JS_FreeValue(ctx, dataJson);
-    
-    JSValue result = js_call_host(ctx, this_val, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *json = JS_ToCString(ctx, result);
-    if (json) {
-        JSValue parsed = JS_ParseJSON(ctx, json, strlen(json), "<http.post>");
-        JS_FreeCString(ctx, json);
-        JS_FreeValue(ctx, result);
-        
+    // Form data is sent as JSON
+    JSValue url = JS_ToString(ctx, argv[0]);
+    JSValue data = JS_IsObject(argv[1]) ? JS_DupValue(ctx, argv[1]) : JS_NewObject(ctx);
+    JSValueConst args[2] = { url, data };
+    JSValue parsed = call_host_json(ctx, HF_HTTP_POST_FORM, 2, args);
+    JS_FreeValue(ctx, url);
+    JS_FreeValue(ctx, data);
+    
+    if (JS_IsObject(parsed)) {
         // Add body.string() method
         JSValue body = JS_GetPropertyStr(ctx, parsed, "body");
         if (JS_IsObject(body)) {
@@ -1577,9 +2208,8 @@ static JSValue js_http_post(JSContext *ctx, JSValueConst this_val, int argc, JSV
             JS_SetPropertyStr(ctx, body, "string", stringFn);
         }
         JS_FreeValue(ctx, body);
-        return parsed;
     }
-    return result;
+    return parsed;
 }
 
 // ==================== Storages ====================
@@ -1604,26 +2234,18 @@ static JSValue js_storage_get(JSContext *ctx, JSValueConst this_val, int argc, J
     JSStorage *s = (JSStorage *)JS_GetOpaque(this_val, js_storage_class_id);
     if (!s || argc < 1) return JS_UNDEFINED;
     
-    const char *key = JS_ToCString(ctx, argv[0]);
-    JSValue args[3] = { JS_NewString(ctx, "storage.get"), JS_NewString(ctx, s->name), JS_NewString(ctx, key ? key : "") };
-    if (key) JS_FreeCString(ctx, key);
+    JSValue name = JS_NewString(ctx, s->name);
+    JSValue key = JS_ToString(ctx, argv[0]);
+    JSValueConst args[2] = { name, key };
+    JSValue parsed = call_host_json(ctx, HF_STORAGE_GET, 2, args);
+    JS_FreeValue(ctx, name);
+    JS_FreeValue(ctx, key);
     
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    JS_FreeValue(ctx, result);
-    
-    if (!str || strcmp(str, "null") == 0) {
-        if (str) JS_FreeCString(ctx, str);
+    if (JS_IsNull(parsed) || JS_IsUndefined(parsed)) {
         // Return default value if provided
         if (argc > 1) return JS_DupValue(ctx, argv[1]);
         return JS_UNDEFINED;
     }
-    
-    // Parse JSON value
-    JSValue parsed = JS_ParseJSON(ctx, str, strlen(str), "<storage.get>");
-    JS_FreeCString(ctx, str);
     return parsed;
 }
 
@@ -1631,27 +2253,19 @@ static JSValue js_storage_put(JSContext *ctx, JSValueConst this_val, int argc, J
     JSStorage *s = (JSStorage *)JS_GetOpaque(this_val, js_storage_class_id);
     if (!s || argc < 2) return JS_FALSE;
     
-    const char *key = JS_ToCString(ctx, argv[0]);
+    // Values are stored as their JSON text
     JSValue valueJson = JS_JSONStringify(ctx, argv[1], JS_UNDEFINED, JS_UNDEFINED);
-    const char *valueStr = JS_ToCString(ctx, valueJson);
-    
-    JSValue args[4] = { 
-        JS_NewString(ctx, "storage.put"), 
-        JS_NewString(ctx, s->name), 
-        JS_NewString(ctx, key ? key : ""),
-        JS_NewString(ctx, valueStr ? valueStr : "null")
-    };
-    if (key) JS_FreeCString(ctx, key);
-    if (valueStr) JS_FreeCString(ctx, valueStr);
+    if (JS_IsException(valueJson) || JS_IsUndefined(valueJson)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        valueJson = JS_NewString(ctx, "null");
+    }
+    JSValue name = JS_NewString(ctx, s->name);
+    JSValue key = JS_ToString(ctx, argv[0]);
+    JSValueConst args[3] = { name, key, valueJson };
+    bool ret = call_host_bool(ctx, HF_STORAGE_PUT, 3, args);
+    JS_FreeValue(ctx, name);
+    JS_FreeValue(ctx, key);
     JS_FreeValue(ctx, valueJson);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 4, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]); JS_FreeValue(ctx, args[3]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
     return JS_NewBool(ctx, ret);
 }
 
@@ -1659,17 +2273,12 @@ static JSValue js_storage_remove(JSContext *ctx, JSValueConst this_val, int argc
     JSStorage *s = (JSStorage *)JS_GetOpaque(this_val, js_storage_class_id);
     if (!s || argc < 1) return JS_FALSE;
     
-    const char *key = JS_ToCString(ctx, argv[0]);
-    JSValue args[3] = { JS_NewString(ctx, "storage.remove"), JS_NewString(ctx, s->name), JS_NewString(ctx, key ? key : "") };
-    if (key) JS_FreeCString(ctx, key);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
+    JSValue name = JS_NewString(ctx, s->name);
+    JSValue key = JS_ToString(ctx, argv[0]);
+    JSValueConst args[2] = { name, key };
+    bool ret = call_host_bool(ctx, HF_STORAGE_REMOVE, 2, args);
+    JS_FreeValue(ctx, name);
+    JS_FreeValue(ctx, key);
     return JS_NewBool(ctx, ret);
 }
 
@@ -1677,17 +2286,12 @@ static JSValue js_storage_contains(JSContext *ctx, JSValueConst this_val, int ar
     JSStorage *s = (JSStorage *)JS_GetOpaque(this_val, js_storage_class_id);
     if (!s || argc < 1) return JS_FALSE;
     
-    const char *key = JS_ToCString(ctx, argv[0]);
-    JSValue args[3] = { JS_NewString(ctx, "storage.contains"), JS_NewString(ctx, s->name), JS_NewString(ctx, key ? key : "") };
-    if (key) JS_FreeCString(ctx, key);
-    
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 3, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]); JS_FreeValue(ctx, args[2]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
+    JSValue name = JS_NewString(ctx, s->name);
+    JSValue key = JS_ToString(ctx, argv[0]);
+    JSValueConst args[2] = { name, key };
+    bool ret = call_host_bool(ctx, HF_STORAGE_CONTAINS, 2, args);
+    JS_FreeValue(ctx, name);
+    JS_FreeValue(ctx, key);
     return JS_NewBool(ctx, ret);
 }
 
@@ -1695,14 +2299,9 @@ static JSValue js_storage_clear(JSContext *ctx, JSValueConst this_val, int argc,
     JSStorage *s = (JSStorage *)JS_GetOpaque(this_val, js_storage_class_id);
     if (!s) return JS_FALSE;
     
-    JSValue args[2] = { JS_NewString(ctx, "storage.clear"), JS_NewString(ctx, s->name) };
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 2, args);
-    JS_FreeValue(ctx, args[0]); JS_FreeValue(ctx, args[1]);
-    
-    const char *str = JS_ToCString(ctx, result);
-    bool ret = str && strcmp(str, "true") == 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
+    JSValue name = JS_NewString(ctx, s->name);
+    bool ret = call_host_bool(ctx, HF_STORAGE_CLEAR, 1, &name);
+    JS_FreeValue(ctx, name);
     return JS_NewBool(ctx, ret);
 }
 
@@ -1732,41 +2331,24 @@ static JSValue js_storages_create(JSContext *ctx, JSValueConst this_val, int arg
 // ==================== Device width/height ====================
 
 static JSValue js_device_width(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "device.width") };
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    const char *str = JS_ToCString(ctx, result);
-    int width = str ? atoi(str) : 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewInt32(ctx, width);
+    return JS_NewInt32(ctx, call_host_int(ctx, HF_DEVICE_WIDTH, 0, nullptr));
 }
 
 static JSValue js_device_height(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "device.height") };
-    JSValue result = js_call_host(ctx, JS_UNDEFINED, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    const char *str = JS_ToCString(ctx, result);
-    int height = str ? atoi(str) : 0;
-    if (str) JS_FreeCString(ctx, str);
-    JS_FreeValue(ctx, result);
-    return JS_NewInt32(ctx, height);
+    return JS_NewInt32(ctx, call_host_int(ctx, HF_DEVICE_HEIGHT, 0, nullptr));
 }
 
 // ==================== currentPackage global ====================
 
 static JSValue js_currentPackage(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    JSValue args[1] = { JS_NewString(ctx, "currentPackage") };
-    JSValue r = js_call_host(ctx, this_val, 1, args);
-    JS_FreeValue(ctx, args[0]);
-    return r;
+    return call_host(ctx, HF_CURRENT_PACKAGE, 0, nullptr);
 }
 
 // ==================== launchApp ====================
 
 static JSValue js_launchApp(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     if (argc < 1) return JS_FALSE;
-    return JS_NewBool(ctx, call_host_bool(ctx, "app.launchApp", argc, argv));
+    return JS_NewBool(ctx, call_host_bool(ctx, HF_APP_LAUNCH_APP, argc, argv));
 }
 
 // ==================== Register All APIs ====================
@@ -1808,53 +2390,12 @@ static void register_automation_api(JSContext *ctx) {
     JS_SetPropertyStr(ctx, global, "notifications", JS_NewCFunction(ctx, js_notifications, "notifications", 0));
     JS_SetPropertyStr(ctx, global, "quickSettings", JS_NewCFunction(ctx, js_quickSettings, "quickSettings", 0));
     
-    // UI Selectors (AutoJS style) - text
-    JS_SetPropertyStr(ctx, global, "text", JS_NewCFunction(ctx, js_text, "text", 1));
-    JS_SetPropertyStr(ctx, global, "textContains", JS_NewCFunction(ctx, js_textContains, "textContains", 1));
-    JS_SetPropertyStr(ctx, global, "textStartsWith", JS_NewCFunction(ctx, js_textStartsWith, "textStartsWith", 1));
-    JS_SetPropertyStr(ctx, global, "textEndsWith", JS_NewCFunction(ctx, js_textEndsWith, "textEndsWith", 1));
-    JS_SetPropertyStr(ctx, global, "textMatches", JS_NewCFunction(ctx, js_textMatches, "textMatches", 1));
-    
-    // UI Selectors - desc
-    JS_SetPropertyStr(ctx, global, "desc", JS_NewCFunction(ctx, js_desc, "desc", 1));
-    JS_SetPropertyStr(ctx, global, "descContains", JS_NewCFunction(ctx, js_descContains, "descContains", 1));
-    JS_SetPropertyStr(ctx, global, "descStartsWith", JS_NewCFunction(ctx, js_descStartsWith, "descStartsWith", 1));
-    JS_SetPropertyStr(ctx, global, "descEndsWith", JS_NewCFunction(ctx, js_descEndsWith, "descEndsWith", 1));
-    JS_SetPropertyStr(ctx, global, "descMatches", JS_NewCFunction(ctx, js_descMatches, "descMatches", 1));
-    
-    // UI Selectors - id
-    JS_SetPropertyStr(ctx, global, "id", JS_NewCFunction(ctx, js_id, "id", 1));
-    JS_SetPropertyStr(ctx, global, "idContains", JS_NewCFunction(ctx, js_idContains, "idContains", 1));
-    JS_SetPropertyStr(ctx, global, "idStartsWith", JS_NewCFunction(ctx, js_idStartsWith, "idStartsWith", 1));
-    JS_SetPropertyStr(ctx, global, "idEndsWith", JS_NewCFunction(ctx, js_idEndsWith, "idEndsWith", 1));
-    JS_SetPropertyStr(ctx, global, "idMatches", JS_NewCFunction(ctx, js_idMatches, "idMatches", 1));
-    
-    // UI Selectors - className
-    JS_SetPropertyStr(ctx, global, "className", JS_NewCFunction(ctx, js_className, "className", 1));
-    JS_SetPropertyStr(ctx, global, "classNameContains", JS_NewCFunction(ctx, js_classNameContains, "classNameContains", 1));
-    JS_SetPropertyStr(ctx, global, "classNameStartsWith", JS_NewCFunction(ctx, js_classNameStartsWith, "classNameStartsWith", 1));
-    JS_SetPropertyStr(ctx, global, "classNameEndsWith", JS_NewCFunction(ctx, js_classNameEndsWith, "classNameEndsWith", 1));
-    JS_SetPropertyStr(ctx, global, "classNameMatches", JS_NewCFunction(ctx, js_classNameMatches, "classNameMatches", 1));
-    
-    // UI Selectors - packageName
-    JS_SetPropertyStr(ctx, global, "packageName", JS_NewCFunction(ctx, js_packageName, "packageName", 1));
-    JS_SetPropertyStr(ctx, global, "packageNameContains", JS_NewCFunction(ctx, js_packageNameContains, "packageNameContains", 1));
-    JS_SetPropertyStr(ctx, global, "packageNameStartsWith", JS_NewCFunction(ctx, js_packageNameStartsWith, "packageNameStartsWith", 1));
-    JS_SetPropertyStr(ctx, global, "packageNameEndsWith", JS_NewCFunction(ctx, js_packageNameEndsWith, "packageNameEndsWith", 1));
-    
-    // UI Selectors - boolean properties
-    JS_SetPropertyStr(ctx, global, "clickable", JS_NewCFunction(ctx, js_clickable, "clickable", 0));
-    JS_SetPropertyStr(ctx, global, "scrollable", JS_NewCFunction(ctx, js_scrollable, "scrollable", 0));
-    JS_SetPropertyStr(ctx, global, "enabled", JS_NewCFunction(ctx, js_enabled, "enabled", 0));
-    JS_SetPropertyStr(ctx, global, "checked", JS_NewCFunction(ctx, js_checked, "checked", 0));
-    JS_SetPropertyStr(ctx, global, "selected", JS_NewCFunction(ctx, js_selected, "selected", 0));
-    JS_SetPropertyStr(ctx, global, "focusable", JS_NewCFunction(ctx, js_focusable, "focusable", 0));
-    JS_SetPropertyStr(ctx, global, "focused", JS_NewCFunction(ctx, js_focused, "focused", 0));
-    JS_SetPropertyStr(ctx, global, "longClickable", JS_NewCFunction(ctx, js_longClickable, "longClickable", 0));
-    JS_SetPropertyStr(ctx, global, "checkable", JS_NewCFunction(ctx, js_checkable, "checkable", 0));
-    JS_SetPropertyStr(ctx, global, "editable", JS_NewCFunction(ctx, js_editable, "editable", 0));
-    JS_SetPropertyStr(ctx, global, "visibleToUser", JS_NewCFunction(ctx, js_visibleToUser, "visibleToUser", 0));
-    JS_SetPropertyStr(ctx, global, "depth", JS_NewCFunction(ctx, js_depth, "depth", 1));
+    // UiObject class (shared prototype) and findAll() results
+    register_uiobject_class(ctx);
+    ui_collection_register(ctx, uiobject_new);
+    
+    // UI Selectors (AutoJS style)
+    register_selector_class(ctx, global);
     
     // Gesture APIs
     JS_SetPropertyStr(ctx, global, "gesture", JS_NewCFunction(ctx, js_gesture, "gesture", 10));
@@ -1879,6 +2420,20 @@ static void register_automation_api(JSContext *ctx) {
     JS_SetPropertyStr(ctx, device, "getHeight", JS_NewCFunction(ctx, js_device_height, "getHeight", 0));
     JS_SetPropertyStr(ctx, global, "device", device);
     
+    // UI module: snapshots and diffs
+    register_uisnapshot_class(ctx);
+    JSValue ui = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ui, "snapshot", JS_NewCFunction(ctx, js_ui_snapshot, "snapshot", 0));
+    JS_SetPropertyStr(ctx, ui, "diff", JS_NewCFunction(ctx, js_ui_diff, "diff", 2));
+    JS_SetPropertyStr(ctx, global, "ui", ui);
+    register_identityset_class(ctx, global);
+    
+    // Images module: captures and native color search
+    register_image_class(ctx);
+    JSValue images = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, images, js_images_funcs, sizeof(js_images_funcs) / sizeof(js_images_funcs[0]));
+    JS_SetPropertyStr(ctx, global, "images", images);
+    
     // Shell
     JS_SetPropertyStr(ctx, global, "shell", JS_NewCFunction(ctx, js_shell, "shell", 2));
     
@@ -1927,6 +2482,7 @@ Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativeInit(JNIEnv *env, jobj
         JS_FreeContext(g_ctx);
         JS_FreeRuntime(g_runtime);
     }
+    g_regex_cache = selector_regex_cache_new();
     
     g_runtime = JS_NewRuntime();
     if (!g_runtime) { LOGE("Failed to create runtime"); return; }
@@ -1939,6 +2495,7 @@ Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativeInit(JNIEnv *env, jobj
     
     if (g_callback) env->DeleteGlobalRef(g_callback);
     g_callback = env->NewGlobalRef(callback);
+    host_bridge_init(env, g_callback);
     
     register_automation_api(g_ctx);
     LOGI("QuickJS engine initialized");
@@ -1955,7 +2512,11 @@ extern "C" JNIEXPORT void JNICALL
 Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativeDestroy(JNIEnv *env, jobject thiz) {
     if (g_ctx) { JS_FreeContext(g_ctx); g_ctx = nullptr; }
     if (g_runtime) { JS_FreeRuntime(g_runtime); g_runtime = nullptr; }
+    g_regex_cache.reset();
     if (g_callback) { env->DeleteGlobalRef(g_callback); g_callback = nullptr; }
+    g_invoke_typed = nullptr;
+    g_attach_buffer = nullptr;
+    host_call_buffer_free(&g_call_buf);
     LOGI("QuickJS engine destroyed");
 }
 
@@ -1995,5 +2556,55 @@ Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativeEval(JNIEnv *env, jobj
 extern "C" JNIEXPORT void JNICALL
 Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativeInterrupt(JNIEnv *env, jobject thiz) {
     g_interrupt_flag = 1;
+    ui_snapshot_wake();
     LOGI("Interrupt requested");
 }
+
+// Publish a UI tree snapshot encoded by UiSnapshot.kt (format in ui_snapshot.h).
+// Returns the new generation, or -1 if the buffer is malformed.
+extern "C" JNIEXPORT jint JNICALL
+Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativePushSnapshot(JNIEnv *env, jobject thiz, jobject buffer, jint length) {
+    const uint8_t *p = static_cast<const uint8_t *>(env->GetDirectBufferAddress(buffer));
+    if (!p || length < 0 || length > env->GetDirectBufferCapacity(buffer)) return -1;
+    
+    auto snap = std::make_shared<UiSnapshot>();
+    if (!ui_snapshot_parse(p, (size_t)length, snap.get())) {
+        LOGE("nativePushSnapshot: malformed snapshot (%d bytes)", length);
+        return -1;
+    }
+    return (jint)ui_snapshot_publish(std::move(snap));
+}
+
+// Publish a screen capture: width x height RGBA pixels, rows rowStride bytes
+// apart (an ImageReader plane). Returns the frame generation, or -1.
+extern "C" JNIEXPORT jint JNICALL
+Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativePushFrame(JNIEnv *env, jobject thiz, jobject buffer,
+                                                                    jint width, jint height, jint rowStride) {
+    const uint8_t *p = static_cast<const uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!p || width <= 0 || height <= 0 || rowStride < (jlong)width * 4 ||
+        capacity < (jlong)rowStride * (height - 1) + (jlong)width * 4) {
+        return -1;
+    }
+    auto frame = std::make_shared<ImageFrame>();
+    image_frame_copy(p, width, height, rowStride, frame.get());
+    return (jint)image_frame_publish(std::move(frame));
+}
+
+// Apply an event delta (ui_snapshot.h) to the current snapshot and publish
+// the result. -1 when the delta does not apply, e.g. its base generation is
+// no longer current; Kotlin then pushes a full snapshot instead.
+extern "C" JNIEXPORT jint JNICALL
+Java_im_zoe_flutter_1automate_quickjs_QuickJSEngine_nativePushDelta(JNIEnv *env, jobject thiz, jobject buffer, jint length) {
+    const uint8_t *p = static_cast<const uint8_t *>(env->GetDirectBufferAddress(buffer));
+    if (!p || length < 0 || length > env->GetDirectBufferCapacity(buffer)) return -1;
+    
+    std::shared_ptr<const UiSnapshot> base = ui_snapshot_current();
+    if (!base) return -1;
+    auto snap = std::make_shared<UiSnapshot>();
+    if (!ui_snapshot_apply_delta(*base, p, (size_t)length, snap.get())) {
+        LOGE("nativePushDelta: delta does not apply to generation %u (%d bytes)", base->generation, length);
+        return -1;
+    }
+    return (jint)ui_snapshot_publish(std::move(snap));
+}
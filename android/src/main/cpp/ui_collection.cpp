@@ -0,0 +1,265 @@
+#include "ui_collection.h"
+#include "ui_snapshot.h"
+
+struct UiCollectionData {
+    std::shared_ptr<const UiSnapshot> snap;
+    std::vector<int32_t> nodes;
+    std::vector<JSValue> items;     // materialized elements, JS_UNDEFINED until read
+};
+
+static JSClassID js_collection_class_id;
+static UiObjectFactory g_collection_factory;
+
+static UiCollectionData *collection_get(JSContext *ctx, JSValueConst this_val) {
+    return static_cast<UiCollectionData *>(JS_GetOpaque2(ctx, this_val, js_collection_class_id));
+}
+
+static void js_collection_finalizer(JSRuntime *rt, JSValue val) {
+    UiCollectionData *d = static_cast<UiCollectionData *>(JS_GetOpaque(val, js_collection_class_id));
+    if (!d) return;
+    for (JSValue &v : d->items) JS_FreeValueRT(rt, v);
+    delete d;
+}
+
+static void js_collection_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) {
+    UiCollectionData *d = static_cast<UiCollectionData *>(JS_GetOpaque(val, js_collection_class_id));
+    if (!d) return;
+    for (JSValue &v : d->items) JS_MarkValue(rt, v, mark_func);
+}
+
+// Element i as a new reference, created on first access
+static JSValue collection_item(JSContext *ctx, UiCollectionData *d, uint32_t i) {
+    if (d->items.empty()) d->items.assign(d->nodes.size(), JS_UNDEFINED);
+    if (JS_IsUndefined(d->items[i])) {
+        JSValue obj = g_collection_factory(ctx, d->snap, d->nodes[i]);
+        if (JS_IsException(obj)) return obj;
+        d->items[i] = obj;
+    }
+    return JS_DupValue(ctx, d->items[i]);
+}
+
+// Parse a canonical array index property name ("0", "17"; not "01" or "-1")
+static bool collection_index(JSContext *ctx, JSAtom prop, uint32_t *index) {
+    const char *s = JS_AtomToCString(ctx, prop);
+    if (!s) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return false;
+    }
+    uint64_t v = 0;
+    size_t n = 0;
+    for (; s[n] >= '0' && s[n] <= '9' && n < 10; n++) v = v * 10 + (s[n] - '0');
+    bool ok = n > 0 && s[n] == 0 && (s[0] != '0' || n == 1) && v < 0xffffffffu;
+    JS_FreeCString(ctx, s);
+    if (ok) *index = (uint32_t)v;
+    return ok;
+}
+
+// ==================== Exotic Methods ====================
+
+static int js_collection_get_own_property(JSContext *ctx, JSPropertyDescriptor *desc, JSValueConst obj, JSAtom prop) {
+    UiCollectionData *d = static_cast<UiCollectionData *>(JS_GetOpaque(obj, js_collection_class_id));
+    uint32_t i;
+    if (!d || !collection_index(ctx, prop, &i) || i >= d->nodes.size()) return false;
+    if (desc) {
+        JSValue v = collection_item(ctx, d, i);
+        if (JS_IsException(v)) return -1;
+        desc->flags = JS_PROP_ENUMERABLE;
+        desc->value = v;
+        desc->getter = JS_UNDEFINED;
+        desc->setter = JS_UNDEFINED;
+    }
+    return true;
+}
+
+static int js_collection_get_own_property_names(JSContext *ctx, JSPropertyEnum **ptab, uint32_t *plen, JSValueConst obj) {
+    UiCollectionData *d = static_cast<UiCollectionData *>(JS_GetOpaque(obj, js_collection_class_id));
+    uint32_t n = d ? (uint32_t)d->nodes.size() : 0;
+    JSPropertyEnum *tab = static_cast<JSPropertyEnum *>(js_malloc(ctx, sizeof(JSPropertyEnum) * (n > 0 ? n : 1)));
+    if (!tab) return -1;
+    for (uint32_t i = 0; i < n; i++) {
+        tab[i].is_enumerable = true;
+        tab[i].atom = JS_NewAtomUInt32(ctx, i);
+    }
+    *ptab = tab;
+    *plen = n;
+    return 0;
+}
+
+// Elements are read-only
+static int js_collection_define_own_property(JSContext *ctx, JSValueConst this_obj, JSAtom prop, JSValueConst val,
+                                             JSValueConst getter, JSValueConst setter, int flags) {
+    return false;
+}
+
+static int js_collection_delete_property(JSContext *ctx, JSValueConst obj, JSAtom prop) {
+    UiCollectionData *d = static_cast<UiCollectionData *>(JS_GetOpaque(obj, js_collection_class_id));
+    uint32_t i;
+    return !(d && collection_index(ctx, prop, &i) && i < d->nodes.size());
+}
+
+static JSClassExoticMethods js_collection_exotic = {
+    .get_own_property = js_collection_get_own_property,
+    .get_own_property_names = js_collection_get_own_property_names,
+    .delete_property = js_collection_delete_property,
+    .define_own_property = js_collection_define_own_property,
+};
+
+static JSClassDef js_collection_class = {
+    "UiCollection",
+    .finalizer = js_collection_finalizer,
+    .gc_mark = js_collection_mark,
+    .exotic = &js_collection_exotic,
+};
+
+// ==================== Methods ====================
+
+// UiCollection.length / size()
+static JSValue js_collection_length(JSContext *ctx, JSValueConst this_val) {
+    UiCollectionData *d = collection_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return JS_NewUint32(ctx, (uint32_t)d->nodes.size());
+}
+
+static JSValue js_collection_size(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return js_collection_length(ctx, this_val);
+}
+
+// UiCollection.get(i) - null when out of range
+static JSValue js_collection_get(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiCollectionData *d = collection_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    int32_t i = 0;
+    if (argc > 0 && JS_ToInt32(ctx, &i, argv[0])) return JS_EXCEPTION;
+    if (i < 0 || (size_t)i >= d->nodes.size()) return JS_NULL;
+    return collection_item(ctx, d, (uint32_t)i);
+}
+
+// UiCollection.empty()/nonEmpty()
+static JSValue js_collection_empty(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    UiCollectionData *d = collection_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    return JS_NewBool(ctx, d->nodes.empty() == (magic == 0));
+}
+
+// UiCollection.toArray()/toJSON() - all elements as a plain array
+static JSValue js_collection_toArray(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    UiCollectionData *d = collection_get(ctx, this_val);
+    if (!d) return JS_EXCEPTION;
+    JSValue ret = JS_NewArray(ctx);
+    for (uint32_t i = 0; i < d->nodes.size(); i++) {
+        JSValue v = collection_item(ctx, d, i);
+        if (JS_IsException(v)) {
+            JS_FreeValue(ctx, ret);
+            return v;
+        }
+        JS_SetPropertyUint32(ctx, ret, i, v);
+    }
+    return ret;
+}
+
+static const JSCFunctionListEntry js_collection_proto_funcs[] = {
+    JS_CGETSET_DEF("length", js_collection_length, NULL),
+    JS_CFUNC_DEF("size", 0, js_collection_size),
+    JS_CFUNC_DEF("get", 1, js_collection_get),
+    JS_CFUNC_MAGIC_DEF("empty", 0, js_collection_empty, 0),
+    JS_CFUNC_MAGIC_DEF("nonEmpty", 0, js_collection_empty, 1),
+    JS_CFUNC_DEF("toArray", 0, js_collection_toArray),
+    JS_CFUNC_DEF("toJSON", 0, js_collection_toArray),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "UiCollection", JS_PROP_CONFIGURABLE),
+};
+
+// ==================== UiIterator ====================
+
+static JSClassID js_iterator_class_id;
+
+static void js_iterator_finalizer(JSRuntime *rt, JSValue val) {
+    delete static_cast<SelectorCursor *>(JS_GetOpaque(val, js_iterator_class_id));
+}
+
+static JSClassDef js_iterator_class = {
+    "UiIterator",
+    .finalizer = js_iterator_finalizer,
+};
+
+static JSValue iterator_result(JSContext *ctx, JSValue value, bool done) {
+    JSValue ret = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ret, "value", value);
+    JS_SetPropertyStr(ctx, ret, "done", JS_NewBool(ctx, done));
+    return ret;
+}
+
+// UiIterator.next() - { value: UiObject, done: false } until exhausted
+static JSValue js_iterator_next(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    SelectorCursor *cur = static_cast<SelectorCursor *>(JS_GetOpaque2(ctx, this_val, js_iterator_class_id));
+    if (!cur) return JS_EXCEPTION;
+    int32_t node = selector_cursor_next(cur);
+    if (node < 0) {
+        cur->sel.reset();
+        cur->snap.reset();
+        return iterator_result(ctx, JS_UNDEFINED, true);
+    }
+    JSValue obj = g_collection_factory(ctx, cur->snap, node);
+    if (JS_IsException(obj)) return obj;
+    return iterator_result(ctx, obj, false);
+}
+
+// UiIterator.return() - stop early
+static JSValue js_iterator_return(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    SelectorCursor *cur = static_cast<SelectorCursor *>(JS_GetOpaque2(ctx, this_val, js_iterator_class_id));
+    if (!cur) return JS_EXCEPTION;
+    *cur = SelectorCursor();
+    cur->done = true;
+    return iterator_result(ctx, argc > 0 ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED, true);
+}
+
+static JSValue js_iterator_self(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return JS_DupValue(ctx, this_val);
+}
+
+static const JSCFunctionListEntry js_iterator_proto_funcs[] = {
+    JS_CFUNC_DEF("next", 0, js_iterator_next),
+    JS_CFUNC_DEF("return", 1, js_iterator_return),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_iterator_self),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "UiIterator", JS_PROP_CONFIGURABLE),
+};
+
+JSValue ui_iterator_new(JSContext *ctx, SelectorCursor cursor) {
+    JSValue obj = JS_NewObjectClass(ctx, js_iterator_class_id);
+    if (JS_IsException(obj)) return obj;
+    JS_SetOpaque(obj, new SelectorCursor(std::move(cursor)));
+    return obj;
+}
+
+// ==================== Registration ====================
+
+void ui_collection_register(JSContext *ctx, UiObjectFactory factory) {
+    g_collection_factory = factory;
+    JS_NewClassID(&js_collection_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_collection_class_id, &js_collection_class);
+
+    // Inherit the generic Array.prototype methods
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSValue array = JS_GetPropertyStr(ctx, global, "Array");
+    JSValue array_proto = JS_GetPropertyStr(ctx, array, "prototype");
+    JSValue proto = JS_NewObjectProto(ctx, array_proto);
+    JS_SetPropertyFunctionList(ctx, proto, js_collection_proto_funcs,
+                               sizeof(js_collection_proto_funcs) / sizeof(js_collection_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_collection_class_id, proto);
+    JS_FreeValue(ctx, array_proto);
+    JS_FreeValue(ctx, array);
+    JS_FreeValue(ctx, global);
+
+    JS_NewClassID(&js_iterator_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_iterator_class_id, &js_iterator_class);
+    JSValue iterator_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, iterator_proto, js_iterator_proto_funcs,
+                               sizeof(js_iterator_proto_funcs) / sizeof(js_iterator_proto_funcs[0]));
+    JS_SetClassProto(ctx, js_iterator_class_id, iterator_proto);
+}
+
+JSValue ui_collection_new(JSContext *ctx, std::shared_ptr<const UiSnapshot> snap, std::vector<int32_t> nodes) {
+    JSValue obj = JS_NewObjectClass(ctx, js_collection_class_id);
+    if (JS_IsException(obj)) return obj;
+    JS_SetOpaque(obj, new UiCollectionData{ std::move(snap), std::move(nodes), {} });
+    return obj;
+}
@@ -0,0 +1,43 @@
+#ifndef UI_COLLECTION_H
+#define UI_COLLECTION_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include "quickjs/quickjs.h"
+}
+
+#include "ui_selector.h"
+
+struct UiSnapshot;
+
+// ==================== UiCollection ====================
+//
+// Result of findAll()/find(): the matching node indices of one snapshot.
+// The snapshot already stores nodes column by column (bounds, flags, string
+// indices into its pool), so a result carries only the index column and
+// nothing is copied or serialized. A UiObject is created the first time an
+// element is read and cached after that. Indexing, length, iteration and the
+// generic Array.prototype methods (map, forEach, filter...) work as on an
+// array; toArray() returns a real one.
+
+typedef JSValue (*UiObjectFactory)(JSContext *ctx, const std::shared_ptr<const UiSnapshot> &snap, int32_t node);
+
+// Register the classes and their prototypes on a context; factory creates
+// the element objects.
+void ui_collection_register(JSContext *ctx, UiObjectFactory factory);
+JSValue ui_collection_new(JSContext *ctx, std::shared_ptr<const UiSnapshot> snap, std::vector<int32_t> nodes);
+
+// ==================== UiIterator ====================
+//
+// Result of iterate()/findLazy(): a JS iterator over a SelectorCursor, so
+// each next() resumes the search just far enough for one more match.
+// return() (called by for-of on break) drops the cursor and its snapshot.
+// Registered by ui_collection_register with the same factory.
+
+JSValue ui_iterator_new(JSContext *ctx, SelectorCursor cursor);
+
+#endif
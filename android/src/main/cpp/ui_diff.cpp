@@ -0,0 +1,184 @@
+#include "ui_diff.h"
+
+#include <functional>
+#include <string_view>
+
+#include "ui_snapshot.h"
+
+// ==================== Node Identity ====================
+
+namespace {
+
+uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    return h * 0xbf58476d1ce4e5b9ull;
+}
+
+// Per-node data of one side
+struct Side {
+    const UiSnapshot &s;
+    std::vector<uint64_t> own;          // the node's class, id, text and description
+    std::vector<uint64_t> hash;         // subtree content
+    std::vector<uint8_t> content;       // subtree has a text or description
+    std::vector<int32_t> ordinal;       // position among the parent's children
+    std::vector<int32_t> match;         // paired node of the other side, or -1
+
+    explicit Side(const UiSnapshot &snap) : s(snap) {
+        size_t n = s.size();
+        std::vector<uint64_t> strings(s.stringCount());
+        for (size_t i = 0; i < strings.size(); i++) strings[i] = std::hash<std::string_view>()(s.str((uint32_t)i));
+        // Children fold into the parent in reverse order, before it is
+        // finished; the parent precedes them in pre-order
+        own.resize(n);
+        hash.assign(n, 0);
+        content.assign(n, 0);
+        for (size_t i = n; i-- > 0;) {
+            own[i] = mix(mix(mix(strings[s.className[i]], strings[s.id[i]]), strings[s.text[i]]), strings[s.desc[i]]);
+            hash[i] = mix(own[i], hash[i]);
+            content[i] |= s.text[i] != 0 || s.desc[i] != 0;
+            int32_t p = s.parent[i];
+            if (p >= 0) {
+                hash[p] = hash[p] * 0x100000001b3ull + hash[i];
+                content[p] |= content[i];
+            }
+        }
+        ordinal.assign(n, 0);
+        std::vector<int32_t> next(n, 0);
+        for (size_t i = 1; i < n; i++) ordinal[i] = next[s.parent[i]]++;
+        match.assign(n, -1);
+    }
+
+    // Key of node i's subtree in the lookup of identical subtrees; parent is
+    // the node of a its parent pairs with (the parent itself for a)
+    uint64_t key(int32_t i, int32_t parent) const {
+        return content[i] ? hash[i] : mix(hash[i], (uint64_t)(int64_t)parent + 1);
+    }
+};
+
+bool same_string(const UiSnapshot &a, uint32_t x, const UiSnapshot &b, uint32_t y) {
+    return a.str(x) == b.str(y);
+}
+
+bool same_view(const Side &a, int32_t i, const Side &b, int32_t j) {
+    return same_string(a.s, a.s.className[i], b.s, b.s.className[j]) && same_string(a.s, a.s.id[i], b.s, b.s.id[j]);
+}
+
+// Pair the subtrees of a at i and of b at j if they have the same shape and
+// node by node the same content (not just the same subtree hash), and no
+// node of i's is paired yet
+bool pair_subtrees(Side &a, int32_t i, Side &b, int32_t j) {
+    int32_t size = a.s.subtreeEnd[i] - i;
+    if (size != b.s.subtreeEnd[j] - j) return false;
+    for (int32_t k = 0; k < size; k++) {
+        int32_t x = i + k, y = j + k;
+        if (a.match[x] >= 0 || a.own[x] != b.own[y] || a.s.depth[x] - a.s.depth[i] != b.s.depth[y] - b.s.depth[j]) {
+            return false;
+        }
+    }
+    for (int32_t k = 0; k < size; k++) {
+        a.match[i + k] = j + k;
+        b.match[j + k] = i + k;
+    }
+    return true;
+}
+
+// Open-addressing map from subtree key to the first unpaired subtree of a
+// with that key; the rest follow through chain, in document order
+struct Heads {
+    struct Slot {
+        uint64_t key;
+        int32_t head;   // -1 once all are taken
+        bool used;
+    };
+    std::vector<Slot> slots;
+    size_t mask;
+
+    explicit Heads(size_t n) {
+        size_t cap = 16;
+        while (cap < n * 2) cap <<= 1;
+        slots.assign(cap, Slot{ 0, -1, false });
+        mask = cap - 1;
+    }
+
+    Slot &slot(uint64_t key) {
+        size_t k = (size_t)(key ^ (key >> 29)) & mask;
+        while (slots[k].used && slots[k].key != key) k = (k + 1) & mask;
+        return slots[k];
+    }
+};
+
+}  // namespace
+
+// ==================== Diff ====================
+
+void ui_diff(const UiSnapshot &sa, const UiSnapshot &sb, UiDiff *out) {
+    *out = UiDiff();
+    Side a(sa), b(sb);
+    int32_t na = (int32_t)sa.size(), nb = (int32_t)sb.size();
+
+    // Subtrees of a by key
+    Heads heads(na);
+    std::vector<int32_t> chain(na, -1);
+    for (int32_t i = na; i-- > 0;) {
+        uint64_t key = a.key(i, sa.parent[i]);
+        Heads::Slot &slot = heads.slot(key);
+        if (slot.used) chain[i] = slot.head;
+        slot = { key, i, true };
+    }
+    // Children of a by ordinal: kids[first[p] + ordinal]
+    std::vector<int32_t> first(na + 1, 0), kids(na > 0 ? na - 1 : 0);
+    for (int32_t i = 1; i < na; i++) first[sa.parent[i] + 1]++;
+    for (int32_t i = 0; i < na; i++) first[i + 1] += first[i];
+    for (int32_t i = 1; i < na; i++) kids[first[sa.parent[i]] + a.ordinal[i]] = i;
+
+    // Nodes paired in place, the only ones whose content may differ
+    std::vector<uint8_t> inPlace(nb, 0);
+    for (int32_t j = 0; j < nb; j++) {
+        if (b.match[j] >= 0) continue;
+        int32_t pb = sb.parent[j];
+        int32_t pa = pb < 0 ? -1 : b.match[pb];
+        if (b.content[j] || pb < 0 || pa >= 0) {
+            Heads::Slot &slot = heads.slot(b.key(j, pa));
+            if (slot.used) {
+                // Taken or failed heads can never pair again: drop them
+                int32_t &head = slot.head;
+                while (head >= 0 && !pair_subtrees(a, head, b, j)) head = chain[head];
+                if (head >= 0) {
+                    head = chain[head];
+                    continue;
+                }
+            }
+        }
+        int32_t i = pb < 0 ? (na > 0 ? 0 : -1)
+                  : pa >= 0 && b.ordinal[j] < first[pa + 1] - first[pa] ? kids[first[pa] + b.ordinal[j]] : -1;
+        if (i >= 0 && a.match[i] < 0 && same_view(a, i, b, j)) {
+            a.match[i] = j;
+            b.match[j] = i;
+            inPlace[j] = 1;
+        }
+    }
+
+    for (int32_t j = 0; j < nb; j++) {
+        int32_t i = b.match[j];
+        if (i < 0) {
+            out->added.push_back(j);
+            continue;
+        }
+        if (inPlace[j] &&
+            (!same_string(sa, sa.text[i], sb, sb.text[j]) || !same_string(sa, sa.desc[i], sb, sb.desc[j]))) {
+            out->textChanged.push_back(j);
+            out->textChangedFrom.push_back(i);
+        }
+        int32_t pb = sb.parent[j];
+        if (sa.left[i] != sb.left[j] || sa.top[i] != sb.top[j] || sa.right[i] != sb.right[j] ||
+            sa.bottom[i] != sb.bottom[j] || a.ordinal[i] != b.ordinal[j] ||
+            (pb < 0 ? sa.parent[i] >= 0 : b.match[pb] != sa.parent[i])) {
+            out->moved.push_back(j);
+            out->movedFrom.push_back(i);
+        }
+    }
+    for (int32_t i = 0; i < na; i++) {
+        if (a.match[i] < 0) out->removed.push_back(i);
+    }
+}
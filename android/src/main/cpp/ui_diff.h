@@ -0,0 +1,42 @@
+#ifndef UI_DIFF_H
+#define UI_DIFF_H
+
+#include <stdint.h>
+
+#include <vector>
+
+struct UiSnapshot;
+
+// ==================== Snapshot Diff ====================
+//
+// Matches the nodes of two snapshots (usually two generations of the same
+// screen) and reports what changed, in one linear pass. A node's identity
+// is the content hash of its subtree (class, id, text and description of
+// every node in it, in order), so a row that scrolled or moved to another
+// parent is still the same row:
+//   1. In document order, each unmatched node of b takes the first
+//      unmatched subtree of a with the same hash, and all nodes in them are
+//      paired. Subtrees without any text or description (an icon, an empty
+//      container) are too common to identify a view; they are only taken
+//      from under the node their parent was paired with.
+//   2. Otherwise a node whose parent was paired takes the child at the same
+//      position among its parent's children in a, if it has the same class
+//      and id: the same view, with new content.
+// Nodes left over were added (in b) or removed (from a). Of the paired
+// nodes, those whose bounds or place in the tree changed moved, and those
+// whose text or description changed had their text changed; a node can be
+// both.
+
+struct UiDiff {
+    std::vector<int32_t> added;             // nodes of b
+    std::vector<int32_t> removed;           // nodes of a
+    std::vector<int32_t> moved;             // nodes of b ...
+    std::vector<int32_t> movedFrom;         // ... and the node of a each was
+    std::vector<int32_t> textChanged;       // nodes of b ...
+    std::vector<int32_t> textChangedFrom;   // ... and the node of a each was
+};
+
+// Lists are in document order of b (removed: of a)
+void ui_diff(const UiSnapshot &a, const UiSnapshot &b, UiDiff *out);
+
+#endif
@@ -0,0 +1,1202 @@
+#include "ui_selector.h"
+#include "ui_snapshot.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+extern "C" {
+#include "quickjs/quickjs.h"
+#include "quickjs/cutils.h"
+#include "quickjs/libregexp.h"
+}
+
+static const char *const g_selector_op_names[SEL_OP_COUNT] = {
+#define X(op, name, arg) name,
+    SELECTOR_OP_LIST(X)
+#undef X
+};
+
+static const SelectorArg g_selector_op_args[SEL_OP_COUNT] = {
+#define X(op, name, arg) arg,
+    SELECTOR_OP_LIST(X)
+#undef X
+};
+
+const char *selector_op_name(int op) {
+    return op >= 0 && op < SEL_OP_COUNT ? g_selector_op_names[op] : "unknown";
+}
+
+SelectorArg selector_op_arg(int op) {
+    return op >= 0 && op < SEL_OP_COUNT ? g_selector_op_args[op] : SEL_ARG_STRING;
+}
+
+// ==================== String Interning ====================
+
+static std::mutex g_intern_mutex;
+static std::unordered_map<std::string, std::weak_ptr<const std::string>> g_intern_pool;
+static size_t g_intern_sweep_at = 256;
+
+SelectorString selector_intern(const char *s, size_t len) {
+    std::string key(s, len);
+    std::lock_guard<std::mutex> lock(g_intern_mutex);
+
+    auto it = g_intern_pool.find(key);
+    if (it != g_intern_pool.end()) {
+        SelectorString str = it->second.lock();
+        if (str) return str;
+    }
+
+    // Drop dead entries once the pool has doubled since the last sweep
+    if (g_intern_pool.size() >= g_intern_sweep_at) {
+        for (auto e = g_intern_pool.begin(); e != g_intern_pool.end();) {
+            if (e->second.expired()) e = g_intern_pool.erase(e);
+            else ++e;
+        }
+        g_intern_sweep_at = g_intern_pool.size() * 2 > 256 ? g_intern_pool.size() * 2 : 256;
+    }
+
+    SelectorString str = std::make_shared<const std::string>(key);
+    g_intern_pool[key] = str;
+    return str;
+}
+
+// ==================== Conditions ====================
+
+void selector_add_string(Selector *sel, int op, const char *s, size_t len) {
+    SelectorCond cond;
+    cond.op = op;
+    cond.value = 0;
+    cond.str = selector_intern(s, len);
+    if (op >= SEL_TEXT_EQUALS_NORMALIZED && op <= SEL_DESC_CONTAINS_NORMALIZED) {
+        std::string folded = ui_fold_string(*cond.str);
+        cond.folded = selector_intern(folded.data(), folded.size());
+    }
+    sel->conds.push_back(std::move(cond));
+    sel->dirty = true;
+    sel->plan.valid = false;
+}
+
+void selector_add_regex(Selector *sel, int op, const char *s, size_t len, uint32_t flags) {
+    selector_add_string(sel, op, s, len);
+    sel->conds.back().value = (int32_t)flags;
+}
+
+uint32_t selector_regex_flags(const char *js_flags, size_t len) {
+    uint32_t flags = 0;
+    for (size_t i = 0; i < len; i++) {
+        switch (js_flags[i]) {
+        case 'i': flags |= SEL_REGEX_IGNORE_CASE; break;
+        case 'm': flags |= SEL_REGEX_MULTILINE; break;
+        case 's': flags |= SEL_REGEX_DOT_ALL; break;
+        case 'u': flags |= SEL_REGEX_UNICODE; break;
+        }
+    }
+    return flags;
+}
+
+void selector_add_int(Selector *sel, int op, int32_t value) {
+    SelectorCond cond;
+    cond.op = op;
+    cond.value = value;
+    sel->conds.push_back(std::move(cond));
+    sel->dirty = true;
+    sel->plan.valid = false;
+}
+
+void selector_add_rect(Selector *sel, int op, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+    SelectorCond cond;
+    cond.op = op;
+    cond.value = 0;
+    cond.rect[0] = left;
+    cond.rect[1] = top;
+    cond.rect[2] = right;
+    cond.rect[3] = bottom;
+    sel->conds.push_back(std::move(cond));
+    sel->dirty = true;
+    sel->plan.valid = false;
+}
+
+static void add_selector_cond(Selector *sel, int op, std::shared_ptr<Selector> sub) {
+    SelectorCond cond;
+    cond.op = op;
+    cond.value = 0;
+    cond.sub = std::move(sub);
+    sel->conds.push_back(std::move(cond));
+    sel->dirty = true;
+    sel->plan.valid = false;
+}
+
+void selector_add_selector(Selector *sel, int op, const Selector &sub) {
+    add_selector_cond(sel, op, std::make_shared<Selector>(sub));
+}
+
+// ==================== Wire Encoding ====================
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+    uint8_t b[4];
+    memcpy(b, &v, 4);
+    out.insert(out.end(), b, b + 4);
+}
+
+const std::vector<uint8_t> &selector_encode(Selector *sel) {
+    if (!sel->dirty) return sel->encoded;
+
+    std::vector<uint8_t> &out = sel->encoded;
+    out.clear();
+    uint16_t count = (uint16_t)(sel->conds.size() > 0xffff ? 0xffff : sel->conds.size());
+    out.push_back(SELECTOR_ENCODING_VERSION);
+    out.push_back((uint8_t)(count & 0xff));
+    out.push_back((uint8_t)(count >> 8));
+
+    for (uint16_t i = 0; i < count; i++) {
+        const SelectorCond &c = sel->conds[i];
+        out.push_back((uint8_t)c.op);
+        switch (selector_op_arg(c.op)) {
+        case SEL_ARG_STRING:
+        case SEL_ARG_REGEX: {
+            const std::string &s = *c.str;
+            put_u32(out, (uint32_t)s.size());
+            out.insert(out.end(), s.begin(), s.end());
+            if (selector_op_arg(c.op) == SEL_ARG_REGEX) out.push_back((uint8_t)c.value);
+            break;
+        }
+        case SEL_ARG_BOOL:
+            out.push_back(c.value ? 1 : 0);
+            break;
+        case SEL_ARG_INT:
+            put_u32(out, (uint32_t)c.value);
+            break;
+        case SEL_ARG_RECT:
+            for (int k = 0; k < 4; k++) put_u32(out, (uint32_t)c.rect[k]);
+            break;
+        case SEL_ARG_POINT:
+            put_u32(out, (uint32_t)c.rect[0]);
+            put_u32(out, (uint32_t)c.rect[1]);
+            break;
+        case SEL_ARG_SELECTOR: {
+            const std::vector<uint8_t> &sub = selector_encode(c.sub.get());
+            put_u32(out, (uint32_t)sub.size());
+            out.insert(out.end(), sub.begin(), sub.end());
+            break;
+        }
+        }
+    }
+
+    sel->dirty = false;
+    return out;
+}
+
+// ==================== Regex ====================
+
+namespace {
+
+// libregexp allocates through the JSContext passed as its opaque pointer: a
+// bare context on a runtime of its own, shared by a cache and every regex
+// compiled through it, so regexes still held by selectors outlive the
+// cache. Stack checks are disabled since matching may run at any depth.
+struct RegexContext {
+    JSRuntime *rt;
+    JSContext *ctx;
+
+    RegexContext() {
+        rt = JS_NewRuntime();
+        JS_SetMaxStackSize(rt, 0);
+        ctx = JS_NewContextRaw(rt);
+    }
+
+    ~RegexContext() {
+        JS_FreeContext(ctx);
+        JS_FreeRuntime(rt);
+    }
+};
+
+}
+
+struct SelectorRegex {
+    std::shared_ptr<RegexContext> context;
+    uint8_t *bytecode;      // null if the pattern failed to compile
+    int captureCount;
+    bool whole;             // the match must span the whole string
+
+    // Snapshot strings are interned, so results are remembered per string
+    // index: a regex runs at most once per distinct string in a snapshot.
+    const UiSnapshot *memoSnapshot = nullptr;
+    uint32_t memoGeneration = 0;
+    std::vector<int8_t> memo;   // -1 unknown, else 0 / 1
+
+    ~SelectorRegex() {
+        if (bytecode) js_free_rt(context->rt, bytecode);
+    }
+};
+
+static std::shared_ptr<SelectorRegex> regex_compile(const std::shared_ptr<RegexContext> &context,
+                                                    const std::string &pattern, uint32_t flags, bool whole) {
+    auto re = std::make_shared<SelectorRegex>();
+    re->context = context;
+    re->whole = whole;
+    // A whole-string match is sticky, so a failing string is rejected at its
+    // first position instead of retried at every offset. It ends in a
+    // lookahead for no character rather than $, which the m flag would let
+    // match before a line break; regex_test also checks where it ended.
+    std::string src = whole ? "(?:" + pattern + ")(?![\\s\\S])" : pattern;
+    int lre_flags = whole ? LRE_FLAG_STICKY : 0;
+    if (flags & SEL_REGEX_IGNORE_CASE) lre_flags |= LRE_FLAG_IGNORECASE;
+    if (flags & SEL_REGEX_MULTILINE) lre_flags |= LRE_FLAG_MULTILINE;
+    if (flags & SEL_REGEX_DOT_ALL) lre_flags |= LRE_FLAG_DOTALL;
+    if (flags & SEL_REGEX_UNICODE) lre_flags |= LRE_FLAG_UTF16;
+    char error[64];
+    int len = 0;
+    re->bytecode = lre_compile(&len, error, sizeof(error), src.c_str(), src.size(), lre_flags, context->ctx);
+    re->captureCount = re->bytecode ? lre_get_capture_count(re->bytecode) : 0;
+    return re;
+}
+
+// Most recently used first; selectors keep their regex alive after eviction
+struct SelectorRegexCache {
+    std::shared_ptr<RegexContext> context = std::make_shared<RegexContext>();
+    std::list<std::pair<std::string, std::shared_ptr<SelectorRegex>>> entries;
+    std::unordered_map<std::string, decltype(entries)::iterator> index;
+};
+
+std::shared_ptr<SelectorRegexCache> selector_regex_cache_new() {
+    return std::make_shared<SelectorRegexCache>();
+}
+
+static std::shared_ptr<SelectorRegex> regex_get(SelectorRegexCache *cache, const std::string &pattern,
+                                                uint32_t flags, bool whole) {
+    if (!cache) {
+        // Selectors made outside a script engine (native code, benchmarks)
+        static std::shared_ptr<SelectorRegexCache> shared = selector_regex_cache_new();
+        cache = shared.get();
+    }
+    std::string key = pattern;
+    key.push_back('\0');
+    key.push_back((char)(flags | (whole ? 0x80 : 0)));
+
+    auto it = cache->index.find(key);
+    if (it != cache->index.end()) {
+        cache->entries.splice(cache->entries.begin(), cache->entries, it->second);
+        return it->second->second;
+    }
+
+    std::shared_ptr<SelectorRegex> re = regex_compile(cache->context, pattern, flags, whole);
+    cache->entries.emplace_front(key, re);
+    cache->index[key] = cache->entries.begin();
+    if (cache->entries.size() > SELECTOR_REGEX_CACHE_SIZE) {
+        cache->index.erase(cache->entries.back().first);
+        cache->entries.pop_back();
+    }
+    return re;
+}
+
+// Decode UTF-8 into UTF-16 code units (invalid bytes become U+FFFD)
+static void utf8_to_utf16(std::string_view s, std::vector<uint16_t> *out) {
+    out->clear();
+    size_t i = 0, n = s.size();
+    const uint8_t *p = (const uint8_t *)s.data();
+    while (i < n) {
+        uint32_t c = p[i];
+        int extra = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xe ? 2 : (c >> 3) == 0x1e ? 3 : -1;
+        if (extra < 0 || i + extra >= n + (extra == 0)) {
+            out->push_back(0xfffd);
+            i++;
+            continue;
+        }
+        if (extra > 0) {
+            c &= 0x3f >> extra;
+            bool ok = true;
+            for (int k = 1; k <= extra; k++) {
+                if ((p[i + k] & 0xc0) != 0x80) { ok = false; break; }
+                c = (c << 6) | (p[i + k] & 0x3f);
+            }
+            if (!ok) {
+                out->push_back(0xfffd);
+                i++;
+                continue;
+            }
+        }
+        i += extra + 1;
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            out->push_back((uint16_t)(0xd800 + (c >> 10)));
+            out->push_back((uint16_t)(0xdc00 + (c & 0x3ff)));
+        } else {
+            out->push_back((uint16_t)c);
+        }
+    }
+}
+
+static bool regex_test(const SelectorRegex *re, std::string_view s) {
+    if (!re->bytecode) return false;
+
+    bool ascii = true;
+    for (unsigned char c : s) {
+        if (c >= 0x80) { ascii = false; break; }
+    }
+
+    uint8_t *capture_buf[64];
+    std::vector<uint8_t *> capture_vec;
+    uint8_t **capture = capture_buf;
+    if (re->captureCount * 2 > 64) {
+        capture_vec.resize(re->captureCount * 2);
+        capture = capture_vec.data();
+    }
+
+    if (ascii) {
+        const uint8_t *str = (const uint8_t *)s.data();
+        if (lre_exec(capture, re->bytecode, str, 0, (int)s.size(), 0, re->context->ctx) != 1) return false;
+        return !re->whole || capture[1] == str + s.size();
+    }
+    thread_local std::vector<uint16_t> wide;
+    utf8_to_utf16(s, &wide);
+    const uint8_t *str = (const uint8_t *)wide.data();
+    if (lre_exec(capture, re->bytecode, str, 0, (int)wide.size(), 1, re->context->ctx) != 1) return false;
+    return !re->whole || capture[1] == str + wide.size() * 2;
+}
+
+// Test snapshot string idx, memoized for published snapshots
+static bool regex_test_string(SelectorRegex *re, const UiSnapshot &snap, uint32_t idx) {
+    if (snap.generation == 0) return regex_test(re, snap.str(idx));
+    if (re->memoSnapshot != &snap || re->memoGeneration != snap.generation) {
+        re->memoSnapshot = &snap;
+        re->memoGeneration = snap.generation;
+        re->memo.assign(snap.stringCount(), -1);
+    }
+    int8_t &m = re->memo[idx];
+    if (m < 0) m = regex_test(re, snap.str(idx)) ? 1 : 0;
+    return m != 0;
+}
+
+// ==================== Matching ====================
+
+static bool starts_with(std::string_view s, std::string_view prefix) {
+    return s.size() >= prefix.size() && memcmp(s.data(), prefix.data(), prefix.size()) == 0;
+}
+
+static bool ends_with(std::string_view s, std::string_view suffix) {
+    return s.size() >= suffix.size() && memcmp(s.data() + s.size() - suffix.size(), suffix.data(), suffix.size()) == 0;
+}
+
+static bool contains(std::string_view s, std::string_view needle) {
+    return s.find(needle) != std::string_view::npos;
+}
+
+// Resource ids look like "com.app:id/name"; the short form matches too
+static bool id_equals(std::string_view id, std::string_view v) {
+    if (id == v) return true;
+    return id.size() > v.size() + 4 && ends_with(id, v) &&
+           id.compare(id.size() - v.size() - 4, 4, ":id/") == 0;
+}
+
+static bool id_starts_with(std::string_view id, std::string_view v) {
+    if (starts_with(id, v)) return true;
+    size_t pos = id.find(":id/");
+    return pos != std::string_view::npos && starts_with(id.substr(pos + 4), v);
+}
+
+// "Button" matches "android.widget.Button" and any "*.Button"
+static bool class_equals(std::string_view cls, std::string_view v) {
+    if (cls == v) return true;
+    if (cls.size() > v.size() && ends_with(cls, v) && cls[cls.size() - v.size() - 1] == '.') return true;
+    return false;
+}
+
+static bool class_starts_with(std::string_view cls, std::string_view v) {
+    static const std::string_view widget = "android.widget.";
+    return starts_with(cls, v) || (starts_with(cls, widget) && starts_with(cls.substr(widget.size()), v));
+}
+
+// *Normalized() conditions
+static int folded_field(int op) {
+    return op == SEL_TEXT_EQUALS_NORMALIZED || op == SEL_TEXT_CONTAINS_NORMALIZED ? UI_FIELD_TEXT : UI_FIELD_DESC;
+}
+
+static bool folded_match(const SelectorCond &c, const UiFoldIndex &fold, const UiSnapshot &snap, int32_t i) {
+    std::string_view s = fold.str(fold.form[snap.column(folded_field(c.op))[i]]);
+    if (c.op == SEL_TEXT_EQUALS_NORMALIZED || c.op == SEL_DESC_EQUALS_NORMALIZED) return s == *c.folded;
+    return contains(s, *c.folded);
+}
+
+static const uint32_t g_bool_op_flags[] = {
+    UI_FLAG_CLICKABLE, UI_FLAG_SCROLLABLE, UI_FLAG_ENABLED, UI_FLAG_CHECKED, UI_FLAG_SELECTED,
+    UI_FLAG_FOCUSABLE, UI_FLAG_FOCUSED, UI_FLAG_LONG_CLICKABLE, UI_FLAG_CHECKABLE, UI_FLAG_EDITABLE,
+    UI_FLAG_VISIBLE_TO_USER,
+};
+
+static bool cond_match(SelectorCond &c, const UiSnapshot &snap, int32_t i) {
+    if (c.op >= SEL_CLICKABLE && c.op <= SEL_VISIBLE_TO_USER) {
+        bool set = (snap.flags[i] & g_bool_op_flags[c.op - SEL_CLICKABLE]) != 0;
+        return set == (c.value != 0);
+    }
+    if (c.op == SEL_DEPTH) return snap.depth[i] == c.value;
+    if (c.op == SEL_DRAWING_ORDER) return snap.drawingOrder[i] == c.value;
+
+    int32_t l = snap.left[i], t = snap.top[i], r = snap.right[i], b = snap.bottom[i];
+    const int32_t *q = c.rect;
+    switch (c.op) {
+    case SEL_BOUNDS:
+        return l == q[0] && t == q[1] && r == q[2] && b == q[3];
+    case SEL_BOUNDS_INSIDE:
+        return q[0] < q[2] && q[1] < q[3] && q[0] <= l && q[1] <= t && q[2] >= r && q[3] >= b;
+    case SEL_BOUNDS_CONTAINS:
+        return l < r && t < b && l <= q[0] && t <= q[1] && r >= q[2] && b >= q[3];
+    case SEL_BOUNDS_INTERSECTS:
+        return l < q[2] && q[0] < r && t < q[3] && q[1] < b;
+    case SEL_NODE_AT:
+        return l < r && t < b && q[0] >= l && q[0] < r && q[1] >= t && q[1] < b;
+    }
+
+    std::string_view v = *c.str;
+    switch (c.op) {
+    case SEL_TEXT: return snap.str(snap.text[i]) == v;
+    case SEL_TEXT_CONTAINS: return contains(snap.str(snap.text[i]), v);
+    case SEL_TEXT_STARTS_WITH: return starts_with(snap.str(snap.text[i]), v);
+    case SEL_TEXT_ENDS_WITH: return ends_with(snap.str(snap.text[i]), v);
+    case SEL_DESC: return snap.str(snap.desc[i]) == v;
+    case SEL_DESC_CONTAINS: return contains(snap.str(snap.desc[i]), v);
+    case SEL_DESC_STARTS_WITH: return starts_with(snap.str(snap.desc[i]), v);
+    case SEL_DESC_ENDS_WITH: return ends_with(snap.str(snap.desc[i]), v);
+    case SEL_ID: return id_equals(snap.str(snap.id[i]), v);
+    case SEL_ID_CONTAINS: return contains(snap.str(snap.id[i]), v);
+    case SEL_ID_STARTS_WITH: return id_starts_with(snap.str(snap.id[i]), v);
+    case SEL_ID_ENDS_WITH: return ends_with(snap.str(snap.id[i]), v);
+    case SEL_CLASS_NAME: return class_equals(snap.str(snap.className[i]), v);
+    case SEL_CLASS_NAME_CONTAINS: return contains(snap.str(snap.className[i]), v);
+    case SEL_CLASS_NAME_STARTS_WITH: return class_starts_with(snap.str(snap.className[i]), v);
+    case SEL_CLASS_NAME_ENDS_WITH: return ends_with(snap.str(snap.className[i]), v);
+    case SEL_PACKAGE_NAME: return snap.str(snap.packageName[i]) == v;
+    case SEL_PACKAGE_NAME_CONTAINS: return contains(snap.str(snap.packageName[i]), v);
+    case SEL_PACKAGE_NAME_STARTS_WITH: return starts_with(snap.str(snap.packageName[i]), v);
+    case SEL_PACKAGE_NAME_ENDS_WITH: return ends_with(snap.str(snap.packageName[i]), v);
+    }
+
+    // Regex conditions, compiled by selector_plan
+    switch (c.op) {
+    case SEL_TEXT_MATCHES: return regex_test_string(c.re.get(), snap, snap.text[i]);
+    case SEL_DESC_MATCHES: return regex_test_string(c.re.get(), snap, snap.desc[i]);
+    case SEL_ID_MATCHES: return regex_test_string(c.re.get(), snap, snap.id[i]);
+    case SEL_CLASS_NAME_MATCHES: return regex_test_string(c.re.get(), snap, snap.className[i]);
+    }
+    return false;
+}
+
+// ==================== Evaluation Plan ====================
+
+SelectorCost selector_op_cost(int op) {
+    if (op >= SEL_CLICKABLE && op <= SEL_VISIBLE_TO_USER) return SEL_COST_FLAGS;
+    switch (op) {
+    case SEL_DEPTH:
+    case SEL_DRAWING_ORDER:
+        return SEL_COST_INT;
+    case SEL_BOUNDS:
+    case SEL_BOUNDS_INSIDE:
+    case SEL_BOUNDS_CONTAINS:
+    case SEL_BOUNDS_INTERSECTS:
+    case SEL_NODE_AT:
+        return SEL_COST_BOUNDS;
+    case SEL_PARENT:
+    case SEL_CHILD:
+    case SEL_SIBLING:
+    case SEL_ANCESTOR:
+    case SEL_DESCENDANT:
+        return SEL_COST_RELATION;
+    case SEL_TEXT:
+    case SEL_DESC:
+    case SEL_PACKAGE_NAME:
+        return SEL_COST_INTERNED;
+    case SEL_TEXT_CONTAINS:
+    case SEL_DESC_CONTAINS:
+    case SEL_ID_CONTAINS:
+    case SEL_CLASS_NAME_CONTAINS:
+    case SEL_PACKAGE_NAME_CONTAINS:
+    case SEL_TEXT_CONTAINS_NORMALIZED:
+    case SEL_DESC_CONTAINS_NORMALIZED:
+        return SEL_COST_SUBSTRING;
+    }
+    return selector_op_arg(op) == SEL_ARG_REGEX ? SEL_COST_REGEX : SEL_COST_STRING;
+}
+
+const SelectorPlan &selector_plan(Selector *sel) {
+    SelectorPlan &plan = sel->plan;
+    if (plan.valid) return plan;
+
+    plan = SelectorPlan();
+    for (size_t i = 0; i < sel->conds.size(); i++) {
+        SelectorCond &c = sel->conds[i];
+        plan.cost.push_back((uint8_t)selector_op_cost(c.op));
+        if (plan.cost[i] == SEL_COST_REGEX && !c.re) {
+            c.re = regex_get(sel->regexes.get(), *c.str, (uint32_t)c.value, c.op == SEL_TEXT_MATCHES);
+        }
+        if (c.op == SEL_NODE_AT) plan.hitTest = true;
+        if (c.folded) plan.normalized = true;
+        if (plan.cost[i] != SEL_COST_FLAGS) {
+            plan.order.push_back((uint16_t)i);
+            continue;
+        }
+        uint32_t flag = g_bool_op_flags[c.op - SEL_CLICKABLE];
+        uint32_t want = c.value ? flag : 0;
+        if ((plan.flagMask & flag) && (plan.flagValue & flag) != want) plan.never = true;
+        plan.flagMask |= flag;
+        plan.flagValue |= want;
+    }
+
+    const std::vector<SelectorCond> &conds = sel->conds;
+    std::stable_sort(plan.order.begin(), plan.order.end(), [&conds, &plan](uint16_t a, uint16_t b) {
+        if (plan.cost[a] != plan.cost[b]) return plan.cost[a] < plan.cost[b];
+        size_t la = conds[a].str ? conds[a].str->size() : 0, lb = conds[b].str ? conds[b].str->size() : 0;
+        return la > lb;
+    });
+    plan.valid = true;
+    return plan;
+}
+
+// Resolve interned conditions against snap; false if snap cannot be bound
+// (unpublished snapshots are compared by content instead)
+static bool plan_bind(Selector *sel, const UiSnapshot &snap) {
+    SelectorPlan &plan = sel->plan;
+    if (plan.normalized) plan.fold = &ui_snapshot_folded(snap);
+    if (snap.generation == 0) return false;
+    if (plan.snapshot == &snap && plan.generation == snap.generation) return true;
+
+    plan.resolved.assign(sel->conds.size(), UINT32_MAX);
+    for (uint16_t k : plan.order) {
+        const SelectorCond &c = sel->conds[k];
+        if (plan.cost[k] == SEL_COST_INTERNED) ui_snapshot_lookup(snap, *c.str, &plan.resolved[k]);
+    }
+    plan.snapshot = &snap;
+    plan.generation = snap.generation;
+    return true;
+}
+
+// Mark the nodes related by op to one of matches (document order)
+static void relate(int op, const UiSnapshot &snap, const std::vector<int32_t> &matches, std::vector<uint8_t> *out) {
+    size_t n = snap.size();
+    const int32_t *parent = snap.parent.data();
+    std::vector<uint8_t> &rel = *out;
+    rel.assign(n, 0);
+    std::vector<uint8_t> matched(n, 0);
+    for (int32_t m : matches) matched[m] = 1;
+
+    switch (op) {
+    case SEL_PARENT:
+        for (size_t i = 1; i < n; i++) rel[i] = matched[parent[i]];
+        break;
+    case SEL_CHILD:
+        for (int32_t m : matches) {
+            if (parent[m] >= 0) rel[parent[m]] = 1;
+        }
+        break;
+    case SEL_SIBLING: {
+        std::vector<uint32_t> children(n, 0);   // matching children per node
+        for (int32_t m : matches) {
+            if (parent[m] >= 0) children[parent[m]]++;
+        }
+        for (size_t i = 1; i < n; i++) rel[i] = children[parent[i]] > matched[i];
+        break;
+    }
+    case SEL_ANCESTOR:
+        // Pre-order: a parent is settled before its children
+        for (size_t i = 1; i < n; i++) rel[i] = matched[parent[i]] | rel[parent[i]];
+        break;
+    case SEL_DESCENDANT:
+        // Walk up from each match, stopping at the first node already marked
+        for (int32_t m : matches) {
+            for (int32_t p = parent[m]; p >= 0 && !rel[p]; p = parent[p]) rel[p] = 1;
+        }
+        break;
+    }
+}
+
+// Resolve the relation conditions against snap (cached for published
+// snapshots)
+static void plan_relate(Selector *sel, const UiSnapshot &snap) {
+    SelectorPlan &plan = sel->plan;
+    if (snap.generation != 0 && plan.relatedSnapshot == &snap && plan.relatedGeneration == snap.generation) return;
+
+    bool any = false;
+    for (uint16_t k : plan.order) {
+        if (plan.cost[k] != SEL_COST_RELATION) continue;
+        if (!any) {
+            plan.related.resize(sel->conds.size());
+            plan.relatedNodes.resize(sel->conds.size());
+            any = true;
+        }
+        const SelectorCond &c = sel->conds[k];
+        std::vector<int32_t> matches;
+        selector_find(c.sub.get(), snap, 0, (int32_t)snap.size(), 0, &matches);
+        relate(c.op, snap, matches, &plan.related[k]);
+        std::vector<int32_t> &nodes = plan.relatedNodes[k];
+        nodes.clear();
+        for (size_t i = 0; i < snap.size(); i++) {
+            if (plan.related[k][i]) nodes.push_back((int32_t)i);
+        }
+    }
+    plan.relatedSnapshot = &snap;
+    plan.relatedGeneration = snap.generation;
+}
+
+static bool plan_match(Selector *sel, const UiSnapshot &snap, int32_t node, bool bound) {
+    const SelectorPlan &plan = sel->plan;
+    if ((snap.flags[node] & plan.flagMask) != plan.flagValue) return false;
+    for (uint16_t k : plan.order) {
+        SelectorCond &c = sel->conds[k];
+        if (plan.cost[k] == SEL_COST_RELATION) {
+            if (!plan.related[k][node]) return false;
+            continue;
+        }
+        if (c.folded) {
+            if (!folded_match(c, *plan.fold, snap, node)) return false;
+            continue;
+        }
+        if (bound && plan.cost[k] == SEL_COST_INTERNED) {
+            const std::vector<uint32_t> &col = c.op == SEL_TEXT ? snap.text : c.op == SEL_DESC ? snap.desc : snap.packageName;
+            if (col[node] != plan.resolved[k]) return false;
+            continue;
+        }
+        if (!cond_match(c, snap, node)) return false;
+    }
+    return true;
+}
+
+bool selector_match(Selector *sel, const UiSnapshot &snap, int32_t node) {
+    if (selector_plan(sel).never) return false;
+    plan_relate(sel, snap);
+    return plan_match(sel, snap, node, plan_bind(sel, snap));
+}
+
+// ==================== Index Planning ====================
+//
+// Exact and prefix conditions on string columns can be answered from the
+// snapshot's lookup indexes, bounds conditions from its R-tree, relation
+// conditions from their resolved node lists. The planner
+// takes the one with the fewest candidate nodes and verifies the full
+// selector on those only, so a query costs O(matches) instead of O(nodes).
+
+namespace {
+
+struct IndexCandidates {
+    const SelectorCond *cond = nullptr;
+    const UiFieldIndex *index = nullptr;
+    std::vector<uint32_t> strings;  // string indices whose nodes are candidates
+    std::vector<int32_t> nodes;     // candidates of a bounds or relation condition (no index), document order
+    size_t count = 0;               // total candidate nodes
+};
+
+}
+
+static int cond_field(int op) {
+    switch (op) {
+    case SEL_TEXT: case SEL_TEXT_STARTS_WITH: return UI_FIELD_TEXT;
+    case SEL_DESC: case SEL_DESC_STARTS_WITH: return UI_FIELD_DESC;
+    case SEL_ID: case SEL_ID_STARTS_WITH: return UI_FIELD_ID;
+    case SEL_CLASS_NAME: case SEL_CLASS_NAME_STARTS_WITH: return UI_FIELD_CLASS_NAME;
+    case SEL_PACKAGE_NAME: case SEL_PACKAGE_NAME_STARTS_WITH: return UI_FIELD_PACKAGE_NAME;
+    }
+    return -1;
+}
+
+static void add_prefix_range(const UiSnapshot &snap, const UiFieldIndex &index, std::string_view prefix,
+                             std::vector<uint32_t> *out) {
+    auto it = std::lower_bound(index.sorted.begin(), index.sorted.end(), prefix,
+                               [&snap](uint32_t s, std::string_view p) { return snap.str(s) < p; });
+    for (; it != index.sorted.end() && starts_with(snap.str(*it), prefix); ++it) out->push_back(*it);
+}
+
+static void add_alias(const UiFieldIndex &index, std::string_view alias, std::vector<uint32_t> *out) {
+    auto it = index.alias.find(alias);
+    if (it != index.alias.end()) out->insert(out->end(), it->second.begin(), it->second.end());
+}
+
+// Collect the candidates of an indexable condition; false if c is not one.
+// Candidates may be a superset (e.g. "widget.Button" looks up "Button"):
+// the whole selector is verified on each of them anyway.
+static bool cond_candidates(const SelectorCond &c, const UiSnapshot &snap, IndexCandidates *out) {
+    SelectorArg arg = selector_op_arg(c.op);
+    if (arg == SEL_ARG_RECT || arg == SEL_ARG_POINT) {
+        // Every bounds condition implies the node touches the (normalized)
+        // query rectangle; boundsInside() of an empty one matches nothing
+        const int32_t *q = c.rect;
+        out->cond = &c;
+        out->index = nullptr;
+        out->strings.clear();
+        out->nodes.clear();
+        if (c.op != SEL_BOUNDS_INSIDE || (q[0] < q[2] && q[1] < q[3])) {
+            ui_snapshot_query_bounds(snap, std::min(q[0], q[2]), std::min(q[1], q[3]), std::max(q[0], q[2]),
+                                     std::max(q[1], q[3]), &out->nodes);
+        }
+        std::sort(out->nodes.begin(), out->nodes.end());
+        out->count = out->nodes.size();
+        return true;
+    }
+
+    if (c.folded) {
+        // The strings folding to the argument, or to a string containing it
+        const UiFoldIndex &fold = ui_snapshot_folded(snap);
+        bool equals = c.op == SEL_TEXT_EQUALS_NORMALIZED || c.op == SEL_DESC_EQUALS_NORMALIZED;
+        std::string_view v = *c.folded;
+        if (!equals && v.empty()) return false;
+        const UiFieldIndex &index = ui_snapshot_index(snap, folded_field(c.op));
+        out->cond = &c;
+        out->index = &index;
+        out->strings.clear();
+        out->nodes.clear();
+        auto add_form = [&fold, out](uint32_t f) {
+            out->strings.insert(out->strings.end(), fold.strings.begin() + fold.stringOffsets[f],
+                                fold.strings.begin() + fold.stringOffsets[f + 1]);
+        };
+        if (equals) {
+            auto it = fold.lookup.find(v);
+            if (it != fold.lookup.end()) add_form(it->second);
+        } else {
+            for (uint32_t f = 1; f < fold.size(); f++) {
+                if (contains(fold.str(f), v)) add_form(f);
+            }
+        }
+        out->count = 0;
+        for (uint32_t s : out->strings) out->count += index.count(s);
+        return true;
+    }
+
+    int field = cond_field(c.op);
+    if (field < 0) return false;
+
+    const UiFieldIndex &index = ui_snapshot_index(snap, field);
+    std::string_view v = *c.str;
+    out->cond = &c;
+    out->index = &index;
+    out->strings.clear();
+    out->nodes.clear();
+
+    uint32_t idx;
+    switch (c.op) {
+    case SEL_TEXT:
+    case SEL_DESC:
+    case SEL_PACKAGE_NAME:
+        if (ui_snapshot_lookup(snap, v, &idx)) out->strings.push_back(idx);
+        break;
+    case SEL_ID:
+        if (ui_snapshot_lookup(snap, v, &idx)) out->strings.push_back(idx);
+        add_alias(index, v, &out->strings);
+        break;
+    case SEL_CLASS_NAME: {
+        if (ui_snapshot_lookup(snap, v, &idx)) out->strings.push_back(idx);
+        size_t dot = v.rfind('.');
+        add_alias(index, dot == std::string_view::npos ? v : v.substr(dot + 1), &out->strings);
+        break;
+    }
+    case SEL_ID_STARTS_WITH: {
+        add_prefix_range(snap, index, v, &out->strings);
+        auto it = std::lower_bound(index.aliasSorted.begin(), index.aliasSorted.end(),
+                                   std::make_pair(v, (uint32_t)0));
+        for (; it != index.aliasSorted.end() && starts_with(it->first, v); ++it) out->strings.push_back(it->second);
+        break;
+    }
+    case SEL_CLASS_NAME_STARTS_WITH:
+        add_prefix_range(snap, index, v, &out->strings);
+        add_prefix_range(snap, index, "android.widget." + std::string(v), &out->strings);
+        break;
+    default:
+        add_prefix_range(snap, index, v, &out->strings);
+        break;
+    }
+
+    std::sort(out->strings.begin(), out->strings.end());
+    out->strings.erase(std::unique(out->strings.begin(), out->strings.end()), out->strings.end());
+    out->count = 0;
+    for (uint32_t s : out->strings) out->count += index.count(s);
+    return true;
+}
+
+// Choose the access path for [begin, end): true with the candidates of the
+// most selective indexable condition, false for a full scan
+static bool plan_access(Selector *sel, const UiSnapshot &snap, int32_t begin, int32_t end, IndexCandidates *best) {
+    IndexCandidates cand;
+    bool indexed = false;
+    for (size_t k = 0; k < sel->conds.size(); k++) {
+        const SelectorCond &c = sel->conds[k];
+        if (sel->plan.cost[k] == SEL_COST_RELATION) {
+            const std::vector<int32_t> &nodes = sel->plan.relatedNodes[k];
+            auto first = std::lower_bound(nodes.begin(), nodes.end(), begin);
+            auto last = std::lower_bound(first, nodes.end(), end);
+            if (!indexed || (size_t)(last - first) < best->count) {
+                best->cond = &c;
+                best->index = nullptr;
+                best->strings.clear();
+                best->nodes.assign(first, last);
+                best->count = best->nodes.size();
+                indexed = true;
+            }
+            if (best->count == 0) return true;
+            continue;
+        }
+        if (!cond_candidates(c, snap, &cand)) continue;
+        if (!indexed || cand.count < best->count) {
+            std::swap(*best, cand);
+            indexed = true;
+        }
+        if (best->count == 0) return true;
+    }
+    // Not worth it when the candidates cover the range anyway
+    return indexed && best->count < (size_t)(end - begin);
+}
+
+static size_t find_range(Selector *sel, const UiSnapshot &snap, int32_t begin, int32_t end,
+                         size_t limit, std::vector<int32_t> *out) {
+    if (begin < 0) begin = 0;
+    if (end > (int32_t)snap.size()) end = (int32_t)snap.size();
+    if (begin >= end || selector_plan(sel).never) return 0;
+    plan_relate(sel, snap);
+    bool bound = plan_bind(sel, snap);
+    bool reverse = sel->plan.hitTest;
+    size_t found = 0;
+
+    IndexCandidates best;
+    if (!plan_access(sel, snap, begin, end, &best)) {
+        // Flag test inline: it rejects most nodes of a typical scan
+        const uint32_t *flags = snap.flags.data();
+        uint32_t mask = sel->plan.flagMask, value = sel->plan.flagValue;
+        for (int32_t k = 0; k < end - begin; k++) {
+            int32_t i = reverse ? end - 1 - k : begin + k;
+            if ((flags[i] & mask) != value || !plan_match(sel, snap, i, bound)) continue;
+            out->push_back(i);
+            if (++found == limit) break;
+        }
+        return found;
+    }
+    if (best.count == 0) return 0;
+
+    const int32_t *first, *last;
+    std::vector<int32_t> merged;
+    if (!best.index) {
+        first = best.nodes.data();
+        last = best.nodes.data() + best.nodes.size();
+    } else if (best.strings.size() == 1) {
+        const UiFieldIndex &index = *best.index;
+        first = index.nodes.data() + index.offsets[best.strings[0]];
+        last = index.nodes.data() + index.offsets[best.strings[0] + 1];
+    } else {
+        const UiFieldIndex &index = *best.index;
+        merged.reserve(best.count);
+        for (uint32_t s : best.strings) {
+            merged.insert(merged.end(), index.nodes.begin() + index.offsets[s], index.nodes.begin() + index.offsets[s + 1]);
+        }
+        std::sort(merged.begin(), merged.end());
+        first = merged.data();
+        last = merged.data() + merged.size();
+    }
+
+    first = std::lower_bound(first, last, begin);
+    last = std::lower_bound(first, last, end);
+    for (ptrdiff_t k = 0; k < last - first; k++) {
+        int32_t i = reverse ? last[-1 - k] : first[k];
+        if (!plan_match(sel, snap, i, bound)) continue;
+        out->push_back(i);
+        if (++found == limit) break;
+    }
+    return found;
+}
+
+// ==================== Result Memo ====================
+
+namespace {
+
+struct MemoEntry {
+    uint32_t generation = 0;
+    size_t limit = 0;               // 0 = no limit
+    std::vector<int32_t> nodes;
+
+    // All matches, rather than the first limit of them
+    bool complete() const { return limit == 0 || nodes.size() < limit; }
+    bool answers(size_t want) const { return complete() || (want != 0 && want <= nodes.size()); }
+};
+
+// Most recently used first
+struct MemoCache {
+    std::list<std::pair<std::string, MemoEntry>> entries;
+    std::unordered_map<std::string, decltype(entries)::iterator> index;
+};
+
+}
+
+static std::atomic<uint64_t> g_memo_hits{ 0 };
+static std::atomic<uint64_t> g_memo_revalidated{ 0 };
+static std::atomic<uint64_t> g_memo_misses{ 0 };
+static std::atomic<bool> g_memo_enabled{ true };
+
+SelectorMemoStats selector_memo_stats() {
+    return { g_memo_hits.load(), g_memo_revalidated.load(), g_memo_misses.load() };
+}
+
+void selector_memo_reset_stats() {
+    g_memo_hits = 0;
+    g_memo_revalidated = 0;
+    g_memo_misses = 0;
+}
+
+void selector_memo_set_enabled(bool enabled) {
+    g_memo_enabled = enabled;
+}
+
+static bool delta_changed(const UiSnapshot &snap, int32_t node) {
+    auto it = std::upper_bound(snap.changed.begin(), snap.changed.end(), std::make_pair(node, INT32_MAX));
+    return it != snap.changed.begin() && node < std::prev(it)->second;
+}
+
+// Carry e's matches over the delta that derived snap from e's snapshot:
+// untouched nodes match as before, so only the nodes the delta wrote are
+// tested. False if e cannot be carried.
+static bool memo_revalidate(Selector *sel, const UiSnapshot &snap, MemoEntry *e) {
+    const SelectorPlan &plan = selector_plan(sel);
+    if (plan.hitTest) return false;
+    for (uint16_t k : plan.order) {
+        if (plan.cost[k] == SEL_COST_RELATION) return false;
+    }
+
+    std::vector<int32_t> carried, fresh, merged;
+    for (int32_t m : e->nodes) {
+        if ((size_t)m >= snap.baseNodes.size()) return false;
+        int32_t i = snap.baseNodes[m];
+        if (i >= 0 && !delta_changed(snap, i)) carried.push_back(i);
+    }
+    bool bound = plan_bind(sel, snap);
+    for (const auto &range : snap.changed) {
+        for (int32_t i = range.first; i < range.second; i++) {
+            if (plan_match(sel, snap, i, bound)) fresh.push_back(i);
+        }
+    }
+    merged.resize(carried.size() + fresh.size());
+    std::merge(carried.begin(), carried.end(), fresh.begin(), fresh.end(), merged.begin());
+
+    if (!e->complete()) {
+        // Only the part up to the last stored match is known
+        int32_t last = snap.baseNodes[e->nodes.back()];
+        if (last < 0 || delta_changed(snap, last)) return false;
+        merged.erase(std::upper_bound(merged.begin(), merged.end(), last), merged.end());
+        if (merged.size() < e->limit) return false;
+    }
+    if (e->limit != 0 && merged.size() > e->limit) merged.resize(e->limit);
+    e->nodes.swap(merged);
+    e->generation = snap.generation;
+    return true;
+}
+
+size_t selector_find(Selector *sel, const UiSnapshot &snap, int32_t begin, int32_t end,
+                     size_t limit, std::vector<int32_t> *out) {
+    if (begin > 0 || end < (int32_t)snap.size() || snap.generation == 0 || !g_memo_enabled ||
+        selector_plan(sel).never) {
+        return find_range(sel, snap, begin, end, limit, out);
+    }
+
+    thread_local MemoCache memo;
+    const std::vector<uint8_t> &encoded = selector_encode(sel);
+    std::string key(encoded.begin(), encoded.end());
+    MemoEntry *e = nullptr;
+    auto it = memo.index.find(key);
+    if (it != memo.index.end()) {
+        memo.entries.splice(memo.entries.begin(), memo.entries, it->second);
+        e = &it->second->second;
+    }
+
+    if (e && e->generation == snap.generation && e->answers(limit)) {
+        g_memo_hits++;
+    } else if (e && snap.baseGeneration != 0 && e->generation == snap.baseGeneration && e->answers(limit) &&
+               memo_revalidate(sel, snap, e) && e->answers(limit)) {
+        g_memo_revalidated++;
+    } else {
+        g_memo_misses++;
+        // Searched before touching the cache: relation conditions search
+        // (and cache) their nested selectors
+        std::vector<int32_t> found;
+        find_range(sel, snap, 0, (int32_t)snap.size(), limit, &found);
+        it = memo.index.find(key);
+        if (it == memo.index.end()) {
+            memo.entries.emplace_front(key, MemoEntry());
+            it = memo.index.emplace(std::move(key), memo.entries.begin()).first;
+            if (memo.entries.size() > SELECTOR_MEMO_SIZE) {
+                memo.index.erase(memo.entries.back().first);
+                memo.entries.pop_back();
+            }
+        } else {
+            memo.entries.splice(memo.entries.begin(), memo.entries, it->second);
+        }
+        e = &it->second->second;
+        e->generation = snap.generation;
+        e->limit = limit;
+        e->nodes.swap(found);
+    }
+
+    size_t n = limit == 0 || limit > e->nodes.size() ? e->nodes.size() : limit;
+    out->insert(out->end(), e->nodes.begin(), e->nodes.begin() + n);
+    return n;
+}
+
+// ==================== Cursors ====================
+
+void selector_cursor_init(SelectorCursor *cur, std::shared_ptr<Selector> sel, std::shared_ptr<const UiSnapshot> snap,
+                          int order, size_t limit, int32_t maxDepth) {
+    *cur = SelectorCursor();
+    cur->sel = std::move(sel);
+    cur->snap = std::move(snap);
+    cur->order = order;
+    cur->limit = limit;
+    cur->maxDepth = maxDepth;
+    cur->done = !cur->snap || cur->snap->size() == 0;
+    if (!cur->done && order != SEL_ORDER_DFS) cur->pending.push_back(0);
+}
+
+// Next node of the walk, or -1
+static int32_t cursor_visit(SelectorCursor *cur) {
+    const UiSnapshot &snap = *cur->snap;
+    int32_t n = (int32_t)snap.size();
+    auto expand = [cur, &snap](int32_t i) {
+        return cur->maxDepth < 0 || snap.depth[i] - snap.depth[0] < cur->maxDepth;
+    };
+
+    if (cur->order == SEL_ORDER_DFS) {
+        if (cur->next >= n) return -1;
+        int32_t i = cur->next;
+        cur->next = expand(i) ? i + 1 : snap.subtreeEnd[i];
+        return i;
+    }
+    if (cur->pending.empty()) return -1;
+
+    if (cur->order == SEL_ORDER_BFS) {
+        int32_t i = cur->pending.front();
+        cur->pending.pop_front();
+        if (expand(i)) {
+            for (int32_t c = i + 1; c < snap.subtreeEnd[i]; c = snap.subtreeEnd[c]) cur->pending.push_back(c);
+        }
+        return i;
+    }
+
+    // Paint order: push children so the lowest drawingOrder pops first
+    int32_t i = cur->pending.back();
+    cur->pending.pop_back();
+    if (expand(i)) {
+        size_t first = cur->pending.size();
+        for (int32_t c = i + 1; c < snap.subtreeEnd[i]; c = snap.subtreeEnd[c]) cur->pending.push_back(c);
+        std::stable_sort(cur->pending.begin() + first, cur->pending.end(), [&snap](int32_t a, int32_t b) {
+            return snap.drawingOrder[a] > snap.drawingOrder[b];
+        });
+    }
+    return i;
+}
+
+int32_t selector_cursor_next(SelectorCursor *cur) {
+    if (cur->done) return -1;
+    const UiSnapshot &snap = *cur->snap;
+    Selector *sel = cur->sel.get();
+    int32_t found = -1;
+
+    if (cur->order == SEL_ORDER_DFS && cur->maxDepth < 0 && !selector_plan(sel).hitTest) {
+        if (cur->batchPos == cur->batch.size() && cur->next < (int32_t)snap.size()) {
+            // Read ahead 1, 2, 4... matches, never past the limit
+            size_t want = cur->batch.empty() ? 1 : std::min(cur->batch.size() * 2, (size_t)SELECTOR_CURSOR_MAX_BATCH);
+            if (cur->limit) want = std::min(want, cur->limit - cur->produced);
+            cur->batch.clear();
+            cur->batchPos = 0;
+            selector_find(sel, snap, cur->next, (int32_t)snap.size(), want, &cur->batch);
+            cur->next = cur->batch.size() == want ? cur->batch.back() + 1 : (int32_t)snap.size();
+        }
+        if (cur->batchPos < cur->batch.size()) found = cur->batch[cur->batchPos++];
+    } else {
+        for (int32_t i; (i = cursor_visit(cur)) >= 0;) {
+            if (selector_match(sel, snap, i)) {
+                found = i;
+                break;
+            }
+        }
+    }
+
+    if (found >= 0) cur->produced++;
+    if (found < 0 || cur->produced == cur->limit) {
+        cur->done = true;
+        cur->pending.clear();
+        cur->batch.clear();
+    }
+    return found;
+}
+
+// ==================== Explain ====================
+
+static const char *const g_selector_cost_names[] = {
+    "flags", "int", "relation", "bounds", "interned", "string", "substring", "regex",
+};
+
+static std::string cond_describe(const SelectorCond &c);
+
+// Conditions as a chain: id("buy").clickable(true)
+static std::string selector_describe(const Selector &sel) {
+    std::string out;
+    for (const SelectorCond &c : sel.conds) {
+        if (!out.empty()) out += ".";
+        out += cond_describe(c);
+    }
+    return out;
+}
+
+static std::string cond_describe(const SelectorCond &c) {
+    std::string out = selector_op_name(c.op);
+    switch (selector_op_arg(c.op)) {
+    case SEL_ARG_STRING: return out + "(\"" + *c.str + "\")";
+    case SEL_ARG_REGEX: {
+        out += "(/" + *c.str + "/";
+        if (c.value & SEL_REGEX_IGNORE_CASE) out += "i";
+        if (c.value & SEL_REGEX_MULTILINE) out += "m";
+        if (c.value & SEL_REGEX_DOT_ALL) out += "s";
+        if (c.value & SEL_REGEX_UNICODE) out += "u";
+        return out + ")";
+    }
+    case SEL_ARG_BOOL: return out + (c.value ? "(true)" : "(false)");
+    case SEL_ARG_INT: return out + "(" + std::to_string(c.value) + ")";
+    case SEL_ARG_RECT:
+        return out + "(" + std::to_string(c.rect[0]) + ", " + std::to_string(c.rect[1]) + ", " +
+               std::to_string(c.rect[2]) + ", " + std::to_string(c.rect[3]) + ")";
+    case SEL_ARG_POINT: return out + "(" + std::to_string(c.rect[0]) + ", " + std::to_string(c.rect[1]) + ")";
+    case SEL_ARG_SELECTOR: return out + "(" + selector_describe(*c.sub) + ")";
+    }
+    return out;
+}
+
+std::string selector_explain(Selector *sel, const UiSnapshot *snap) {
+    const SelectorPlan &plan = selector_plan(sel);
+    std::string out;
+
+    if (snap) {
+        IndexCandidates best;
+        int32_t n = (int32_t)snap->size();
+        plan_relate(sel, *snap);
+        if (plan.never) {
+            out += "empty: contradictory flags\n";
+        } else if (n > 0 && plan_access(sel, *snap, 0, n, &best)) {
+            const char *path = best.index ? "index " : selector_op_cost(best.cond->op) == SEL_COST_RELATION ? "relation " : "spatial ";
+            out += path + cond_describe(*best.cond) + ": " + std::to_string(best.count) + " of " +
+                   std::to_string(n) + " nodes\n";
+        } else {
+            out += "scan " + std::to_string(n) + " nodes\n";
+        }
+        if (plan.hitTest && !plan.never) out += "topmost first\n";
+    }
+
+    int step = 1;
+    if (plan.flagMask) {
+        std::string flags;
+        for (const SelectorCond &c : sel->conds) {
+            if (selector_op_cost(c.op) != SEL_COST_FLAGS) continue;
+            if (!flags.empty()) flags += " && ";
+            flags += cond_describe(c);
+        }
+        out += std::to_string(step++) + ". " + flags + " [flags]\n";
+    }
+    for (uint16_t k : plan.order) {
+        const SelectorCond &c = sel->conds[k];
+        out += std::to_string(step++) + ". " + cond_describe(c) + " [" + g_selector_cost_names[plan.cost[k]] + "]\n";
+    }
+    return out;
+}
@@ -0,0 +1,338 @@
+#ifndef UI_SELECTOR_H
+#define UI_SELECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ==================== Selector Conditions ====================
+//
+// A selector is a flat list of conditions, each an operator plus one
+// argument. Operator ids are part of the encoding (selector_encode), which
+// now only keys the result memo; keep appending to this list all the same.
+
+enum SelectorArg {
+    SEL_ARG_STRING,
+    SEL_ARG_REGEX,
+    SEL_ARG_BOOL,
+    SEL_ARG_INT,
+    SEL_ARG_RECT,       // left, top, right, bottom
+    SEL_ARG_POINT,      // x, y
+    SEL_ARG_SELECTOR,   // nested selector a relative must match
+};
+
+#define SELECTOR_OP_LIST(X) \
+    X(SEL_TEXT, "text", SEL_ARG_STRING) \
+    X(SEL_TEXT_CONTAINS, "textContains", SEL_ARG_STRING) \
+    X(SEL_TEXT_STARTS_WITH, "textStartsWith", SEL_ARG_STRING) \
+    X(SEL_TEXT_ENDS_WITH, "textEndsWith", SEL_ARG_STRING) \
+    X(SEL_TEXT_MATCHES, "textMatches", SEL_ARG_REGEX) \
+    X(SEL_DESC, "desc", SEL_ARG_STRING) \
+    X(SEL_DESC_CONTAINS, "descContains", SEL_ARG_STRING) \
+    X(SEL_DESC_STARTS_WITH, "descStartsWith", SEL_ARG_STRING) \
+    X(SEL_DESC_ENDS_WITH, "descEndsWith", SEL_ARG_STRING) \
+    X(SEL_DESC_MATCHES, "descMatches", SEL_ARG_REGEX) \
+    X(SEL_ID, "id", SEL_ARG_STRING) \
+    X(SEL_ID_CONTAINS, "idContains", SEL_ARG_STRING) \
+    X(SEL_ID_STARTS_WITH, "idStartsWith", SEL_ARG_STRING) \
+    X(SEL_ID_ENDS_WITH, "idEndsWith", SEL_ARG_STRING) \
+    X(SEL_ID_MATCHES, "idMatches", SEL_ARG_REGEX) \
+    X(SEL_CLASS_NAME, "className", SEL_ARG_STRING) \
+    X(SEL_CLASS_NAME_CONTAINS, "classNameContains", SEL_ARG_STRING) \
+    X(SEL_CLASS_NAME_STARTS_WITH, "classNameStartsWith", SEL_ARG_STRING) \
+    X(SEL_CLASS_NAME_ENDS_WITH, "classNameEndsWith", SEL_ARG_STRING) \
+    X(SEL_CLASS_NAME_MATCHES, "classNameMatches", SEL_ARG_REGEX) \
+    X(SEL_PACKAGE_NAME, "packageName", SEL_ARG_STRING) \
+    X(SEL_PACKAGE_NAME_CONTAINS, "packageNameContains", SEL_ARG_STRING) \
+    X(SEL_PACKAGE_NAME_STARTS_WITH, "packageNameStartsWith", SEL_ARG_STRING) \
+    X(SEL_PACKAGE_NAME_ENDS_WITH, "packageNameEndsWith", SEL_ARG_STRING) \
+    X(SEL_CLICKABLE, "clickable", SEL_ARG_BOOL) \
+    X(SEL_SCROLLABLE, "scrollable", SEL_ARG_BOOL) \
+    X(SEL_ENABLED, "enabled", SEL_ARG_BOOL) \
+    X(SEL_CHECKED, "checked", SEL_ARG_BOOL) \
+    X(SEL_SELECTED, "selected", SEL_ARG_BOOL) \
+    X(SEL_FOCUSABLE, "focusable", SEL_ARG_BOOL) \
+    X(SEL_FOCUSED, "focused", SEL_ARG_BOOL) \
+    X(SEL_LONG_CLICKABLE, "longClickable", SEL_ARG_BOOL) \
+    X(SEL_CHECKABLE, "checkable", SEL_ARG_BOOL) \
+    X(SEL_EDITABLE, "editable", SEL_ARG_BOOL) \
+    X(SEL_VISIBLE_TO_USER, "visibleToUser", SEL_ARG_BOOL) \
+    X(SEL_DEPTH, "depth", SEL_ARG_INT) \
+    X(SEL_DRAWING_ORDER, "drawingOrder", SEL_ARG_INT) \
+    X(SEL_BOUNDS, "bounds", SEL_ARG_RECT) \
+    X(SEL_BOUNDS_INSIDE, "boundsInside", SEL_ARG_RECT) \
+    X(SEL_BOUNDS_CONTAINS, "boundsContains", SEL_ARG_RECT) \
+    X(SEL_BOUNDS_INTERSECTS, "boundsIntersects", SEL_ARG_RECT) \
+    X(SEL_NODE_AT, "nodeAt", SEL_ARG_POINT) \
+    X(SEL_PARENT, "parent", SEL_ARG_SELECTOR) \
+    X(SEL_CHILD, "child", SEL_ARG_SELECTOR) \
+    X(SEL_SIBLING, "sibling", SEL_ARG_SELECTOR) \
+    X(SEL_ANCESTOR, "ancestor", SEL_ARG_SELECTOR) \
+    X(SEL_DESCENDANT, "descendant", SEL_ARG_SELECTOR) \
+    X(SEL_TEXT_EQUALS_NORMALIZED, "textEqualsNormalized", SEL_ARG_STRING) \
+    X(SEL_TEXT_CONTAINS_NORMALIZED, "textContainsNormalized", SEL_ARG_STRING) \
+    X(SEL_DESC_EQUALS_NORMALIZED, "descEqualsNormalized", SEL_ARG_STRING) \
+    X(SEL_DESC_CONTAINS_NORMALIZED, "descContainsNormalized", SEL_ARG_STRING)
+
+enum SelectorOp {
+#define X(op, name, arg) op,
+    SELECTOR_OP_LIST(X)
+#undef X
+    SEL_OP_COUNT
+};
+
+const char *selector_op_name(int op);
+SelectorArg selector_op_arg(int op);
+
+// Condition strings are interned: selectors rebuilt with the same literals
+// (e.g. text("OK") inside a polling loop) share one copy, and equal strings
+// compare by pointer. Entries are dropped once no selector references them.
+typedef std::shared_ptr<const std::string> SelectorString;
+
+SelectorString selector_intern(const char *s, size_t len);
+
+// Regex flags (SEL_ARG_REGEX conditions), from a JS RegExp's flags
+enum SelectorRegexFlag {
+    SEL_REGEX_IGNORE_CASE = 1 << 0,     // i
+    SEL_REGEX_MULTILINE = 1 << 1,       // m
+    SEL_REGEX_DOT_ALL = 1 << 2,         // s
+    SEL_REGEX_UNICODE = 1 << 3,         // u
+};
+
+uint32_t selector_regex_flags(const char *js_flags, size_t len);
+
+struct Selector;
+struct SelectorRegex;
+struct SelectorRegexCache;
+struct UiFoldIndex;
+struct UiSnapshot;
+
+typedef struct {
+    int op = 0;
+    int32_t value = 0;      // SEL_ARG_BOOL / SEL_ARG_INT, SEL_REGEX_* for SEL_ARG_REGEX
+    SelectorString str;     // SEL_ARG_STRING / SEL_ARG_REGEX
+    SelectorString folded;  // *Normalized() conditions: str folded (ui_fold_string)
+    // Taken from the selector's regex cache when its plan is built
+    std::shared_ptr<SelectorRegex> re;
+    int32_t rect[4] = {};   // SEL_ARG_RECT; SEL_ARG_POINT as x, y, x, y
+    // SEL_ARG_SELECTOR; never modified once added, so copies may share it
+    std::shared_ptr<Selector> sub;
+} SelectorCond;
+
+// ==================== Encoding ====================
+//
+//   u8  version (SELECTOR_ENCODING_VERSION)
+//   u16 condition count
+//   per condition: u8 op, then
+//     SEL_ARG_STRING                   u32 byte length + UTF-8 bytes
+//     SEL_ARG_REGEX                    u32 byte length + UTF-8 bytes, u8 flags
+//     SEL_ARG_BOOL                     u8
+//     SEL_ARG_INT                      i32
+//     SEL_ARG_RECT                     4 x i32: left, top, right, bottom
+//     SEL_ARG_POINT                    2 x i32: x, y
+//     SEL_ARG_SELECTOR                 u32 byte length + nested encoding
+//
+// Integers are in native (little-endian) order, like host_call.h.
+
+#define SELECTOR_ENCODING_VERSION 2
+
+// ==================== Evaluation Plan ====================
+//
+// Conditions are compiled once into a plan (selector_plan) that evaluates
+// them cheapest first, so a node is usually rejected before any string is
+// looked at: all flag conditions fold into one mask compare, then integer
+// and interned-string equality, then other string tests, then regexes.
+// Within a cost class longer needles go first, as they are rarer.
+//
+// A relation condition (parent(s), child(s), sibling(s), ancestor(s),
+// descendant(s)) is resolved once per snapshot: s is found with its own
+// plan, then a single pass over the parent array marks every node whose
+// relative matched, so testing a node is one lookup.
+
+enum SelectorCost {
+    SEL_COST_FLAGS,
+    SEL_COST_INT,
+    SEL_COST_RELATION,
+    SEL_COST_BOUNDS,
+    SEL_COST_INTERNED,      // exact text/desc/packageName: compares string indices
+    SEL_COST_STRING,        // id/className equality, prefix and suffix tests
+    SEL_COST_SUBSTRING,
+    SEL_COST_REGEX,
+};
+
+SelectorCost selector_op_cost(int op);
+
+typedef struct {
+    bool valid = false;
+    bool never = false;             // contradictory flag conditions
+    bool hitTest = false;           // has nodeAt(): results topmost first
+    uint32_t flagMask = 0;
+    uint32_t flagValue = 0;
+    std::vector<uint16_t> order;    // non-flag condition indices, evaluation order
+    std::vector<uint8_t> cost;      // SelectorCost per condition
+    // SEL_COST_INTERNED values resolved to string indices of one published
+    // snapshot (UINT32_MAX: not in it), per condition
+    const UiSnapshot *snapshot = nullptr;
+    uint32_t generation = 0;
+    std::vector<uint32_t> resolved;
+    // SEL_COST_RELATION conditions resolved on one snapshot, per condition:
+    // whether each node's relative matches, and those nodes in order
+    const UiSnapshot *relatedSnapshot = nullptr;
+    uint32_t relatedGeneration = 0;
+    std::vector<std::vector<uint8_t>> related;
+    std::vector<std::vector<int32_t>> relatedNodes;
+    // Folded strings of the snapshot last matched, if any condition is a
+    // *Normalized() one
+    bool normalized = false;
+    const UiFoldIndex *fold = nullptr;
+} SelectorPlan;
+
+struct Selector {
+    std::vector<SelectorCond> conds;
+    // Cached encoding, rebuilt lazily after the conditions change so a
+    // selector reused across calls is encoded only once.
+    std::vector<uint8_t> encoded;
+    bool dirty = true;
+    // Cached plan, rebuilt after the conditions change
+    SelectorPlan plan;
+    // Where regex conditions compile; null for the process-wide cache
+    std::shared_ptr<SelectorRegexCache> regexes;
+};
+
+void selector_add_string(Selector *sel, int op, const char *s, size_t len);
+void selector_add_int(Selector *sel, int op, int32_t value);
+void selector_add_regex(Selector *sel, int op, const char *s, size_t len, uint32_t flags);
+// SEL_ARG_RECT, or SEL_ARG_POINT with right = left and bottom = top
+void selector_add_rect(Selector *sel, int op, int32_t left, int32_t top, int32_t right, int32_t bottom);
+// SEL_ARG_SELECTOR; sub is copied, later changes to it do not apply
+void selector_add_selector(Selector *sel, int op, const Selector &sub);
+
+const SelectorPlan &selector_plan(Selector *sel);
+const std::vector<uint8_t> &selector_encode(Selector *sel);
+
+// ==================== Matching ====================
+//
+// Evaluates conditions against a UiSnapshot with the same semantics as
+// UiSelector.kt: id() also matches the part after ":id/", className() also
+// matches the simple name, textMatches() must match the whole text while
+// the other *Matches() conditions search. Regexes use the QuickJS engine
+// (ECMAScript syntax, UTF-16 units, so "." matches half of a surrogate
+// pair unless the u flag is set); one that fails to compile matches nothing.
+// The *Normalized() conditions (UiSelector.kt has no counterpart) compare
+// the folded forms of the argument and of the node's value (ui_snapshot.h,
+// Normalized Text): textEqualsNormalized("ｏｋ") matches "OK".
+//
+// Compiled regexes live in an LRU cache keyed by pattern and flags, so a
+// polling loop that rebuilds textMatches(/\d+ sold/) each time compiles it
+// once, and also shares its per-snapshot match results. A script engine
+// keeps one cache per JS runtime, set on the selectors it creates, and drops
+// it with the runtime; a cache is used by one thread at a time, like the
+// runtime. Selectors without one share a process-wide cache.
+//
+// Bounds conditions follow android.graphics.Rect: boundsInside(r) needs a
+// non-empty r containing the node, boundsContains(r) a non-empty node
+// containing r, boundsIntersects(r) a strict overlap, and nodeAt(x, y) a
+// node whose half-open bounds contain the point. A selector with nodeAt()
+// is a hit test: its matches come topmost first, i.e. in reverse document
+// order (deeper and later-drawn siblings before their ancestors).
+//
+// Relations: parent(s) needs the node's parent to match s, child(s) some
+// child, sibling(s) another child of the same parent, ancestor(s) and
+// descendant(s) any node on the path to the root or in the subtree. The
+// whole snapshot is searched for s, regardless of the range passed to
+// selector_find.
+
+#define SELECTOR_REGEX_CACHE_SIZE 64
+
+std::shared_ptr<SelectorRegexCache> selector_regex_cache_new();
+
+bool selector_match(Selector *sel, const UiSnapshot &snap, int32_t node);
+
+// Append the nodes in [begin, end) matching sel, in document order, stopping
+// after limit matches (0 = no limit). Returns the number appended. Exact and
+// *StartsWith conditions on string columns, *Normalized() conditions, and
+// bounds conditions are served from the snapshot's lookup, folded text and
+// spatial indexes, so only their candidate nodes are visited. Hit tests append in reverse document order.
+// Searches of a whole published snapshot go through the result memo below.
+size_t selector_find(Selector *sel, const UiSnapshot &snap, int32_t begin, int32_t end,
+                     size_t limit, std::vector<int32_t> *out);
+
+// ==================== Result Memo ====================
+//
+// Polling loops (while (!text("OK").exists()) sleep(200)) repeat the same
+// search, usually through a new Selector each time, while the UI does not
+// change. Whole-snapshot results are kept per thread in an LRU of
+// SELECTOR_MEMO_SIZE entries keyed by the selector's encoding, with
+// the generation and limit they were found for:
+//   hit          same generation: the stored matches are returned
+//   revalidated  the snapshot was derived by a delta from the entry's
+//                generation (ui_snapshot_apply_delta): matches outside the
+//                nodes the delta wrote are carried over and only those
+//                nodes are tested. Selectors with relation conditions or
+//                nodeAt() depend on other nodes and search again instead.
+//   miss         anything else: searched, and the entry replaced
+// A result that reached its limit answers requests for at most as many
+// matches. The counters are process-wide.
+
+#define SELECTOR_MEMO_SIZE 128
+
+typedef struct {
+    uint64_t hits;
+    uint64_t revalidated;
+    uint64_t misses;
+} SelectorMemoStats;
+
+SelectorMemoStats selector_memo_stats();
+void selector_memo_reset_stats();
+// On by default; off, every search runs (for benchmarks of the engine)
+void selector_memo_set_enabled(bool enabled);
+
+// ==================== Cursors ====================
+//
+// A resumable search that yields one match at a time, so a caller that
+// stops after a few matches only pays for the part of the tree it walked.
+// Depths are relative to the root; maxDepth < 0 means unlimited.
+//   SEL_ORDER_DFS       document order (pre-order)
+//   SEL_ORDER_BFS       level by level
+//   SEL_ORDER_DRAWING   paint order: a parent before its children, siblings
+//                       by drawingOrder
+// An unlimited depth-first cursor reads ahead in growing batches through
+// selector_find, so it keeps the index access paths; the other orders test
+// each visited node.
+
+enum SelectorOrder {
+    SEL_ORDER_DFS,
+    SEL_ORDER_BFS,
+    SEL_ORDER_DRAWING,
+};
+
+#define SELECTOR_CURSOR_MAX_BATCH 64
+
+struct SelectorCursor {
+    std::shared_ptr<Selector> sel;
+    std::shared_ptr<const UiSnapshot> snap;
+    int order = SEL_ORDER_DFS;
+    size_t limit = 0;               // 0 = no limit
+    int32_t maxDepth = -1;
+    size_t produced = 0;
+    bool done = false;
+    int32_t next = 0;               // SEL_ORDER_DFS: next node to visit
+    std::deque<int32_t> pending;    // SEL_ORDER_BFS queue / SEL_ORDER_DRAWING stack
+    std::vector<int32_t> batch;     // read-ahead matches
+    size_t batchPos = 0;
+};
+
+void selector_cursor_init(SelectorCursor *cur, std::shared_ptr<Selector> sel, std::shared_ptr<const UiSnapshot> snap,
+                          int order, size_t limit, int32_t maxDepth);
+// The next match, or -1 once exhausted
+int32_t selector_cursor_next(SelectorCursor *cur);
+
+// Describe how selector_find would run: the access path on snap (index or
+// scan; omitted if snap is null), then the plan's conditions in order.
+std::string selector_explain(Selector *sel, const UiSnapshot *snap);
+
+#endif
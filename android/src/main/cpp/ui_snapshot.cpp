@@ -0,0 +1,815 @@
+#include "ui_snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+extern "C" {
+#include "quickjs/cutils.h"
+#include "quickjs/libunicode.h"
+}
+
+// ==================== Parsing ====================
+
+namespace {
+
+struct Reader {
+    const uint8_t *p;
+    size_t len;
+    size_t pos;
+
+    bool u32(uint32_t *v) {
+        if (len - pos < 4) return false;
+        memcpy(v, p + pos, 4);
+        pos += 4;
+        return true;
+    }
+};
+
+}
+
+// Fill subtreeEnd, checking pre-order with the current root path: a node's
+// parent must be on it, and nodes popped off it have seen their whole subtree
+static bool finish_tree(UiSnapshot *out) {
+    uint32_t nodeCount = (uint32_t)out->parent.size();
+    out->subtreeEnd.resize(nodeCount);
+    std::vector<int32_t> path;
+    for (uint32_t i = 0; i < nodeCount; i++) {
+        int32_t par = out->parent[i];
+        while (!path.empty() && path.back() != par) {
+            out->subtreeEnd[path.back()] = (int32_t)i;
+            path.pop_back();
+        }
+        if (i > 0 && path.empty()) return false;
+        path.push_back((int32_t)i);
+    }
+    for (int32_t n : path) out->subtreeEnd[n] = (int32_t)nodeCount;
+    return true;
+}
+
+static void reset_indexes(UiSnapshot *out) {
+    out->stringIndex.reset();
+    for (auto &f : out->fieldIndex) f.reset();
+    out->spatialIndex.reset();
+    out->identity.reset();
+    out->foldIndex.reset();
+}
+
+bool ui_snapshot_parse(const uint8_t *p, size_t len, UiSnapshot *out) {
+    Reader r = { p, len, 0 };
+    uint32_t magic, version, nodeCount, stringCount;
+    if (!r.u32(&magic) || !r.u32(&version) || !r.u32(&nodeCount) || !r.u32(&stringCount)) return false;
+    if (magic != UI_SNAPSHOT_MAGIC || version != UI_SNAPSHOT_VERSION || stringCount == 0) return false;
+    // Cheap upper bound before reserving anything
+    if ((uint64_t)nodeCount * UI_SNAPSHOT_NODE_FIELDS * 4 > len || (uint64_t)stringCount * 4 > len) return false;
+
+    reset_indexes(out);
+    out->deltaStrings = 0;
+    out->baseGeneration = 0;
+    out->baseNodes.clear();
+    out->changed.clear();
+    out->stringData.clear();
+    out->stringOffsets.clear();
+    out->stringOffsets.reserve(stringCount + 1);
+    out->stringOffsets.push_back(0);
+    for (uint32_t i = 0; i < stringCount; i++) {
+        uint32_t n;
+        if (!r.u32(&n) || len - r.pos < n) return false;
+        if (i == 0 && n != 0) return false;
+        out->stringData.append((const char *)p + r.pos, n);
+        out->stringOffsets.push_back((uint32_t)out->stringData.size());
+        r.pos += n;
+    }
+
+    if ((len - r.pos) / (UI_SNAPSHOT_NODE_FIELDS * 4) < nodeCount) return false;
+
+    std::vector<int32_t> *ints[] = {
+        &out->parent, &out->depth, &out->indexInParent, &out->drawingOrder, &out->childCount,
+    };
+    std::vector<uint32_t> *strs[] = {
+        &out->text, &out->id, &out->className, &out->desc, &out->packageName,
+    };
+    std::vector<int32_t> *rect[] = { &out->left, &out->top, &out->right, &out->bottom };
+    for (auto v : ints) v->resize(nodeCount);
+    for (auto v : strs) v->resize(nodeCount);
+    for (auto v : rect) v->resize(nodeCount);
+    out->flags.resize(nodeCount);
+
+    for (uint32_t i = 0; i < nodeCount; i++) {
+        int32_t f[UI_SNAPSHOT_NODE_FIELDS];
+        memcpy(f, p + r.pos, sizeof(f));
+        r.pos += sizeof(f);
+
+        // Pre-order: the root has no parent and every other parent precedes its child
+        if (i == 0 ? f[0] != -1 : (f[0] < 0 || (uint32_t)f[0] >= i)) return false;
+        for (int k = 0; k < 5; k++) (*ints[k])[i] = f[k];
+        for (int k = 0; k < 5; k++) {
+            if ((uint32_t)f[5 + k] >= stringCount) return false;
+            (*strs[k])[i] = (uint32_t)f[5 + k];
+        }
+        for (int k = 0; k < 4; k++) (*rect[k])[i] = f[10 + k];
+        out->flags[i] = (uint32_t)f[14];
+    }
+
+    return finish_tree(out);
+}
+
+void ui_snapshot_write(const UiSnapshot &snap, std::vector<uint8_t> *out) {
+    size_t nodeCount = snap.size(), stringCount = snap.stringCount();
+    out->clear();
+    out->reserve(16 + stringCount * 4 + snap.stringData.size() + nodeCount * UI_SNAPSHOT_NODE_FIELDS * 4);
+    auto put = [out](const void *p, size_t n) {
+        out->insert(out->end(), (const uint8_t *)p, (const uint8_t *)p + n);
+    };
+    uint32_t header[4] = { UI_SNAPSHOT_MAGIC, UI_SNAPSHOT_VERSION, (uint32_t)nodeCount, (uint32_t)stringCount };
+    put(header, sizeof(header));
+    for (uint32_t i = 0; i < stringCount; i++) {
+        std::string_view str = snap.str(i);
+        uint32_t n = (uint32_t)str.size();
+        put(&n, 4);
+        put(str.data(), n);
+    }
+    for (size_t i = 0; i < nodeCount; i++) {
+        int32_t f[UI_SNAPSHOT_NODE_FIELDS] = {
+            snap.parent[i], snap.depth[i], snap.indexInParent[i], snap.drawingOrder[i], snap.childCount[i],
+            (int32_t)snap.text[i], (int32_t)snap.id[i], (int32_t)snap.className[i], (int32_t)snap.desc[i],
+            (int32_t)snap.packageName[i], snap.left[i], snap.top[i], snap.right[i], snap.bottom[i],
+            (int32_t)snap.flags[i],
+        };
+        put(f, sizeof(f));
+    }
+}
+
+// ==================== Snapshot Files ====================
+
+bool ui_snapshot_save(const UiSnapshot &snap, const char *path) {
+    std::vector<uint8_t> data;
+    ui_snapshot_write(snap, &data);
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool ui_snapshot_load(const char *path, UiSnapshot *out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    madvise(p, len, MADV_SEQUENTIAL);
+    bool ok = ui_snapshot_parse(static_cast<const uint8_t *>(p), len, out);
+    munmap(p, len);
+    return ok;
+}
+
+// ==================== Deltas ====================
+
+namespace {
+
+struct DeltaOp {
+    uint32_t kind;
+    int32_t target;
+    uint32_t count;             // node records
+    const uint8_t *records;
+};
+
+}
+
+static std::vector<int32_t> UiSnapshot::*const g_copied_int_columns[] = {
+    &UiSnapshot::depth, &UiSnapshot::indexInParent, &UiSnapshot::drawingOrder, &UiSnapshot::childCount,
+    &UiSnapshot::left, &UiSnapshot::top, &UiSnapshot::right, &UiSnapshot::bottom,
+};
+
+static std::vector<uint32_t> UiSnapshot::*const g_string_columns[] = {
+    &UiSnapshot::text, &UiSnapshot::id, &UiSnapshot::className, &UiSnapshot::desc, &UiSnapshot::packageName,
+};
+
+// Append base nodes [begin, end) unchanged, recording where they went
+static void copy_nodes(const UiSnapshot &base, int32_t begin, int32_t end, std::vector<int32_t> &remap,
+                       UiSnapshot *out) {
+    if (begin >= end) return;
+    int32_t shift = (int32_t)out->parent.size() - begin;
+    out->parent.resize(out->parent.size() + (end - begin));
+    int32_t *parent = out->parent.data() + shift;
+    for (int32_t i = begin; i < end; i++) {
+        remap[i] = i + shift;
+        int32_t par = base.parent[i];
+        parent[i] = par < 0 ? -1 : remap[par];
+    }
+    for (auto col : g_copied_int_columns) {
+        (out->*col).insert((out->*col).end(), (base.*col).begin() + begin, (base.*col).begin() + end);
+    }
+    for (auto col : g_string_columns) {
+        (out->*col).insert((out->*col).end(), (base.*col).begin() + begin, (base.*col).begin() + end);
+    }
+    out->flags.insert(out->flags.end(), base.flags.begin() + begin, base.flags.begin() + end);
+}
+
+// Append one delta node record; structure fields come from the caller.
+// False if it names a string the delta does not have.
+static bool push_record(const uint8_t *record, const std::vector<uint32_t> &strings, int32_t parent, int32_t depth,
+                        int32_t indexInParent, int32_t childCount, UiSnapshot *out) {
+    int32_t f[UI_SNAPSHOT_NODE_FIELDS];
+    memcpy(f, record, sizeof(f));
+    for (int k = 0; k < 5; k++) {
+        if ((uint32_t)f[5 + k] >= strings.size()) return false;
+    }
+    out->parent.push_back(parent);
+    out->depth.push_back(depth);
+    out->indexInParent.push_back(indexInParent);
+    out->drawingOrder.push_back(f[3]);
+    out->childCount.push_back(childCount);
+    for (int k = 0; k < 5; k++) (out->*g_string_columns[k]).push_back(strings[f[5 + k]]);
+    out->left.push_back(f[10]);
+    out->top.push_back(f[11]);
+    out->right.push_back(f[12]);
+    out->bottom.push_back(f[13]);
+    out->flags.push_back((uint32_t)f[14]);
+    return true;
+}
+
+// Drop strings no node uses once they are at least half of the table. Only
+// strings appended by deltas can be unused, so most deltas skip the scan.
+static void compact_strings(UiSnapshot *s) {
+    size_t count = s->stringCount();
+    if (count < 64 || (size_t)s->deltaStrings * 2 < count) return;
+    std::vector<uint32_t> map(count, UINT32_MAX);
+    map[0] = 0;
+    size_t live = 1;
+    for (auto col : g_string_columns) {
+        for (uint32_t v : s->*col) {
+            if (map[v] == UINT32_MAX) {
+                map[v] = 0;
+                live++;
+            }
+        }
+    }
+    s->deltaStrings = (uint32_t)(count - live);
+    if (live * 2 > count) return;
+
+    std::string data;
+    std::vector<uint32_t> offsets = { 0 };
+    for (uint32_t i = 0; i < count; i++) {
+        if (map[i] == UINT32_MAX) continue;
+        map[i] = (uint32_t)offsets.size() - 1;
+        data += s->str(i);
+        offsets.push_back((uint32_t)data.size());
+    }
+    s->stringData.swap(data);
+    s->stringOffsets.swap(offsets);
+    s->deltaStrings = 0;
+    for (auto col : g_string_columns) {
+        for (uint32_t &v : s->*col) v = map[v];
+    }
+}
+
+// Length and end bytes: distinguishes most strings of a table at a fraction
+// of a hash
+static inline uint32_t string_filter_key(std::string_view s) {
+    if (s.empty()) return 0;
+    uint32_t h = (uint32_t)s.size() * 0x9e3779b1u;
+    h ^= (uint8_t)s.front() * 0x85ebca6bu;
+    h ^= (uint8_t)s.back() * 0xc2b2ae35u;
+    if (s.size() > 2) h ^= (uint8_t)s[s.size() - 2] * 0x27d4eb2fu;
+    return h >> 20;
+}
+
+bool ui_snapshot_apply_delta(const UiSnapshot &base, const uint8_t *p, size_t len, UiSnapshot *out) {
+    const size_t record = UI_SNAPSHOT_NODE_FIELDS * 4;
+    Reader r = { p, len, 0 };
+    uint32_t magic, version, generation, opCount, stringCount;
+    if (!r.u32(&magic) || !r.u32(&version) || !r.u32(&generation) || !r.u32(&opCount) || !r.u32(&stringCount)) {
+        return false;
+    }
+    if (magic != UI_DELTA_MAGIC || version != UI_DELTA_VERSION || generation != base.generation ||
+        stringCount == 0 || base.size() == 0) {
+        return false;
+    }
+    if ((uint64_t)opCount * 8 > len || (uint64_t)stringCount * 4 > len) return false;
+
+    // The base's string table plus the delta's strings it lacks. A delta
+    // names a handful of strings: unless the base has its hash index
+    // already, one pass over the table with a cheap prefilter finds them.
+    std::vector<std::string_view> views(stringCount);
+    std::unordered_map<std::string_view, uint32_t> first;
+    std::vector<bool> filter(4096);
+    for (uint32_t i = 0; i < stringCount; i++) {
+        uint32_t n;
+        if (!r.u32(&n) || len - r.pos < n) return false;
+        if (i == 0 && n != 0) return false;
+        views[i] = std::string_view((const char *)p + r.pos, n);
+        first.emplace(views[i], i);
+        filter[string_filter_key(views[i])] = true;
+        r.pos += n;
+    }
+    std::vector<uint32_t> strings(stringCount, UINT32_MAX);
+    strings[0] = 0;
+    bool indexed;
+    {
+        std::lock_guard<std::mutex> lock(base.indexMutex);
+        indexed = base.stringIndex != nullptr;
+    }
+    if (indexed) {
+        for (auto &f : first) ui_snapshot_lookup(base, f.first, &strings[f.second]);
+    } else {
+        size_t missing = first.size() - 1;
+        for (uint32_t k = 1; k < base.stringCount() && missing > 0; k++) {
+            std::string_view str = base.str(k);
+            if (!filter[string_filter_key(str)]) continue;
+            auto it = first.find(str);
+            if (it == first.end() || strings[it->second] != UINT32_MAX) continue;
+            strings[it->second] = k;
+            missing--;
+        }
+    }
+
+    reset_indexes(out);
+    out->stringData = base.stringData;
+    out->stringOffsets = base.stringOffsets;
+    out->deltaStrings = base.deltaStrings;
+    for (uint32_t i = 1; i < stringCount; i++) {
+        uint32_t f = first[views[i]];
+        if (strings[f] == UINT32_MAX) {
+            out->deltaStrings++;
+            strings[f] = (uint32_t)out->stringCount();
+            out->stringData.append(views[f]);
+            out->stringOffsets.push_back((uint32_t)out->stringData.size());
+        }
+        strings[i] = strings[f];
+    }
+
+    std::vector<DeltaOp> ops(opCount);
+    for (DeltaOp &op : ops) {
+        uint32_t target;
+        if (!r.u32(&op.kind) || !r.u32(&target) || target >= base.size()) return false;
+        op.target = (int32_t)target;
+        op.count = op.kind == UI_DELTA_UPDATE ? 1 : 0;
+        if (op.kind == UI_DELTA_REPLACE && (!r.u32(&op.count) || op.count == 0)) return false;
+        if (op.kind > UI_DELTA_REMOVE || (op.kind == UI_DELTA_REMOVE && target == 0)) return false;
+        if ((len - r.pos) / record < op.count) return false;
+        op.records = p + r.pos;
+        r.pos += op.count * record;
+    }
+    std::stable_sort(ops.begin(), ops.end(), [](const DeltaOp &a, const DeltaOp &b) { return a.target < b.target; });
+    int32_t covered = 0;
+    for (size_t k = 0; k < ops.size(); k++) {
+        if ((k > 0 && ops[k].target == ops[k - 1].target) || ops[k].target < covered) return false;
+        if (ops[k].kind != UI_DELTA_UPDATE) covered = base.subtreeEnd[ops[k].target];
+    }
+
+    int32_t n = (int32_t)base.size();
+    size_t capacity = base.size();
+    for (const DeltaOp &op : ops) capacity += op.count;
+    std::vector<int32_t> remap(n, -1);
+    out->parent.clear();
+    out->parent.reserve(capacity);
+    for (auto col : g_copied_int_columns) {
+        (out->*col).clear();
+        (out->*col).reserve(capacity);
+    }
+    for (auto col : g_string_columns) {
+        (out->*col).clear();
+        (out->*col).reserve(capacity);
+    }
+    out->flags.clear();
+    out->flags.reserve(capacity);
+    out->changed.clear();
+
+    int32_t i = 0;
+    for (const DeltaOp &op : ops) {
+        copy_nodes(base, i, op.target, remap, out);
+        int32_t t = op.target;
+        int32_t at = (int32_t)out->parent.size();
+        int32_t par = t == 0 ? -1 : remap[base.parent[t]];
+        switch (op.kind) {
+        case UI_DELTA_UPDATE:
+            remap[t] = at;
+            if (!push_record(op.records, strings, par, base.depth[t], base.indexInParent[t], base.childCount[t], out)) {
+                return false;
+            }
+            out->changed.emplace_back(at, at + 1);
+            i = t + 1;
+            break;
+        case UI_DELTA_REPLACE:
+            remap[t] = at;
+            for (uint32_t j = 0; j < op.count; j++) {
+                const uint8_t *rec = op.records + j * record;
+                int32_t f[UI_SNAPSHOT_NODE_FIELDS];
+                memcpy(f, rec, sizeof(f));
+                bool root = j == 0;
+                if (root ? f[0] != -1 : (f[0] < 0 || (uint32_t)f[0] >= j)) return false;
+                int32_t p = root ? par : at + f[0];
+                if (!push_record(rec, strings, p, root ? base.depth[t] : out->depth[p] + 1,
+                                 root ? base.indexInParent[t] : f[2], f[4], out)) {
+                    return false;
+                }
+            }
+            out->changed.emplace_back(at, at + (int32_t)op.count);
+            i = base.subtreeEnd[t];
+            break;
+        case UI_DELTA_REMOVE:
+            i = base.subtreeEnd[t];
+            break;
+        }
+    }
+    copy_nodes(base, i, n, remap, out);
+    if (!finish_tree(out)) return false;
+
+    // A removed node's parent loses a child; later siblings move up. Going
+    // backwards handles several removals under one parent.
+    for (auto op = ops.rbegin(); op != ops.rend(); ++op) {
+        if (op->kind != UI_DELTA_REMOVE) continue;
+        int32_t par = remap[base.parent[op->target]];
+        int32_t removed = base.indexInParent[op->target];
+        out->childCount[par]--;
+        for (int32_t c = par + 1; c < out->subtreeEnd[par]; c = out->subtreeEnd[c]) {
+            if (out->indexInParent[c] > removed) out->indexInParent[c]--;
+        }
+    }
+
+    compact_strings(out);
+    out->baseGeneration = base.generation;
+    out->baseNodes.swap(remap);
+    return true;
+}
+
+// ==================== Current Snapshot ====================
+
+static std::mutex g_snapshot_mutex;
+static std::condition_variable g_snapshot_cond;
+static std::shared_ptr<const UiSnapshot> g_snapshot;
+static uint32_t g_snapshot_generation = 0;
+
+uint32_t ui_snapshot_publish(std::shared_ptr<UiSnapshot> snap) {
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+        generation = snap->generation = ++g_snapshot_generation;
+        g_snapshot = std::move(snap);
+    }
+    g_snapshot_cond.notify_all();
+    return generation;
+}
+
+std::shared_ptr<const UiSnapshot> ui_snapshot_current() {
+    std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+    return g_snapshot;
+}
+
+std::shared_ptr<const UiSnapshot> ui_snapshot_wait(uint32_t generation, int64_t timeout_ms,
+                                                   const volatile int *cancel) {
+    std::unique_lock<std::mutex> lock(g_snapshot_mutex);
+    if (timeout_ms > 0) {
+        g_snapshot_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [generation, cancel] {
+            return g_snapshot_generation != generation || (cancel && *cancel);
+        });
+    }
+    return g_snapshot;
+}
+
+void ui_snapshot_wake() {
+    // Taking the lock orders this after a waiter's predicate check
+    { std::lock_guard<std::mutex> lock(g_snapshot_mutex); }
+    g_snapshot_cond.notify_all();
+}
+
+// ==================== Lookup Indexes ====================
+
+bool ui_snapshot_lookup(const UiSnapshot &snap, std::string_view s, uint32_t *idx) {
+    std::lock_guard<std::mutex> lock(snap.indexMutex);
+    if (!snap.stringIndex) {
+        auto map = std::make_unique<std::unordered_map<std::string_view, uint32_t>>();
+        map->reserve(snap.stringCount());
+        for (uint32_t i = 0; i < snap.stringCount(); i++) map->emplace(snap.str(i), i);
+        snap.stringIndex = std::move(map);
+    }
+    auto it = snap.stringIndex->find(s);
+    if (it == snap.stringIndex->end()) return false;
+    *idx = it->second;
+    return true;
+}
+
+// The short form a value also matches under: "name" for "com.app:id/name",
+// "Button" for "android.widget.Button"; empty if there is none
+static std::string_view field_alias(int field, std::string_view s) {
+    if (field == UI_FIELD_ID) {
+        size_t pos = s.find(":id/");
+        return pos == std::string_view::npos ? std::string_view() : s.substr(pos + 4);
+    }
+    if (field == UI_FIELD_CLASS_NAME) {
+        size_t pos = s.rfind('.');
+        return pos == std::string_view::npos ? std::string_view() : s.substr(pos + 1);
+    }
+    return std::string_view();
+}
+
+static std::unique_ptr<UiFieldIndex> build_field_index(const UiSnapshot &snap, int field) {
+    auto index = std::make_unique<UiFieldIndex>();
+    const std::vector<uint32_t> &col = snap.column(field);
+    uint32_t strings = (uint32_t)snap.stringCount();
+
+    // Counting sort by string index keeps each posting list in document order
+    index->offsets.assign(strings + 1, 0);
+    for (uint32_t s : col) index->offsets[s + 1]++;
+    for (uint32_t s = 0; s < strings; s++) {
+        if (index->offsets[s + 1]) index->sorted.push_back(s);
+        index->offsets[s + 1] += index->offsets[s];
+    }
+    index->nodes.resize(col.size());
+    std::vector<uint32_t> fill(index->offsets.begin(), index->offsets.end() - 1);
+    for (size_t i = 0; i < col.size(); i++) index->nodes[fill[col[i]]++] = (int32_t)i;
+
+    std::sort(index->sorted.begin(), index->sorted.end(),
+              [&snap](uint32_t a, uint32_t b) { return snap.str(a) < snap.str(b); });
+
+    for (uint32_t s : index->sorted) {
+        std::string_view alias = field_alias(field, snap.str(s));
+        if (alias.empty()) continue;
+        index->alias[alias].push_back(s);
+        index->aliasSorted.emplace_back(alias, s);
+    }
+    std::sort(index->aliasSorted.begin(), index->aliasSorted.end());
+    return index;
+}
+
+const UiFieldIndex &ui_snapshot_index(const UiSnapshot &snap, int field) {
+    std::lock_guard<std::mutex> lock(snap.indexMutex);
+    std::unique_ptr<UiFieldIndex> &index = snap.fieldIndex[field];
+    if (!index) index = build_field_index(snap, field);
+    return *index;
+}
+
+// ==================== Spatial Index ====================
+
+typedef UiSpatialIndex::Box UiBox;
+
+static UiBox box_union(const UiBox *b, size_t n) {
+    UiBox u = b[0];
+    for (size_t i = 1; i < n; i++) {
+        u.left = std::min(u.left, b[i].left);
+        u.top = std::min(u.top, b[i].top);
+        u.right = std::max(u.right, b[i].right);
+        u.bottom = std::max(u.bottom, b[i].bottom);
+    }
+    return u;
+}
+
+static std::unique_ptr<UiSpatialIndex> build_spatial_index(const UiSnapshot &snap) {
+    auto index = std::make_unique<UiSpatialIndex>();
+    size_t n = snap.size();
+    const size_t F = UI_SPATIAL_FANOUT;
+
+    std::vector<UiBox> bounds(n);
+    for (size_t i = 0; i < n; i++) {
+        bounds[i] = { std::min(snap.left[i], snap.right[i]), std::min(snap.top[i], snap.bottom[i]),
+                      std::max(snap.left[i], snap.right[i]), std::max(snap.top[i], snap.bottom[i]) };
+    }
+
+    // Sort-Tile-Recursive: vertical slices by center x, each sorted by
+    // center y, then cut into leaves of F nodes
+    auto cx = [&bounds](int32_t i) { return (int64_t)bounds[i].left + bounds[i].right; };
+    auto cy = [&bounds](int32_t i) { return (int64_t)bounds[i].top + bounds[i].bottom; };
+    index->items.resize(n);
+    for (size_t i = 0; i < n; i++) index->items[i] = (int32_t)i;
+    std::sort(index->items.begin(), index->items.end(), [&cx](int32_t a, int32_t b) { return cx(a) < cx(b); });
+    size_t leaves = (n + F - 1) / F;
+    size_t slices = 1;
+    while (slices * slices < leaves) slices++;
+    size_t slice = ((leaves + slices - 1) / slices) * F;
+    for (size_t s = 0; s < n; s += slice) {
+        auto first = index->items.begin() + s, last = index->items.begin() + std::min(n, s + slice);
+        std::sort(first, last, [&cy](int32_t a, int32_t b) { return cy(a) < cy(b); });
+    }
+    index->itemBoxes.resize(n);
+    for (size_t i = 0; i < n; i++) index->itemBoxes[i] = bounds[index->items[i]];
+
+    // Levels bottom-up until a single root box
+    std::vector<UiBox> level = index->itemBoxes, next;
+    do {
+        next.clear();
+        for (size_t i = 0; i < level.size(); i += F) next.push_back(box_union(&level[i], std::min(F, level.size() - i)));
+        index->levelStart.push_back((uint32_t)index->boxes.size());
+        index->boxes.insert(index->boxes.end(), next.begin(), next.end());
+        level.swap(next);
+    } while (level.size() > 1);
+    index->levelStart.push_back((uint32_t)index->boxes.size());
+    return index;
+}
+
+static bool box_touches(const UiBox &b, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+    return b.left <= right && left <= b.right && b.top <= bottom && top <= b.bottom;
+}
+
+void ui_snapshot_query_bounds(const UiSnapshot &snap, int32_t left, int32_t top, int32_t right, int32_t bottom,
+                              std::vector<int32_t> *out) {
+    const UiSpatialIndex *index;
+    {
+        std::lock_guard<std::mutex> lock(snap.indexMutex);
+        if (!snap.spatialIndex) snap.spatialIndex = build_spatial_index(snap);
+        index = snap.spatialIndex.get();
+    }
+    if (index->items.empty()) return;
+
+    const size_t F = UI_SPATIAL_FANOUT;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;   // (level, box)
+    uint32_t top_level = (uint32_t)index->levelStart.size() - 2;
+    stack.emplace_back(top_level, 0);
+    while (!stack.empty()) {
+        auto [level, box] = stack.back();
+        stack.pop_back();
+        if (!box_touches(index->boxes[index->levelStart[level] + box], left, top, right, bottom)) continue;
+
+        if (level == 0) {
+            size_t end = std::min(index->items.size(), (size_t)(box + 1) * F);
+            for (size_t i = (size_t)box * F; i < end; i++) {
+                if (box_touches(index->itemBoxes[i], left, top, right, bottom)) out->push_back(index->items[i]);
+            }
+            continue;
+        }
+        uint32_t children = index->levelStart[level] - index->levelStart[level - 1];
+        uint32_t end = std::min(children, (box + 1) * (uint32_t)F);
+        for (uint32_t c = box * (uint32_t)F; c < end; c++) stack.emplace_back(level - 1, c);
+    }
+}
+
+// ==================== Node Identity ====================
+
+uint64_t ui_hash_string(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+    return h;
+}
+
+static uint64_t identity_mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    return h * 0xbf58476d1ce4e5b9ull;
+}
+
+static std::unique_ptr<std::vector<uint64_t>> build_identities(const UiSnapshot &snap) {
+    size_t n = snap.size();
+    auto identity = std::make_unique<std::vector<uint64_t>>(n);
+    // String hashes on demand: only class names and ids are needed
+    std::vector<uint64_t> strings(snap.stringCount(), 0);
+    auto str_hash = [&](uint32_t s) {
+        if (!strings[s]) strings[s] = ui_hash_string(snap.str(s)) | 1;
+        return strings[s];
+    };
+
+    // Siblings seen so far per (parent, class name, id), open addressing
+    struct Slot {
+        uint64_t key;
+        int32_t count;  // 0 = empty
+    };
+    size_t cap = 16;
+    while (cap < n * 2) cap <<= 1;
+    std::vector<Slot> slots(cap, Slot{ 0, 0 });
+
+    for (size_t i = 0; i < n; i++) {
+        uint64_t kind = identity_mix(str_hash(snap.className[i]), str_hash(snap.id[i]));
+        int32_t p = snap.parent[i];
+        if (p < 0) {
+            (*identity)[i] = identity_mix(0, kind);
+            continue;
+        }
+        uint64_t parent = (*identity)[p];
+        uint64_t key = identity_mix((uint64_t)p, kind);
+        size_t k = (size_t)(key >> 32 ^ key) & (cap - 1);
+        while (slots[k].count && slots[k].key != key) k = (k + 1) & (cap - 1);
+        slots[k].key = key;
+        int32_t ordinal = slots[k].count++;
+        (*identity)[i] = identity_mix(identity_mix(parent, kind), (uint64_t)ordinal);
+    }
+    return identity;
+}
+
+const std::vector<uint64_t> &ui_snapshot_identities(const UiSnapshot &snap) {
+    std::lock_guard<std::mutex> lock(snap.indexMutex);
+    if (!snap.identity) snap.identity = build_identities(snap);
+    return *snap.identity;
+}
+
+// ==================== Normalized Text ====================
+
+static void *fold_realloc(void *, void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+// NFKC of cps, in place; false if libunicode runs out of memory
+static bool nfkc(std::vector<uint32_t> &cps) {
+    uint32_t *out;
+    int n = unicode_normalize(&out, cps.data(), (int)cps.size(), UNICODE_NFKC, nullptr, fold_realloc);
+    if (n < 0) return false;
+    cps.assign(out, out + n);
+    free(out);
+    return true;
+}
+
+std::string ui_fold_string(std::string_view s) {
+    std::string out(s);
+    size_t i = 0;
+    for (; i < s.size() && (unsigned char)s[i] < 0x80; i++) {
+        if (s[i] >= 'A' && s[i] <= 'Z') out[i] = (char)(s[i] - 'A' + 'a');
+    }
+    if (i == s.size()) return out;
+
+    // Code points; malformed UTF-8 becomes U+FFFD
+    std::vector<uint32_t> cps;
+    cps.reserve(s.size());
+    const uint8_t *p = (const uint8_t *)s.data(), *end = p + s.size();
+    while (p < end) {
+        if (*p < 0x80) {
+            cps.push_back(*p++);
+            continue;
+        }
+        const uint8_t *next;
+        int c = unicode_from_utf8(p, (int)(end - p), &next);
+        if (c < 0) {
+            cps.push_back(0xfffd);
+            p++;
+        } else {
+            cps.push_back((uint32_t)c);
+            p = next;
+        }
+    }
+    if (!nfkc(cps)) return out;
+    std::vector<uint32_t> folded;
+    folded.reserve(cps.size());
+    uint32_t res[LRE_CC_RES_LEN_MAX];
+    for (uint32_t c : cps) {
+        int n = lre_case_conv(res, c, 2);
+        folded.insert(folded.end(), res, res + n);
+    }
+    if (!nfkc(folded)) return out;
+
+    out.clear();
+    uint8_t buf[UTF8_CHAR_LEN_MAX];
+    for (uint32_t c : folded) out.append((const char *)buf, unicode_to_utf8(buf, c));
+    return out;
+}
+
+static std::unique_ptr<UiFoldIndex> build_fold_index(const UiSnapshot &snap) {
+    auto index = std::make_unique<UiFoldIndex>();
+    uint32_t strings = (uint32_t)snap.stringCount();
+    std::vector<uint8_t> used(strings, 0);
+    for (uint32_t s : snap.text) used[s] = 1;
+    for (uint32_t s : snap.desc) used[s] = 1;
+
+    // Fold each used string, numbering the distinct results; "" is form 0
+    std::vector<std::string> folded(strings);
+    std::vector<std::string_view> forms = { std::string_view() };
+    std::unordered_map<std::string_view, uint32_t> seen = { { std::string_view(), 0 } };
+    index->form.assign(strings, 0);
+    for (uint32_t s = 1; s < strings; s++) {
+        if (!used[s]) continue;
+        folded[s] = ui_fold_string(snap.str(s));
+        auto it = seen.emplace(folded[s], (uint32_t)forms.size());
+        if (it.second) forms.push_back(folded[s]);
+        index->form[s] = it.first->second;
+    }
+
+    index->offsets.reserve(forms.size() + 1);
+    index->offsets.push_back(0);
+    for (std::string_view f : forms) {
+        index->data.append(f);
+        index->offsets.push_back((uint32_t)index->data.size());
+    }
+    index->lookup.reserve(forms.size());
+    for (uint32_t f = 0; f < forms.size(); f++) index->lookup.emplace(index->str(f), f);
+
+    // Counting sort of the used strings by form
+    index->stringOffsets.assign(forms.size() + 1, 0);
+    if (strings > 0) used[0] = 1;
+    for (uint32_t s = 0; s < strings; s++) {
+        if (used[s]) index->stringOffsets[index->form[s] + 1]++;
+    }
+    for (size_t f = 0; f < forms.size(); f++) index->stringOffsets[f + 1] += index->stringOffsets[f];
+    index->strings.resize(index->stringOffsets.back());
+    std::vector<uint32_t> fill(index->stringOffsets.begin(), index->stringOffsets.end() - 1);
+    for (uint32_t s = 0; s < strings; s++) {
+        if (used[s]) index->strings[fill[index->form[s]]++] = s;
+    }
+    return index;
+}
+
+const UiFoldIndex &ui_snapshot_folded(const UiSnapshot &snap) {
+    std::lock_guard<std::mutex> lock(snap.indexMutex);
+    if (!snap.foldIndex) snap.foldIndex = build_fold_index(snap);
+    return *snap.foldIndex;
+}
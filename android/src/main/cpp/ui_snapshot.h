@@ -0,0 +1,286 @@
+#ifndef UI_SNAPSHOT_H
+#define UI_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ==================== UI Tree Snapshot ====================
+//
+// A flattened copy of the accessibility tree, pushed by the host once per
+// frame and queried natively by the selector engine. Nodes are stored in
+// pre-order as parallel arrays, so a node's subtree is the contiguous index
+// range [i + 1, subtreeEnd[i]) and node 0 is the root.
+
+// Node flags, mirrors the boolean getters on UiObject
+enum {
+    UI_FLAG_CLICKABLE       = 1 << 0,
+    UI_FLAG_LONG_CLICKABLE  = 1 << 1,
+    UI_FLAG_SCROLLABLE      = 1 << 2,
+    UI_FLAG_ENABLED         = 1 << 3,
+    UI_FLAG_CHECKED         = 1 << 4,
+    UI_FLAG_SELECTED        = 1 << 5,
+    UI_FLAG_FOCUSABLE       = 1 << 6,
+    UI_FLAG_FOCUSED         = 1 << 7,
+    UI_FLAG_CHECKABLE       = 1 << 8,
+    UI_FLAG_EDITABLE        = 1 << 9,
+    UI_FLAG_VISIBLE_TO_USER = 1 << 10,
+};
+
+// String columns that can be indexed
+enum UiField {
+    UI_FIELD_TEXT,
+    UI_FIELD_ID,
+    UI_FIELD_CLASS_NAME,
+    UI_FIELD_DESC,
+    UI_FIELD_PACKAGE_NAME,
+    UI_FIELD_COUNT
+};
+
+// Inverted index over one string column. Nodes whose value is string s are
+// nodes[offsets[s] .. offsets[s + 1]), in document order.
+struct UiFieldIndex {
+    std::vector<uint32_t> offsets;
+    std::vector<int32_t> nodes;
+    // String indices present in this column, sorted by content (prefix search)
+    std::vector<uint32_t> sorted;
+    // Short form of each value, resolved by the selector semantics: the
+    // name after ":id/" for ids, the simple class name for class names.
+    std::unordered_map<std::string_view, std::vector<uint32_t>> alias;
+    std::vector<std::pair<std::string_view, uint32_t>> aliasSorted;
+
+    size_t count(uint32_t s) const { return offsets[s + 1] - offsets[s]; }
+};
+
+// Packed R-tree over node bounds (Sort-Tile-Recursive, UI_SPATIAL_FANOUT
+// children per box). Box j of level 0 covers items[j * F .. (j + 1) * F),
+// box j of level k covers boxes j * F .. (j + 1) * F of level k - 1; level
+// k's boxes are boxes[levelStart[k] .. levelStart[k + 1]). Boxes are
+// normalized (left <= right, top <= bottom) and closed.
+#define UI_SPATIAL_FANOUT 16
+
+struct UiSpatialIndex {
+    struct Box {
+        int32_t left, top, right, bottom;
+    };
+    std::vector<int32_t> items;         // node indices, packing order
+    std::vector<Box> itemBoxes;
+    std::vector<Box> boxes;
+    std::vector<uint32_t> levelStart;
+};
+
+// Folded forms of the text and desc columns' strings (ui_snapshot_folded).
+// Folded string f is str(f); table string s folds to form[s], and the table
+// strings folding to f are strings[stringOffsets[f] .. stringOffsets[f + 1]).
+struct UiFoldIndex {
+    std::string data;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> form;         // 0 ("") for strings of other columns
+    std::vector<uint32_t> stringOffsets;
+    std::vector<uint32_t> strings;
+    std::unordered_map<std::string_view, uint32_t> lookup;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    std::string_view str(uint32_t f) const {
+        return std::string_view(data.data() + offsets[f], offsets[f + 1] - offsets[f]);
+    }
+};
+
+struct UiSnapshot {
+    uint32_t generation = 0;
+
+    // String table; index 0 is always the empty string
+    std::string stringData;
+    std::vector<uint32_t> stringOffsets;
+
+    std::vector<int32_t> parent;        // -1 for the root
+    std::vector<int32_t> subtreeEnd;
+    std::vector<int32_t> depth;
+    std::vector<int32_t> indexInParent;
+    std::vector<int32_t> drawingOrder;
+    std::vector<int32_t> childCount;
+    std::vector<uint32_t> text;         // string table indices
+    std::vector<uint32_t> id;
+    std::vector<uint32_t> className;
+    std::vector<uint32_t> desc;
+    std::vector<uint32_t> packageName;
+    std::vector<int32_t> left;
+    std::vector<int32_t> top;
+    std::vector<int32_t> right;
+    std::vector<int32_t> bottom;
+    std::vector<uint32_t> flags;
+
+    // Strings deltas appended since the table was last known to be all live
+    uint32_t deltaStrings = 0;
+
+    // Set by ui_snapshot_apply_delta: the generation this snapshot was
+    // derived from (0 if parsed), where each of its nodes went (-1 if
+    // removed), and the node ranges the delta wrote, in document order.
+    // Lets results of the base be carried over (ui_selector.h, Result Memo).
+    uint32_t baseGeneration = 0;
+    std::vector<int32_t> baseNodes;
+    std::vector<std::pair<int32_t, int32_t>> changed;
+
+    size_t size() const { return parent.size(); }
+    size_t stringCount() const { return stringOffsets.empty() ? 0 : stringOffsets.size() - 1; }
+
+    std::string_view str(uint32_t idx) const {
+        return std::string_view(stringData.data() + stringOffsets[idx],
+                                stringOffsets[idx + 1] - stringOffsets[idx]);
+    }
+
+    const std::vector<uint32_t> &column(int field) const {
+        switch (field) {
+        case UI_FIELD_ID: return id;
+        case UI_FIELD_CLASS_NAME: return className;
+        case UI_FIELD_DESC: return desc;
+        case UI_FIELD_PACKAGE_NAME: return packageName;
+        default: return text;
+        }
+    }
+
+    // Lookup indexes, built on first use (ui_snapshot_lookup/ui_snapshot_index)
+    mutable std::mutex indexMutex;
+    mutable std::unique_ptr<std::unordered_map<std::string_view, uint32_t>> stringIndex;
+    mutable std::unique_ptr<UiFieldIndex> fieldIndex[UI_FIELD_COUNT];
+    mutable std::unique_ptr<UiSpatialIndex> spatialIndex;
+    mutable std::unique_ptr<std::vector<uint64_t>> identity;   // ui_snapshot_identities
+    mutable std::unique_ptr<UiFoldIndex> foldIndex;             // ui_snapshot_folded
+};
+
+// ==================== Wire Format ====================
+//
+// Written by core/UiSnapshot.kt, native byte order:
+//
+//   u32 magic (UI_SNAPSHOT_MAGIC), u32 version
+//   u32 node count, u32 string count
+//   strings: u32 byte length + UTF-8 bytes, string 0 must be ""
+//   nodes in pre-order, 15 x i32 each:
+//     parent, depth, indexInParent, drawingOrder, childCount,
+//     text, id, className, desc, packageName (string indices),
+//     left, top, right, bottom, flags
+
+#define UI_SNAPSHOT_MAGIC 0x4e534955u   // "UISN"
+#define UI_SNAPSHOT_VERSION 1
+#define UI_SNAPSHOT_NODE_FIELDS 15
+
+// Parse a pushed snapshot. Returns false (leaving out unspecified) on a
+// malformed buffer, e.g. a parent that does not precede its child.
+bool ui_snapshot_parse(const uint8_t *p, size_t len, UiSnapshot *out);
+
+// Encode snap back into the wire format (replacing out's contents)
+void ui_snapshot_write(const UiSnapshot &snap, std::vector<uint8_t> *out);
+
+// ==================== Snapshot Files ====================
+//
+// A snapshot file holds the wire format as is, versioned by its header, so
+// a snapshot dumped on a device (dumpSnapshot() in scripts) loads into the
+// host benchmarks and tests unchanged. Loading maps the file read-only and
+// parses straight from the mapping, without an intermediate copy.
+
+bool ui_snapshot_save(const UiSnapshot &snap, const char *path);
+// False if the file cannot be read or is not a valid snapshot
+bool ui_snapshot_load(const char *path, UiSnapshot *out);
+
+// ==================== Deltas ====================
+//
+// After a content change the host refetches only the subtrees its
+// accessibility events name and pushes them as a delta against the current
+// snapshot. Node ids are the base snapshot's node indices:
+//
+//   u32 magic (UI_DELTA_MAGIC), u32 version, u32 base generation
+//   u32 op count, u32 string count, strings as in a snapshot
+//   per op: u32 kind, u32 target node, then
+//     UI_DELTA_UPDATE    one node record; its own fields change, its place
+//                        in the tree (parent, depth, indexInParent,
+//                        childCount) and its children are kept
+//     UI_DELTA_REPLACE   u32 node count + node records: the target's new
+//                        subtree in pre-order, parents given relative to it
+//                        (-1 for the target itself); depth is recomputed
+//                        and the target keeps its indexInParent
+//     UI_DELTA_REMOVE    nothing; drops the target's subtree
+//
+// Targets may come in any order but may not repeat, nest in a replaced or
+// removed subtree, or remove the root. Indexes are not carried over: the
+// result builds them lazily like a parsed snapshot. Strings no longer used
+// by any node are dropped once they may make up half the table.
+
+#define UI_DELTA_MAGIC 0x4c444955u      // "UIDL"
+#define UI_DELTA_VERSION 1
+
+enum UiDeltaKind {
+    UI_DELTA_UPDATE,
+    UI_DELTA_REPLACE,
+    UI_DELTA_REMOVE,
+};
+
+// Apply a delta to base (which must be the snapshot of the delta's base
+// generation) into out. Returns false on a malformed or mismatched delta.
+bool ui_snapshot_apply_delta(const UiSnapshot &base, const uint8_t *p, size_t len, UiSnapshot *out);
+
+// The most recently published snapshot, shared by all queries until the
+// host pushes a new one. publish() assigns and returns the generation.
+uint32_t ui_snapshot_publish(std::shared_ptr<UiSnapshot> snap);
+std::shared_ptr<const UiSnapshot> ui_snapshot_current();
+
+// Block until a snapshot newer than generation is published, timeout_ms
+// passes, *cancel becomes non-zero or ui_snapshot_wake() is called. Returns
+// the current snapshot (possibly still the old one).
+std::shared_ptr<const UiSnapshot> ui_snapshot_wait(uint32_t generation, int64_t timeout_ms,
+                                                   const volatile int *cancel);
+// Wake all waiters so they re-check their cancel flag
+void ui_snapshot_wake();
+
+// ==================== Lookup Indexes ====================
+//
+// Built lazily and at most once per snapshot, so a snapshot that is only
+// scanned never pays for them. Both are safe to call from any thread.
+
+// Find the string table index of s. Returns false if the table lacks it.
+bool ui_snapshot_lookup(const UiSnapshot &snap, std::string_view s, uint32_t *idx);
+const UiFieldIndex &ui_snapshot_index(const UiSnapshot &snap, int field);
+
+// Append the nodes whose bounds touch the closed rectangle [left, right] x
+// [top, bottom] (a point when left == right and top == bottom), unordered.
+// O(log n + matches) on the snapshot's R-tree.
+void ui_snapshot_query_bounds(const UiSnapshot &snap, int32_t left, int32_t top, int32_t right, int32_t bottom,
+                              std::vector<int32_t> *out);
+
+// ==================== Node Identity ====================
+//
+// A 64-bit identity per node that is the same in every snapshot while the
+// view keeps its place: a hash of the parent's identity, the class name,
+// the resource id and the node's index among the siblings with the same
+// class name and id. Counting only those, a sibling of another kind that
+// appears or goes away does not change it; bounds, text and state never
+// do. Computed on first use, like the lookup indexes.
+
+const std::vector<uint64_t> &ui_snapshot_identities(const UiSnapshot &snap);
+
+// 64-bit FNV-1a, the string hash identities are built from
+uint64_t ui_hash_string(std::string_view s);
+
+// ==================== Normalized Text ====================
+//
+// Apps render the same words in different encodings: full-width digits and
+// letters, precomposed or combining accents, ligatures, other case. The
+// folded form of a string is its NFKC normalization (which also maps
+// full-width forms to ASCII), Unicode case folded and normalized again, so
+// all of these compare equal; ASCII is only lowercased. The vendored
+// libunicode does the work.
+//
+// A snapshot folds each distinct string of its text and desc columns once,
+// on first use (nodes share the folded form of their string), and indexes
+// the folded strings like the lookup indexes.
+
+std::string ui_fold_string(std::string_view s);
+const UiFoldIndex &ui_snapshot_folded(const UiSnapshot &snap);
+
+#endif
@@ -19,8 +19,10 @@ import android.util.Log
 import android.view.WindowManager
 import java.io.File
 import java.io.FileOutputStream
+import java.nio.ByteBuffer
 import java.util.concurrent.CountDownLatch
 import java.util.concurrent.TimeUnit
+import java.util.concurrent.atomic.AtomicInteger
 import java.util.concurrent.atomic.AtomicReference
 
 /**
@@ -31,6 +33,8 @@ object ScreenCapture {
     
     private const val TAG = "ScreenCapture"
     const val REQUEST_CODE = 1001
+    /** captureFrame：上次取帧后画面没有新帧（屏幕未变化） */
+    const val NO_NEW_FRAME = -2
     
     private var mediaProjection: MediaProjection? = null
     private var virtualDisplay: VirtualDisplay? = null
@@ -216,6 +220,44 @@ object ScreenCapture {
         return bitmapRef.get()
     }
     
+    /**
+     * 截取屏幕，不经过 Bitmap：把 RGBA 平面缓冲区 (buffer, 宽, 高, 行跨度) 交给 push，
+     * 在 Image 关闭前调用
+     * @return push 的返回值；没有新帧时为 [NO_NEW_FRAME]，未初始化或截图失败时为 -1
+     */
+    fun captureFrame(push: (ByteBuffer, Int, Int, Int) -> Int): Int {
+        if (!isAvailable()) {
+            Log.w(TAG, "ScreenCapture not initialized")
+            return -1
+        }
+        
+        val result = AtomicInteger(-1)
+        val latch = CountDownLatch(1)
+        
+        handler.post {
+            try {
+                val image = imageReader?.acquireLatestImage()
+                if (image != null) {
+                    val plane = image.planes[0]
+                    if (plane.pixelStride == 4) {
+                        result.set(push(plane.buffer, screenWidth, screenHeight, plane.rowStride))
+                    }
+                    image.close()
+                } else if (imageReader != null) {
+                    // 画面不变时不会有新帧入队，上一帧仍是当前画面
+                    result.set(NO_NEW_FRAME)
+                }
+            } catch (e: Exception) {
+                Log.e(TAG, "Capture failed", e)
+            } finally {
+                latch.countDown()
+            }
+        }
+        
+        latch.await(3, TimeUnit.SECONDS)
+        return result.get()
+    }
+    
     /**
      * 截图并保存到文件
      */
@@ -0,0 +1,487 @@
+package im.zoe.flutter_automate.core
+
+import android.graphics.Rect
+import android.os.Build
+import android.os.Handler
+import android.os.HandlerThread
+import android.os.SystemClock
+import android.view.accessibility.AccessibilityEvent
+import android.view.accessibility.AccessibilityNodeInfo
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicInteger
+
+/**
+ * UI 树快照
+ *
+ * 把当前窗口的节点树按先序展开，编码为 native 层 ui_snapshot.h 的格式
+ * （字符串表 + 每节点 15 个 i32，本机字节序），由 native 选择器引擎直接查询。
+ * 一帧内最多采集一次；收到无障碍事件后才重新采集，界面静止时复用上一份。
+ * 有 native waitFor 在等待时（[watch]），收到事件后在后台线程主动采集并推送，
+ * 等待方随即被唤醒，无需轮询。
+ *
+ * 只改动了局部的事件（文本变化、某个子树变化等）不重新遍历整棵树：
+ * 只采集事件源节点或其子树，编码为增量（ui_snapshot.h 的 delta 格式）推送，
+ * native 在上一份快照的基础上生成新快照。无法局部描述的变化仍完整采集。
+ */
+object UiSnapshot {
+
+    private const val MAGIC = 0x4e534955        // "UISN"
+    private const val VERSION = 1
+    private const val NODE_FIELDS = 15
+
+    private const val DELTA_MAGIC = 0x4c444955  // "UIDL"
+    private const val DELTA_VERSION = 1
+    private const val DELTA_UPDATE = 0
+    private const val DELTA_REPLACE = 1
+    private const val DELTA_REMOVE = 2
+
+    /** 两次采集之间的事件源超过该数量时，改为完整采集 */
+    private const val MAX_DELTA_SOURCES = 32
+
+    /** 两次采集的最小间隔（约一帧） */
+    private const val MIN_INTERVAL_MS = 16L
+
+    /** 没有收到事件时，超过该时长也重新采集（部分界面变化不发事件） */
+    private const val MAX_AGE_MS = 1000L
+
+    /** 保留最近几份快照的节点，供仍持有旧 UiObject 的脚本执行操作 */
+    private const val RETAINED_GENERATIONS = 8
+
+    // 节点操作，与 native 层 quickjs_jni.cpp 的 UI_ACTION_* 一致
+    const val ACTION_CLICK = 0
+    const val ACTION_LONG_CLICK = 1
+    const val ACTION_SET_TEXT = 2
+    const val ACTION_SCROLL_FORWARD = 3
+    const val ACTION_SCROLL_BACKWARD = 4
+
+    private const val FLAG_CLICKABLE = 1 shl 0
+    private const val FLAG_LONG_CLICKABLE = 1 shl 1
+    private const val FLAG_SCROLLABLE = 1 shl 2
+    private const val FLAG_ENABLED = 1 shl 3
+    private const val FLAG_CHECKED = 1 shl 4
+    private const val FLAG_SELECTED = 1 shl 5
+    private const val FLAG_FOCUSABLE = 1 shl 6
+    private const val FLAG_FOCUSED = 1 shl 7
+    private const val FLAG_CHECKABLE = 1 shl 8
+    private const val FLAG_EDITABLE = 1 shl 9
+    private const val FLAG_VISIBLE_TO_USER = 1 shl 10
+
+    @Volatile
+    private var dirty = true
+    @Volatile
+    private var capturedAt = 0L
+    private var generation = -1
+    private var listeningTo: AutomateAccessibilityService? = null
+    private var buffer: ByteBuffer? = null
+
+    /** 上次采集后的事件源 -> 增量类型；fullCapture 为 true 时需要完整采集 */
+    private val pendingSources = HashMap<AccessibilityNodeInfo, Int>()
+    private var fullCapture = true
+
+    private val listener = object : AccessibilityEventListener {
+        override fun onEvent(event: AccessibilityEvent) {
+            collectSource(event)
+            dirty = true
+            if (watchers.get() > 0) schedulePush()
+        }
+    }
+
+    /** 正在等待界面变化的 waitFor 个数 */
+    private val watchers = AtomicInteger()
+    @Volatile
+    private var pusher: Pusher? = null
+    private val pushScheduled = AtomicBoolean()
+    private val worker: Handler by lazy {
+        Handler(HandlerThread("UiSnapshot").apply { start() }.looper)
+    }
+    private val pushTask = Runnable {
+        pushScheduled.set(false)
+        if (watchers.get() > 0) pusher?.let { refresh(it) }
+    }
+
+    private var nodes: List<AccessibilityNodeInfo> = emptyList()
+    /** 当前快照每个节点的深度，用于计算子树范围 */
+    private var depths = IntArray(0)
+    /** 节点 -> 下标，生成增量时按需建立 */
+    private var nodeIndex: HashMap<AccessibilityNodeInfo, Int>? = null
+
+    /**
+     * native 推送入口
+     * @param snapshot 推送完整快照
+     * @param delta 推送相对当前快照的增量
+     * 均返回新快照代号（失败为 -1）
+     */
+    class Pusher(
+        val snapshot: (ByteBuffer, Int) -> Int,
+        val delta: (ByteBuffer, Int) -> Int,
+    )
+
+    /** 快照代号 -> 节点列表，下标与 native 层节点下标一致 */
+    private val retained = object : LinkedHashMap<Int, List<AccessibilityNodeInfo>>() {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<Int, List<AccessibilityNodeInfo>>?) =
+            size > RETAINED_GENERATIONS
+    }
+
+    /** 按句柄（快照代号 + 节点下标）取回节点；快照已被淘汰时返回 null */
+    @Synchronized
+    fun node(generation: Int, index: Int): AccessibilityNodeInfo? {
+        return retained[generation]?.getOrNull(index)
+    }
+
+    /**
+     * 确保 native 层持有足够新的快照
+     * @param push 把编码后的快照或增量交给 native
+     * @return 当前快照代号；无障碍服务未开启时为 -1
+     */
+    @Synchronized
+    fun refresh(push: Pusher): Int {
+        pusher = push
+        val service = AutomateAccessibilityService.instance ?: return -1
+        if (listeningTo !== service) {
+            listeningTo?.removeEventListener(listener)
+            service.addEventListener(listener)
+            listeningTo = service
+            dirty = true
+        }
+
+        val now = SystemClock.uptimeMillis()
+        val age = now - capturedAt
+        if (generation >= 0 && (age < MIN_INTERVAL_MS || (!dirty && age < MAX_AGE_MS))) {
+            return generation
+        }
+
+        dirty = false
+        val root = service.getRootNode() ?: return -1
+        val sources = synchronized(pendingSources) {
+            val taken = if (fullCapture) emptyMap<AccessibilityNodeInfo, Int>() else HashMap(pendingSources)
+            pendingSources.clear()
+            fullCapture = false
+            taken
+        }
+
+        var gen = -1
+        if (sources.isNotEmpty() && generation >= 0 && root == nodes.firstOrNull()) {
+            gen = pushDelta(sources, push)
+        }
+        if (gen < 0) {
+            val length = encode(root)
+            gen = push.snapshot(buffer!!, length)
+        }
+        generation = gen
+        if (generation >= 0) retained[generation] = nodes
+        capturedAt = now
+        return generation
+    }
+
+    /** 标记快照已过期（例如执行了点击等会改变界面的操作），下次完整采集 */
+    fun invalidate() {
+        synchronized(pendingSources) {
+            fullCapture = true
+            pendingSources.clear()
+        }
+        dirty = true
+    }
+
+    /**
+     * 开始/结束等待界面变化。等待期间每个无障碍事件都会触发一次后台采集
+     * （同样受 [MIN_INTERVAL_MS] 限制），新快照推送后 native 等待方即被唤醒
+     */
+    fun watch(on: Boolean) {
+        if (on) watchers.incrementAndGet() else watchers.updateAndGet { maxOf(0, it - 1) }
+    }
+
+    /** 在后台线程采集并推送；事件线程不等待采集，连续事件合并为一次 */
+    private fun schedulePush() {
+        if (pusher == null || !pushScheduled.compareAndSet(false, true)) return
+        val delay = capturedAt + MIN_INTERVAL_MS - SystemClock.uptimeMillis()
+        worker.postDelayed(pushTask, maxOf(0L, delay))
+    }
+
+    // ==================== 编码 ====================
+
+    private fun encode(root: AccessibilityNodeInfo): Int {
+        val enc = Encoder()
+        enc.addTree(root)
+
+        val size = 16 + enc.stringBytes + enc.count * NODE_FIELDS * 4
+        val buf = ensureBuffer(size)
+        buf.putInt(MAGIC)
+        buf.putInt(VERSION)
+        buf.putInt(enc.count)
+        enc.putStrings(buf)
+        buf.asIntBuffer().put(enc.records, 0, enc.count * NODE_FIELDS)
+
+        nodes = enc.collected
+        depths = IntArray(enc.count) { enc.records[it * NODE_FIELDS + 1] }
+        nodeIndex = null
+        return size
+    }
+
+    private fun ensureBuffer(size: Int): ByteBuffer {
+        var buf = buffer
+        if (buf == null || buf.capacity() < size) {
+            buf = ByteBuffer.allocateDirect(Integer.highestOneBit(size) shl 1).order(ByteOrder.nativeOrder())
+            buffer = buf
+        }
+        buf!!.clear()
+        return buf
+    }
+
+    /** 字符串表与节点记录，完整快照和增量共用 */
+    private class Encoder {
+        private val strings = ArrayList<ByteArray>()
+        private val stringIndex = HashMap<String, Int>()
+        var stringBytes = 0
+            private set
+        var records = IntArray(256 * NODE_FIELDS)
+            private set
+        val collected = ArrayList<AccessibilityNodeInfo>()
+        val count get() = collected.size
+        private val rect = Rect()
+
+        init {
+            intern("")
+        }
+
+        private fun intern(s: CharSequence?): Int {
+            val str = s?.toString() ?: return 0
+            return stringIndex.getOrPut(str) {
+                val bytes = str.toByteArray(Charsets.UTF_8)
+                strings.add(bytes)
+                stringBytes += 4 + bytes.size
+                strings.size - 1
+            }
+        }
+
+        /** 追加一条节点记录，返回其下标 */
+        fun add(node: AccessibilityNodeInfo, parent: Int, depth: Int, indexInParent: Int): Int {
+            val index = collected.size
+            collected.add(node)
+            if ((index + 1) * NODE_FIELDS > records.size) records = records.copyOf(records.size * 2)
+
+            node.getBoundsInScreen(rect)
+            val base = index * NODE_FIELDS
+            records[base] = parent
+            records[base + 1] = depth
+            records[base + 2] = indexInParent
+            records[base + 3] = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.N) node.drawingOrder else 0
+            records[base + 4] = node.childCount
+            records[base + 5] = intern(node.text)
+            records[base + 6] = intern(node.viewIdResourceName)
+            records[base + 7] = intern(node.className)
+            records[base + 8] = intern(node.contentDescription)
+            records[base + 9] = intern(node.packageName)
+            records[base + 10] = rect.left
+            records[base + 11] = rect.top
+            records[base + 12] = rect.right
+            records[base + 13] = rect.bottom
+            records[base + 14] = flagsOf(node)
+            return index
+        }
+
+        /**
+         * 先序追加以 root 为根的子树。父节点下标和深度相对子树根计算，
+         * 根的父节点为 -1、深度为 0
+         */
+        fun addTree(root: AccessibilityNodeInfo) {
+            val start = collected.size
+            // 栈中保存 (节点, 父节点下标, 深度, 在父节点中的位置)
+            val stack = ArrayDeque<NodeEntry>()
+            stack.addLast(NodeEntry(root, -1, 0, -1))
+            while (stack.isNotEmpty()) {
+                val e = stack.removeLast()
+                val node = e.node
+                val index = add(node, e.parent, e.depth, e.indexInParent) - start
+
+                // 逆序入栈，保证子节点按顺序出栈
+                for (i in node.childCount - 1 downTo 0) {
+                    val child = node.getChild(i) ?: continue
+                    stack.addLast(NodeEntry(child, index, e.depth + 1, i))
+                }
+            }
+        }
+
+        fun putStrings(buf: ByteBuffer) {
+            buf.putInt(strings.size)
+            for (s in strings) {
+                buf.putInt(s.size)
+                buf.put(s)
+            }
+        }
+
+        /** 写出 [from, to) 的节点记录 */
+        fun putRecords(buf: ByteBuffer, from: Int, to: Int) {
+            buf.asIntBuffer().put(records, from * NODE_FIELDS, (to - from) * NODE_FIELDS)
+            buf.position(buf.position() + (to - from) * NODE_FIELDS * 4)
+        }
+    }
+
+    // ==================== 增量 ====================
+
+    /**
+     * 事件 -> 增量类型；-1 表示无法局部描述。
+     * 只有文本/描述变化的节点原地更新；子树变化和滚动替换事件源的整棵子树
+     */
+    private fun deltaKind(event: AccessibilityEvent): Int {
+        return when (event.eventType) {
+            AccessibilityEvent.TYPE_WINDOW_CONTENT_CHANGED -> {
+                val attributes = AccessibilityEvent.CONTENT_CHANGE_TYPE_TEXT or
+                    AccessibilityEvent.CONTENT_CHANGE_TYPE_CONTENT_DESCRIPTION
+                val types = event.contentChangeTypes
+                if (types != 0 && types and attributes.inv() == 0) DELTA_UPDATE else DELTA_REPLACE
+            }
+            AccessibilityEvent.TYPE_VIEW_TEXT_CHANGED,
+            AccessibilityEvent.TYPE_VIEW_TEXT_SELECTION_CHANGED -> DELTA_UPDATE
+            AccessibilityEvent.TYPE_VIEW_SCROLLED -> DELTA_REPLACE
+            else -> -1
+        }
+    }
+
+    private fun collectSource(event: AccessibilityEvent) {
+        val kind = deltaKind(event)
+        val source = if (kind >= 0) event.source else null
+        synchronized(pendingSources) {
+            if (fullCapture) return
+            if (source == null || pendingSources.size >= MAX_DELTA_SOURCES) {
+                fullCapture = true
+                pendingSources.clear()
+            } else {
+                pendingSources[source] = maxOf(kind, pendingSources[source] ?: kind)
+            }
+        }
+    }
+
+    /** 各节点子树的结束下标（不含），由先序深度推出 */
+    private fun subtreeEnds(): IntArray {
+        val n = depths.size
+        val ends = IntArray(n)
+        val stack = IntArray(n)
+        var top = 0
+        for (i in 0 until n) {
+            while (top > 0 && depths[stack[top - 1]] >= depths[i]) ends[stack[--top]] = i
+            stack[top++] = i
+        }
+        while (top > 0) ends[stack[--top]] = n
+        return ends
+    }
+
+    private class DeltaOp(val target: Int, val kind: Int, val node: AccessibilityNodeInfo) {
+        var start = 0
+        var end = 0
+    }
+
+    /**
+     * 把事件源编码为增量并推送。事件源不在当前快照中、替换的节点超过半棵树
+     * 或 native 拒绝时返回 -1，由调用方完整采集
+     */
+    private fun pushDelta(sources: Map<AccessibilityNodeInfo, Int>, push: Pusher): Int {
+        val index = nodeIndex ?: HashMap<AccessibilityNodeInfo, Int>(nodes.size * 2).also { map ->
+            nodes.forEachIndexed { i, node -> map[node] = i }
+            nodeIndex = map
+        }
+        val ops = ArrayList<DeltaOp>(sources.size)
+        for ((node, kind) in sources) {
+            val target = index[node] ?: return -1
+            if (!node.refresh()) {
+                if (target == 0) return -1
+                ops.add(DeltaOp(target, DELTA_REMOVE, node))
+            } else {
+                ops.add(DeltaOp(target, kind, node))
+            }
+        }
+        ops.sortBy { it.target }
+
+        // 被替换或删除的子树内的事件源已包含在内
+        val ends = subtreeEnds()
+        val kept = ArrayList<DeltaOp>(ops.size)
+        var covered = 0
+        for (op in ops) {
+            if (op.target < covered) continue
+            kept.add(op)
+            if (op.kind != DELTA_UPDATE) covered = ends[op.target]
+        }
+
+        val enc = Encoder()
+        var size = 20
+        var nodeCount = nodes.size
+        for (op in kept) {
+            op.start = enc.count
+            when (op.kind) {
+                DELTA_UPDATE -> enc.add(op.node, -1, 0, -1)
+                DELTA_REPLACE -> enc.addTree(op.node)
+            }
+            op.end = enc.count
+            if (op.kind != DELTA_UPDATE) nodeCount -= ends[op.target] - op.target
+            nodeCount += if (op.kind == DELTA_REPLACE) op.end - op.start else 0
+            size += 8 + (if (op.kind == DELTA_REPLACE) 4 else 0) + (op.end - op.start) * NODE_FIELDS * 4
+        }
+        if (enc.count > nodes.size / 2) return -1
+        size += enc.stringBytes
+
+        val buf = ensureBuffer(size)
+        buf.putInt(DELTA_MAGIC)
+        buf.putInt(DELTA_VERSION)
+        buf.putInt(generation)
+        buf.putInt(kept.size)
+        enc.putStrings(buf)
+        for (op in kept) {
+            buf.putInt(op.kind)
+            buf.putInt(op.target)
+            if (op.kind == DELTA_REPLACE) buf.putInt(op.end - op.start)
+            enc.putRecords(buf, op.start, op.end)
+        }
+        val gen = push.delta(buf, size)
+        if (gen < 0) return -1
+
+        // 与 native 相同的拼接：未变化的区间原样保留
+        val newNodes = ArrayList<AccessibilityNodeInfo>(nodeCount)
+        val newDepths = IntArray(nodeCount)
+        var i = 0
+        fun copyTo(end: Int) {
+            while (i < end) {
+                newDepths[newNodes.size] = depths[i]
+                newNodes.add(nodes[i++])
+            }
+        }
+        for (op in kept) {
+            copyTo(op.target)
+            val depth = depths[op.target]
+            for (r in op.start until op.end) {
+                newDepths[newNodes.size] = depth + enc.records[r * NODE_FIELDS + 1]
+                newNodes.add(enc.collected[r])
+            }
+            i = if (op.kind == DELTA_UPDATE) op.target + 1 else ends[op.target]
+        }
+        copyTo(nodes.size)
+
+        nodes = newNodes
+        depths = newDepths
+        nodeIndex = null
+        return gen
+    }
+
+    private fun flagsOf(node: AccessibilityNodeInfo): Int {
+        var f = 0
+        if (node.isClickable) f = f or FLAG_CLICKABLE
+        if (node.isLongClickable) f = f or FLAG_LONG_CLICKABLE
+        if (node.isScrollable) f = f or FLAG_SCROLLABLE
+        if (node.isEnabled) f = f or FLAG_ENABLED
+        if (node.isChecked) f = f or FLAG_CHECKED
+        if (node.isSelected) f = f or FLAG_SELECTED
+        if (node.isFocusable) f = f or FLAG_FOCUSABLE
+        if (node.isFocused) f = f or FLAG_FOCUSED
+        if (node.isCheckable) f = f or FLAG_CHECKABLE
+        if (node.isEditable) f = f or FLAG_EDITABLE
+        if (node.isVisibleToUser) f = f or FLAG_VISIBLE_TO_USER
+        return f
+    }
+
+    private class NodeEntry(
+        val node: AccessibilityNodeInfo,
+        val parent: Int,
+        val depth: Int,
+        val indexInParent: Int,
+    )
+}
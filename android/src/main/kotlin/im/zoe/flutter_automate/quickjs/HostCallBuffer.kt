@@ -0,0 +1,208 @@
+package im.zoe.flutter_automate.quickjs
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * 宿主调用共享缓冲区
+ *
+ * 与 native 层 host_call.h 的布局一致：每个值为 1 字节类型标签 + 负载（本机字节序）。
+ * 参数从偏移 0 依次写入；宿主读取完参数后，把唯一的返回值写回偏移 0。
+ * 缓冲区由 native 分配，通过 attachCallBuffer() 以 direct ByteBuffer 形式传入，
+ * 每次调用不再创建 String 数组。
+ */
+class HostCallBuffer {
+
+    companion object {
+        const val TAG_UNDEFINED = 0
+        const val TAG_NULL = 1
+        const val TAG_BOOL = 2
+        const val TAG_INT = 3
+        const val TAG_DOUBLE = 4
+        const val TAG_STRING = 5
+        const val TAG_BYTES = 6
+        const val TAG_JSON = 7
+    }
+
+    private var buf: ByteBuffer = ByteBuffer.allocateDirect(0)
+    private var scratch = ByteArray(256)
+
+    /** 返回值放不进缓冲区时，改由 invokeTyped 以 String 返回 */
+    private var overflow: String? = null
+
+    fun attach(buffer: ByteBuffer) {
+        buf = buffer.order(ByteOrder.nativeOrder())
+    }
+
+    /** 读取 argc 个参数到 args（复用对象，避免每次分配） */
+    fun readArgs(argc: Int, args: HostArgs) {
+        args.reset(argc)
+        var pos = 0
+        for (i in 0 until argc) {
+            val tag = buf.get(pos).toInt()
+            pos += 1
+            args.tags[i] = tag
+            when (tag) {
+                TAG_BOOL -> { args.nums[i] = buf.get(pos).toDouble(); pos += 1 }
+                TAG_INT -> { args.nums[i] = buf.getInt(pos).toDouble(); pos += 4 }
+                TAG_DOUBLE -> { args.nums[i] = buf.getDouble(pos); pos += 8 }
+                TAG_STRING, TAG_JSON, TAG_BYTES -> {
+                    val len = buf.getInt(pos)
+                    pos += 4
+                    if (tag == TAG_BYTES) {
+                        val bytes = ByteArray(len)
+                        for (k in 0 until len) bytes[k] = buf.get(pos + k)
+                        args.refs[i] = bytes
+                    } else {
+                        if (scratch.size < len) scratch = ByteArray(maxOf(len, scratch.size * 2))
+                        buf.position(pos)
+                        buf.get(scratch, 0, len)
+                        args.refs[i] = String(scratch, 0, len, Charsets.UTF_8)
+                    }
+                    pos += len
+                }
+            }
+        }
+    }
+
+    fun writeUndefined() {
+        overflow = null
+        buf.put(0, TAG_UNDEFINED.toByte())
+    }
+
+    fun writeNull() {
+        overflow = null
+        buf.put(0, TAG_NULL.toByte())
+    }
+
+    fun writeBool(v: Boolean) {
+        overflow = null
+        buf.put(0, TAG_BOOL.toByte())
+        buf.put(1, if (v) 1 else 0)
+    }
+
+    fun writeInt(v: Int) {
+        overflow = null
+        buf.put(0, TAG_INT.toByte())
+        buf.putInt(1, v)
+    }
+
+    fun writeDouble(v: Double) {
+        overflow = null
+        buf.put(0, TAG_DOUBLE.toByte())
+        buf.putDouble(1, v)
+    }
+
+    fun writeString(v: String?) = writeText(TAG_STRING, v)
+
+    /** JSON 文本，native 层直接解析为 JS 值 */
+    fun writeJson(v: String?) = writeText(TAG_JSON, v)
+
+    fun writeBytes(v: ByteArray) {
+        if (5 + v.size > buf.capacity()) {
+            // 字节数组没有 String 回退通道，只能返回 null
+            writeNull()
+            return
+        }
+        overflow = null
+        buf.put(0, TAG_BYTES.toByte())
+        buf.putInt(1, v.size)
+        buf.position(5)
+        buf.put(v)
+    }
+
+    private fun writeText(tag: Int, v: String?) {
+        if (v == null) {
+            writeNull()
+            return
+        }
+        val bytes = v.toByteArray(Charsets.UTF_8)
+        if (5 + bytes.size > buf.capacity()) {
+            overflow = v
+            return
+        }
+        overflow = null
+        buf.put(0, tag.toByte())
+        buf.putInt(1, bytes.size)
+        buf.position(5)
+        buf.put(bytes)
+    }
+
+    /** 取出溢出的返回值（没有则为 null） */
+    fun takeOverflow(): String? {
+        val v = overflow
+        overflow = null
+        return v
+    }
+}
+
+/**
+ * 一次宿主调用的参数视图，按需做宽松类型转换
+ */
+class HostArgs {
+    var size = 0
+        private set
+    internal var tags = IntArray(16)
+    internal var nums = DoubleArray(16)
+    internal var refs = arrayOfNulls<Any>(16)
+
+    internal fun reset(argc: Int) {
+        if (tags.size < argc) {
+            tags = IntArray(argc)
+            nums = DoubleArray(argc)
+            refs = arrayOfNulls(argc)
+        }
+        java.util.Arrays.fill(refs, 0, refs.size, null)
+        size = argc
+    }
+
+    private fun isNumber(i: Int) = i < size && (tags[i] == HostCallBuffer.TAG_INT ||
+        tags[i] == HostCallBuffer.TAG_DOUBLE || tags[i] == HostCallBuffer.TAG_BOOL)
+
+    fun double(i: Int, def: Double = 0.0): Double = when {
+        isNumber(i) -> nums[i]
+        i < size -> (refs[i] as? String)?.toDoubleOrNull() ?: def
+        else -> def
+    }
+
+    fun float(i: Int, def: Float = 0f): Float = if (i < size) double(i, def.toDouble()).toFloat() else def
+
+    fun int(i: Int, def: Int = 0): Int = if (i < size) double(i, def.toDouble()).toInt() else def
+
+    fun long(i: Int, def: Long = 0L): Long = if (i < size) double(i, def.toDouble()).toLong() else def
+
+    fun bool(i: Int, def: Boolean = false): Boolean = when {
+        i >= size -> def
+        isNumber(i) -> nums[i] != 0.0
+        else -> (refs[i] as? String)?.toBoolean() ?: def
+    }
+
+    fun str(i: Int, def: String? = null): String? = if (i < size) format(i) ?: def else def
+
+    fun bytes(i: Int): ByteArray? = if (i < size) refs[i] as? ByteArray else null
+
+    /** 旧版字符串协议的参数形式 */
+    fun toStringArray(from: Int = 0): Array<String> =
+        Array(maxOf(size - from, 0)) { format(from + it) ?: "" }
+
+    private fun format(i: Int): String? = when (tags[i]) {
+        HostCallBuffer.TAG_UNDEFINED -> "undefined"
+        HostCallBuffer.TAG_NULL -> "null"
+        HostCallBuffer.TAG_BOOL -> (nums[i] != 0.0).toString()
+        HostCallBuffer.TAG_INT -> nums[i].toInt().toString()
+        HostCallBuffer.TAG_DOUBLE -> {
+            // 与 JS 的数字转字符串保持一致：整数值不带 ".0"
+            val d = nums[i]
+            if (d == Math.rint(d) && Math.abs(d) < 1e15) d.toLong().toString() else d.toString()
+        }
+        HostCallBuffer.TAG_BYTES -> null
+        else -> refs[i] as? String
+    }
+}
+
+/**
+ * 类型化宿主函数：直接读取参数、把结果写回共享缓冲区
+ */
+fun interface TypedHandler {
+    fun call(args: HostArgs, out: HostCallBuffer)
+}
@@ -23,6 +23,22 @@ class QuickJSEngine(private val context: Context) {
     companion object {
         private const val TAG = "QuickJSEngine"
         
+        /**
+         * 会改变界面的宿主调用：调用后作废快照，下次强制全量采集。
+         * 其余调用（toast、剪贴板、存储、文件、网络、设备信息等）不影响界面，
+         * 保留增量推送和记忆化选择器的复用
+         */
+        private val UI_CHANGING_CALLS = setOf(
+            "click", "longClick", "doubleClick", "press",
+            "swipe", "swipeUp", "swipeDown", "swipeLeft", "swipeRight", "scrollUp", "scrollDown",
+            "gesture", "gestures",
+            "back", "home", "recents", "notifications", "quickSettings", "powerDialog",
+            "setText", "uiobject.action",
+            "app.launch", "app.launchApp", "openUrl",
+            "dialogs.alert", "dialogs.confirm", "dialogs.input",
+            "device.wakeUp", "shell",
+        )
+        
         init {
             try {
                 System.loadLibrary("quickjs_jni")
@@ -42,6 +58,146 @@ class QuickJSEngine(private val context: Context) {
      * 宿主函数回调 - 处理所有从 JS 调用的原生功能
      */
     inner class HostCallback {
+        private val callBuffer = HostCallBuffer()
+        private val callArgs = HostArgs()
+        private var boundNames: Array<String> = emptyArray()
+        private var boundHandlers: Array<TypedHandler?> = emptyArray()
+        private val snapshotPusher = UiSnapshot.Pusher(
+            snapshot = { buffer, length -> nativePushSnapshot(buffer, length) },
+            delta = { buffer, length -> nativePushDelta(buffer, length) },
+        )
+
+        // ==================== 类型化调用 ====================
+
+        /** 高频函数直接读写共享缓冲区；其余函数走 invoke() 字符串协议 */
+        private val typedHandlers: Map<String, TypedHandler> = mapOf(
+            "toast" to TypedHandler { args, out ->
+                val text = args.str(0)
+                if (text != null) {
+                    android.os.Handler(context.mainLooper).post {
+                        Toast.makeText(context, text, Toast.LENGTH_SHORT).show()
+                    }
+                }
+                out.writeBool(true)
+            },
+            "setClip" to TypedHandler { args, out ->
+                val text = args.str(0)
+                if (text != null) {
+                    val clipboard = context.getSystemService(Context.CLIPBOARD_SERVICE) as ClipboardManager
+                    clipboard.setPrimaryClip(ClipData.newPlainText("text", text))
+                }
+                out.writeBool(text != null)
+            },
+            "getClip" to TypedHandler { _, out ->
+                val clipboard = context.getSystemService(Context.CLIPBOARD_SERVICE) as ClipboardManager
+                out.writeString(clipboard.primaryClip?.getItemAt(0)?.text?.toString() ?: "")
+            },
+            "click" to TypedHandler { args, out ->
+                out.writeBool(args.size >= 2 && GestureEngine.click(args.float(0), args.float(1), args.long(2, 100L)))
+            },
+            "longClick" to TypedHandler { args, out ->
+                out.writeBool(args.size >= 2 && GestureEngine.longClick(args.float(0), args.float(1), args.long(2, 500L)))
+            },
+            "press" to TypedHandler { args, out ->
+                out.writeBool(args.size >= 3 && GestureEngine.click(args.float(0), args.float(1), args.long(2, 500L)))
+            },
+            "swipe" to TypedHandler { args, out ->
+                out.writeBool(args.size >= 4 && GestureEngine.swipe(
+                    args.float(0), args.float(1), args.float(2), args.float(3), args.long(4, 300L)))
+            },
+            "swipeUp" to TypedHandler { _, out -> out.writeBool(GestureEngine.swipeUp()) },
+            "swipeDown" to TypedHandler { _, out -> out.writeBool(GestureEngine.swipeDown()) },
+            "swipeLeft" to TypedHandler { _, out -> out.writeBool(GestureEngine.swipeLeft()) },
+            "swipeRight" to TypedHandler { _, out -> out.writeBool(GestureEngine.swipeRight()) },
+            "back" to TypedHandler { _, out -> out.writeBool(AutomateAccessibilityService.instance?.pressBack() ?: false) },
+            "home" to TypedHandler { _, out -> out.writeBool(AutomateAccessibilityService.instance?.pressHome() ?: false) },
+            "recents" to TypedHandler { _, out -> out.writeBool(AutomateAccessibilityService.instance?.pressRecents() ?: false) },
+            "notifications" to TypedHandler { _, out -> out.writeBool(AutomateAccessibilityService.instance?.openNotifications() ?: false) },
+            "quickSettings" to TypedHandler { _, out -> out.writeBool(AutomateAccessibilityService.instance?.openQuickSettings() ?: false) },
+            "device.getBattery" to TypedHandler { _, out -> out.writeInt(DeviceUtils.getBatteryLevel(context)) },
+            "device.width" to TypedHandler { _, out -> out.writeInt(DeviceUtils.getScreenWidth(context)) },
+            "device.height" to TypedHandler { _, out -> out.writeInt(DeviceUtils.getScreenHeight(context)) },
+            "currentPackage" to TypedHandler { _, out ->
+                out.writeString(AutomateAccessibilityService.instance?.rootInActiveWindow?.packageName?.toString() ?: "")
+            },
+            "app.currentPackage" to TypedHandler { _, out ->
+                out.writeString(AutomateAccessibilityService.instance?.rootInActiveWindow?.packageName?.toString() ?: "")
+            },
+            // 查询由 native 在快照上完成，这里只负责推送快照（或增量）
+            "ui.snapshot" to TypedHandler { _, out ->
+                out.writeInt(UiSnapshot.refresh(snapshotPusher))
+            },
+            // native waitFor 开始/结束等待：等待期间界面变化时主动推送快照
+            "ui.watch" to TypedHandler { args, out ->
+                UiSnapshot.watch(args.bool(0))
+                out.writeBool(true)
+            },
+            // 截屏：像素直接从 ImageReader 缓冲区推给 native，返回帧代号
+            // （没有新帧时为 ScreenCapture.NO_NEW_FRAME，无权限时为 -1）
+            "images.capture" to TypedHandler { _, out ->
+                out.writeInt(ScreenCapture.captureFrame { buffer, width, height, rowStride ->
+                    nativePushFrame(buffer, width, height, rowStride)
+                })
+            },
+            // 对快照中的节点执行操作：参数为 (快照代号, 节点下标, 操作, 文本)
+            "uiobject.action" to TypedHandler { args, out ->
+                val node = UiSnapshot.node(args.int(0), args.int(1))
+                val obj = if (node != null) UiObject(node) else null
+                out.writeBool(when (args.int(2)) {
+                    UiSnapshot.ACTION_CLICK -> obj?.click()
+                    UiSnapshot.ACTION_LONG_CLICK -> obj?.longClick()
+                    UiSnapshot.ACTION_SET_TEXT -> obj?.setText(args.str(3, "")!!)
+                    UiSnapshot.ACTION_SCROLL_FORWARD -> obj?.scrollForward()
+                    UiSnapshot.ACTION_SCROLL_BACKWARD -> obj?.scrollBackward()
+                    else -> null
+                } ?: false)
+            },
+        )
+
+        /** native 初始化时绑定函数 ID（下标即 ID） */
+        fun bindFunctions(names: Array<String>) {
+            boundNames = names
+            boundHandlers = Array(names.size) { typedHandlers[names[it]] }
+        }
+
+        /** native 分配（或扩容）共享缓冲区后调用 */
+        fun attachCallBuffer(buffer: java.nio.ByteBuffer) {
+            callBuffer.attach(buffer)
+        }
+
+        /**
+         * 类型化调用入口。参数已写入共享缓冲区，结果写回缓冲区；
+         * 返回非 null 时表示结果以字符串形式返回（旧协议回退或结果过大）
+         */
+        fun invokeTyped(funcId: Int, argc: Int): String? {
+            callBuffer.readArgs(argc, callArgs)
+
+            // funcId < 0: __callHost(name, ...) 动态调用
+            val name = if (funcId >= 0) boundNames.getOrNull(funcId) else callArgs.str(0)
+            if (name == null) {
+                callBuffer.writeUndefined()
+                return null
+            }
+
+            // 手势、按键、节点操作、启动应用和 shell 会改变界面
+            if (name in UI_CHANGING_CALLS) UiSnapshot.invalidate()
+
+            val handler = if (funcId >= 0) boundHandlers[funcId] else null
+            if (handler == null) {
+                val result = invoke(name, callArgs.toStringArray(if (funcId >= 0) 0 else 1))
+                if (result == null) callBuffer.writeUndefined()
+                return result
+            }
+
+            try {
+                handler.call(callArgs, callBuffer)
+            } catch (e: Exception) {
+                Log.e(TAG, "Host callback error: $name", e)
+                callBuffer.writeUndefined()
+            }
+            return callBuffer.takeOverflow()
+        }
+
         fun invoke(funcName: String, args: Array<String>): String? {
             Log.d(TAG, "invoke: $funcName, args=${args.joinToString()}")
             return try {
@@ -274,244 +430,6 @@ class QuickJSEngine(private val context: Context) {
                     "selector_className" -> selectorClick(UiSelector().className(args.getOrNull(0) ?: ""))
                     "selector_packageName" -> selectorClick(UiSelector().packageName(args.getOrNull(0) ?: ""))
                     
-                    // 新的选择器 API（支持链式调用）
-                    "selector.findOne" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val obj = selector.findOne()
-                        if (obj != null) uiObjectToJson(obj) else "null"
-                    }
-                    "selector.findOnce" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val index = args.getOrNull(1)?.toIntOrNull() ?: 0
-                        val objs = selector.findAll()
-                        if (index >= 0 && index < objs.size) {
-                            uiObjectToJson(objs[index])
-                        } else "null"
-                    }
-                    "selector.findAll" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val objs = selector.findAll()
-                        uiObjectListToJson(objs)
-                    }
-                    "selector.waitFor" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val timeout = args.getOrNull(1)?.toLongOrNull() ?: 10000L
-                        val obj = selector.waitFor(timeout)
-                        if (obj != null) uiObjectToJson(obj) else "null"
-                    }
-                    "selector.exists" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        selector.exists().toString()
-                    }
-                    "selector.click" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        selector.click().toString()
-                    }
-                    "selector.longClick" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        selector.longClick().toString()
-                    }
-                    "selector.scrollForward" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val obj = selector.findOne()
-                        (obj?.scrollForward() ?: false).toString()
-                    }
-                    "selector.scrollBackward" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val obj = selector.findOne()
-                        (obj?.scrollBackward() ?: false).toString()
-                    }
-                    "selector.setText" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val text = args.getOrNull(1) ?: ""
-                        selector.setText(text).toString()
-                    }
-                    
-                    // selector.findOne with children
-                    "selector.findOneWithChildren" -> {
-                        val selector = buildSelectorFromJson(args.getOrNull(0) ?: "[]")
-                        val obj = selector.findOne()
-                        if (obj != null) uiObjectToJson(obj, true) else "null"
-                    }
-                    
-                    // UiObject 节点操作 (基于 bounds 重新查找)
-                    "uiobject.findByBounds" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            // 通过 bounds 查找节点
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    uiObjectToJson(UiObject(found), true)
-                                } else "null"
-                            } else "null"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.findByBounds failed", e)
-                            "null"
-                        }
-                    }
-                    
-                    // 获取子节点
-                    "uiobject.children" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val obj = UiObject(found)
-                                    uiObjectListToJson(obj.children())
-                                } else "[]"
-                            } else "[]"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.children failed", e)
-                            "[]"
-                        }
-                    }
-                    
-                    // 获取父节点
-                    "uiobject.parent" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val obj = UiObject(found)
-                                    val parent = obj.parent()
-                                    if (parent != null) uiObjectToJson(parent, false) else "null"
-                                } else "null"
-                            } else "null"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.parent failed", e)
-                            "null"
-                        }
-                    }
-                    
-                    // 在子树中查找
-                    "uiobject.find" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        val selectorJson = args.getOrNull(1) ?: "[]"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val selector = buildSelectorFromJson(selectorJson)
-                                    val results = selector.findAll(found)
-                                    uiObjectListToJson(results)
-                                } else "[]"
-                            } else "[]"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.find failed", e)
-                            "[]"
-                        }
-                    }
-                    
-                    // UiObject 操作 - sibling
-                    "uiobject.sibling" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        val index = args.getOrNull(1)?.toIntOrNull() ?: 0
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val obj = UiObject(found)
-                                    val parent = obj.parent()
-                                    if (parent != null) {
-                                        val siblings = parent.children()
-                                        val actualIndex = if (index < 0) siblings.size + index else index
-                                        if (actualIndex >= 0 && actualIndex < siblings.size) {
-                                            uiObjectToJson(siblings[actualIndex], false)
-                                        } else "null"
-                                    } else "null"
-                                } else "null"
-                            } else "null"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.sibling failed", e)
-                            "null"
-                        }
-                    }
-                    
-                    // UiObject scroll operations
-                    "uiobject.scrollForward" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val obj = UiObject(found)
-                                    obj.scrollForward().toString()
-                                } else "false"
-                            } else "false"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.scrollForward failed", e)
-                            "false"
-                        }
-                    }
-                    
-                    "uiobject.scrollBackward" -> {
-                        val boundsJson = args.getOrNull(0) ?: "{}"
-                        try {
-                            val json = org.json.JSONObject(boundsJson)
-                            val left = json.optInt("left", 0)
-                            val top = json.optInt("top", 0)
-                            val right = json.optInt("right", 0)
-                            val bottom = json.optInt("bottom", 0)
-                            
-                            val root = AutomateAccessibilityService.instance?.getRootNode()
-                            if (root != null) {
-                                val found = findNodeByBounds(root, left, top, right, bottom)
-                                if (found != null) {
-                                    val obj = UiObject(found)
-                                    obj.scrollBackward().toString()
-                                } else "false"
-                            } else "false"
-                        } catch (e: Exception) {
-                            Log.e(TAG, "uiobject.scrollBackward failed", e)
-                            "false"
-                        }
-                    }
-                    
                     // Gesture API
                     "gesture" -> {
                         try {
@@ -655,16 +573,6 @@ class QuickJSEngine(private val context: Context) {
                     }
                     
                     // ==================== UiObject 操作 ====================
-                    "uiobject.parent" -> {
-                        val nodeJson = args.getOrNull(0) ?: "{}"
-                        // 需要通过 bounds 重新查找节点
-                        "null" // TODO: 需要实现节点引用机制
-                    }
-                    "uiobject.children" -> {
-                        val nodeJson = args.getOrNull(0) ?: "{}"
-                        "[]" // TODO: 需要实现节点引用机制
-                    }
-                    
                     // currentPackage 全局函数
                     "currentPackage" -> {
                         AutomateAccessibilityService.instance?.rootInActiveWindow?.packageName?.toString() ?: ""
@@ -710,171 +618,6 @@ class QuickJSEngine(private val context: Context) {
             }
         }
         
-        // 从 JSON 构建 UiSelector
-        private fun buildSelectorFromJson(json: String): UiSelector {
-            val selector = UiSelector()
-            try {
-                val conditions = org.json.JSONArray(json)
-                for (i in 0 until conditions.length()) {
-                    val cond = conditions.getJSONObject(i)
-                    val type = cond.getString("type")
-                    val value = cond.optString("value", "")
-                    
-                    when (type) {
-                        "text" -> selector.text(value)
-                        "textContains" -> selector.textContains(value)
-                        "textStartsWith" -> selector.textStartsWith(value)
-                        "textEndsWith" -> selector.textEndsWith(value)
-                        "textMatches" -> selector.textMatches(value)
-                        "desc" -> selector.desc(value)
-                        "descContains" -> selector.descContains(value)
-                        "descStartsWith" -> selector.descStartsWith(value)
-                        "descEndsWith" -> selector.descEndsWith(value)
-                        "descMatches" -> selector.descMatches(value)
-                        "id" -> selector.id(value)
-                        "idContains" -> selector.idContains(value)
-                        "idStartsWith" -> selector.idStartsWith(value)
-                        "idEndsWith" -> selector.idEndsWith(value)
-                        "idMatches" -> selector.idMatches(value)
-                        "className" -> selector.className(value)
-                        "classNameContains" -> selector.classNameContains(value)
-                        "classNameStartsWith" -> selector.classNameStartsWith(value)
-                        "classNameEndsWith" -> selector.classNameEndsWith(value)
-                        "classNameMatches" -> selector.classNameMatches(value)
-                        "packageName" -> selector.packageName(value)
-                        "packageNameContains" -> selector.packageNameContains(value)
-                        "packageNameStartsWith" -> selector.packageNameStartsWith(value)
-                        "packageNameEndsWith" -> selector.packageNameEndsWith(value)
-                        "clickable" -> selector.clickable(value == "true")
-                        "scrollable" -> selector.scrollable(value == "true")
-                        "enabled" -> selector.enabled(value == "true")
-                        "checked" -> selector.checked(value == "true")
-                        "selected" -> selector.selected(value == "true")
-                        "focusable" -> selector.focusable(value == "true")
-                        "focused" -> selector.focused(value == "true")
-                        "longClickable" -> selector.longClickable(value == "true")
-                        "checkable" -> selector.checkable(value == "true")
-                        "editable" -> selector.editable(value == "true")
-                        "visibleToUser" -> selector.visibleToUser(value == "true")
-                        "depth" -> selector.depth(value.toIntOrNull() ?: 0)
-                    }
-                }
-            } catch (e: Exception) {
-                Log.e(TAG, "Failed to parse selector JSON: $json", e)
-            }
-            return selector
-        }
-        
-        // 通过 bounds 查找节点
-        private fun findNodeByBounds(
-            node: android.view.accessibility.AccessibilityNodeInfo,
-            left: Int, top: Int, right: Int, bottom: Int
-        ): android.view.accessibility.AccessibilityNodeInfo? {
-            val rect = android.graphics.Rect()
-            node.getBoundsInScreen(rect)
-            if (rect.left == left && rect.top == top && rect.right == right && rect.bottom == bottom) {
-                return node
-            }
-            for (i in 0 until node.childCount) {
-                val child = node.getChild(i) ?: continue
-                val found = findNodeByBounds(child, left, top, right, bottom)
-                if (found != null) return found
-            }
-            return null
-        }
-        
-        // 将 UiObject 转为 JSON (带子节点引用)
-        private fun uiObjectToJson(obj: UiObject, includeChildren: Boolean = false): String {
-            return try {
-                val bounds = obj.bounds()
-                JSONObject().apply {
-                    put("_text", obj.text())
-                    put("_id", obj.id())
-                    put("_className", obj.className())
-                    put("_desc", obj.desc())
-                    put("_packageName", obj.packageName())
-                    put("bounds", JSONObject().apply {
-                        put("left", bounds.left)
-                        put("top", bounds.top)
-                        put("right", bounds.right)
-                        put("bottom", bounds.bottom)
-                        put("centerX", (bounds.left + bounds.right) / 2)
-                        put("centerY", (bounds.top + bounds.bottom) / 2)
-                    })
-                    put("_indexInParent", obj.indexInParent())
-                    put("_depth", obj.depth())
-                    put("_drawingOrder", obj.drawingOrder())
-                    put("clickable", obj.isClickable())
-                    put("longClickable", obj.isLongClickable())
-                    put("scrollable", obj.isScrollable())
-                    put("enabled", obj.isEnabled())
-                    put("checked", obj.isChecked())
-                    put("selected", obj.isSelected())
-                    put("focusable", obj.isFocusable())
-                    put("focused", obj.isFocused())
-                    put("checkable", obj.isCheckable())
-                    put("editable", obj.isEditable())
-                    put("visibleToUser", obj.isVisibleToUser())
-                    put("childCount", obj.childCount())
-                    
-                    if (includeChildren && obj.childCount() > 0) {
-                        val childrenArr = org.json.JSONArray()
-                        obj.children().forEach { child ->
-                            childrenArr.put(org.json.JSONObject(uiObjectToJson(child, false)))
-                        }
-                        put("_children", childrenArr)
-                    }
-                }.toString()
-            } catch (e: Exception) {
-                Log.e(TAG, "Failed to convert UiObject to JSON", e)
-                "null"
-            }
-        }
-        
-        // 将 UiObject 列表转为 JSON 数组
-        private fun uiObjectListToJson(objs: List<UiObject>): String {
-            return try {
-                val arr = org.json.JSONArray()
-                for (obj in objs) {
-                    val bounds = obj.bounds()
-                    arr.put(JSONObject().apply {
-                        put("_text", obj.text())
-                        put("_id", obj.id())
-                        put("_className", obj.className())
-                        put("_desc", obj.desc())
-                        put("_packageName", obj.packageName())
-                        put("bounds", JSONObject().apply {
-                            put("left", bounds.left)
-                            put("top", bounds.top)
-                            put("right", bounds.right)
-                            put("bottom", bounds.bottom)
-                            put("centerX", (bounds.left + bounds.right) / 2)
-                            put("centerY", (bounds.top + bounds.bottom) / 2)
-                        })
-                        put("_indexInParent", obj.indexInParent())
-                        put("_depth", obj.depth())
-                        put("_drawingOrder", obj.drawingOrder())
-                        put("clickable", obj.isClickable())
-                        put("longClickable", obj.isLongClickable())
-                        put("scrollable", obj.isScrollable())
-                        put("enabled", obj.isEnabled())
-                        put("checked", obj.isChecked())
-                        put("selected", obj.isSelected())
-                        put("focusable", obj.isFocusable())
-                        put("focused", obj.isFocused())
-                        put("checkable", obj.isCheckable())
-                        put("editable", obj.isEditable())
-                        put("visibleToUser", obj.isVisibleToUser())
-                        put("childCount", obj.childCount())
-                    })
-                }
-                arr.toString()
-            } catch (e: Exception) {
-                Log.e(TAG, "Failed to convert UiObject list to JSON", e)
-                "[]"
-            }
-        }
-        
         private fun vibrate(duration: Long) {
             try {
                 if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.S) {
@@ -992,4 +735,7 @@ class QuickJSEngine(private val context: Context) {
     private external fun nativeEval(code: String, filename: String): String
     private external fun nativeInterrupt()
     private external fun nativeDestroy()
+    private external fun nativePushSnapshot(buffer: java.nio.ByteBuffer, length: Int): Int
+    private external fun nativePushDelta(buffer: java.nio.ByteBuffer, length: Int): Int
+    private external fun nativePushFrame(buffer: java.nio.ByteBuffer, width: Int, height: Int, rowStride: Int): Int
 }
@@ -45,7 +45,8 @@ function process({max, msg, keywords, debug}) {
 
         // 找到所有
         // 滚动常按评论, adc, 这里需要指定的版本,
-        let cmt = id("adc").find();
+        // 只要父节点是 e6o 的, 过滤其他的,由于高精度导致的错误
+        let cmt = id("adc").parent(idContains("e6o")).find();
 
         toast("共:" + cmt.length + "个评论")
         console.log("共:" + cmt.length + "个评论")
@@ -54,12 +55,6 @@ function process({max, msg, keywords, debug}) {
             let item = cmt[i];
             console.log("=>" + item.id())
 
-            if (item.parent() && item.parent().id().indexOf("e6o") < 0) {
-                // 过滤其他的,由于高精度导致的错误
-                console.log("parent =>" + item.parent().id())
-                continue
-            }
-
             if (count >= max) {
                 console.log("发送数量达总量:"+count);
                 break;